@@ -0,0 +1,23 @@
+#include "Arguments.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+bool TryParseCount(const std::string& sValue, uint32_t& nValue)
+{
+	// Digits only - std::stoull would otherwise skip whitespace and wrap negative numbers round
+	if (sValue.empty() || !std::all_of(sValue.begin(), sValue.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) return false;
+
+	unsigned long long nParsed = 0;
+	try
+	{
+		nParsed = std::stoull(sValue);
+	}
+	catch (const std::out_of_range&)
+	{
+		return false;
+	}
+	if (nParsed > UINT32_MAX) return false;
+	nValue = static_cast<uint32_t>(nParsed);
+	return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#ifndef ARGUMENTS_H
+#define ARGUMENTS_H
+
+#include <cstdint>
+#include <string>
+
+// Leaves nValue as it was, and returns false, if sValue isn't a whole number that fits
+bool TryParseCount(const std::string& sValue, uint32_t& nValue);
+
+#endif
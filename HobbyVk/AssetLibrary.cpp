@@ -0,0 +1,195 @@
+#include "AssetLibrary.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+	constexpr char archiveMagic[8] = { 'H', 'V', 'K', 'P', 'A', 'K', 0, 0 };
+	constexpr uint32_t nArchiveVersion = 1;
+
+	// Header, then nEntries entries, then the names they point into, then the data
+	struct ArchiveHeader
+	{
+		char magic[8];
+		uint32_t nVersion;
+		uint32_t nEntries;
+		uint64_t nNamesSize;
+	};
+
+	struct ArchiveEntry
+	{
+		uint64_t nOffset; // From the start of the archive
+		uint64_t nSize;
+		uint32_t nNameOffset; // Into the names
+		uint32_t nNameLength;
+	};
+
+	inline uint64_t AlignUp(uint64_t nValue, uint64_t nAlignment)
+	{
+		return (nValue + nAlignment - 1) / nAlignment * nAlignment;
+	}
+}
+
+AssetSpan::AssetSpan(std::shared_ptr<const MappedFile> file, size_t nOffset, size_t nSize)
+	: m_File(std::move(file)), m_nOffset(nOffset), m_nSize(nSize)
+{
+	m_pData = m_File ? m_File->GetData() + nOffset : nullptr;
+}
+
+AssetSpan::AssetSpan(std::vector<uint32_t>&& vWords)
+	: m_vWords(std::make_shared<const std::vector<uint32_t>>(std::move(vWords)))
+{
+	m_pData = reinterpret_cast<const uint8_t*>(m_vWords->data());
+	m_nSize = m_vWords->size() * sizeof(uint32_t);
+}
+
+void AssetSpan::Prefetch(size_t nOffset, size_t nSize) const
+{
+	if (!m_File || nOffset >= m_nSize) return;
+	m_File->Prefetch(m_nOffset + nOffset, std::min(nSize, m_nSize - nOffset));
+}
+
+std::string AssetLibrary::Normalise(const std::string& sName)
+{
+	return std::filesystem::path(sName).lexically_normal().generic_string();
+}
+
+void AssetLibrary::Mount(const std::string& sArchive)
+{
+	auto archive = std::make_shared<const MappedFile>(sArchive);
+	const uint8_t* pData = archive->GetData();
+	size_t nSize = archive->GetSize();
+
+	ArchiveHeader header;
+	if (nSize < sizeof(header)) throw std::runtime_error(sArchive + " isn't an asset archive");
+	std::memcpy(&header, pData, sizeof(header));
+	if (std::memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) != 0) throw std::runtime_error(sArchive + " isn't an asset archive");
+	if (header.nVersion != nArchiveVersion) throw std::runtime_error(sArchive + " is an archive from a different version, repack it");
+
+	uint64_t nNamesOffset = sizeof(ArchiveHeader) + static_cast<uint64_t>(header.nEntries) * sizeof(ArchiveEntry);
+	if (nNamesOffset + header.nNamesSize > nSize) throw std::runtime_error(sArchive + " is truncated");
+	const char* pNames = reinterpret_cast<const char*>(pData + nNamesOffset);
+
+	for (uint32_t i = 0; i < header.nEntries; ++i)
+	{
+		ArchiveEntry archiveEntry;
+		std::memcpy(&archiveEntry, pData + sizeof(ArchiveHeader) + i * sizeof(ArchiveEntry), sizeof(archiveEntry));
+		// Both come straight from the file, so adding them could wrap - and spans rely on entries being aligned
+		bool bOutside = archiveEntry.nOffset > nSize || archiveEntry.nSize > nSize - archiveEntry.nOffset;
+		if (bOutside || archiveEntry.nOffset % nArchiveAlignment != 0 || static_cast<uint64_t>(archiveEntry.nNameOffset) + archiveEntry.nNameLength > header.nNamesSize)
+			throw std::runtime_error(sArchive + " has a malformed entry");
+
+		Entry entry;
+		entry.archive = archive;
+		entry.nOffset = static_cast<size_t>(archiveEntry.nOffset);
+		entry.nSize = static_cast<size_t>(archiveEntry.nSize);
+		m_Entries[std::string(pNames + archiveEntry.nNameOffset, archiveEntry.nNameLength)] = entry;
+	}
+}
+
+bool AssetLibrary::TryOpenArchived(const std::string& sName, AssetSpan& span) const
+{
+	auto it = m_Entries.find(Normalise(sName));
+	if (it == m_Entries.end()) return false;
+	span = AssetSpan(it->second.archive, it->second.nOffset, it->second.nSize);
+	return true;
+}
+
+bool AssetLibrary::TryOpenLoose(const std::string& sFilename, AssetSpan& span)
+{
+	std::error_code error;
+	if (!std::filesystem::is_regular_file(sFilename, error)) return false;
+
+	// Empty files can't be mapped, but they're still there
+	if (std::filesystem::file_size(sFilename, error) == 0 && !error) { span = AssetSpan(); return true; }
+
+	try
+	{
+		auto file = std::make_shared<const MappedFile>(sFilename);
+		size_t nSize = file->GetSize();
+		span = AssetSpan(std::move(file), 0, nSize);
+	}
+	catch (const std::runtime_error&) { return false; }
+	return true;
+}
+
+bool AssetLibrary::TryOpen(const std::string& sName, AssetSpan& span) const
+{
+	if (m_bPreferLoose && TryOpenLoose(sName, span)) return true;
+	if (TryOpenArchived(sName, span)) return true;
+	return !m_bPreferLoose && TryOpenLoose(sName, span);
+}
+
+AssetSpan AssetLibrary::Open(const std::string& sName) const
+{
+	AssetSpan span;
+	if (!TryOpen(sName, span)) throw std::runtime_error("Unable to open file " + sName + "!");
+	return span;
+}
+
+AssetSpan AssetLibrary::OpenLoose(const std::string& sFilename)
+{
+	AssetSpan span;
+	if (!TryOpenLoose(sFilename, span)) throw std::runtime_error("Unable to open file " + sFilename + "!");
+	return span;
+}
+
+void AssetLibrary::Pack(const std::string& sArchive, const std::vector<std::string>& vFiles)
+{
+	// Names first, so the data's offsets are known before any of it's written
+	std::string sNames;
+	std::vector<ArchiveEntry> vEntries;
+	std::vector<AssetSpan> vSpans;
+	for (const std::string& sFile : vFiles)
+	{
+		std::string sName = Normalise(sFile);
+		ArchiveEntry entry{};
+		entry.nNameOffset = static_cast<uint32_t>(sNames.size());
+		entry.nNameLength = static_cast<uint32_t>(sName.size());
+		sNames += sName;
+		vSpans.push_back(OpenLoose(sFile));
+		entry.nSize = vSpans.back().GetSize();
+		vEntries.push_back(entry);
+	}
+
+	uint64_t nOffset = sizeof(ArchiveHeader) + vEntries.size() * sizeof(ArchiveEntry) + sNames.size();
+	for (auto& entry : vEntries)
+	{
+		nOffset = AlignUp(nOffset, nArchiveAlignment);
+		entry.nOffset = nOffset;
+		nOffset += entry.nSize;
+	}
+
+	ArchiveHeader header{};
+	std::memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+	header.nVersion = nArchiveVersion;
+	header.nEntries = static_cast<uint32_t>(vEntries.size());
+	header.nNamesSize = sNames.size();
+
+	// Written to the side then moved into place, so a running copy never maps half an archive
+	std::string sTemporary = sArchive + ".tmp";
+	{
+		std::ofstream fArchive(sTemporary, std::ios::binary | std::ios::trunc);
+		if (!fArchive.is_open()) throw std::runtime_error("Unable to write " + sArchive + "!");
+
+		fArchive.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fArchive.write(reinterpret_cast<const char*>(vEntries.data()), vEntries.size() * sizeof(ArchiveEntry));
+		fArchive.write(sNames.data(), sNames.size());
+
+		const char padding[nArchiveAlignment] = {};
+		for (size_t i = 0; i < vEntries.size(); ++i)
+		{
+			uint64_t nPosition = static_cast<uint64_t>(fArchive.tellp());
+			fArchive.write(padding, static_cast<std::streamsize>(vEntries[i].nOffset - nPosition));
+			fArchive.write(reinterpret_cast<const char*>(vSpans[i].GetData()), static_cast<std::streamsize>(vSpans[i].GetSize()));
+		}
+		if (!fArchive) throw std::runtime_error("Unable to write " + sArchive + "!");
+	}
+
+	std::error_code error;
+	std::filesystem::rename(sTemporary, sArchive, error);
+	if (error) throw std::runtime_error("Unable to write " + sArchive + "!");
+}
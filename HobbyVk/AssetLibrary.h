@@ -0,0 +1,89 @@
+#pragma once
+#ifndef ASSET_LIBRARY_H
+#define ASSET_LIBRARY_H
+
+#include "MappedFile.h"
+#include <cassert>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A read only range of bytes that keeps whatever it points into alive - a mapped file (loose, or an
+// archive that it's one entry of), or words made at runtime like freshly compiled SPIR-V. Cheap to copy,
+// and what's in it can go straight to Vulkan or the staging ring without landing anywhere in between
+class AssetSpan
+{
+public:
+	AssetSpan() = default;
+	AssetSpan(std::shared_ptr<const MappedFile> file, size_t nOffset, size_t nSize);
+	explicit AssetSpan(std::vector<uint32_t>&& vWords);
+
+	inline const uint8_t* GetData() const { return m_pData; }
+	inline size_t GetSize() const { return m_nSize; }
+	inline bool IsEmpty() const { return m_nSize == 0; }
+
+	// Mappings start on a page and archive entries on nArchiveAlignment, so anything up to that is fine
+	template<typename T> inline const T* As() const
+	{
+		assert(reinterpret_cast<uintptr_t>(m_pData) % alignof(T) == 0);
+		return reinterpret_cast<const T*>(m_pData);
+	}
+
+	// Faults a range in now, so whoever reads it next doesn't stall on the disk. Nothing to do if it's not mapped
+	void Prefetch(size_t nOffset = 0, size_t nSize = SIZE_MAX) const;
+
+private:
+	std::shared_ptr<const MappedFile> m_File;
+	std::shared_ptr<const std::vector<uint32_t>> m_vWords;
+	const uint8_t* m_pData = nullptr;
+	size_t m_nOffset = 0; // Into m_File
+	size_t m_nSize = 0;
+};
+
+// Where assets come from - packed archives mounted at startup, then loose files. An archive is a
+// table of contents and every file in it back to back, so mounting one is a single mapping rather
+// than a stream of small reads, and assets are just spans of it. Names are paths as the renderer
+// uses them ("Shaders/shader.vert"), normalised, so they're found the same way in either. Mount
+// everything before anything's opened - Open is safe from any thread after that
+class AssetLibrary
+{
+public:
+	// Entries start on this, enough for anything that's read in place
+	static constexpr size_t nArchiveAlignment = 64;
+
+	// bPreferLoose looks on disk first, for when loose files are being edited (hot reloading, say)
+	AssetLibrary(bool bPreferLoose = false) : m_bPreferLoose(bPreferLoose) {}
+
+	// Throws if it isn't an archive. Later mounts win where names clash
+	void Mount(const std::string& sArchive);
+
+	// Throws if it's nowhere. TryOpen doesn't
+	AssetSpan Open(const std::string& sName) const;
+	bool TryOpen(const std::string& sName, AssetSpan& span) const;
+
+	// Maps a loose file, bypassing any archives - for things that only ever live on disk, like caches
+	static AssetSpan OpenLoose(const std::string& sFilename);
+	static bool TryOpenLoose(const std::string& sFilename, AssetSpan& span);
+
+	// Writes vFiles into an archive, under their names as given. Throws if any can't be read or it can't be written
+	static void Pack(const std::string& sArchive, const std::vector<std::string>& vFiles);
+
+	inline size_t GetEntryCount() const { return m_Entries.size(); }
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<const MappedFile> archive;
+		size_t nOffset = 0;
+		size_t nSize = 0;
+	};
+
+	static std::string Normalise(const std::string& sName);
+	bool TryOpenArchived(const std::string& sName, AssetSpan& span) const;
+
+	bool m_bPreferLoose;
+	std::unordered_map<std::string, Entry> m_Entries;
+};
+
+#endif
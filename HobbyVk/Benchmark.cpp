@@ -0,0 +1,269 @@
+#include "Benchmark.h"
+#include "MeshConverter.h"
+#include "Arguments.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+
+Benchmark::Benchmark(const RendererConfig& config, uint32_t nWarmupFrames, uint32_t nFrames)
+	: m_Config(config), m_nWarmupFrames(nWarmupFrames), m_nFrames(std::max(1u, nFrames))
+{
+	// Anything that would hold frames back, or write files over each other scene after scene
+	m_Config.presentMode = vk::PresentModeKHR::eImmediate;
+	m_Config.bLowLatency = false;
+	m_Config.nMaxFrames = 0;
+	m_Config.sCpuTimingsCsv.clear();
+	m_Config.sCpuTimingsJson.clear();
+}
+
+BenchmarkScene Benchmark::ParseScene(const std::string& sScene)
+{
+	size_t nEquals = sScene.find('=');
+	std::string sName = sScene.substr(0, nEquals);
+	for (const BenchmarkScene& scene : GetDefaultScenes())
+	{
+		if (sName != GetSceneName(scene.type)) continue;
+		BenchmarkScene parsed = scene;
+		if (nEquals != std::string::npos && !TryParseCount(sScene.substr(nEquals + 1), parsed.nCount))
+			throw std::runtime_error("Invalid count " + sScene.substr(nEquals + 1) + " for benchmark scene " + sName + "!");
+		return parsed;
+	}
+	throw std::runtime_error("Unknown benchmark scene " + sName + "!");
+}
+
+std::vector<BenchmarkScene> Benchmark::GetDefaultScenes()
+{
+	// Big enough to be limited by what they're testing on a desktop GPU, rather than by the frame's fixed costs
+	return
+	{
+		{ BenchmarkSceneType::eTriangles, 1000000 },
+		{ BenchmarkSceneType::eInstances, 100000 },
+		{ BenchmarkSceneType::eDraws, 10000 },
+		{ BenchmarkSceneType::ePipelines, 256 }
+	};
+}
+
+const char* Benchmark::GetSceneName(BenchmarkSceneType type)
+{
+	switch (type)
+	{
+	case BenchmarkSceneType::eTriangles:	return "triangles";
+	case BenchmarkSceneType::eInstances:	return "instances";
+	case BenchmarkSceneType::eDraws:		return "draws";
+	case BenchmarkSceneType::ePipelines:	return "pipelines";
+	}
+	return "unknown";
+}
+
+std::string Benchmark::WriteTriangleMesh(uint32_t nTriangles)
+{
+	// Quads of two triangles, clockwise on screen (y is down), sharing their corners as a real mesh would
+	const uint32_t nSide = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(nTriangles / 2.0))));
+	MeshSource source;
+	for (uint32_t y = 0; y <= nSide; ++y)
+	{
+		for (uint32_t x = 0; x <= nSide; ++x)
+		{
+			float u = static_cast<float>(x) / nSide;
+			float v = static_cast<float>(y) / nSide;
+			source.vPositions.push_back(glm::vec3(-0.9f + 1.8f * u, -0.9f + 1.8f * v, 0.0f));
+			source.vColours.push_back(glm::vec4(u, v, 1.0f - u, 1.0f));
+		}
+	}
+	for (uint32_t i = 0; i < nTriangles; ++i)
+	{
+		uint32_t nQuad = i / 2;
+		uint32_t nTopLeft = (nQuad / nSide) * (nSide + 1) + nQuad % nSide;
+		uint32_t nBottomLeft = nTopLeft + nSide + 1;
+		if (i % 2 == 0) source.vIndices.insert(source.vIndices.end(), { nTopLeft, nTopLeft + 1, nBottomLeft + 1 });
+		else source.vIndices.insert(source.vIndices.end(), { nTopLeft, nBottomLeft + 1, nBottomLeft });
+	}
+
+	std::vector<uint32_t> vFile = MeshConverter::Build(source);
+	std::string sFilename = (std::filesystem::temp_directory_path() / ("HobbyVk_benchmark_" + std::to_string(nTriangles) + ".hvkmesh")).string();
+	std::ofstream fFile(sFilename, std::ios::binary | std::ios::trunc);
+	fFile.write(reinterpret_cast<const char*>(vFile.data()), vFile.size() * sizeof(uint32_t));
+	if (!fFile) throw std::runtime_error("Failed to write " + sFilename + "!");
+	return sFilename;
+}
+
+BenchmarkResult Benchmark::Run(const BenchmarkScene& scene)
+{
+	BenchmarkResult result;
+	result.scene = scene;
+
+	// GPU driven draws an instance per scene object and ignores the instance updater, so instances are objects there -
+	// the same as the draws scene, but counted under this one's name
+	RendererConfig config = m_Config;
+	bool bObjects = scene.type == BenchmarkSceneType::eDraws || (scene.type == BenchmarkSceneType::eInstances && config.bGpuDriven);
+	if (scene.type == BenchmarkSceneType::eInstances || scene.type == BenchmarkSceneType::eDraws) config.nMaxInstances = std::max(config.nMaxInstances, scene.nCount);
+	if (bObjects) config.nMaxGpuObjects = std::max(config.nMaxGpuObjects, scene.nCount);
+
+	// Declared before the renderer, so the mesh is only removed once it's been unmapped - however the run ends
+	struct TemporaryFile
+	{
+		std::string sFilename;
+		~TemporaryFile() { std::error_code error; if (!sFilename.empty()) std::filesystem::remove(sFilename, error); }
+	} meshFile;
+	if (scene.type == BenchmarkSceneType::eTriangles) config.sMesh = meshFile.sFilename = WriteTriangleMesh(std::max(1u, scene.nCount));
+
+	std::cout << "Benchmarking " << GetSceneName(scene.type) << " (" << scene.nCount << ")" << std::endl;
+	if (scene.type == BenchmarkSceneType::eInstances && bObjects) std::cout << "  GPU driven, so drawn as an object per instance" << std::endl;
+	Renderer renderer = Renderer(m_nWidth, m_nHeight, config);
+	m_DeviceProperties = renderer.GetDeviceProperties();
+
+	// Everything on screen, so nothing's culled and each frame does the same work
+	const uint32_t nSide = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(scene.nCount)))));
+	const float fSpacing = 1.8f / nSide;
+	if (!bObjects && scene.type == BenchmarkSceneType::eInstances)
+	{
+		uint32_t nInstances = scene.nCount;
+		uint64_t nFrame = 0;
+		renderer.SetInstanceUpdater([=](InstanceStreams& streams, uint32_t) mutable
+		{
+			// Spun by the frame number rather than the time, so every run writes the same
+			uint32_t nCount = std::min(nInstances, streams.nCapacity);
+			float fAngle = static_cast<float>(nFrame++) * 0.01f;
+			for (uint32_t i = 0; i < nCount; ++i)
+				streams.pTransforms[i] = glm::vec4(-0.9f + fSpacing * (i % nSide + 0.5f), -0.9f + fSpacing * (i / nSide + 0.5f), fSpacing * 0.5f, fAngle);
+			for (uint32_t i = 0; i < nCount; ++i) streams.pColours[i] = 0xFFFFFFFF;
+			return nCount;
+		});
+	}
+	else if (bObjects)
+	{
+		SceneStore& sceneStore = renderer.GetScene();
+		const MeshFileHeader& header = renderer.GetMesh().GetHeader();
+		glm::vec4 sphere = glm::vec4(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]);
+		sceneStore.Clear();
+		for (uint32_t i = 0; i < scene.nCount; ++i)
+			sceneStore.Add({ renderer.GetMesh().GetIndexCount(), 0, 0 }, sphere, glm::vec4(-0.9f + fSpacing * (i % nSide + 0.5f), -0.9f + fSpacing * (i / nSide + 0.5f), fSpacing * 0.5f, 0.0f));
+	}
+
+	for (uint32_t i = 0; i < m_nWarmupFrames && renderer.ShouldRun(); ++i) renderer.DrawFrame();
+	renderer.WaitIdle();
+
+	// Variants of the scene's pipeline that only differ in a specialisation constant nothing reads - which is still
+	// a pipeline (and a cache lookup or compile) each. They aren't drawn with, the frames show what building them costs
+	std::vector<GraphicsPipelineKey> vPending;
+	if (scene.type == BenchmarkSceneType::ePipelines)
+	{
+		for (uint32_t i = 0; i < scene.nCount; ++i)
+		{
+			GraphicsPipelineKey key = renderer.GetScenePipelineKey();
+			key.fragmentConstants.Set(1000u, i);
+			vPending.push_back(key);
+		}
+	}
+
+	std::vector<double> vCpuSamples;
+	std::vector<double> vGpuSamples;
+	uint64_t nDraws = 0;
+	uint64_t nTriangles = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto pipelinesStart = start;
+	for (uint32_t i = 0; i < m_nFrames && renderer.ShouldRun(); ++i)
+	{
+		// Ready ones come back straight away, the rest are (still) being compiled on the job system
+		vPending.erase(std::remove_if(vPending.begin(), vPending.end(),
+			[&renderer](const GraphicsPipelineKey& key) { return renderer.GetPipelineLibrary().Request(key) != vk::Pipeline{}; }), vPending.end());
+		if (vPending.empty() && result.fPipelinesReadyMs == 0.0 && scene.type == BenchmarkSceneType::ePipelines)
+			result.fPipelinesReadyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelinesStart).count();
+
+		auto frameStart = std::chrono::steady_clock::now();
+		renderer.DrawFrame();
+		vCpuSamples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+
+		// One frame's timings come back each frame, so this is a sample per frame, just from a few frames ago
+		std::vector<GpuPassTiming> vPasses = renderer.GetGpuTimings();
+		if (!vPasses.empty())
+		{
+			double fGpuMs = 0.0;
+			for (const GpuPassTiming& pass : vPasses) fGpuMs += pass.fLastMs;
+			vGpuSamples.push_back(fGpuMs);
+		}
+
+		nDraws += renderer.GetFrameStats().nDraws;
+		nTriangles += renderer.GetFrameStats().nTriangles;
+		result.nFrames++;
+	}
+	result.fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Whatever's left is finished off here, so the time's for all of them
+	if (scene.type == BenchmarkSceneType::ePipelines && result.fPipelinesReadyMs == 0.0)
+	{
+		for (const GraphicsPipelineKey& key : vPending) renderer.GetPipelineLibrary().Get(key);
+		result.fPipelinesReadyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelinesStart).count();
+	}
+	renderer.WaitIdle();
+
+	result.cpuFrame = CpuProfiler::Summarise("cpu_frame", vCpuSamples);
+	result.gpuFrame = CpuProfiler::Summarise("gpu_frame", vGpuSamples);
+	result.frameStats = renderer.GetFrameStats();
+	result.fDrawsPerSecond = result.fSeconds > 0.0 ? nDraws / result.fSeconds : 0.0;
+	result.fTrianglesPerSecond = result.fSeconds > 0.0 ? nTriangles / result.fSeconds : 0.0;
+	result.memory = renderer.GetMemoryStats();
+	result.budget = renderer.GetMemoryBudget();
+	result.nPipelines = renderer.GetPipelineLibrary().GetPipelineCount();
+
+	std::cout	<< "  CPU " << result.cpuFrame.fAverageMs << "ms (p99 " << result.cpuFrame.fP99Ms << "ms), GPU " << result.gpuFrame.fAverageMs << "ms, "
+				<< result.fDrawsPerSecond << " draws/s, " << result.fTrianglesPerSecond << " triangles/s, " << result.memory.nBytesInUse << " bytes in use" << std::endl;
+	if (scene.type == BenchmarkSceneType::ePipelines) std::cout << "  " << scene.nCount << " pipelines ready in " << result.fPipelinesReadyMs << "ms" << std::endl;
+
+	m_vResults.push_back(result);
+	return result;
+}
+
+bool Benchmark::WriteJson(const std::string& sFilename) const
+{
+	std::ofstream fFile(sFilename, std::ios::trunc);
+	if (!fFile.is_open()) return false;
+
+	// The device name's the only thing that isn't ours
+	std::string sName = m_DeviceProperties.deviceName;
+	std::string sDevice;
+	for (char c : sName)
+	{
+		if (c == '"' || c == '\\') sDevice += '\\';
+		sDevice += c;
+	}
+
+	auto writeTiming = [&fFile](const CpuStageTiming& timing)
+	{
+		fFile	<< "{ \"samples\": " << timing.nSamples << ", \"average_ms\": " << timing.fAverageMs << ", \"p50_ms\": " << timing.fP50Ms
+				<< ", \"p99_ms\": " << timing.fP99Ms << ", \"p999_ms\": " << timing.fP999Ms << ", \"max_ms\": " << timing.fMaxMs << " }";
+	};
+
+	fFile	<< "{\n\t\"device\": { \"name\": \"" << sDevice << "\", \"vendor_id\": " << m_DeviceProperties.vendorID
+			<< ", \"device_id\": " << m_DeviceProperties.deviceID << ", \"driver_version\": " << m_DeviceProperties.driverVersion
+			<< ", \"api_version\": \"" << VK_VERSION_MAJOR(m_DeviceProperties.apiVersion) << "." << VK_VERSION_MINOR(m_DeviceProperties.apiVersion)
+			<< "." << VK_VERSION_PATCH(m_DeviceProperties.apiVersion) << "\" },\n";
+	fFile	<< "\t\"config\": { \"width\": " << m_nWidth << ", \"height\": " << m_nHeight << ", \"headless\": " << (m_Config.bHeadless ? "true" : "false")
+			<< ", \"gpu_driven\": " << (m_Config.bGpuDriven ? "true" : "false") << ", \"msaa\": " << m_Config.nMsaaSamples
+			<< ", \"frames_in_flight\": " << m_Config.nFramesInFlight << ", \"warmup_frames\": " << m_nWarmupFrames << ", \"frames\": " << m_nFrames << " },\n";
+	fFile << "\t\"scenes\": [\n";
+	for (size_t i = 0; i < m_vResults.size(); ++i)
+	{
+		const BenchmarkResult& result = m_vResults[i];
+		fFile << "\t\t{\n\t\t\t\"scene\": \"" << GetSceneName(result.scene.type) << "\", \"count\": " << result.scene.nCount
+			  << ", \"frames\": " << result.nFrames << ", \"seconds\": " << result.fSeconds << ",\n";
+		fFile << "\t\t\t\"cpu_frame\": ";
+		writeTiming(result.cpuFrame);
+		fFile << ",\n\t\t\t\"gpu_frame\": ";
+		writeTiming(result.gpuFrame);
+		fFile	<< ",\n\t\t\t\"draws_per_frame\": " << result.frameStats.nDraws << ", \"instances_per_draw\": " << result.frameStats.nInstances
+				<< ", \"triangles_per_frame\": " << result.frameStats.nTriangles << ", \"draws_per_second\": " << result.fDrawsPerSecond
+				<< ", \"triangles_per_second\": " << result.fTrianglesPerSecond << ",\n";
+		fFile	<< "\t\t\t\"memory\": { \"reserved_bytes\": " << result.memory.nBytesReserved << ", \"in_use_bytes\": " << result.memory.nBytesInUse
+				<< ", \"allocations\": " << result.memory.nAllocations << ", \"blocks\": " << result.memory.nBlocks
+				<< ", \"device_local_budget_bytes\": " << result.budget.nBudget << ", \"device_local_usage_bytes\": " << result.budget.nUsage << " },\n";
+		fFile << "\t\t\t\"pipelines\": " << result.nPipelines;
+		if (result.scene.type == BenchmarkSceneType::ePipelines) fFile << ", \"pipelines_ready_ms\": " << result.fPipelinesReadyMs;
+		fFile << "\n\t\t}" << (i + 1 < m_vResults.size() ? "," : "") << "\n";
+	}
+	fFile << "\t]\n}\n";
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Renderer.h"
+#include <string>
+#include <vector>
+
+enum class BenchmarkSceneType
+{
+	eTriangles,	// One draw of a mesh of nCount triangles
+	eInstances,	// The triangle, nCount instances of it
+	eDraws,		// The triangle, as nCount scene objects - a draw each
+	ePipelines	// The triangle, while nCount pipeline variants compile in the background
+};
+
+struct BenchmarkScene
+{
+	BenchmarkSceneType type = BenchmarkSceneType::eTriangles;
+	uint32_t nCount = 0;
+};
+
+struct BenchmarkResult
+{
+	BenchmarkScene scene;
+	uint32_t nFrames = 0;			// Measured, after the warmup
+	double fSeconds = 0.0;
+	CpuStageTiming cpuFrame;		// DrawFrame, start to finish
+	CpuStageTiming gpuFrame;		// Every pass, summed - from the GPU profiler, so a few frames behind but the same count
+	FrameStats frameStats;			// The last frame's
+	double fDrawsPerSecond = 0.0;
+	double fTrianglesPerSecond = 0.0;
+	MemoryStats memory;
+	MemoryBudget budget;
+	uint32_t nPipelines = 0;
+	double fPipelinesReadyMs = 0.0;	// Pipelines only, from requesting them all to the last being built
+};
+
+// Fixed scenes drawn for a fixed number of frames, each with a renderer of its own, so runs can be compared
+// across builds, drivers and machines. Nothing's random or timed by the clock, v-sync's off (immediate, if the
+// surface can - the renderer says if it falls back to FIFO) and the pacing that would hold frames back is
+// off. The warmup covers first use costs (pipelines, uploads, the driver settling its clocks) and isn't counted
+class Benchmark
+{
+public:
+	Benchmark(const RendererConfig& config, uint32_t nWarmupFrames, uint32_t nFrames);
+
+	// "triangles=1000000" and the like, defaulting the count if there's no =. Throws on an unknown scene
+	static BenchmarkScene ParseScene(const std::string& sScene);
+	static std::vector<BenchmarkScene> GetDefaultScenes();
+	static const char* GetSceneName(BenchmarkSceneType type);
+
+	BenchmarkResult Run(const BenchmarkScene& scene);
+
+	// Everything run so far, with the device and settings it ran with. Returns false if it can't be written
+	bool WriteJson(const std::string& sFilename) const;
+
+private:
+	// A grid of nTriangles filling most of clip space, written out as a .hvkmesh for the renderer to map
+	static std::string WriteTriangleMesh(uint32_t nTriangles);
+
+	RendererConfig m_Config;
+	uint32_t m_nWarmupFrames;
+	uint32_t m_nFrames;
+
+	std::vector<BenchmarkResult> m_vResults;
+	vk::PhysicalDeviceProperties m_DeviceProperties;
+	uint32_t m_nWidth = 1280;
+	uint32_t m_nHeight = 720;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "Buffer.h"
+#include <set>
+
+Buffer::Buffer(	MemoryAllocator& allocator, vk::Device device, vk::DeviceSize size, vk::BufferUsageFlags usage,
+				vk::MemoryPropertyFlags memoryFlags, const std::vector<uint32_t>& vQueueFamilies)
+	: m_pAllocator(&allocator), m_Size(size)
+{
+	vk::BufferCreateInfo bufferInfo{};
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+
+	// If more than one queue family touches the buffer (say, transfer and graphics), share it
+	// concurrently rather than bothering with queue family ownership transfers
+	std::set<uint32_t> uniqueFamilies(vQueueFamilies.begin(), vQueueFamilies.end());
+	std::vector<uint32_t> vFamilies(uniqueFamilies.begin(), uniqueFamilies.end());
+	if (vFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(vFamilies.size());
+		bufferInfo.pQueueFamilyIndices = vFamilies.data();
+	}
+	else bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+	m_Buffer = device.createBufferUnique(bufferInfo);
+	m_Memory = m_pAllocator->Allocate(device.getBufferMemoryRequirements(m_Buffer.get()), memoryFlags);
+	device.bindBufferMemory(m_Buffer.get(), m_Memory.memory, m_Memory.offset);
+}
+
+Buffer::Buffer(Buffer&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+Buffer& Buffer::operator=(Buffer&& other) noexcept
+{
+	if (this == &other) return *this;
+	Release();
+
+	m_pAllocator = other.m_pAllocator;
+	m_Buffer = std::move(other.m_Buffer);
+	m_Memory = other.m_Memory;
+	m_Size = other.m_Size;
+
+	other.m_pAllocator = nullptr;
+	other.m_Memory = MemoryAllocation{};
+	other.m_Size = 0;
+	return *this;
+}
+
+void Buffer::Release()
+{
+	// Buffer first, then its memory
+	m_Buffer.reset();
+	if (m_pAllocator) m_pAllocator->Free(m_Memory);
+	m_pAllocator = nullptr;
+	m_Size = 0;
+}
+
+Buffer::~Buffer()
+{
+	Release();
+}
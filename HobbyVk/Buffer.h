@@ -0,0 +1,36 @@
+#pragma once
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "MemoryAllocator.h"
+
+// A vk::Buffer and the memory backing it, sub-allocated from a MemoryAllocator
+// and handed back when the buffer is destroyed
+class Buffer
+{
+public:
+	Buffer() = default;
+	Buffer(	MemoryAllocator& allocator, vk::Device device, vk::DeviceSize size, vk::BufferUsageFlags usage,
+			vk::MemoryPropertyFlags memoryFlags, const std::vector<uint32_t>& vQueueFamilies = {});
+	~Buffer();
+
+	Buffer(Buffer&& other) noexcept;
+	Buffer& operator=(Buffer&& other) noexcept;
+	Buffer(const Buffer&) = delete;
+	Buffer& operator=(const Buffer&) = delete;
+
+	inline vk::Buffer Get() const { return m_Buffer.get(); }
+	inline vk::DeviceSize GetSize() const { return m_Size; }
+	inline void* GetMapped() const { return m_Memory.pMapped; } // nullptr unless host visible
+	inline bool IsValid() const { return static_cast<bool>(m_Buffer); }
+
+private:
+	void Release();
+
+	MemoryAllocator* m_pAllocator = nullptr;
+	vk::UniqueBuffer m_Buffer;
+	MemoryAllocation m_Memory;
+	vk::DeviceSize m_Size = 0;
+};
+
+#endif
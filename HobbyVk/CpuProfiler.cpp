@@ -0,0 +1,110 @@
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <fstream>
+
+CpuProfiler::CpuProfiler(uint32_t nHistory) : m_nHistory(std::max(1u, nHistory))
+{
+}
+
+uint32_t CpuProfiler::RegisterStage(const std::string& sName)
+{
+	m_vStageNames.push_back(sName);
+	m_vCurrentFrame.push_back(0.0);
+	return static_cast<uint32_t>(m_vStageNames.size() - 1);
+}
+
+void CpuProfiler::Record(uint32_t nStage, double fMs)
+{
+	m_vCurrentFrame[nStage] += fMs;
+}
+
+void CpuProfiler::EndFrame()
+{
+	if (m_vFrames.size() < m_nHistory) m_vFrames.push_back(m_vCurrentFrame);
+	else m_vFrames[m_nNextFrame] = m_vCurrentFrame;
+	m_nNextFrame = (m_nNextFrame + 1) % m_nHistory;
+	m_nFramesRecorded++;
+
+	std::fill(m_vCurrentFrame.begin(), m_vCurrentFrame.end(), 0.0);
+}
+
+std::vector<double> CpuProfiler::GetSamples(uint32_t nStage) const
+{
+	// Until the ring's filled up, the oldest frame is at the start
+	std::vector<double> vSamples;
+	vSamples.reserve(m_vFrames.size());
+	uint32_t nOldest = m_vFrames.size() < m_nHistory ? 0 : m_nNextFrame;
+	for (size_t i = 0; i < m_vFrames.size(); ++i) vSamples.push_back(m_vFrames[(nOldest + i) % m_vFrames.size()][nStage]);
+	return vSamples;
+}
+
+std::vector<CpuStageTiming> CpuProfiler::GetTimings() const
+{
+	std::vector<CpuStageTiming> vTimings;
+	for (uint32_t i = 0; i < m_vStageNames.size(); ++i) vTimings.push_back(Summarise(m_vStageNames[i], GetSamples(i)));
+	return vTimings;
+}
+
+CpuStageTiming CpuProfiler::Summarise(const std::string& sName, std::vector<double> vSamples)
+{
+	CpuStageTiming timing;
+	timing.sName = sName;
+	timing.nSamples = static_cast<uint32_t>(vSamples.size());
+	if (vSamples.empty()) return timing;
+
+	std::sort(vSamples.begin(), vSamples.end());
+	auto percentile = [&vSamples](double fPercentile) { return vSamples[static_cast<size_t>(fPercentile * (vSamples.size() - 1) + 0.5)]; };
+
+	for (double fSample : vSamples) timing.fAverageMs += fSample;
+	timing.fAverageMs /= vSamples.size();
+	timing.fP50Ms = percentile(0.5);
+	timing.fP99Ms = percentile(0.99);
+	timing.fP999Ms = percentile(0.999);
+	timing.fMaxMs = vSamples.back();
+	return timing;
+}
+
+bool CpuProfiler::WriteCsv(const std::string& sFilename) const
+{
+	std::ofstream fFile(sFilename, std::ios::trunc);
+	if (!fFile.is_open()) return false;
+
+	// Header, then one row per frame in milliseconds
+	fFile << "frame";
+	for (const auto& sName : m_vStageNames) fFile << "," << sName;
+	fFile << "\n";
+
+	std::vector<std::vector<double>> vSamples;
+	for (uint32_t i = 0; i < m_vStageNames.size(); ++i) vSamples.push_back(GetSamples(i));
+
+	uint64_t nFirstFrame = m_nFramesRecorded - m_vFrames.size();
+	for (size_t nFrame = 0; nFrame < m_vFrames.size(); ++nFrame)
+	{
+		fFile << nFirstFrame + nFrame;
+		for (const auto& vStage : vSamples) fFile << "," << vStage[nFrame];
+		fFile << "\n";
+	}
+
+	return true;
+}
+
+bool CpuProfiler::WriteJson(const std::string& sFilename) const
+{
+	std::ofstream fFile(sFilename, std::ios::trunc);
+	if (!fFile.is_open()) return false;
+
+	// Stage names are ours, so there's nothing that needs escaping
+	std::vector<CpuStageTiming> vTimings = GetTimings();
+	fFile << "{\n\t\"frames\": " << m_nFramesRecorded << ",\n\t\"stages\": [\n";
+	for (size_t i = 0; i < vTimings.size(); ++i)
+	{
+		const CpuStageTiming& timing = vTimings[i];
+		fFile	<< "\t\t{ \"name\": \"" << timing.sName << "\", \"samples\": " << timing.nSamples
+				<< ", \"average_ms\": " << timing.fAverageMs << ", \"p50_ms\": " << timing.fP50Ms
+				<< ", \"p99_ms\": " << timing.fP99Ms << ", \"p999_ms\": " << timing.fP999Ms
+				<< ", \"max_ms\": " << timing.fMaxMs << " }" << (i + 1 < vTimings.size() ? "," : "") << "\n";
+	}
+	fFile << "\t]\n}\n";
+
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct CpuStageTiming
+{
+	std::string sName;
+	uint32_t nSamples = 0;
+	double fAverageMs = 0.0;
+	double fP50Ms = 0.0;
+	double fP99Ms = 0.0;
+	double fP999Ms = 0.0;
+	double fMaxMs = 0.0;
+};
+
+// Times named stages of a frame with scoped timers, keeping the last nHistory frames in a
+// ring so hitches can be attributed after the fact - eg in DrawFrame, long frame waits mean
+// we're GPU bound, long acquires mean we're waiting on presentation, and long recording
+// means we're CPU bound. Not thread safe, stages are expected to be timed by one thread
+class CpuProfiler
+{
+public:
+	explicit CpuProfiler(uint32_t nHistory = 4096);
+
+	uint32_t RegisterStage(const std::string& sName); // Do this up front, before any frames are recorded
+	void Record(uint32_t nStage, double fMs); // Accumulates if a stage is timed more than once in a frame
+	void EndFrame();
+
+	std::vector<CpuStageTiming> GetTimings() const;
+	bool WriteCsv(const std::string& sFilename) const;	// Every frame in the history
+	bool WriteJson(const std::string& sFilename) const;	// Just the percentiles
+
+	// Percentiles of any old set of timings
+	static CpuStageTiming Summarise(const std::string& sName, std::vector<double> vSamples);
+
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(CpuProfiler& profiler, uint32_t nStage) : m_Profiler(profiler), m_nStage(nStage), m_Start(std::chrono::steady_clock::now()) {}
+		~ScopedTimer() { m_Profiler.Record(m_nStage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count()); }
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	private:
+		CpuProfiler& m_Profiler;
+		uint32_t m_nStage;
+		std::chrono::steady_clock::time_point m_Start;
+	};
+
+private:
+	std::vector<double> GetSamples(uint32_t nStage) const; // Oldest first
+
+	uint32_t m_nHistory;
+	std::vector<std::string> m_vStageNames;
+	std::vector<double> m_vCurrentFrame;
+
+	std::vector<std::vector<double>> m_vFrames; // Ring of per frame stage timings
+	uint32_t m_nNextFrame = 0;
+	uint64_t m_nFramesRecorded = 0;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "DepthPyramid.h"
+#include <algorithm>
+#include <array>
+
+DepthPyramid::DepthPyramid(	MemoryAllocator& allocator, vk::Device device, PipelineLibrary& pipelineLibrary, const std::string& sShaderFile,
+							vk::Extent2D depthExtent, vk::ImageView depthView)
+	: m_Device(device), m_PipelineLibrary(pipelineLibrary), m_DepthExtent(depthExtent)
+{
+	// Halved (rounding down) all the way to 1x1
+	vk::Extent2D extent = vk::Extent2D(std::max(1u, depthExtent.width / 2), std::max(1u, depthExtent.height / 2));
+	m_vLevelExtents.push_back(extent);
+	while (extent.width > 1 || extent.height > 1)
+	{
+		extent = vk::Extent2D(std::max(1u, extent.width / 2), std::max(1u, extent.height / 2));
+		m_vLevelExtents.push_back(extent);
+	}
+	uint32_t nLevels = static_cast<uint32_t>(m_vLevelExtents.size());
+
+	vk::ImageCreateInfo imageInfo{};
+	imageInfo.imageType = vk::ImageType::e2D;
+	imageInfo.format = vk::Format::eR32Sfloat; // Storage image support is required for it
+	imageInfo.extent = vk::Extent3D(m_vLevelExtents[0].width, m_vLevelExtents[0].height, 1);
+	imageInfo.mipLevels = nLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = vk::SampleCountFlagBits::e1;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+	imageInfo.sharingMode = vk::SharingMode::eExclusive;
+	imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+	m_Pyramid = Image(allocator, m_Device, imageInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+	for (uint32_t i = 0; i < nLevels; ++i)
+	{
+		vk::ImageViewCreateInfo viewInfo{};
+		viewInfo.image = m_Pyramid.Get();
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1);
+		m_vLevelViews.push_back(m_Device.createImageViewUnique(viewInfo));
+	}
+
+	// Everything's read with texelFetch, so this is only here because combined image samplers need one
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eNearest;
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	m_Sampler = m_Device.createSamplerUnique(samplerInfo);
+
+	// The level above in, this level out
+	std::array<vk::DescriptorSetLayoutBinding, 2> bindings =
+	{
+		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute)
+	};
+	m_DescriptorSetLayout = m_Device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo({}, static_cast<uint32_t>(bindings.size()), bindings.data()));
+
+	std::array<vk::DescriptorPoolSize, 2> poolSizes =
+	{
+		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, nLevels),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, nLevels)
+	};
+	m_DescriptorPool = m_Device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, nLevels, static_cast<uint32_t>(poolSizes.size()), poolSizes.data()));
+
+	std::vector<vk::DescriptorSetLayout> vLayouts(nLevels, m_DescriptorSetLayout.get());
+	m_vDescriptorSets = m_Device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(m_DescriptorPool.get(), nLevels, vLayouts.data()));
+	for (uint32_t i = 0; i < nLevels; ++i)
+	{
+		vk::DescriptorImageInfo sourceInfo = i == 0 ?	vk::DescriptorImageInfo(m_Sampler.get(), depthView, vk::ImageLayout::eShaderReadOnlyOptimal) :
+														vk::DescriptorImageInfo(m_Sampler.get(), m_vLevelViews[i - 1].get(), vk::ImageLayout::eGeneral);
+		vk::DescriptorImageInfo destinationInfo = vk::DescriptorImageInfo(vk::Sampler{}, m_vLevelViews[i].get(), vk::ImageLayout::eGeneral);
+		std::array<vk::WriteDescriptorSet, 2> writes =
+		{
+			vk::WriteDescriptorSet(m_vDescriptorSets[i], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &sourceInfo),
+			vk::WriteDescriptorSet(m_vDescriptorSets[i], 1, 0, 1, vk::DescriptorType::eStorageImage, &destinationInfo)
+		};
+		m_Device.updateDescriptorSets(writes, nullptr);
+	}
+
+	vk::PushConstantRange pushConstantRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(PyramidConstants));
+	m_PipelineLayout = m_Device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, 1, &m_DescriptorSetLayout.get(), 1, &pushConstantRange));
+
+	// Built now rather than on the first frame, then fetched each time in case it's been reloaded
+	m_PipelineKey.sShader = sShaderFile;
+	m_PipelineKey.layout = m_PipelineLayout.get();
+	m_PipelineLibrary.GetCompute(m_PipelineKey);
+}
+
+void DepthPyramid::RecordPrepare(vk::CommandBuffer commandBuffer)
+{
+	if (m_bPrepared) return;
+	m_bPrepared = true;
+
+	vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier(vk::AccessFlags{}, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+															vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+															m_Pyramid.Get(), vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1));
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{}, nullptr, nullptr, barrier);
+}
+
+void DepthPyramid::RecordBuild(vk::CommandBuffer commandBuffer, const glm::mat4& viewProjection)
+{
+	RecordPrepare(commandBuffer);
+
+	// Wait for this frame's cull to finish reading the last one before overwriting it
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{}, nullptr, nullptr, nullptr);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_PipelineLibrary.GetCompute(m_PipelineKey));
+	for (uint32_t i = 0; i < m_vLevelExtents.size(); ++i)
+	{
+		PyramidConstants constants;
+		vk::Extent2D source = i == 0 ? m_DepthExtent : m_vLevelExtents[i - 1];
+		constants.sourceSize = glm::ivec2(source.width, source.height);
+		constants.destinationSize = glm::ivec2(m_vLevelExtents[i].width, m_vLevelExtents[i].height);
+
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_PipelineLayout.get(), 0, m_vDescriptorSets[i], nullptr);
+		commandBuffer.pushConstants(m_PipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PyramidConstants), &constants);
+		commandBuffer.dispatch((m_vLevelExtents[i].width + nGroupSize - 1) / nGroupSize, (m_vLevelExtents[i].height + nGroupSize - 1) / nGroupSize, 1);
+
+		// Each level's read by the next, and all of them by the next frame's cull
+		vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+																vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+																m_Pyramid.Get(), vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1));
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{}, nullptr, nullptr, barrier);
+	}
+
+	m_bBuilt = true;
+	m_ViewProjection = viewProjection;
+}
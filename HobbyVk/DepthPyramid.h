@@ -0,0 +1,69 @@
+#pragma once
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include "Image.h"
+#include "PipelineLibrary.h"
+
+// Hierarchical Z - the frame's depth reduced down a mip chain, each texel holding the farthest depth of
+// everything it covers, so the GPU culler can tell from four taps whether an object's behind whatever was
+// drawn there. Level 0 is half the depth buffer's size, and each level after half the one before - when
+// a size is odd, the last row or column takes in the extra one too. Built once the main pass is done and
+// read by the next frame's cull, so it's a frame behind. It lives in GENERAL, and sees to its own
+// barriers against the build and the cull - it's the same one for every frame in flight, on one queue
+class DepthPyramid
+{
+public:
+	DepthPyramid(	MemoryAllocator& allocator, vk::Device device, PipelineLibrary& pipelineLibrary, const std::string& sShaderFile,
+					vk::Extent2D depthExtent, vk::ImageView depthView);
+
+	// Outside of a render pass, with the depth buffer in SHADER_READ_ONLY_OPTIMAL and its writes visible to
+	// compute. viewProjection is what the depth was drawn with, for culling against it later
+	void RecordBuild(vk::CommandBuffer commandBuffer, const glm::mat4& viewProjection);
+
+	// Before anything reads it in a frame - it starts off undefined, so the first one moves it into GENERAL
+	void RecordPrepare(vk::CommandBuffer commandBuffer);
+
+	inline bool IsBuilt() const { return m_bBuilt; } // Whether a build's been recorded, so there's something to test against
+	inline const glm::mat4& GetViewProjection() const { return m_ViewProjection; }
+	inline vk::ImageView GetView() const { return m_Pyramid.GetView(); }
+	inline vk::Sampler GetSampler() const { return m_Sampler.get(); }
+	inline vk::Extent2D GetDepthExtent() const { return m_DepthExtent; }
+	inline uint32_t GetMipLevels() const { return m_Pyramid.GetMipLevels(); }
+
+private:
+	// Matches PyramidConstants in Shaders/depth_pyramid.comp
+	struct PyramidConstants
+	{
+		glm::ivec2 sourceSize;
+		glm::ivec2 destinationSize;
+	};
+
+	static constexpr uint32_t nGroupSize = 8; // local_size_x and y in Shaders/depth_pyramid.comp
+
+	vk::Device m_Device;
+	PipelineLibrary& m_PipelineLibrary;
+	ComputePipelineKey m_PipelineKey;
+	vk::Extent2D m_DepthExtent;
+	std::vector<vk::Extent2D> m_vLevelExtents;
+
+	Image m_Pyramid;
+	std::vector<vk::UniqueImageView> m_vLevelViews;
+	vk::UniqueSampler m_Sampler;
+	vk::UniqueDescriptorSetLayout m_DescriptorSetLayout;
+	vk::UniqueDescriptorPool m_DescriptorPool;
+	std::vector<vk::DescriptorSet> m_vDescriptorSets; // One per level - the level above (or the depth) in, that level out
+	vk::UniquePipelineLayout m_PipelineLayout;
+
+	bool m_bPrepared = false;
+	bool m_bBuilt = false;
+	glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+};
+
+#endif
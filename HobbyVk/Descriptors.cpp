@@ -0,0 +1,139 @@
+#include "Descriptors.h"
+#include <algorithm>
+#include <cstring>
+
+DescriptorLayoutCache::DescriptorLayoutCache(vk::Device device) : m_Device(device)
+{
+}
+
+bool DescriptorLayoutCache::LayoutKey::operator==(const LayoutKey& other) const
+{
+	if (vBindings.size() != other.vBindings.size()) return false;
+	for (size_t i = 0; i < vBindings.size(); ++i)
+	{
+		const auto& a = vBindings[i];
+		const auto& b = other.vBindings[i];
+		if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) return false;
+	}
+	return true;
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()(const LayoutKey& key) const
+{
+	// Pack each binding into a word and mix them together
+	size_t nHash = key.vBindings.size();
+	for (const auto& binding : key.vBindings)
+	{
+		uint64_t nBinding =	static_cast<uint64_t>(binding.binding) | (static_cast<uint64_t>(binding.descriptorType) << 8) |
+							(static_cast<uint64_t>(binding.descriptorCount) << 16) | (static_cast<uint64_t>(static_cast<VkShaderStageFlags>(binding.stageFlags)) << 32);
+		nHash ^= std::hash<uint64_t>()(nBinding) + 0x9e3779b9 + (nHash << 6) + (nHash >> 2);
+	}
+	return nHash;
+}
+
+vk::DescriptorSetLayout DescriptorLayoutCache::Get(const std::vector<vk::DescriptorSetLayoutBinding>& vBindings)
+{
+	// The order bindings are given in doesn't change the layout
+	LayoutKey key;
+	key.vBindings = vBindings;
+	std::sort(key.vBindings.begin(), key.vBindings.end(), [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Layouts.find(key);
+	if (it != m_Layouts.end()) return it->second.get();
+
+	vk::DescriptorSetLayoutCreateInfo layoutInfo = vk::DescriptorSetLayoutCreateInfo({}, static_cast<uint32_t>(key.vBindings.size()), key.vBindings.data());
+	vk::UniqueDescriptorSetLayout layout = m_Device.createDescriptorSetLayoutUnique(layoutInfo);
+	vk::DescriptorSetLayout handle = layout.get();
+	m_Layouts.emplace(std::move(key), std::move(layout));
+	return handle;
+}
+
+DescriptorAllocator::DescriptorAllocator(vk::Device device, uint32_t nFramesInFlight, uint32_t nSetsPerPool)
+	: m_Device(device), m_nSetsPerPool(std::max(1u, nSetsPerPool)), m_vFrames(nFramesInFlight)
+{
+}
+
+vk::UniqueDescriptorPool DescriptorAllocator::CreatePool()
+{
+	// A rough mix of what sets tend to hold, scaled by how many sets fit in a pool
+	const std::pair<vk::DescriptorType, float> ratios[] =
+	{
+		{ vk::DescriptorType::eUniformBuffer,			1.0f },
+		{ vk::DescriptorType::eUniformBufferDynamic,	1.0f },
+		{ vk::DescriptorType::eStorageBuffer,			2.0f },
+		{ vk::DescriptorType::eStorageBufferDynamic,	0.5f },
+		{ vk::DescriptorType::eCombinedImageSampler,	4.0f },
+		{ vk::DescriptorType::eSampledImage,			1.0f },
+		{ vk::DescriptorType::eStorageImage,			1.0f },
+		{ vk::DescriptorType::eSampler,					0.5f }
+	};
+
+	std::vector<vk::DescriptorPoolSize> vPoolSizes;
+	for (const auto& ratio : ratios) vPoolSizes.emplace_back(ratio.first, static_cast<uint32_t>(ratio.second * m_nSetsPerPool));
+
+	// No eFreeDescriptorSet, as sets are only ever freed by resetting the whole pool
+	vk::DescriptorPoolCreateInfo poolInfo = vk::DescriptorPoolCreateInfo({}, m_nSetsPerPool, static_cast<uint32_t>(vPoolSizes.size()), vPoolSizes.data());
+	return m_Device.createDescriptorPoolUnique(poolInfo);
+}
+
+void DescriptorAllocator::ResetFrame(uint32_t nFrame)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	FramePools& frame = m_vFrames[nFrame];
+	for (uint32_t i = 0; i < frame.vPools.size() && i <= frame.nCurrent; ++i) m_Device.resetDescriptorPool(frame.vPools[i].get());
+	frame.nCurrent = 0;
+}
+
+vk::DescriptorSet DescriptorAllocator::Allocate(uint32_t nFrame, vk::DescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	FramePools& frame = m_vFrames[nFrame];
+
+	vk::DescriptorSetAllocateInfo allocateInfo{};
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+
+	// Try the current pool first, moving on to the next (or a new one) when it's full
+	while (true)
+	{
+		bool bNewPool = frame.nCurrent == frame.vPools.size();
+		if (bNewPool) frame.vPools.push_back(CreatePool());
+		allocateInfo.descriptorPool = frame.vPools[frame.nCurrent].get();
+
+		vk::DescriptorSet set;
+		vk::Result result = m_Device.allocateDescriptorSets(&allocateInfo, &set);
+		if (result == vk::Result::eSuccess) return set;
+
+		// A brand new pool failing means the set can never fit
+		bool bPoolFull = result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool;
+		if (!bPoolFull || bNewPool) throw std::runtime_error("Failed to allocate descriptor set!");
+		frame.nCurrent++;
+	}
+}
+
+UniformRing::UniformRing(	MemoryAllocator& allocator, vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize nFrameSize,
+							uint32_t nFramesInFlight, vk::DeviceSize nMaxRange)
+	: m_nMaxRange(nMaxRange)
+{
+	m_nAlignment = std::max<vk::DeviceSize>(physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment, 1);
+
+	// Each frame's region has to start aligned too
+	nFrameSize = (nFrameSize + m_nAlignment - 1) / m_nAlignment * m_nAlignment;
+	m_pLinearAllocator = std::make_unique<LinearAllocator>(allocator, device, nFrameSize, nFramesInFlight, vk::BufferUsageFlagBits::eUniformBuffer);
+}
+
+void UniformRing::Reset(uint32_t nFrame)
+{
+	m_pLinearAllocator->Reset(nFrame);
+}
+
+uint32_t UniformRing::Push(const void* pData, vk::DeviceSize size)
+{
+	if (size > m_nMaxRange) throw std::runtime_error("Uniform data larger than the ring's descriptor range!");
+
+	// Always allocate the full range, so the descriptor never reads past the end of the buffer
+	LinearAllocation allocation = m_pLinearAllocator->Allocate(m_nMaxRange, m_nAlignment);
+	std::memcpy(allocation.pMapped, pData, static_cast<size_t>(size));
+	return static_cast<uint32_t>(allocation.offset);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef DESCRIPTORS_H
+#define DESCRIPTORS_H
+
+#include "MemoryAllocator.h"
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+
+// Hands out one set layout per unique list of bindings, so pipelines asking for the same
+// shape of set share a layout (and so can share sets)
+class DescriptorLayoutCache
+{
+public:
+	DescriptorLayoutCache(vk::Device device);
+
+	vk::DescriptorSetLayout Get(const std::vector<vk::DescriptorSetLayoutBinding>& vBindings);
+
+private:
+	struct LayoutKey
+	{
+		std::vector<vk::DescriptorSetLayoutBinding> vBindings; // Sorted by binding
+		bool operator==(const LayoutKey& other) const;
+	};
+	struct LayoutKeyHash { size_t operator()(const LayoutKey& key) const; };
+
+	vk::Device m_Device;
+	std::unordered_map<LayoutKey, vk::UniqueDescriptorSetLayout, LayoutKeyHash> m_Layouts;
+	std::mutex m_Mutex;
+};
+
+// Transient descriptor sets that only live for a frame. Each frame in flight has its own pools,
+// reset wholesale once its last frame has been waited on, so there's never any freeing of single sets.
+// Pools are added as needed and kept around, so after the first few frames it never allocates
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(vk::Device device, uint32_t nFramesInFlight, uint32_t nSetsPerPool = 256);
+
+	void ResetFrame(uint32_t nFrame);
+	vk::DescriptorSet Allocate(uint32_t nFrame, vk::DescriptorSetLayout layout);
+
+private:
+	struct FramePools
+	{
+		std::vector<vk::UniqueDescriptorPool> vPools;
+		uint32_t nCurrent = 0;
+	};
+
+	vk::UniqueDescriptorPool CreatePool();
+
+	vk::Device m_Device;
+	uint32_t m_nSetsPerPool;
+	std::vector<FramePools> m_vFrames;
+	std::mutex m_Mutex; // Worker threads may well want sets while recording
+};
+
+// Per frame uniform data from a ring of host visible memory, bound through one dynamic uniform
+// buffer descriptor - each push just hands back a new dynamic offset, so there's no descriptor
+// work at all per draw. Offsets are aligned to minUniformBufferOffsetAlignment
+class UniformRing
+{
+public:
+	UniformRing(MemoryAllocator& allocator, vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize nFrameSize,
+				uint32_t nFramesInFlight, vk::DeviceSize nMaxRange);
+
+	void Reset(uint32_t nFrame); // Call once the GPU is done with nFrame
+	uint32_t Push(const void* pData, vk::DeviceSize size); // Returns the dynamic offset
+	template<typename T> inline uint32_t Push(const T& data) { return Push(&data, sizeof(T)); }
+
+	// For writing into a UNIFORM_BUFFER_DYNAMIC descriptor
+	inline vk::DescriptorBufferInfo GetDescriptorInfo() const { return vk::DescriptorBufferInfo(m_pLinearAllocator->GetBuffer(), 0, m_nMaxRange); }
+
+private:
+	std::unique_ptr<LinearAllocator> m_pLinearAllocator;
+	vk::DeviceSize m_nAlignment;
+	vk::DeviceSize m_nMaxRange;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "FrameCapture.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+FrameCapture::FrameCapture(	MemoryAllocator& allocator, vk::Device device, CaptureSink sink, const std::string& sTarget,
+							uint32_t nFramesInFlight, uint32_t nBuffers)
+	: m_Allocator(allocator), m_Device(device), m_Sink(sink), m_sTarget(sTarget), m_vPendingGpu(nFramesInFlight)
+{
+	// Enough to cover the frames the GPU has, plus a couple for the writer to chew on
+	m_vBuffers.resize(nBuffers > 0 ? nBuffers : nFramesInFlight + 2);
+
+	if (m_Sink == CaptureSink::eRaw) m_pFile = std::fopen(m_sTarget.c_str(), "wb");
+	else if (m_Sink == CaptureSink::ePipe)
+	{
+#ifdef _WIN32
+		m_pFile = popen(m_sTarget.c_str(), "wb");
+#else
+		m_pFile = popen(m_sTarget.c_str(), "w");
+#endif
+	}
+	if (!IsOpen()) throw std::runtime_error("Failed to open capture target " + m_sTarget);
+
+	m_Writer = std::thread(&FrameCapture::WriterThread, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	// The device is idle, so whatever's still on the GPU is done
+	for (uint32_t i = 0; i < m_vPendingGpu.size(); ++i) OnFrameComplete(i);
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_Condition.notify_all();
+	m_Writer.join();
+
+	if (m_pFile)
+	{
+		if (m_Sink == CaptureSink::ePipe) pclose(m_pFile);
+		else std::fclose(m_pFile);
+	}
+}
+
+bool FrameCapture::IsFormatSupported(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eB8G8R8A8Srgb:
+	case vk::Format::eB8G8R8A8Unorm:
+	case vk::Format::eR8G8B8A8Srgb:
+	case vk::Format::eR8G8B8A8Unorm:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool FrameCapture::RecordCopy(	vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout layout, vk::Extent2D extent,
+								vk::Format format, uint32_t nFrameSlot, uint64_t nFrameNumber)
+{
+	// Find a buffer neither the GPU nor the writer is using
+	uint32_t nBuffer = UINT32_MAX;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint32_t i = 0; i < m_vBuffers.size(); ++i)
+		{
+			if (m_vBuffers[i].state != BufferState::eFree) continue;
+			m_vBuffers[i].state = BufferState::eGpu;
+			nBuffer = i;
+			break;
+		}
+	}
+	if (nBuffer == UINT32_MAX) { m_nFramesDropped++; return false; }
+
+	// Nobody else is touching it, so it's safe to grow if the swapchain has
+	CaptureBuffer& capture = m_vBuffers[nBuffer];
+	vk::DeviceSize size = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+	if (!capture.buffer.IsValid() || capture.buffer.GetSize() < size)
+	{
+		capture.buffer = Buffer(m_Allocator, m_Device, size, vk::BufferUsageFlagBits::eTransferDst,
+								vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+	capture.extent = extent;
+	capture.format = format;
+	capture.nFrameNumber = nFrameNumber;
+
+	vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+	bool bTransition = layout != vk::ImageLayout::eTransferSrcOptimal;
+
+	// Wait for the render pass' writes, moving it over for copying if it's not already there
+	{
+		vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier(vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eTransferRead,
+			layout, vk::ImageLayout::eTransferSrcOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, range);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{}, nullptr, nullptr, barrier);
+	}
+
+	vk::BufferImageCopy region{};
+	region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	region.imageExtent = vk::Extent3D(extent.width, extent.height, 1);
+	commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, capture.buffer.Get(), region);
+
+	// And back to where it was, ready for presenting
+	if (bTransition)
+	{
+		vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferRead, vk::AccessFlags{},
+			vk::ImageLayout::eTransferSrcOptimal, layout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, range);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags{}, nullptr, nullptr, barrier);
+	}
+
+	// Make the copy visible to the host once the frame's done
+	vk::MemoryBarrier hostBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags{}, hostBarrier, nullptr, nullptr);
+
+	m_vPendingGpu[nFrameSlot].push_back(nBuffer);
+	return true;
+}
+
+void FrameCapture::OnFrameComplete(uint32_t nFrameSlot)
+{
+	if (m_vPendingGpu[nFrameSlot].empty()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint32_t nBuffer : m_vPendingGpu[nFrameSlot])
+		{
+			m_vBuffers[nBuffer].state = BufferState::eWriting;
+			m_vWriteQueue.push_back(nBuffer);
+		}
+	}
+	m_vPendingGpu[nFrameSlot].clear();
+	m_Condition.notify_one();
+}
+
+void FrameCapture::WriterThread()
+{
+	while (true)
+	{
+		uint32_t nBuffer;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_bQuit || !m_vWriteQueue.empty(); });
+			if (m_vWriteQueue.empty()) return; // Only once everything's been written out
+
+			nBuffer = m_vWriteQueue.front();
+			m_vWriteQueue.pop_front();
+		}
+
+		// Straight from mapped memory, there's no need to copy it somewhere first
+		WriteFrame(m_vBuffers[nBuffer]);
+		m_nFramesWritten++;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_vBuffers[nBuffer].state = BufferState::eFree;
+	}
+}
+
+void FrameCapture::WriteFrame(const CaptureBuffer& capture)
+{
+	if (m_Sink == CaptureSink::ePng) { WritePng(capture); return; }
+
+	size_t nSize = static_cast<size_t>(capture.extent.width) * capture.extent.height * 4;
+	if (std::fwrite(capture.buffer.GetMapped(), 1, nSize, m_pFile) != nSize) std::cerr << "Failed to write captured frame " << capture.nFrameNumber << std::endl;
+}
+
+namespace
+{
+	uint32_t Crc32(const uint8_t* pData, size_t nSize, uint32_t nCrc = 0)
+	{
+		static const std::array<uint32_t, 256> table = []()
+		{
+			std::array<uint32_t, 256> table;
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[i] = c;
+			}
+			return table;
+		}();
+
+		nCrc = ~nCrc;
+		for (size_t i = 0; i < nSize; ++i) nCrc = table[(nCrc ^ pData[i]) & 0xFF] ^ (nCrc >> 8);
+		return ~nCrc;
+	}
+
+	void WriteBigEndian(std::vector<uint8_t>& vData, uint32_t nValue)
+	{
+		vData.push_back(static_cast<uint8_t>(nValue >> 24));
+		vData.push_back(static_cast<uint8_t>(nValue >> 16));
+		vData.push_back(static_cast<uint8_t>(nValue >> 8));
+		vData.push_back(static_cast<uint8_t>(nValue));
+	}
+
+	void WriteChunk(std::ofstream& file, const char* sType, const std::vector<uint8_t>& vData)
+	{
+		std::vector<uint8_t> vChunk;
+		WriteBigEndian(vChunk, static_cast<uint32_t>(vData.size()));
+		vChunk.insert(vChunk.end(), sType, sType + 4);
+		vChunk.insert(vChunk.end(), vData.begin(), vData.end());
+		WriteBigEndian(vChunk, Crc32(vChunk.data() + 4, vChunk.size() - 4)); // Covers the type and data, not the length
+		file.write(reinterpret_cast<const char*>(vChunk.data()), vChunk.size());
+	}
+}
+
+void FrameCapture::WritePng(const CaptureBuffer& capture)
+{
+	// Stored (uncompressed) deflate blocks keep this cheap enough to keep up with rendering
+	// and save pulling in zlib - pipe to an encoder if size matters
+	const uint32_t nWidth = capture.extent.width;
+	const uint32_t nHeight = capture.extent.height;
+	const bool bSwizzle = capture.format == vk::Format::eB8G8R8A8Srgb || capture.format == vk::Format::eB8G8R8A8Unorm;
+	const uint8_t* pPixels = static_cast<const uint8_t*>(capture.buffer.GetMapped());
+
+	// Each scanline gets a leading filter byte of 0 (none)
+	std::vector<uint8_t> vRaw;
+	vRaw.reserve(static_cast<size_t>(nWidth * 4 + 1) * nHeight);
+	for (uint32_t y = 0; y < nHeight; ++y)
+	{
+		vRaw.push_back(0);
+		const uint8_t* pRow = pPixels + static_cast<size_t>(y) * nWidth * 4;
+		for (uint32_t x = 0; x < nWidth; ++x)
+		{
+			const uint8_t* p = pRow + x * 4;
+			if (bSwizzle) { vRaw.push_back(p[2]); vRaw.push_back(p[1]); vRaw.push_back(p[0]); }
+			else { vRaw.push_back(p[0]); vRaw.push_back(p[1]); vRaw.push_back(p[2]); }
+			vRaw.push_back(255); // Whatever's in alpha isn't meaningful for a presented image
+		}
+	}
+
+	// zlib stream: header, 64K stored blocks, then an adler32 of the raw data
+	std::vector<uint8_t> vZlib = { 0x78, 0x01 };
+	size_t nOffset = 0;
+	do
+	{
+		size_t nBlock = std::min<size_t>(65535, vRaw.size() - nOffset);
+		bool bFinal = nOffset + nBlock == vRaw.size();
+		vZlib.push_back(bFinal ? 1 : 0);
+		vZlib.push_back(static_cast<uint8_t>(nBlock));
+		vZlib.push_back(static_cast<uint8_t>(nBlock >> 8));
+		vZlib.push_back(static_cast<uint8_t>(~nBlock));
+		vZlib.push_back(static_cast<uint8_t>(~nBlock >> 8));
+		vZlib.insert(vZlib.end(), vRaw.begin() + nOffset, vRaw.begin() + nOffset + nBlock);
+		nOffset += nBlock;
+	} while (nOffset < vRaw.size());
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : vRaw) { a = (a + byte) % 65521; b = (b + a) % 65521; }
+	WriteBigEndian(vZlib, (b << 16) | a);
+
+	std::ostringstream sFilename;
+	sFilename << m_sTarget << "_" << std::setw(6) << std::setfill('0') << capture.nFrameNumber << ".png";
+	std::ofstream file(sFilename.str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) { std::cerr << "Failed to open " << sFilename.str() << std::endl; return; }
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<uint8_t> vHeader;
+	WriteBigEndian(vHeader, nWidth);
+	WriteBigEndian(vHeader, nHeight);
+	vHeader.insert(vHeader.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA, deflate, adaptive filtering, no interlace
+	WriteChunk(file, "IHDR", vHeader);
+	WriteChunk(file, "IDAT", vZlib);
+	WriteChunk(file, "IEND", {});
+}
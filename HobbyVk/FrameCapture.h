@@ -0,0 +1,81 @@
+#pragma once
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "Buffer.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <cstdio>
+
+enum class CaptureSink
+{
+	eRaw,	// Every frame appended to one file, tightly packed, in the image's own format
+	ePng,	// One PNG per frame, named <target>_<frame>.png
+	ePipe	// Raw frames written to a command's stdin, eg: ffmpeg -f rawvideo -pix_fmt bgra -s 800x600 -i - out.mp4
+};
+
+// Copies rendered images into a ring of persistently mapped host buffers and hands them to
+// a background thread to write out once the GPU's done with them. Nothing here ever waits
+// on the GPU or the writer - if every buffer's still busy the frame is simply dropped.
+// Only 8 bit RGBA/BGRA images are supported, which covers what we render into.
+class FrameCapture
+{
+public:
+	FrameCapture(	MemoryAllocator& allocator, vk::Device device, CaptureSink sink, const std::string& sTarget,
+					uint32_t nFramesInFlight, uint32_t nBuffers = 0);
+	~FrameCapture(); // Writes out everything outstanding, so the device must be idle
+
+	static bool IsFormatSupported(vk::Format format);
+
+	// Records a copy of the image into a free buffer, transitioning it from and back to layout if needed.
+	// nFrameSlot is the frame in flight the command buffer belongs to
+	bool RecordCopy(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout layout, vk::Extent2D extent,
+					vk::Format format, uint32_t nFrameSlot, uint64_t nFrameNumber);
+
+	// Call once the frame slot's last frame is done, before recording into it again
+	void OnFrameComplete(uint32_t nFrameSlot);
+
+	inline uint64_t GetFramesWritten() const { return m_nFramesWritten; }
+	inline uint64_t GetFramesDropped() const { return m_nFramesDropped; }
+	inline bool IsOpen() const { return m_pFile != nullptr || m_Sink == CaptureSink::ePng; }
+
+private:
+	enum class BufferState { eFree, eGpu, eWriting };
+
+	struct CaptureBuffer
+	{
+		Buffer buffer;
+		BufferState state = BufferState::eFree;
+		vk::Extent2D extent;
+		vk::Format format = vk::Format::eUndefined;
+		uint64_t nFrameNumber = 0;
+	};
+
+	void WriterThread();
+	void WriteFrame(const CaptureBuffer& capture);
+	void WritePng(const CaptureBuffer& capture);
+
+	MemoryAllocator& m_Allocator;
+	vk::Device m_Device;
+	CaptureSink m_Sink;
+	std::string m_sTarget;
+	FILE* m_pFile = nullptr;
+
+	std::vector<CaptureBuffer> m_vBuffers;
+	std::vector<std::vector<uint32_t>> m_vPendingGpu; // Buffers copied into by each frame slot
+
+	std::thread m_Writer;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::deque<uint32_t> m_vWriteQueue;
+	bool m_bQuit = false;
+
+	std::atomic<uint64_t> m_nFramesWritten = 0;
+	std::atomic<uint64_t> m_nFramesDropped = 0;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer(vk::Device device, bool bPresentWait, double fRefreshMs, uint32_t nHistory)
+	: m_Device(device), m_fRefreshMs(fRefreshMs), m_nHistory(nHistory), m_vLatencies(nHistory), m_vSleeps(nHistory)
+{
+#ifdef HOBBYVK_PRESENT_WAIT
+	// Not exported by the loader, like every other device extension function
+	if (bPresentWait) m_pfnWaitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(m_Device.getProcAddr("vkWaitForPresentKHR"));
+#endif
+}
+
+void FramePacer::SleepUntil(Clock::time_point time)
+{
+	// OS sleeps can overshoot by a millisecond or more, so sleep most of the way and yield the rest
+	Clock::time_point coarse = time - std::chrono::milliseconds(1);
+	if (Clock::now() < coarse) std::this_thread::sleep_until(coarse);
+	while (Clock::now() < time) std::this_thread::yield();
+}
+
+void FramePacer::WaitToStart(vk::SwapchainKHR swapchain)
+{
+#ifdef HOBBYVK_PRESENT_WAIT
+	// The last frame reaching the screen is a vblank we know the time of, and where its latency ends. A few refreshes
+	// is plenty to wait - longer means it was dropped, minimised or similar, and the prediction carries on instead
+	if (m_pfnWaitForPresent && m_nLastPresentId > 0)
+	{
+		uint64_t nTimeout = static_cast<uint64_t>(m_fRefreshMs * 4.0 * 1e6);
+		VkResult result = m_pfnWaitForPresent(static_cast<VkDevice>(m_Device), static_cast<VkSwapchainKHR>(swapchain), m_nLastPresentId, nTimeout);
+		if (result == VK_SUCCESS)
+		{
+			Clock::time_point presented = Clock::now();
+			AddLatency(ToMs(presented - m_LastStart));
+
+			// Back to back vblanks refine the refresh period, anything else is a missed one
+			double fSinceLast = ToMs(presented - m_LastVblank);
+			if (m_bHaveVblank && fSinceLast > m_fRefreshMs * 0.5 && fSinceLast < m_fRefreshMs * 1.5) m_fRefreshMs += (fSinceLast - m_fRefreshMs) * 0.05;
+			m_LastVblank = presented;
+			m_bHaveVblank = true;
+		}
+		m_nLastPresentId = 0;
+	}
+#endif
+
+	Clock::time_point now = Clock::now();
+	if (!m_bHaveVblank)
+	{
+		// Nothing to go on yet, so any phase is as good as another
+		m_LastVblank = now;
+		m_bHaveVblank = true;
+	}
+
+	// The first vblank after the last frame's that there's time to make, then start that long before it
+	Clock::duration refresh = FromMs(m_fRefreshMs);
+	Clock::duration lead = FromMs(m_fWorkMs + fMarginMs);
+	Clock::time_point target = m_LastVblank + refresh;
+	while (target <= m_TargetVblank || target - lead < now) target += refresh;
+	m_TargetVblank = target;
+
+	Clock::time_point start = target - lead;
+	if (start > now) SleepUntil(start);
+
+	m_FrameStart = Clock::now();
+	m_fLastSleepMs = std::max(0.0, ToMs(m_FrameStart - now));
+	m_vSleeps[m_nSleeps++ % m_nHistory] = m_fLastSleepMs;
+}
+
+void FramePacer::OnAcquired(Clock::time_point start, Clock::time_point end)
+{
+	// Images are handed back as vblanks swap them off the screen, so an acquire that had to wait
+	// returned at (about) one - the closest the fallback gets to seeing it
+	if (ToMs(end - start) > 1.0)
+	{
+#ifdef HOBBYVK_PRESENT_WAIT
+		if (m_pfnWaitForPresent) return;
+#endif
+		m_LastVblank = end;
+		m_bHaveVblank = true;
+	}
+}
+
+uint64_t FramePacer::OnPresent(double fGpuMs)
+{
+	// Rise straight away, fall slowly - underestimating means missing vblanks
+	Clock::time_point now = Clock::now();
+	double fWorkMs = ToMs(now - m_FrameStart) + fGpuMs;
+	m_fWorkMs = std::max(fWorkMs, m_fWorkMs * 0.95 + fWorkMs * 0.05);
+
+	bool bPredicted = true;
+#ifdef HOBBYVK_PRESENT_WAIT
+	bPredicted = !m_pfnWaitForPresent;
+#endif
+	if (bPredicted)
+	{
+		// It'll go up at the vblank it aimed at, or the first one after the GPU's done if it's late
+		Clock::time_point presented = m_TargetVblank;
+		while (presented < now + FromMs(fGpuMs)) presented += FromMs(m_fRefreshMs);
+		AddLatency(ToMs(presented - m_FrameStart));
+		m_LastVblank = m_TargetVblank;
+	}
+
+	m_nLastPresentId = m_nNextPresentId;
+	m_LastStart = m_FrameStart;
+	return m_nNextPresentId++;
+}
+
+void FramePacer::OnSwapchainRecreated()
+{
+	m_nLastPresentId = 0;
+	m_bHaveVblank = false;
+}
+
+void FramePacer::AddLatency(double fMs)
+{
+	m_vLatencies[m_nLatencies++ % m_nHistory] = fMs;
+	m_bNewSample = true;
+}
+
+bool FramePacer::TakeLatencySample(double& fMs)
+{
+	if (!m_bNewSample) return false;
+	m_bNewSample = false;
+	fMs = m_vLatencies[(m_nLatencies - 1) % m_nHistory];
+	return true;
+}
+
+LatencyTiming FramePacer::GetTiming() const
+{
+	LatencyTiming timing;
+#ifdef HOBBYVK_PRESENT_WAIT
+	timing.bMeasured = m_pfnWaitForPresent != nullptr;
+#endif
+	timing.fRefreshMs = m_fRefreshMs;
+	timing.nSamples = static_cast<uint32_t>(std::min<uint64_t>(m_nLatencies, m_nHistory));
+	if (timing.nSamples == 0) return timing;
+
+	timing.fLastMs = m_vLatencies[(m_nLatencies - 1) % m_nHistory];
+	for (uint32_t i = 0; i < timing.nSamples; ++i)
+	{
+		timing.fAverageMs += m_vLatencies[i];
+		timing.fMaxMs = std::max(timing.fMaxMs, m_vLatencies[i]);
+	}
+	timing.fAverageMs /= timing.nSamples;
+
+	uint32_t nSleeps = static_cast<uint32_t>(std::min<uint64_t>(m_nSleeps, m_nHistory));
+	for (uint32_t i = 0; i < nSleeps; ++i) timing.fSleepMs += m_vSleeps[i];
+	if (nSleeps > 0) timing.fSleepMs /= nSleeps;
+	return timing;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <chrono>
+#include <vector>
+
+// VK_KHR_present_wait is newer than the 1.2.148 SDK this was started on, so older headers just get the fallback
+#if defined(VK_KHR_present_id) && defined(VK_KHR_present_wait)
+#define HOBBYVK_PRESENT_WAIT
+#endif
+
+struct LatencyTiming
+{
+	bool bMeasured = false;		// Present times from VK_KHR_present_wait, rather than predicted from the refresh rate
+	uint32_t nSamples = 0;
+	double fLastMs = 0.0;		// Input to present - from the frame starting to it reaching the screen
+	double fAverageMs = 0.0;	// Over the last nHistory frames
+	double fMaxMs = 0.0;
+	double fSleepMs = 0.0;		// Average time frames were held back for
+	double fRefreshMs = 0.0;	// The display period being paced to
+};
+
+// Starts frames as late as they can be while still making the next vblank, so what they show is as
+// fresh as it can be, rather than queueing up behind the display. Each frame aims at the first vblank
+// it can make after the last one's, and starts that long before it, given how long frames have been
+// taking (CPU up to submit, plus the GPU). With VK_KHR_present_wait the vblanks come from waiting for
+// the last frame to actually be shown, otherwise they're predicted from the refresh rate, phased off
+// acquires that blocked (which return as a vblank frees an image). Trades throughput for latency -
+// frames that take longer than a refresh only make every other one
+class FramePacer
+{
+public:
+	// bPresentWait only if both present extensions and features are enabled on the device
+	FramePacer(vk::Device device, bool bPresentWait, double fRefreshMs, uint32_t nHistory = 256);
+
+	// Blocks until the frame should start, before anything it shows (input above all) is read
+	void WaitToStart(vk::SwapchainKHR swapchain);
+
+	void OnAcquired(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	// Just before presenting, with how long the GPU's been taking per frame. Returns the id to
+	// present with through VkPresentIdKHR, when present wait's in use
+	uint64_t OnPresent(double fGpuMs);
+
+	// Present ids don't carry over, so there's nothing to wait for until the new swapchain's presented
+	void OnSwapchainRecreated();
+
+	// The input to present latency measured (or predicted) since the last call, if there is one
+	bool TakeLatencySample(double& fMs);
+	inline double GetLastSleepMs() const { return m_fLastSleepMs; }
+	LatencyTiming GetTiming() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	static inline double ToMs(Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+	static inline Clock::duration FromMs(double fMs) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(fMs)); }
+	static void SleepUntil(Clock::time_point time);
+	void AddLatency(double fMs);
+
+	static constexpr double fMarginMs = 1.5; // Slack for estimates being off and the OS waking us late
+
+	vk::Device m_Device;
+	double m_fRefreshMs;
+#ifdef HOBBYVK_PRESENT_WAIT
+	PFN_vkWaitForPresentKHR m_pfnWaitForPresent = nullptr;
+#endif
+
+	uint64_t m_nNextPresentId = 1;
+	uint64_t m_nLastPresentId = 0;	// Still to be waited for, 0 once it has
+	Clock::time_point m_LastStart;	// Of the frame with m_nLastPresentId
+
+	bool m_bHaveVblank = false;
+	Clock::time_point m_LastVblank;		// Seen, or predicted
+	Clock::time_point m_TargetVblank;	// The one the frame being recorded is aiming for
+	Clock::time_point m_FrameStart;
+	double m_fWorkMs = 0.0;
+
+	uint32_t m_nHistory;
+	std::vector<double> m_vLatencies; // Rings
+	std::vector<double> m_vSleeps;
+	uint64_t m_nLatencies = 0;
+	uint64_t m_nSleeps = 0;
+	bool m_bNewSample = false;
+	double m_fLastSleepMs = 0.0;
+};
+
+#endif
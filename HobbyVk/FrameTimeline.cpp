@@ -0,0 +1,28 @@
+#include "FrameTimeline.h"
+#include <algorithm>
+
+FrameTimeline::FrameTimeline(vk::Device device) : m_Device(device)
+{
+	vk::SemaphoreTypeCreateInfo timelineInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0);
+	vk::SemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.pNext = &timelineInfo;
+	m_Semaphore = m_Device.createSemaphoreUnique(semaphoreInfo);
+}
+
+bool FrameTimeline::IsComplete(uint64_t nValue)
+{
+	if (nValue <= m_nCompleted) return true;
+	uint64_t nCounter = m_Device.getSemaphoreCounterValue(m_Semaphore.get());
+	m_nCompleted = std::max(m_nCompleted, nCounter);
+	return nValue <= m_nCompleted;
+}
+
+bool FrameTimeline::Wait(uint64_t nValue)
+{
+	if (IsComplete(nValue)) return false;
+
+	vk::SemaphoreWaitInfo waitInfo = vk::SemaphoreWaitInfo(vk::SemaphoreWaitFlags{}, 1, &m_Semaphore.get(), &nValue);
+	m_Device.waitSemaphores(waitInfo, UINT64_MAX);
+	m_nCompleted = nValue;
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef FRAME_TIMELINE_H
+#define FRAME_TIMELINE_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+// Paces frames on one timeline semaphore rather than a fence per frame in flight. The graphics
+// queue signals GetValue(nFrame) as frame nFrame finishes, so "is frame N done" is a comparison,
+// waiting on any frame (or an image's last frame) is the same call, and other queues can wait on
+// the semaphore for whichever frame they need without fences of their own. The last value seen
+// complete is remembered, so the CPU only goes to the driver - let alone blocks - when it's behind
+class FrameTimeline
+{
+public:
+	FrameTimeline(vk::Device device);
+
+	// Frames count from 0, values from 1 - 0 is "nothing", so waiting on it never blocks
+	static inline uint64_t GetValue(uint64_t nFrame) { return nFrame + 1; }
+
+	bool IsComplete(uint64_t nValue);
+	bool Wait(uint64_t nValue); // Returns whether it actually had to block
+
+	inline vk::Semaphore GetSemaphore() const { return m_Semaphore.get(); }
+
+private:
+	vk::Device m_Device;
+	vk::UniqueSemaphore m_Semaphore;
+	uint64_t m_nCompleted = 0;
+};
+
+#endif
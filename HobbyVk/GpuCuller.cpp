@@ -0,0 +1,171 @@
+#include "GpuCuller.h"
+#include <algorithm>
+#include <cstring>
+
+GpuCuller::GpuCuller(	MemoryAllocator& allocator, vk::Device device, PipelineLibrary& pipelineLibrary, const std::string& sShaderFile,
+						const std::vector<uint32_t>& vQueueFamilies, uint32_t nFramesInFlight, uint32_t nMaxObjects,
+						bool bDrawIndirectCount, bool bMultiDrawIndirect, bool bDrawIndirectFirstInstance, bool bOcclusion)
+	: m_Device(device), m_bDrawIndirectCount(bDrawIndirectCount && bDrawIndirectFirstInstance), m_bMultiDrawIndirect(bMultiDrawIndirect && bDrawIndirectFirstInstance),
+	  m_bDrawIndirectFirstInstance(bDrawIndirectFirstInstance), m_bOcclusion(bOcclusion),
+	  m_nMaxObjects(std::max(1u, nMaxObjects)), m_PipelineLibrary(pipelineLibrary)
+{
+	m_vFrames.resize(nFramesInFlight);
+	for (auto& frame : m_vFrames)
+	{
+		// Objects are uploaded from the transfer queue, everything else stays on graphics
+		frame.objectBuffer = Buffer(allocator, m_Device, sizeof(DrawObject) * m_nMaxObjects,
+									vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, vQueueFamilies);
+		if (m_bOcclusion)
+		{
+			frame.occlusionBuffer = Buffer(	allocator, m_Device, sizeof(OcclusionUniforms), vk::BufferUsageFlagBits::eUniformBuffer,
+											vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+		}
+		frame.drawBuffer = Buffer(	allocator, m_Device, sizeof(vk::DrawIndexedIndirectCommand) * m_nMaxObjects,
+									vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		frame.countBuffer = Buffer(	allocator, m_Device, sizeof(uint32_t),
+									vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+									vk::MemoryPropertyFlagBits::eDeviceLocal);
+	}
+
+	// Objects, draws out, and the count of draws out - then the pyramid and what it was drawn with, for occlusion
+	std::vector<vk::DescriptorSetLayoutBinding> vBindings;
+	for (uint32_t i = 0; i < 3; ++i) vBindings.push_back(vk::DescriptorSetLayoutBinding(i, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute));
+	if (m_bOcclusion)
+	{
+		vBindings.push_back(vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute));
+		vBindings.push_back(vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute));
+	}
+	m_DescriptorSetLayout = m_Device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo({}, static_cast<uint32_t>(vBindings.size()), vBindings.data()));
+
+	std::vector<vk::DescriptorPoolSize> vPoolSizes = { vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 3 * nFramesInFlight) };
+	if (m_bOcclusion)
+	{
+		vPoolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, nFramesInFlight));
+		vPoolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, nFramesInFlight));
+	}
+	m_DescriptorPool = m_Device.createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, nFramesInFlight, static_cast<uint32_t>(vPoolSizes.size()), vPoolSizes.data()));
+
+	std::vector<vk::DescriptorSetLayout> vLayouts(nFramesInFlight, m_DescriptorSetLayout.get());
+	std::vector<vk::DescriptorSet> vSets = m_Device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(m_DescriptorPool.get(), nFramesInFlight, vLayouts.data()));
+	for (uint32_t i = 0; i < nFramesInFlight; ++i)
+	{
+		FrameBuffers& frame = m_vFrames[i];
+		frame.descriptorSet = vSets[i];
+
+		std::array<vk::DescriptorBufferInfo, 3> bufferInfos =
+		{
+			vk::DescriptorBufferInfo(frame.objectBuffer.Get(), 0, VK_WHOLE_SIZE),
+			vk::DescriptorBufferInfo(frame.drawBuffer.Get(), 0, VK_WHOLE_SIZE),
+			vk::DescriptorBufferInfo(frame.countBuffer.Get(), 0, VK_WHOLE_SIZE)
+		};
+		std::array<vk::WriteDescriptorSet, 3> writes;
+		for (uint32_t j = 0; j < writes.size(); ++j) writes[j] = vk::WriteDescriptorSet(frame.descriptorSet, j, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfos[j]);
+		m_Device.updateDescriptorSets(writes, nullptr);
+
+		// The pyramid's written in when there is one, see RecordCull
+		if (m_bOcclusion)
+		{
+			vk::DescriptorBufferInfo occlusionInfo = vk::DescriptorBufferInfo(frame.occlusionBuffer.Get(), 0, VK_WHOLE_SIZE);
+			m_Device.updateDescriptorSets(vk::WriteDescriptorSet(frame.descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &occlusionInfo), nullptr);
+		}
+	}
+
+	vk::PushConstantRange pushConstantRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants));
+	m_PipelineLayout = m_Device.createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, 1, &m_DescriptorSetLayout.get(), 1, &pushConstantRange));
+
+	// Whether to compact is known up front, so it's baked in rather than branched on per invocation. Draws only
+	// have a firstInstance with drawIndirectFirstInstance - otherwise there's a draw per object, in object order,
+	// so the CPU knows which instance each one is for
+	// It's built now rather than on the first cull, then fetched each time in case it's been reloaded
+	m_PipelineKey.sShader = sShaderFile;
+	m_PipelineKey.constants.Set(eCompact, m_bDrawIndirectCount).Set(eGroupSize, nGroupSize).Set(eFirstInstance, m_bDrawIndirectFirstInstance);
+	m_PipelineKey.layout = m_PipelineLayout.get();
+	m_PipelineLibrary.GetCompute(m_PipelineKey);
+}
+
+void GpuCuller::SetObjects(StagingRing& stagingRing, uint32_t nFrame, const std::vector<DrawObject>& vObjects)
+{
+	if (vObjects.size() > m_nMaxObjects) throw std::runtime_error("Too many objects for the GPU culler!");
+	FrameBuffers& frame = m_vFrames[nFrame];
+	frame.nObjects = static_cast<uint32_t>(vObjects.size());
+	if (frame.nObjects > 0) stagingRing.Upload(frame.objectBuffer.Get(), 0, vObjects.data(), sizeof(DrawObject) * vObjects.size());
+
+	if (m_bDrawIndirectFirstInstance) return;
+	frame.vInstances.clear();
+	for (const DrawObject& object : vObjects) frame.vInstances.push_back(object.nInstance);
+}
+
+void GpuCuller::RecordCull(vk::CommandBuffer commandBuffer, uint32_t nFrame, const std::array<glm::vec4, 6>& planes, DepthPyramid* pDepthPyramid)
+{
+	FrameBuffers& frame = m_vFrames[nFrame];
+
+	// This frame's set isn't in use any more, so it can be pointed at a new pyramid
+	if (m_bOcclusion)
+	{
+		if (!pDepthPyramid) throw std::runtime_error("Occlusion culling needs a depth pyramid!");
+		pDepthPyramid->RecordPrepare(commandBuffer);
+		if (frame.depthPyramid != pDepthPyramid->GetView())
+		{
+			frame.depthPyramid = pDepthPyramid->GetView();
+			vk::DescriptorImageInfo pyramidInfo = vk::DescriptorImageInfo(pDepthPyramid->GetSampler(), frame.depthPyramid, vk::ImageLayout::eGeneral);
+			m_Device.updateDescriptorSets(vk::WriteDescriptorSet(frame.descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &pyramidInfo), nullptr);
+		}
+
+		OcclusionUniforms occlusion;
+		occlusion.viewProjection = pDepthPyramid->GetViewProjection();
+		occlusion.depthSize = glm::uvec4(pDepthPyramid->GetDepthExtent().width, pDepthPyramid->GetDepthExtent().height, pDepthPyramid->GetMipLevels(), pDepthPyramid->IsBuilt() ? 1 : 0);
+		std::memcpy(frame.occlusionBuffer.GetMapped(), &occlusion, sizeof(occlusion));
+	}
+
+	// Start the count from zero, and have the shader wait for that
+	commandBuffer.fillBuffer(frame.countBuffer.Get(), 0, sizeof(uint32_t), 0);
+	vk::MemoryBarrier clearBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{}, clearBarrier, nullptr, nullptr);
+
+	CullConstants constants;
+	constants.planes = planes;
+	constants.nObjectCount = frame.nObjects;
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_PipelineLibrary.GetCompute(m_PipelineKey));
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_PipelineLayout.get(), 0, frame.descriptorSet, nullptr);
+	commandBuffer.pushConstants(m_PipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants), &constants);
+	commandBuffer.dispatch((frame.nObjects + nGroupSize - 1) / nGroupSize, 1, 1);
+}
+
+void GpuCuller::RecordDraws(vk::CommandBuffer commandBuffer, uint32_t nFrame, InstanceBuffer& instances, uint32_t nInstanceBinding)
+{
+	FrameBuffers& frame = m_vFrames[nFrame];
+	constexpr uint32_t nStride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	// Without a count from the GPU every object gets a draw, culled ones are just empty, and
+	// without multi draw there's no choice but to issue them one by one
+	if (!m_bDrawIndirectFirstInstance)
+	{
+		for (uint32_t i = 0; i < frame.nObjects; ++i)
+		{
+			instances.Bind(commandBuffer, nFrame, nInstanceBinding, frame.vInstances[i]);
+			commandBuffer.drawIndexedIndirect(frame.drawBuffer.Get(), i * nStride, 1, nStride);
+		}
+	}
+	else if (m_bDrawIndirectCount) commandBuffer.drawIndexedIndirectCount(frame.drawBuffer.Get(), 0, frame.countBuffer.Get(), 0, frame.nObjects, nStride);
+	else if (m_bMultiDrawIndirect) commandBuffer.drawIndexedIndirect(frame.drawBuffer.Get(), 0, frame.nObjects, nStride);
+	else for (uint32_t i = 0; i < frame.nObjects; ++i) commandBuffer.drawIndexedIndirect(frame.drawBuffer.Get(), i * nStride, 1, nStride);
+}
+
+std::array<glm::vec4, 6> GpuCuller::ExtractFrustumPlanes(const glm::mat4& viewProjection)
+{
+	// GLM's column major, so pull the rows out by hand
+	auto row = [&viewProjection](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+
+	std::array<glm::vec4, 6> planes =
+	{
+		row(3) + row(0), // Left
+		row(3) - row(0), // Right
+		row(3) + row(1), // Bottom
+		row(3) - row(1), // Top
+		row(2),			 // Near, as z goes 0 to 1
+		row(3) - row(2)	 // Far
+	};
+	for (auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+	return planes;
+}
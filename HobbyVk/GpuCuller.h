@@ -0,0 +1,115 @@
+#pragma once
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <array>
+#include "Buffer.h"
+#include "StagingRing.h"
+#include "PipelineLibrary.h"
+#include "DepthPyramid.h"
+#include "InstanceBuffer.h"
+
+// Matches DrawObject in Shaders/cull.comp (std430)
+struct DrawObject
+{
+	uint32_t nIndexCount;
+	uint32_t nFirstIndex;
+	int32_t nVertexOffset;
+	uint32_t nInstance;			// Drawn with this instance - a draw split into meshlets shares its one
+	glm::vec4 boundingSphere;	// Centre in xyz, radius in w
+};
+
+// Matches Occlusion in Shaders/cull.glsl (std140)
+struct OcclusionUniforms
+{
+	glm::mat4 viewProjection;
+	glm::uvec4 depthSize; // Depth buffer size in xy, pyramid levels in z, w 0 until it's been built
+};
+
+// GPU driven drawing - objects live in a storage buffer, a compute pass frustum culls them and
+// writes out VkDrawIndexedIndirectCommands, and one drawIndexedIndirectCount draws the
+// survivors, so recording costs the same no matter how many objects there are. With bOcclusion
+// (and the shader built with it, Shaders/cull_occlusion.comp) whatever survives is also tested
+// against the last frame's DepthPyramid. Each frame in flight has its own objects, draw and
+// count buffers, so the CPU never waits on them
+class GpuCuller
+{
+public:
+	GpuCuller(	MemoryAllocator& allocator, vk::Device device, PipelineLibrary& pipelineLibrary, const std::string& sShaderFile,
+				const std::vector<uint32_t>& vQueueFamilies, uint32_t nFramesInFlight, uint32_t nMaxObjects,
+				bool bDrawIndirectCount, bool bMultiDrawIndirect, bool bDrawIndirectFirstInstance, bool bOcclusion = false);
+
+	// Uploads through the staging ring into nFrame's copy, so that frame must wait on it
+	void SetObjects(StagingRing& stagingRing, uint32_t nFrame, const std::vector<DrawObject>& vObjects);
+	inline uint32_t GetObjectCount(uint32_t nFrame) const { return m_vFrames[nFrame].nObjects; }
+	inline uint32_t GetMaxObjects() const { return m_nMaxObjects; }
+	inline bool HasOcclusion() const { return m_bOcclusion; }
+
+	// Record outside of a render pass, before the draws - whatever records it (the render graph, say)
+	// needs to make the draw and count buffers' shader writes visible to the draws' indirect reads
+	// pDepthPyramid is only for occlusion, when it's needed
+	void RecordCull(vk::CommandBuffer commandBuffer, uint32_t nFrame, const std::array<glm::vec4, 6>& planes, DepthPyramid* pDepthPyramid = nullptr);
+
+	// Record inside the render pass, with the pipeline and vertex/index buffers already bound. Without
+	// drawIndirectFirstInstance the draws go one by one, each rebinding instances at its object's
+	void RecordDraws(vk::CommandBuffer commandBuffer, uint32_t nFrame, InstanceBuffer& instances, uint32_t nInstanceBinding);
+
+	inline vk::Buffer GetDrawBuffer(uint32_t nFrame) const { return m_vFrames[nFrame].drawBuffer.Get(); }
+	inline vk::Buffer GetCountBuffer(uint32_t nFrame) const { return m_vFrames[nFrame].countBuffer.Get(); }
+
+	// Gribb-Hartmann planes, normalised and pointing inwards, for Vulkan's 0 to 1 depth
+	static std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProjection);
+
+private:
+	// Matches CullConstants in Shaders/cull.comp
+	struct CullConstants
+	{
+		std::array<glm::vec4, 6> planes;
+		uint32_t nObjectCount;
+	};
+
+	// constant_ids in Shaders/cull.comp
+	enum SpecializationId : uint32_t
+	{
+		eCompact = 0,	// Without drawIndirectCount, culled draws just get zero instances
+		eGroupSize = 1,
+		eFirstInstance = 2
+	};
+
+	struct FrameBuffers
+	{
+		Buffer objectBuffer;
+		Buffer drawBuffer;
+		Buffer countBuffer;
+		Buffer occlusionBuffer;			// Host visible, occlusion only
+		vk::ImageView depthPyramid;		// What the descriptor set's pointing at, as pyramids are remade on resize
+		vk::DescriptorSet descriptorSet; // Freed with the pool
+		uint32_t nObjects = 0;
+		std::vector<uint32_t> vInstances; // Each object's, only kept without drawIndirectFirstInstance
+	};
+
+	static constexpr uint32_t nGroupSize = 64; // Specialised into local_size_x in Shaders/cull.comp
+
+	vk::Device m_Device;
+	bool m_bDrawIndirectCount;
+	bool m_bMultiDrawIndirect;
+	bool m_bDrawIndirectFirstInstance;
+	bool m_bOcclusion;
+	uint32_t m_nMaxObjects;
+
+	std::vector<FrameBuffers> m_vFrames;
+
+	vk::UniqueDescriptorSetLayout m_DescriptorSetLayout;
+	vk::UniqueDescriptorPool m_DescriptorPool;
+	vk::UniquePipelineLayout m_PipelineLayout;
+	PipelineLibrary& m_PipelineLibrary;
+	ComputePipelineKey m_PipelineKey; // Fetched each cull, in case it's been reloaded
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "GpuProfiler.h"
+#include <algorithm>
+
+GpuProfiler::GpuProfiler(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t nQueueFamily, uint32_t nFramesInFlight, uint32_t nMaxPasses)
+	: m_Device(device), m_nMaxPasses(nMaxPasses)
+{
+	// Not every queue can write timestamps, and valid bits tells us how many of the 64 are meaningful
+	vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+	uint32_t nValidBits = physicalDevice.getQueueFamilyProperties()[nQueueFamily].timestampValidBits;
+	m_bSupported = nValidBits > 0 && properties.limits.timestampPeriod > 0.0f;
+	m_fTimestampPeriod = properties.limits.timestampPeriod;
+	m_nTimestampMask = nValidBits >= 64 ? UINT64_MAX : ((1ull << nValidBits) - 1);
+	if (!m_bSupported) return;
+
+	vk::QueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+	queryPoolInfo.queryCount = nMaxPasses * 2; // Start and end
+
+	m_vFrames.resize(nFramesInFlight);
+	for (auto& frame : m_vFrames) frame.queryPool = m_Device.createQueryPoolUnique(queryPoolInfo);
+}
+
+void GpuProfiler::BeginFrame(vk::CommandBuffer commandBuffer, uint32_t nFrame)
+{
+	if (!m_bSupported) return;
+
+	// Whatever this frame slot wrote last time round has finished by now
+	m_nCurrentFrame = nFrame;
+	FrameQueries& frame = m_vFrames[nFrame];
+	ResolveFrame(frame);
+
+	frame.vPassNames.clear();
+	frame.nQueries = 0;
+	m_vOpenPasses.clear();
+	commandBuffer.resetQueryPool(frame.queryPool.get(), 0, m_nMaxPasses * 2);
+}
+
+void GpuProfiler::BeginPass(vk::CommandBuffer commandBuffer, const std::string& sName)
+{
+	if (!m_bSupported) return;
+
+	FrameQueries& frame = m_vFrames[m_nCurrentFrame];
+	uint32_t nPass = static_cast<uint32_t>(frame.vPassNames.size());
+	if (nPass >= m_nMaxPasses) { m_vOpenPasses.push_back(UINT32_MAX); return; } // Out of queries, quietly ignore it
+
+	frame.vPassNames.push_back(sName);
+	m_vOpenPasses.push_back(nPass);
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool.get(), nPass * 2);
+}
+
+void GpuProfiler::EndPass(vk::CommandBuffer commandBuffer)
+{
+	if (!m_bSupported || m_vOpenPasses.empty()) return;
+
+	uint32_t nPass = m_vOpenPasses.back();
+	m_vOpenPasses.pop_back();
+	if (nPass == UINT32_MAX) return;
+
+	FrameQueries& frame = m_vFrames[m_nCurrentFrame];
+	commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.queryPool.get(), nPass * 2 + 1);
+	frame.nQueries = std::max(frame.nQueries, nPass * 2 + 2);
+}
+
+void GpuProfiler::ResolveFrame(FrameQueries& frame)
+{
+	if (frame.nQueries == 0) return;
+
+	// No eWait - the frame's already been waited on, so the results are there
+	std::vector<uint64_t> vTimestamps(frame.nQueries);
+	vk::Result result = m_Device.getQueryPoolResults(frame.queryPool.get(), 0, frame.nQueries, vTimestamps.size() * sizeof(uint64_t),
+													vTimestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+	if (result != vk::Result::eSuccess) return;
+
+	for (uint32_t i = 0; i < frame.nQueries / 2; ++i)
+	{
+		uint64_t nStart = vTimestamps[i * 2] & m_nTimestampMask;
+		uint64_t nEnd = vTimestamps[i * 2 + 1] & m_nTimestampMask;
+		uint64_t nTicks = (nEnd - nStart) & m_nTimestampMask; // Handles the counter wrapping
+		AddSample(frame.vPassNames[i], static_cast<double>(nTicks) * m_fTimestampPeriod / 1e6);
+	}
+}
+
+void GpuProfiler::AddSample(const std::string& sName, double fMs)
+{
+	auto it = std::find_if(m_vHistory.begin(), m_vHistory.end(), [&sName](const PassHistory& history) { return history.sName == sName; });
+	if (it == m_vHistory.end())
+	{
+		m_vHistory.push_back(PassHistory{ sName });
+		it = m_vHistory.end() - 1;
+	}
+
+	if (it->vSamples.size() < nHistory) it->vSamples.push_back(fMs);
+	else it->vSamples[it->nNext] = fMs;
+	it->nNext = (it->nNext + 1) % nHistory;
+	it->fLastMs = fMs;
+}
+
+std::vector<GpuPassTiming> GpuProfiler::GetTimings() const
+{
+	std::vector<GpuPassTiming> vTimings;
+	for (const auto& history : m_vHistory)
+	{
+		GpuPassTiming timing;
+		timing.sName = history.sName;
+		timing.fLastMs = history.fLastMs;
+		timing.fMinMs = *std::min_element(history.vSamples.begin(), history.vSamples.end());
+		timing.fMaxMs = *std::max_element(history.vSamples.begin(), history.vSamples.end());
+		for (double fSample : history.vSamples) timing.fAverageMs += fSample;
+		timing.fAverageMs /= history.vSamples.size();
+		vTimings.push_back(timing);
+	}
+	return vTimings;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+
+struct GpuPassTiming
+{
+	std::string sName;
+	double fLastMs = 0.0;
+	double fAverageMs = 0.0; // Over the last nHistory frames the pass ran in
+	double fMinMs = 0.0;
+	double fMaxMs = 0.0;
+};
+
+// Brackets passes with timestamp queries. Each frame in flight has its own query pool, and
+// results are only read back once that frame has been waited on (which happens anyway
+// before re-recording it), so reading them never stalls - at the cost of being a few frames old
+class GpuProfiler
+{
+public:
+	GpuProfiler(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t nQueueFamily, uint32_t nFramesInFlight, uint32_t nMaxPasses = 32);
+
+	// Call at the start of recording nFrame's command buffer, outside of a render pass
+	void BeginFrame(vk::CommandBuffer commandBuffer, uint32_t nFrame);
+
+	// Passes may nest, but mustn't straddle frames
+	void BeginPass(vk::CommandBuffer commandBuffer, const std::string& sName);
+	void EndPass(vk::CommandBuffer commandBuffer);
+
+	std::vector<GpuPassTiming> GetTimings() const;
+	inline bool IsSupported() const { return m_bSupported; }
+
+private:
+	struct FrameQueries
+	{
+		vk::UniqueQueryPool queryPool;
+		std::vector<std::string> vPassNames; // Pass i owns queries 2i and 2i + 1
+		uint32_t nQueries = 0;
+	};
+
+	struct PassHistory
+	{
+		std::string sName;
+		std::vector<double> vSamples; // Ring of the last nHistory timings
+		uint32_t nNext = 0;
+		double fLastMs = 0.0;
+	};
+
+	void ResolveFrame(FrameQueries& frame);
+	void AddSample(const std::string& sName, double fMs);
+
+	static constexpr uint32_t nHistory = 64;
+
+	vk::Device m_Device;
+	bool m_bSupported;
+	double m_fTimestampPeriod; // Nanoseconds per tick
+	uint64_t m_nTimestampMask;
+	uint32_t m_nMaxPasses;
+
+	std::vector<FrameQueries> m_vFrames;
+	uint32_t m_nCurrentFrame = 0;
+	std::vector<uint32_t> m_vOpenPasses; // Stack of pass indices for nesting
+
+	std::vector<PassHistory> m_vHistory; // In the order passes were first seen
+};
+
+#endif
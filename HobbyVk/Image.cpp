@@ -0,0 +1,61 @@
+#include "Image.h"
+
+Image::Image(	MemoryAllocator& allocator, vk::Device device, const vk::ImageCreateInfo& createInfo,
+				vk::MemoryPropertyFlags memoryFlags, vk::ImageAspectFlags aspect, vk::MemoryPropertyFlags preferredMemoryFlags)
+	: m_pAllocator(&allocator), m_Format(createInfo.format), m_Extent(createInfo.extent), m_nMipLevels(createInfo.mipLevels)
+{
+	m_Image = device.createImageUnique(createInfo);
+
+	// Optimal tiling images are kept apart from buffers by the allocator, linear ones can share
+	bool bLinear = createInfo.tiling == vk::ImageTiling::eLinear;
+	m_Memory = m_pAllocator->Allocate(device.getImageMemoryRequirements(m_Image.get()), memoryFlags, preferredMemoryFlags, bLinear);
+	device.bindImageMemory(m_Image.get(), m_Memory.memory, m_Memory.offset);
+
+	vk::ImageViewCreateInfo viewInfo{};
+	viewInfo.image = m_Image.get();
+	viewInfo.viewType = createInfo.imageType == vk::ImageType::e3D ? vk::ImageViewType::e3D : vk::ImageViewType::e2D;
+	viewInfo.format = createInfo.format;
+	viewInfo.subresourceRange.aspectMask = aspect;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = createInfo.mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	m_View = device.createImageViewUnique(viewInfo);
+}
+
+Image::Image(Image&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+Image& Image::operator=(Image&& other) noexcept
+{
+	if (this == &other) return *this;
+	Release();
+
+	m_pAllocator = other.m_pAllocator;
+	m_Image = std::move(other.m_Image);
+	m_View = std::move(other.m_View);
+	m_Memory = other.m_Memory;
+	m_Format = other.m_Format;
+	m_Extent = other.m_Extent;
+	m_nMipLevels = other.m_nMipLevels;
+
+	other.m_pAllocator = nullptr;
+	other.m_Memory = MemoryAllocation{};
+	return *this;
+}
+
+void Image::Release()
+{
+	// View, then image, then its memory
+	m_View.reset();
+	m_Image.reset();
+	if (m_pAllocator) m_pAllocator->Free(m_Memory);
+	m_pAllocator = nullptr;
+}
+
+Image::~Image()
+{
+	Release();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "MemoryAllocator.h"
+
+// A vk::Image and the memory backing it, sub-allocated from a MemoryAllocator,
+// along with a view of the whole thing
+class Image
+{
+public:
+	Image() = default;
+	Image(	MemoryAllocator& allocator, vk::Device device, const vk::ImageCreateInfo& createInfo,
+			vk::MemoryPropertyFlags memoryFlags, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor,
+			vk::MemoryPropertyFlags preferredMemoryFlags = vk::MemoryPropertyFlags{});
+	~Image();
+
+	Image(Image&& other) noexcept;
+	Image& operator=(Image&& other) noexcept;
+	Image(const Image&) = delete;
+	Image& operator=(const Image&) = delete;
+
+	inline vk::Image Get() const { return m_Image.get(); }
+	inline vk::ImageView GetView() const { return m_View.get(); }
+	inline vk::Format GetFormat() const { return m_Format; }
+	inline vk::Extent3D GetExtent() const { return m_Extent; }
+	inline uint32_t GetMipLevels() const { return m_nMipLevels; }
+	inline bool IsValid() const { return static_cast<bool>(m_Image); }
+
+private:
+	void Release();
+
+	MemoryAllocator* m_pAllocator = nullptr;
+	vk::UniqueImage m_Image;
+	vk::UniqueImageView m_View;
+	MemoryAllocation m_Memory;
+	vk::Format m_Format = vk::Format::eUndefined;
+	vk::Extent3D m_Extent;
+	uint32_t m_nMipLevels = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "InstanceBuffer.h"
+#include <algorithm>
+
+InstanceBuffer::InstanceBuffer(MemoryAllocator& allocator, vk::Device device, uint32_t nFramesInFlight, uint32_t nCapacity)
+	: m_nCapacity(std::max(1u, nCapacity))
+{
+	// Streams back to back in one buffer, the colours start 16 byte aligned as the transforms are vec4s anyway
+	m_nColourOffset = sizeof(glm::vec4) * m_nCapacity;
+	vk::DeviceSize size = m_nColourOffset + sizeof(uint32_t) * m_nCapacity;
+
+	for (uint32_t i = 0; i < nFramesInFlight; ++i)
+	{
+		m_vFrames.emplace_back(allocator, device, size, vk::BufferUsageFlagBits::eVertexBuffer,
+								vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+}
+
+InstanceStreams InstanceBuffer::GetStreams(uint32_t nFrame)
+{
+	uint8_t* pMapped = static_cast<uint8_t*>(m_vFrames[nFrame].GetMapped());
+
+	InstanceStreams streams;
+	streams.pTransforms = reinterpret_cast<glm::vec4*>(pMapped);
+	streams.pColours = reinterpret_cast<uint32_t*>(pMapped + m_nColourOffset);
+	streams.nCapacity = m_nCapacity;
+	return streams;
+}
+
+void InstanceBuffer::Bind(vk::CommandBuffer commandBuffer, uint32_t nFrame, uint32_t nFirstBinding, uint32_t nFirstInstance)
+{
+	std::array<vk::Buffer, nStreams> buffers = { m_vFrames[nFrame].Get(), m_vFrames[nFrame].Get() };
+	std::array<vk::DeviceSize, nStreams> offsets = { sizeof(glm::vec4) * nFirstInstance, m_nColourOffset + sizeof(uint32_t) * nFirstInstance };
+	commandBuffer.bindVertexBuffers(nFirstBinding, buffers, offsets);
+}
+
+std::array<vk::VertexInputBindingDescription, InstanceBuffer::nStreams> InstanceBuffer::GetBindingDescriptions(uint32_t nFirstBinding)
+{
+	std::array<vk::VertexInputBindingDescription, nStreams> bindingDescriptions{};
+	bindingDescriptions[0] = vk::VertexInputBindingDescription(nFirstBinding, sizeof(glm::vec4), vk::VertexInputRate::eInstance);
+	bindingDescriptions[1] = vk::VertexInputBindingDescription(nFirstBinding + 1, sizeof(uint32_t), vk::VertexInputRate::eInstance);
+	return bindingDescriptions;
+}
+
+std::array<vk::VertexInputAttributeDescription, InstanceBuffer::nStreams> InstanceBuffer::GetAttributeDescriptions(uint32_t nFirstBinding, uint32_t nFirstLocation)
+{
+	std::array<vk::VertexInputAttributeDescription, nStreams> attributeDescriptions{};
+	attributeDescriptions[0] = vk::VertexInputAttributeDescription(nFirstLocation, nFirstBinding, vk::Format::eR32G32B32A32Sfloat, 0);		// vec4
+	attributeDescriptions[1] = vk::VertexInputAttributeDescription(nFirstLocation + 1, nFirstBinding + 1, vk::Format::eR8G8B8A8Unorm, 0);	// vec4, from 0-255
+	return attributeDescriptions;
+}
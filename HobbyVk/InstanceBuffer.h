@@ -0,0 +1,44 @@
+#pragma once
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include "Buffer.h"
+#include <glm/glm.hpp>
+#include <array>
+
+// Where to write this frame's instances - each attribute is its own tightly packed array
+// (structure of arrays), so a pass that only touches transforms doesn't drag colours through the cache
+struct InstanceStreams
+{
+	glm::vec4* pTransforms;	// Offset in xy, scale in z, rotation in radians in w
+	uint32_t* pColours;		// RGBA8, multiplied with the vertex colour
+	uint32_t nCapacity;
+};
+
+// Per instance vertex attributes, streamed from the CPU. Each frame in flight gets its own
+// persistently mapped buffer, so filling one never stalls on the GPU reading another
+class InstanceBuffer
+{
+public:
+	InstanceBuffer(MemoryAllocator& allocator, vk::Device device, uint32_t nFramesInFlight, uint32_t nCapacity);
+
+	// Only write to a frame slot whose last frame has been waited on
+	InstanceStreams GetStreams(uint32_t nFrame);
+	void Bind(vk::CommandBuffer commandBuffer, uint32_t nFrame, uint32_t nFirstBinding, uint32_t nFirstInstance = 0); // nFirstInstance becomes instance 0
+	inline uint32_t GetCapacity() const { return m_nCapacity; }
+
+	static constexpr uint32_t nStreams = 2;
+
+	// One binding per stream, each stepping once per instance
+	static std::array<vk::VertexInputBindingDescription, nStreams> GetBindingDescriptions(uint32_t nFirstBinding);
+
+	// layout(location = n) in the vertex shader, following on from nFirstLocation
+	static std::array<vk::VertexInputAttributeDescription, nStreams> GetAttributeDescriptions(uint32_t nFirstBinding, uint32_t nFirstLocation);
+
+private:
+	uint32_t m_nCapacity;
+	vk::DeviceSize m_nColourOffset; // Where the colour stream starts in each buffer
+	std::vector<Buffer> m_vFrames;
+};
+
+#endif
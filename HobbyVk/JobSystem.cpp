@@ -0,0 +1,159 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+static thread_local uint32_t nThreadIndex = 0;
+
+JobSystem::JobSystem(uint32_t nThreads)
+{
+	if (nThreads == 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < nThreads; ++i) m_vQueues.push_back(std::make_unique<WorkQueue>());
+
+	// Thread 0 is whoever created us, so only spawn the rest
+	for (uint32_t i = 1; i < nThreads; ++i) m_vWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+	return nThreadIndex;
+}
+
+void JobSystem::Schedule(Job job, JobCounter* pCounter)
+{
+	// Jobs go onto the scheduling thread's own queue, idle threads will steal them
+	Enqueue(*m_vQueues[GetThreadIndex()], std::move(job), pCounter);
+}
+
+void JobSystem::ScheduleBackground(Job job, JobCounter* pCounter)
+{
+	Enqueue(m_BackgroundQueue, std::move(job), pCounter);
+}
+
+void JobSystem::Enqueue(WorkQueue& queue, Job job, JobCounter* pCounter)
+{
+	if (pCounter)
+	{
+		pCounter->nPending.fetch_add(1, std::memory_order_relaxed);
+		job = [job = std::move(job), pCounter]() { job(); pCounter->nPending.fetch_sub(1, std::memory_order_release); };
+	}
+
+	m_nQueuedJobs.fetch_add(1, std::memory_order_release); // Before the push, so it can never go negative
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+
+	// Take the sleep mutex so a worker can't miss the wake up between checking and sleeping
+	{ std::lock_guard<std::mutex> lock(m_SleepMutex); }
+	m_WakeCondition.notify_one();
+}
+
+bool JobSystem::PopOrSteal(uint32_t nThread, Job& job)
+{
+	// Our own work first, newest first
+	{
+		WorkQueue& queue = *m_vQueues[nThread];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			return true;
+		}
+	}
+
+	// Then steal the oldest job from someone else, starting with our neighbour so thieves spread out
+	for (uint32_t i = 1; i < m_vQueues.size(); ++i)
+	{
+		WorkQueue& queue = *m_vQueues[(nThread + i) % m_vQueues.size()];
+		std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || queue.jobs.empty()) continue;
+
+		job = std::move(queue.jobs.front());
+		queue.jobs.pop_front();
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::TryRunJob(uint32_t nThread)
+{
+	Job job;
+	if (!PopOrSteal(nThread, job)) return false;
+
+	m_nQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	job();
+	return true;
+}
+
+bool JobSystem::TryRunBackgroundJob()
+{
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(m_BackgroundQueue.mutex);
+		if (m_BackgroundQueue.jobs.empty()) return false;
+		job = std::move(m_BackgroundQueue.jobs.front());
+		m_BackgroundQueue.jobs.pop_front();
+	}
+
+	m_nQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	job();
+	return true;
+}
+
+void JobSystem::WorkerLoop(uint32_t nThread)
+{
+	nThreadIndex = nThread;
+
+	// Background work only once there's nothing more pressing, so it never holds up a ParallelFor
+	while (m_bRunning.load(std::memory_order_acquire))
+	{
+		if (TryRunJob(nThread) || TryRunBackgroundJob()) continue;
+
+		// Nothing to do (or we lost a race for a queue lock), so sleep until more work turns up
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_WakeCondition.wait(lock, [this]() { return m_nQueuedJobs.load(std::memory_order_acquire) > 0 || !m_bRunning.load(std::memory_order_acquire); });
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	// Waits never run background jobs, which could take far longer than what's being waited on - unless
+	// there are no workers, and nobody else ever would
+	uint32_t nThread = GetThreadIndex();
+	while (!counter.IsDone())
+	{
+		if (TryRunJob(nThread)) continue;
+		if (m_vWorkers.empty() && TryRunBackgroundJob()) continue;
+		std::this_thread::yield(); // The last few jobs are running elsewhere
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t nCount, uint32_t nBatchSize, const RangeJob& job)
+{
+	if (nCount == 0) return;
+	nBatchSize = std::max(1u, nBatchSize);
+
+	// Not worth the overhead of scheduling if there's only one batch
+	if (nCount <= nBatchSize) { job(0, nCount, GetThreadIndex()); return; }
+
+	JobCounter counter;
+	for (uint32_t nBegin = 0; nBegin < nCount; nBegin += nBatchSize)
+	{
+		uint32_t nEnd = std::min(nBegin + nBatchSize, nCount);
+		Schedule([&job, nBegin, nEnd]() { job(nBegin, nEnd, GetThreadIndex()); }, &counter);
+	}
+	Wait(counter);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_bRunning.store(false, std::memory_order_release);
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_vWorkers) worker.join();
+}
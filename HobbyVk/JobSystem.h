@@ -0,0 +1,72 @@
+#pragma once
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tracks a group of jobs so that they may be waited upon
+struct JobCounter
+{
+	std::atomic<uint32_t> nPending{ 0 };
+	inline bool IsDone() const { return nPending.load(std::memory_order_acquire) == 0; }
+};
+
+// A work-stealing thread pool. Each thread has its own queue: it pushes and pops the back
+// of its own (so freshly spawned, cache warm work runs first) and, when that's empty, steals
+// from the front of everyone else's. The thread that created the pool is thread 0, and helps
+// out with jobs whenever it waits, so there are GetThreadCount() threads doing work in total.
+// Long running work (pipeline compiles, say) goes through ScheduleBackground instead, onto a
+// queue only idle workers take from - so thread 0 never picks it up while waiting on its own
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+	using RangeJob = std::function<void(uint32_t nBegin, uint32_t nEnd, uint32_t nThread)>;
+
+	explicit JobSystem(uint32_t nThreads = 0); // 0 - one per hardware thread
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	void Schedule(Job job, JobCounter* pCounter = nullptr);
+	void ScheduleBackground(Job job, JobCounter* pCounter = nullptr); // Oldest first, and never run by Wait on thread 0 unless there are no workers
+	void Wait(JobCounter& counter); // Runs other jobs rather than sleeping
+
+	// Splits [0, nCount) into batches of nBatchSize and waits for them all
+	void ParallelFor(uint32_t nCount, uint32_t nBatchSize, const RangeJob& job);
+
+	inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_vQueues.size()); }
+	static uint32_t GetThreadIndex(); // Index of the calling thread, 0 for the main thread (and any thread that isn't ours)
+
+private:
+	struct WorkQueue
+	{
+		std::deque<Job> jobs;
+		std::mutex mutex;
+	};
+
+	void WorkerLoop(uint32_t nThread);
+	bool TryRunJob(uint32_t nThread);
+	bool TryRunBackgroundJob();
+	bool PopOrSteal(uint32_t nThread, Job& job);
+	void Enqueue(WorkQueue& queue, Job job, JobCounter* pCounter);
+
+	std::vector<std::unique_ptr<WorkQueue>> m_vQueues; // One per thread, including the main thread
+	WorkQueue m_BackgroundQueue;
+	std::vector<std::thread> m_vWorkers;
+
+	std::atomic<uint32_t> m_nQueuedJobs{ 0 };
+	std::atomic<bool> m_bRunning{ true };
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeCondition;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& sFilename)
+{
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(sFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open " + sFilename);
+	m_hFile = hFile;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size)) { Close(); throw std::runtime_error("Failed to get the size of " + sFilename); }
+	m_nSize = static_cast<size_t>(size.QuadPart);
+	if (m_nSize == 0) { Close(); throw std::runtime_error(sFilename + " is empty"); }
+
+	m_hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping) { Close(); throw std::runtime_error("Failed to map " + sFilename); }
+
+	m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_pData) { Close(); throw std::runtime_error("Failed to map " + sFilename); }
+#else
+	m_nFile = open(sFilename.c_str(), O_RDONLY);
+	if (m_nFile < 0) throw std::runtime_error("Failed to open " + sFilename);
+
+	struct stat info;
+	if (fstat(m_nFile, &info) != 0) { Close(); throw std::runtime_error("Failed to get the size of " + sFilename); }
+	m_nSize = static_cast<size_t>(info.st_size);
+	if (m_nSize == 0) { Close(); throw std::runtime_error(sFilename + " is empty"); }
+
+	void* pData = mmap(nullptr, m_nSize, PROT_READ, MAP_PRIVATE, m_nFile, 0);
+	if (pData == MAP_FAILED) { Close(); throw std::runtime_error("Failed to map " + sFilename); }
+	m_pData = static_cast<const uint8_t*>(pData);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this == &other) return *this;
+	Close();
+
+	m_pData = other.m_pData;
+	m_nSize = other.m_nSize;
+	other.m_pData = nullptr;
+	other.m_nSize = 0;
+#ifdef _WIN32
+	m_hFile = other.m_hFile;
+	m_hMapping = other.m_hMapping;
+	other.m_hFile = nullptr;
+	other.m_hMapping = nullptr;
+#else
+	m_nFile = other.m_nFile;
+	other.m_nFile = -1;
+#endif
+	return *this;
+}
+
+void MappedFile::Prefetch(size_t nOffset, size_t nSize) const
+{
+	if (!m_pData || nOffset >= m_nSize) return;
+	nSize = std::min(nSize, m_nSize - nOffset);
+
+#ifndef _WIN32
+	// A hint to start reading ahead, which the page touching below then (mostly) doesn't have to wait on
+	constexpr size_t nPageSize = 4096;
+	size_t nStart = nOffset / nPageSize * nPageSize;
+	madvise(const_cast<uint8_t*>(m_pData) + nStart, nOffset + nSize - nStart, MADV_WILLNEED);
+#endif
+
+	// One read per page is enough to fault it in - volatile so it isn't optimised away
+	volatile uint8_t nSink = 0;
+	for (size_t i = 0; i < nSize; i += 4096) nSink += m_pData[nOffset + i];
+	nSink += m_pData[nOffset + nSize - 1];
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_hMapping) CloseHandle(m_hMapping);
+	if (m_hFile) CloseHandle(m_hFile);
+	m_hFile = nullptr;
+	m_hMapping = nullptr;
+#else
+	if (m_pData) munmap(const_cast<uint8_t*>(m_pData), m_nSize);
+	if (m_nFile >= 0) close(m_nFile);
+	m_nFile = -1;
+#endif
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A read only view of a whole file, mapped into memory rather than read into a buffer. Pages come
+// in from the OS' cache as they're touched, so nothing gets copied until it's needed, and then only
+// once - straight from the mapping to wherever it's going (a staging buffer, usually)
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const std::string& sFilename); // Throws if it can't be opened
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	inline const uint8_t* GetData() const { return m_pData; }
+	inline size_t GetSize() const { return m_nSize; }
+	inline bool IsOpen() const { return m_pData != nullptr; }
+
+	// Faults a range in now, on the calling thread, so whoever reads it later doesn't stall on the disk
+	void Prefetch(size_t nOffset, size_t nSize) const;
+
+private:
+	void Close();
+
+	const uint8_t* m_pData = nullptr;
+	size_t m_nSize = 0;
+#ifdef _WIN32
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+#else
+	int m_nFile = -1;
+#endif
+};
+
+#endif
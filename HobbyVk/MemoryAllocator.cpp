@@ -0,0 +1,318 @@
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Blocks are this big unless the heap is small, in which case we don't want to hog it
+constexpr vk::DeviceSize nDefaultBlockSize = 64ull * 1024 * 1024;
+constexpr vk::DeviceSize nSmallHeapSize = 1024ull * 1024 * 1024;
+
+static inline vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Without VK_EXT_memory_budget we can't see anyone else's usage, so leave them some room
+constexpr float fFallbackBudget = 0.8f;
+
+MemoryAllocator::MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device, bool bMemoryBudget)
+	: m_PhysicalDevice(physicalDevice), m_Device(device), m_bMemoryBudget(bMemoryBudget)
+{
+	m_MemoryProperties = physicalDevice.getMemoryProperties();
+	m_nMaxAllocations = physicalDevice.getProperties().limits.maxMemoryAllocationCount;
+
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; ++i)
+	{
+		const vk::MemoryHeap& heap = m_MemoryProperties.memoryHeaps[i];
+		const vk::MemoryHeap& best = m_MemoryProperties.memoryHeaps[m_nDeviceLocalHeap];
+		bool bDeviceLocal = static_cast<bool>(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+		bool bBestDeviceLocal = static_cast<bool>(best.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+		if ((bDeviceLocal && !bBestDeviceLocal) || (bDeviceLocal == bBestDeviceLocal && heap.size > best.size)) m_nDeviceLocalHeap = i;
+	}
+
+	m_vPools.resize(m_MemoryProperties.memoryTypeCount * 2);
+	for (uint32_t i = 0; i < m_vPools.size(); ++i) m_vPools[i].nMemoryType = i / 2;
+}
+
+uint32_t MemoryAllocator::FindMemoryType(uint32_t nTypeBits, vk::MemoryPropertyFlags requiredFlags, vk::MemoryPropertyFlags preferredFlags)
+{
+	// Try to get everything we'd like first, then settle for what we need
+	for (vk::MemoryPropertyFlags flags : { requiredFlags | preferredFlags, requiredFlags })
+	{
+		for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; ++i)
+		{
+			if ((nTypeBits & (1 << i)) && (m_MemoryProperties.memoryTypes[i].propertyFlags & flags) == flags) return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+vk::DeviceSize MemoryAllocator::GetPreferredBlockSize(uint32_t nMemoryType)
+{
+	vk::DeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[nMemoryType].heapIndex].size;
+	return heapSize <= nSmallHeapSize ? heapSize / 8 : nDefaultBlockSize;
+}
+
+uint32_t MemoryAllocator::CreateBlock(Pool& pool, vk::DeviceSize size, bool bDedicated)
+{
+	if (m_nDeviceAllocations >= m_nMaxAllocations) throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+
+	Block block;
+	block.size = size;
+	block.bDedicated = bDedicated;
+	block.freeRanges[0] = size;
+
+	vk::MemoryAllocateInfo allocateInfo = vk::MemoryAllocateInfo(size, pool.nMemoryType);
+	block.memory = m_Device.allocateMemory(allocateInfo);
+	m_nDeviceAllocations++;
+
+	// Keep host visible memory mapped for its whole lifetime, mapping is far from free
+	if (m_MemoryProperties.memoryTypes[pool.nMemoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+		block.pMapped = m_Device.mapMemory(block.memory, 0, VK_WHOLE_SIZE);
+
+	// Reuse an empty slot if there is one
+	for (uint32_t i = 0; i < pool.vBlocks.size(); ++i)
+	{
+		if (pool.vBlocks[i].memory == vk::DeviceMemory{}) { pool.vBlocks[i] = std::move(block); return i; }
+	}
+	pool.vBlocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.vBlocks.size() - 1);
+}
+
+void MemoryAllocator::DestroyBlock(Block& block)
+{
+	if (block.memory == vk::DeviceMemory{}) return;
+	if (block.pMapped) m_Device.unmapMemory(block.memory);
+	m_Device.freeMemory(block.memory);
+	m_nDeviceAllocations--;
+	block = Block{};
+}
+
+bool MemoryAllocator::AllocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset)
+{
+	// First fit - find a free range big enough once aligned, then split off what's left either side
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it)
+	{
+		vk::DeviceSize rangeStart = it->first;
+		vk::DeviceSize rangeSize = it->second;
+		vk::DeviceSize alignedStart = AlignUp(rangeStart, alignment);
+		if (alignedStart + size > rangeStart + rangeSize) continue;
+
+		block.freeRanges.erase(it);
+		if (alignedStart > rangeStart) block.freeRanges[rangeStart] = alignedStart - rangeStart;
+		if (alignedStart + size < rangeStart + rangeSize) block.freeRanges[alignedStart + size] = rangeStart + rangeSize - alignedStart - size;
+
+		offset = alignedStart;
+		return true;
+	}
+
+	return false;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags requiredFlags, vk::MemoryPropertyFlags preferredFlags, bool bLinear)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	uint32_t nMemoryType = FindMemoryType(requirements.memoryTypeBits, requiredFlags, preferredFlags);
+	uint32_t nPool = nMemoryType * 2 + (bLinear ? 1 : 0);
+	Pool& pool = m_vPools[nPool];
+
+	vk::DeviceSize blockSize = GetPreferredBlockSize(nMemoryType);
+	vk::DeviceSize alignment = std::max<vk::DeviceSize>(requirements.alignment, 1);
+
+	MemoryAllocation allocation;
+	allocation.size = requirements.size;
+	allocation.nPool = nPool;
+
+	bool bFound = false;
+	vk::DeviceSize offset = 0;
+	if (requirements.size > blockSize / 2)
+	{
+		// Big resources get their own block - they'd only fragment the shared ones
+		allocation.nBlock = CreateBlock(pool, requirements.size, true);
+		bFound = AllocateFromBlock(pool.vBlocks[allocation.nBlock], requirements.size, alignment, offset);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < pool.vBlocks.size() && !bFound; ++i)
+		{
+			Block& block = pool.vBlocks[i];
+			if (block.memory == vk::DeviceMemory{} || block.bDedicated || block.size - block.nBytesInUse < requirements.size) continue;
+			if (AllocateFromBlock(block, requirements.size, alignment, offset)) { allocation.nBlock = i; bFound = true; }
+		}
+
+		if (!bFound)
+		{
+			allocation.nBlock = CreateBlock(pool, blockSize, false);
+			bFound = AllocateFromBlock(pool.vBlocks[allocation.nBlock], requirements.size, alignment, offset);
+		}
+	}
+	if (!bFound) throw std::runtime_error("Failed to sub-allocate device memory!");
+
+	Block& block = pool.vBlocks[allocation.nBlock];
+	block.nBytesInUse += requirements.size;
+	block.nAllocations++;
+
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.pMapped = block.pMapped ? static_cast<char*>(block.pMapped) + offset : nullptr;
+	return allocation;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+	if (!allocation.IsValid()) return;
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	Pool& pool = m_vPools[allocation.nPool];
+	Block& block = pool.vBlocks[allocation.nBlock];
+	block.nBytesInUse -= allocation.size;
+	block.nAllocations--;
+
+	// Give the range back, merging with the free ranges either side of it
+	vk::DeviceSize start = allocation.offset;
+	vk::DeviceSize size = allocation.size;
+	auto next = block.freeRanges.lower_bound(start);
+	if (next != block.freeRanges.end() && next->first == start + size)
+	{
+		size += next->second;
+		next = block.freeRanges.erase(next);
+	}
+	if (next != block.freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == start)
+		{
+			start = previous->first;
+			size += previous->second;
+			block.freeRanges.erase(previous);
+		}
+	}
+	block.freeRanges[start] = size;
+
+	// Return empty blocks to the driver, but hang on to one shared block per pool to avoid churn
+	if (block.nAllocations == 0)
+	{
+		bool bKeep = false;
+		if (!block.bDedicated)
+		{
+			bKeep = true;
+			for (uint32_t i = 0; i < pool.vBlocks.size(); ++i)
+			{
+				const Block& other = pool.vBlocks[i];
+				if (i != allocation.nBlock && other.memory != vk::DeviceMemory{} && !other.bDedicated) { bKeep = false; break; }
+			}
+		}
+		if (!bKeep) DestroyBlock(block);
+	}
+
+	allocation = MemoryAllocation{};
+}
+
+MemoryStats MemoryAllocator::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	MemoryStats stats;
+	vk::DeviceSize nBytesFree = 0;
+	for (const auto& pool : m_vPools)
+	{
+		for (const auto& block : pool.vBlocks)
+		{
+			if (block.memory == vk::DeviceMemory{}) continue;
+
+			stats.nBlocks++;
+			stats.nAllocations += block.nAllocations;
+			stats.nBytesReserved += block.size;
+			stats.nBytesInUse += block.nBytesInUse;
+			for (const auto& range : block.freeRanges)
+			{
+				stats.nFreeRanges++;
+				nBytesFree += range.second;
+				stats.nLargestFreeRange = std::max(stats.nLargestFreeRange, range.second);
+			}
+		}
+	}
+
+	if (nBytesFree > 0) stats.fFragmentation = 1.0f - static_cast<float>(stats.nLargestFreeRange) / static_cast<float>(nBytesFree);
+	return stats;
+}
+
+MemoryBudget MemoryAllocator::GetDeviceLocalBudget()
+{
+	MemoryBudget budget;
+	if (m_bMemoryBudget)
+	{
+		// Cheap enough to ask every frame, it's just a read of what the driver's keeping track of anyway
+		auto properties = m_PhysicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		const auto& budgetProperties = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		budget.nBudget = budgetProperties.heapBudget[m_nDeviceLocalHeap];
+		budget.nUsage = budgetProperties.heapUsage[m_nDeviceLocalHeap];
+		budget.bFromDriver = true;
+		return budget;
+	}
+
+	budget.nBudget = static_cast<vk::DeviceSize>(m_MemoryProperties.memoryHeaps[m_nDeviceLocalHeap].size * fFallbackBudget);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (const auto& pool : m_vPools)
+	{
+		if (m_MemoryProperties.memoryTypes[pool.nMemoryType].heapIndex != m_nDeviceLocalHeap) continue;
+		for (const auto& block : pool.vBlocks) budget.nUsage += block.nBytesInUse; // Not reserved - empty blocks are kept around, and we'd never see frees
+	}
+	return budget;
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (auto& pool : m_vPools)
+	{
+		for (auto& block : pool.vBlocks) DestroyBlock(block);
+	}
+}
+
+LinearAllocator::LinearAllocator(MemoryAllocator& allocator, vk::Device device, vk::DeviceSize nFrameSize, uint32_t nFrames, vk::BufferUsageFlags usage)
+	: m_Allocator(allocator), m_Device(device), m_nFrameSize(nFrameSize)
+{
+	vk::BufferCreateInfo bufferInfo{};
+	bufferInfo.size = nFrameSize * nFrames;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+	m_Buffer = m_Device.createBufferUnique(bufferInfo);
+
+	// Written by the CPU every frame, and read by the GPU about once, so host memory is fine -
+	// though device local host visible memory (resizable BAR) is better still if it's there
+	m_Memory = m_Allocator.Allocate(m_Device.getBufferMemoryRequirements(m_Buffer.get()),
+									vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+									vk::MemoryPropertyFlagBits::eDeviceLocal);
+	m_Device.bindBufferMemory(m_Buffer.get(), m_Memory.memory, m_Memory.offset);
+}
+
+void LinearAllocator::Reset(uint32_t nFrame)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_nFrameStart = m_nFrameSize * nFrame;
+	m_nOffset = m_nFrameStart;
+}
+
+LinearAllocation LinearAllocator::Allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	vk::DeviceSize offset = AlignUp(m_nOffset, std::max<vk::DeviceSize>(alignment, 1));
+	if (offset + size > m_nFrameStart + m_nFrameSize) throw std::runtime_error("Linear allocator out of memory for this frame!");
+	m_nOffset = offset + size;
+
+	LinearAllocation allocation;
+	allocation.buffer = m_Buffer.get();
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.pMapped = static_cast<char*>(m_Memory.pMapped) + offset;
+	return allocation;
+}
+
+LinearAllocator::~LinearAllocator()
+{
+	m_Buffer.reset();
+	m_Allocator.Free(m_Memory);
+}
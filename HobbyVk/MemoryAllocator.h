@@ -0,0 +1,146 @@
+#pragma once
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+// A range of device memory handed out by the MemoryAllocator, bind
+// resources with memory + offset and give it back once they're destroyed
+struct MemoryAllocation
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* pMapped = nullptr; // Only set for host visible memory, which is kept mapped
+
+	uint32_t nPool = 0; // Bookkeeping for MemoryAllocator::Free()
+	uint32_t nBlock = 0;
+
+	inline bool IsValid() const { return memory != vk::DeviceMemory{}; }
+};
+
+struct MemoryStats
+{
+	vk::DeviceSize nBytesReserved = 0;	// Sum of every vkAllocateMemory'd block
+	vk::DeviceSize nBytesInUse = 0;		// What's actually been handed out
+	vk::DeviceSize nLargestFreeRange = 0;
+	uint32_t nFreeRanges = 0;
+	uint32_t nBlocks = 0;
+	uint32_t nAllocations = 0;
+	float fFragmentation = 0.0f; // 0 when all free memory is contiguous, approaching 1 as it's scattered
+};
+
+// How much of a heap there is to go round, and how much is gone
+struct MemoryBudget
+{
+	vk::DeviceSize nBudget = 0;		// Past this things start getting paged out (or failing to allocate)
+	vk::DeviceSize nUsage = 0;
+	bool bFromDriver = false;		// VK_EXT_memory_budget's numbers, which count everyone else using it too. Otherwise
+									// it's a share of the heap's size, against just what we've allocated from it
+};
+
+// Sub-allocates resources out of large vkAllocateMemory blocks, one set of blocks
+// per memory type, rather than giving every buffer and image its own allocation
+// (we'd run out of maxMemoryAllocationCount rather quickly otherwise)
+class MemoryAllocator
+{
+public:
+	// bMemoryBudget only if VK_EXT_memory_budget is enabled on the device
+	MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device, bool bMemoryBudget = false);
+	~MemoryAllocator();
+
+	// bLinear distinguishes buffers and linear images from optimal images, which
+	// are kept in separate blocks so we needn't worry about bufferImageGranularity
+	MemoryAllocation Allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags requiredFlags,
+								vk::MemoryPropertyFlags preferredFlags = vk::MemoryPropertyFlags{}, bool bLinear = true);
+	void Free(MemoryAllocation& allocation);
+
+	uint32_t FindMemoryType(uint32_t nTypeBits, vk::MemoryPropertyFlags requiredFlags, vk::MemoryPropertyFlags preferredFlags = vk::MemoryPropertyFlags{});
+	MemoryStats GetStats();
+
+	// Of the largest device local heap, where anything worth budgeting for lives
+	MemoryBudget GetDeviceLocalBudget();
+
+	inline const vk::PhysicalDeviceMemoryProperties& GetMemoryProperties() const { return m_MemoryProperties; }
+
+private:
+	struct Block
+	{
+		vk::DeviceMemory memory;
+		vk::DeviceSize size = 0;
+		vk::DeviceSize nBytesInUse = 0;
+		void* pMapped = nullptr;
+		bool bDedicated = false; // Allocations larger than half a block get a block to themselves
+		std::map<vk::DeviceSize, vk::DeviceSize> freeRanges; // Offset -> size, ordered so neighbours can be merged
+		uint32_t nAllocations = 0;
+	};
+
+	// One pool per memory type and linear/optimal pair
+	struct Pool
+	{
+		uint32_t nMemoryType = 0;
+		std::vector<Block> vBlocks; // Freed blocks leave an empty slot so indices stay valid
+	};
+
+	bool AllocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+	uint32_t CreateBlock(Pool& pool, vk::DeviceSize size, bool bDedicated);
+	void DestroyBlock(Block& block);
+	vk::DeviceSize GetPreferredBlockSize(uint32_t nMemoryType);
+
+	vk::PhysicalDevice m_PhysicalDevice;
+	vk::Device m_Device;
+	bool m_bMemoryBudget;
+	uint32_t m_nDeviceLocalHeap = 0;
+	vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+	uint32_t m_nMaxAllocations;
+	uint32_t m_nDeviceAllocations = 0;
+
+	std::vector<Pool> m_vPools; // Indexed by memory type * 2 + bLinear
+	std::mutex m_Mutex;
+};
+
+// A range of the linear allocator's buffer, valid until the frame it was allocated in comes round again
+struct LinearAllocation
+{
+	vk::Buffer buffer;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* pMapped = nullptr;
+};
+
+// Bump allocator for transient per-frame data (uniforms, instance data, etc).
+// One persistently mapped buffer is split into a region per frame in flight, and
+// each region is reset wholesale when its frame begins again - no freeing required
+class LinearAllocator
+{
+public:
+	LinearAllocator(MemoryAllocator& allocator, vk::Device device, vk::DeviceSize nFrameSize, uint32_t nFrames, vk::BufferUsageFlags usage);
+	~LinearAllocator();
+
+	void Reset(uint32_t nFrame); // Call once the GPU is done with nFrame
+	LinearAllocation Allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+	inline vk::DeviceSize GetBytesUsed() const { return m_nOffset - m_nFrameStart; }
+	inline vk::DeviceSize GetFrameSize() const { return m_nFrameSize; }
+	inline vk::Buffer GetBuffer() const { return m_Buffer.get(); }
+
+private:
+	MemoryAllocator& m_Allocator;
+	vk::Device m_Device;
+	vk::UniqueBuffer m_Buffer;
+	MemoryAllocation m_Memory;
+
+	vk::DeviceSize m_nFrameSize;
+	vk::DeviceSize m_nFrameStart = 0;
+	vk::DeviceSize m_nOffset = 0;
+	std::mutex m_Mutex; // Worker threads may write their own transient data
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "Mesh.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+Mesh::Mesh(AssetSpan data) : m_Data(std::move(data))
+{
+	if (m_Data.GetSize() < sizeof(MeshFileHeader)) throw std::runtime_error("Not a mesh file, it's too small");
+	std::memcpy(&m_Header, m_Data.GetData(), sizeof(MeshFileHeader));
+	if (std::memcmp(m_Header.magic, meshFileMagic, sizeof(meshFileMagic)) != 0) throw std::runtime_error("Not a mesh file");
+	if (m_Header.nVersion != nMeshFileVersion) throw std::runtime_error("Mesh file is from a different version, convert it again");
+	if (m_Header.nIndexSize != 2 && m_Header.nIndexSize != 4) throw std::runtime_error("Mesh file has a bad index size");
+
+	// Every section has to be inside the file, and aligned for reading in place
+	auto CheckSection = [&](uint64_t nOffset, uint64_t nSize)
+	{
+		if (nOffset % 16 != 0 || nOffset > m_Data.GetSize() || nSize > m_Data.GetSize() - nOffset) throw std::runtime_error("Mesh file is truncated or malformed");
+	};
+	CheckSection(m_Header.nVertexOffset, static_cast<uint64_t>(m_Header.nVertexCount) * sizeof(Vertex));
+	CheckSection(m_Header.nIndexOffset, static_cast<uint64_t>(m_Header.nIndexCount) * m_Header.nIndexSize);
+	CheckSection(m_Header.nMeshletOffset, static_cast<uint64_t>(m_Header.nMeshletCount) * sizeof(Meshlet));
+	if (m_Header.nVertexCount == 0 || m_Header.nIndexCount == 0 || m_Header.nIndexCount % 3 != 0) throw std::runtime_error("Mesh file has no triangles");
+
+	// Everything's uploaded as it is, so anything pointing outside the mesh would have the GPU reading past
+	// the end of its buffers - one pass over the indices is cheap next to loading them
+	const uint8_t* pIndices = m_Data.GetData() + m_Header.nIndexOffset;
+	uint32_t nMaxIndex = 0;
+	if (m_Header.nIndexSize == 2)
+	{
+		const uint16_t* p16 = reinterpret_cast<const uint16_t*>(pIndices);
+		for (uint32_t i = 0; i < m_Header.nIndexCount; ++i) nMaxIndex = std::max<uint32_t>(nMaxIndex, p16[i]);
+	}
+	else
+	{
+		const uint32_t* p32 = reinterpret_cast<const uint32_t*>(pIndices);
+		for (uint32_t i = 0; i < m_Header.nIndexCount; ++i) nMaxIndex = std::max(nMaxIndex, p32[i]);
+	}
+	if (nMaxIndex >= m_Header.nVertexCount) throw std::runtime_error("Mesh file has indices past its vertices");
+
+	const Meshlet* pMeshlets = reinterpret_cast<const Meshlet*>(m_Data.GetData() + m_Header.nMeshletOffset);
+	for (uint32_t i = 0; i < m_Header.nMeshletCount; ++i)
+	{
+		if (static_cast<uint64_t>(pMeshlets[i].nFirstIndex) + pMeshlets[i].nIndexCount > m_Header.nIndexCount)
+			throw std::runtime_error("Mesh file has meshlets past its indices");
+	}
+
+	m_pVertices = reinterpret_cast<const Vertex*>(m_Data.GetData() + m_Header.nVertexOffset);
+	m_pIndices = pIndices;
+	m_pMeshlets = pMeshlets;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef MESH_H
+#define MESH_H
+
+#include "Vertex.h"
+#include "AssetLibrary.h"
+
+// .hvkmesh, as written by MeshConverter - a header, then the vertices, indices and meshlets, each
+// 16 byte aligned so they can be uploaded (or read) straight out of the mapping
+struct MeshFileHeader
+{
+	char magic[8];
+	uint32_t nVersion;
+	uint32_t nVertexCount;
+	uint32_t nIndexCount;
+	uint32_t nIndexSize;		// 2 or 4 bytes, 2 whenever every vertex fits
+	uint32_t nMeshletCount;
+	uint32_t nPadding;
+	uint64_t nVertexOffset;		// From the start of the file
+	uint64_t nIndexOffset;
+	uint64_t nMeshletOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundingSphere[4];
+};
+
+constexpr char meshFileMagic[8] = { 'H', 'V', 'K', 'M', 'E', 'S', 'H', 0 };
+constexpr uint32_t nMeshFileVersion = 1;
+
+// Meshlets are at most this big, which is what mesh shading hardware tends to like too
+constexpr uint32_t nMaxMeshletVertices = 64;
+constexpr uint32_t nMaxMeshletTriangles = 124;
+
+// A run of the index buffer, small enough to cull on its own
+struct Meshlet
+{
+	uint32_t nFirstIndex;
+	uint32_t nIndexCount;
+	uint32_t nVertexCount;		// Distinct vertices it uses
+	uint32_t nPadding;
+	glm::vec4 boundingSphere;	// Centre in xyz, radius in w
+	glm::vec4 cone;				// Axis in xyz - every triangle faces away from views within acos(w) of it.
+								// w is 1 when there's no such cone, as the triangles face too many ways
+};
+
+// A mesh file, read in place - whatever it was loaded from stays mapped for as long as it's around
+class Mesh
+{
+public:
+	Mesh() = default;
+	explicit Mesh(AssetSpan data); // Throws if it isn't a mesh file (of this version)
+
+	inline const Vertex* GetVertices() const { return m_pVertices; }
+	inline uint32_t GetVertexCount() const { return m_Header.nVertexCount; }
+	inline const void* GetIndices() const { return m_pIndices; }
+	inline uint32_t GetIndexCount() const { return m_Header.nIndexCount; }
+	inline vk::DeviceSize GetIndexBufferSize() const { return static_cast<vk::DeviceSize>(m_Header.nIndexCount) * m_Header.nIndexSize; }
+	inline vk::IndexType GetIndexType() const { return m_Header.nIndexSize == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32; }
+	inline const Meshlet* GetMeshlets() const { return m_pMeshlets; }
+	inline uint32_t GetMeshletCount() const { return m_Header.nMeshletCount; }
+	inline const MeshFileHeader& GetHeader() const { return m_Header; }
+	inline bool IsValid() const { return m_pVertices != nullptr; }
+
+private:
+	AssetSpan m_Data;
+	MeshFileHeader m_Header{};
+	const Vertex* m_pVertices = nullptr;
+	const void* m_pIndices = nullptr;
+	const Meshlet* m_pMeshlets = nullptr;
+};
+
+#endif
@@ -0,0 +1,631 @@
+#include "MeshConverter.h"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+	// Forsyth's "Linear-Speed Vertex Cache Optimisation" - the cache it models is bigger than most
+	// real ones, which costs little on small caches and helps on big ones
+	constexpr uint32_t nOptimiseCacheSize = 32;
+	constexpr float fCacheDecayPower = 1.5f;
+	constexpr float fLastTriangleScore = 0.75f;
+	constexpr float fValenceBoostScale = 2.0f;
+	constexpr float fValenceBoostPower = 0.5f;
+
+	// Clusters are split at points where the cache starts cold anyway, so reordering them costs
+	// (next to) nothing in cache misses - but no smaller than this, or there's nothing to gain
+	constexpr uint32_t nMinClusterTriangles = 16;
+	constexpr uint32_t nClusterCacheSize = 16;
+
+	float CacheScore(int32_t nPosition)
+	{
+		if (nPosition < 0) return 0.0f;
+		if (nPosition < 3) return fLastTriangleScore; // Used by the last triangle, so some of it's wasted on the next one
+		float fScale = 1.0f - static_cast<float>(nPosition - 3) / static_cast<float>(nOptimiseCacheSize - 3);
+		return std::pow(fScale, fCacheDecayPower);
+	}
+
+	float ValenceScore(uint32_t nRemaining)
+	{
+		// Vertices with few triangles left get finished off, so they don't linger
+		return nRemaining == 0 ? 0.0f : fValenceBoostScale * std::pow(static_cast<float>(nRemaining), -fValenceBoostPower);
+	}
+
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& vertex) const
+		{
+			uint32_t nWords[5];
+			std::memcpy(nWords, &vertex, sizeof(nWords));
+			size_t nHash = 0xcbf29ce484222325ull;
+			for (uint32_t nWord : nWords) nHash = (nHash ^ nWord) * 0x100000001b3ull;
+			return nHash;
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+	};
+
+	// An OBJ face corner - indices into the position, UV and normal lists, -1 if it didn't have one
+	struct Corner
+	{
+		int32_t nPosition;
+		int32_t nUv;
+		int32_t nNormal;
+		bool operator==(const Corner& other) const { return nPosition == other.nPosition && nUv == other.nUv && nNormal == other.nNormal; }
+	};
+
+	struct CornerHash
+	{
+		size_t operator()(const Corner& corner) const
+		{
+			return (static_cast<size_t>(corner.nPosition) * 73856093u) ^ (static_cast<size_t>(corner.nUv) * 19349663u) ^ (static_cast<size_t>(corner.nNormal) * 83492791u);
+		}
+	};
+
+	inline uint64_t AlignUp(uint64_t nValue, uint64_t nAlignment)
+	{
+		return (nValue + nAlignment - 1) / nAlignment * nAlignment;
+	}
+
+	glm::vec4 BoundingSphere(const glm::vec3& minimum, const glm::vec3& maximum, const std::vector<glm::vec3>& vPoints)
+	{
+		// The centre of the bounds and the furthest point from it - not the tightest, but close and cheap
+		glm::vec3 centre = (minimum + maximum) * 0.5f;
+		float fRadius = 0.0f;
+		for (const glm::vec3& point : vPoints) fRadius = std::max(fRadius, glm::length(point - centre));
+		return glm::vec4(centre, fRadius);
+	}
+}
+
+MeshSource MeshConverter::LoadObj(const std::string& sFilename)
+{
+	std::ifstream fFile(sFilename);
+	if (!fFile.is_open()) throw std::runtime_error("Unable to open file " + sFilename + "!");
+
+	std::vector<glm::vec3> vPositions;
+	std::vector<glm::vec4> vColours;
+	std::vector<glm::vec3> vNormals;
+	std::vector<glm::vec2> vUvs;
+	bool bColours = false;
+
+	MeshSource source;
+	std::unordered_map<Corner, uint32_t, CornerHash> corners;
+	bool bMissingNormals = false;
+	bool bAnyUvs = false;
+
+	// 1 based, or negative to count back from the end
+	auto Resolve = [](int32_t nIndex, size_t nCount) { return nIndex < 0 ? static_cast<int32_t>(nCount) + nIndex : nIndex - 1; };
+
+	std::string sLine;
+	uint32_t nLine = 0;
+	std::vector<uint32_t> vFace;
+	while (std::getline(fFile, sLine))
+	{
+		nLine++;
+		std::istringstream line(sLine);
+		std::string sType;
+		line >> sType;
+
+		if (sType == "v")
+		{
+			// Some exporters put vertex colours after the position
+			glm::vec3 position;
+			glm::vec3 colour = glm::vec3(1.0f);
+			line >> position.x >> position.y >> position.z;
+			if (line >> colour.r >> colour.g >> colour.b) bColours = true;
+			vPositions.push_back(position);
+			vColours.push_back(glm::vec4(colour, 1.0f));
+		}
+		else if (sType == "vn")
+		{
+			glm::vec3 normal;
+			line >> normal.x >> normal.y >> normal.z;
+			vNormals.push_back(normal);
+		}
+		else if (sType == "vt")
+		{
+			// OBJ's V goes up, Vulkan's goes down
+			glm::vec2 uv;
+			line >> uv.x >> uv.y;
+			vUvs.push_back(glm::vec2(uv.x, 1.0f - uv.y));
+		}
+		else if (sType == "f")
+		{
+			vFace.clear();
+			std::string sCorner;
+			while (line >> sCorner)
+			{
+				// v, v/vt, v//vn or v/vt/vn
+				Corner corner = { -1, -1, -1 };
+				std::istringstream parts(sCorner);
+				std::string sPart;
+				for (int32_t i = 0; std::getline(parts, sPart, '/') && i < 3; ++i)
+				{
+					if (sPart.empty()) continue;
+					int32_t nIndex = std::stoi(sPart);
+					if (i == 0) corner.nPosition = Resolve(nIndex, vPositions.size());
+					else if (i == 1) corner.nUv = Resolve(nIndex, vUvs.size());
+					else corner.nNormal = Resolve(nIndex, vNormals.size());
+				}
+				if (corner.nPosition < 0 || corner.nPosition >= static_cast<int32_t>(vPositions.size()) ||
+					corner.nUv >= static_cast<int32_t>(vUvs.size()) || corner.nNormal >= static_cast<int32_t>(vNormals.size()))
+					throw std::runtime_error(sFilename + " has a face with a bad index on line " + std::to_string(nLine));
+
+				auto it = corners.find(corner);
+				if (it == corners.end())
+				{
+					it = corners.emplace(corner, static_cast<uint32_t>(source.vPositions.size())).first;
+					source.vPositions.push_back(vPositions[corner.nPosition]);
+					source.vColours.push_back(vColours[corner.nPosition]);
+					source.vUvs.push_back(corner.nUv >= 0 ? vUvs[corner.nUv] : glm::vec2(0.0f));
+					source.vNormals.push_back(corner.nNormal >= 0 ? vNormals[corner.nNormal] : glm::vec3(0.0f));
+					bMissingNormals = bMissingNormals || corner.nNormal < 0;
+					bAnyUvs = bAnyUvs || corner.nUv >= 0;
+				}
+				vFace.push_back(it->second);
+			}
+
+			// Polygons are fanned out from their first corner
+			for (size_t i = 2; i < vFace.size(); ++i)
+			{
+				source.vIndices.push_back(vFace[0]);
+				source.vIndices.push_back(vFace[i - 1]);
+				source.vIndices.push_back(vFace[i]);
+			}
+		}
+	}
+
+	if (source.vIndices.empty()) throw std::runtime_error(sFilename + " has no faces");
+
+	// All or nothing - if any corner's without a normal they're all generated, so the shading's consistent
+	if (bMissingNormals) source.vNormals.clear();
+	if (!bAnyUvs) source.vUvs.clear();
+	if (!bColours) source.vColours.clear();
+	return source;
+}
+
+void MeshConverter::GenerateNormals(MeshSource& source)
+{
+	// Smoothed across vertices in the same place, even if they're split by UV seams. Cross products are
+	// twice the triangle's area, so bigger triangles count for more
+	std::unordered_map<uint64_t, glm::vec3> normals;
+	auto Key = [](const glm::vec3& position)
+	{
+		uint32_t nBits[3];
+		std::memcpy(nBits, &position, sizeof(nBits));
+		return (static_cast<uint64_t>(nBits[0]) * 73856093u) ^ (static_cast<uint64_t>(nBits[1]) * 19349663u) ^ (static_cast<uint64_t>(nBits[2]) * 83492791u);
+	};
+
+	for (size_t i = 0; i + 2 < source.vIndices.size(); i += 3)
+	{
+		const glm::vec3& a = source.vPositions[source.vIndices[i]];
+		const glm::vec3& b = source.vPositions[source.vIndices[i + 1]];
+		const glm::vec3& c = source.vPositions[source.vIndices[i + 2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		for (uint32_t j = 0; j < 3; ++j) normals[Key(source.vPositions[source.vIndices[i + j]])] += normal;
+	}
+
+	source.vNormals.resize(source.vPositions.size());
+	for (size_t i = 0; i < source.vPositions.size(); ++i)
+	{
+		glm::vec3 normal = normals[Key(source.vPositions[i])];
+		float fLength = glm::length(normal);
+		source.vNormals[i] = fLength > 0.0f ? normal / fLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+float MeshConverter::GetAcmr(const std::vector<uint32_t>& vIndices, uint32_t nVertices, uint32_t nCacheSize)
+{
+	if (vIndices.empty()) return 0.0f;
+
+	// FIFO, like the hardware (more or less) - a vertex's time stamp is when it entered the cache
+	std::vector<uint64_t> vEntered(nVertices, 0);
+	uint64_t nTime = nCacheSize + 1;
+	uint32_t nMisses = 0;
+	for (uint32_t nIndex : vIndices)
+	{
+		if (nTime - vEntered[nIndex] > nCacheSize)
+		{
+			vEntered[nIndex] = nTime++;
+			nMisses++;
+		}
+	}
+	return static_cast<float>(nMisses) / static_cast<float>(vIndices.size() / 3);
+}
+
+std::vector<uint32_t> MeshConverter::OptimiseVertexCache(const std::vector<uint32_t>& vIndices, uint32_t nVertices)
+{
+	uint32_t nTriangles = static_cast<uint32_t>(vIndices.size() / 3);
+
+	// Each vertex's triangles, packed into one array, the ones still to be drawn at the front of each range
+	std::vector<uint32_t> vRemaining(nVertices, 0);
+	for (uint32_t nIndex : vIndices) vRemaining[nIndex]++;
+	std::vector<uint32_t> vFirst(nVertices + 1, 0);
+	for (uint32_t i = 0; i < nVertices; ++i) vFirst[i + 1] = vFirst[i] + vRemaining[i];
+	std::vector<uint32_t> vTriangles(vIndices.size());
+	{
+		std::vector<uint32_t> vFill(vFirst.begin(), vFirst.end() - 1);
+		for (uint32_t i = 0; i < vIndices.size(); ++i) vTriangles[vFill[vIndices[i]]++] = i / 3;
+	}
+
+	std::vector<int32_t> vCachePosition(nVertices, -1);
+	std::vector<float> vVertexScore(nVertices);
+	for (uint32_t i = 0; i < nVertices; ++i) vVertexScore[i] = ValenceScore(vRemaining[i]);
+
+	std::vector<float> vTriangleScore(nTriangles);
+	std::vector<bool> vAdded(nTriangles, false);
+	for (uint32_t i = 0; i < nTriangles; ++i) vTriangleScore[i] = vVertexScore[vIndices[i * 3]] + vVertexScore[vIndices[i * 3 + 1]] + vVertexScore[vIndices[i * 3 + 2]];
+
+	std::vector<uint32_t> vCache;
+	std::vector<uint32_t> vNewCache;
+	vCache.reserve(nOptimiseCacheSize + 3);
+	vNewCache.reserve(nOptimiseCacheSize + 3);
+
+	std::vector<uint32_t> vOutput;
+	vOutput.reserve(vIndices.size());
+
+	uint32_t nBest = UINT32_MAX;
+	uint32_t nScanFrom = 0; // Everything before this has been added, for when there's no best in the cache
+	for (uint32_t nOutput = 0; nOutput < nTriangles; ++nOutput)
+	{
+		if (nBest == UINT32_MAX)
+		{
+			// The cache had nothing left to offer, so start afresh with the best triangle anywhere
+			float fBestScore = -1.0f;
+			while (nScanFrom < nTriangles && vAdded[nScanFrom]) nScanFrom++;
+			for (uint32_t i = nScanFrom; i < nTriangles; ++i)
+			{
+				if (!vAdded[i] && vTriangleScore[i] > fBestScore) { fBestScore = vTriangleScore[i]; nBest = i; }
+			}
+		}
+
+		uint32_t nTriangle = nBest;
+		vAdded[nTriangle] = true;
+		const uint32_t* pCorners = &vIndices[nTriangle * 3];
+		vOutput.insert(vOutput.end(), pCorners, pCorners + 3);
+
+		// Its vertices go to the front of the cache, pushing the rest back
+		vNewCache.assign(pCorners, pCorners + 3);
+		for (uint32_t nVertex : vCache)
+		{
+			if (nVertex != pCorners[0] && nVertex != pCorners[1] && nVertex != pCorners[2]) vNewCache.push_back(nVertex);
+		}
+
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			// Take it off the list of triangles still to go
+			uint32_t nVertex = pCorners[i];
+			uint32_t* pBegin = &vTriangles[vFirst[nVertex]];
+			uint32_t* pEnd = pBegin + vRemaining[nVertex];
+			uint32_t* pFound = std::find(pBegin, pEnd, nTriangle);
+			std::swap(*pFound, *(pEnd - 1));
+			vRemaining[nVertex]--;
+		}
+
+		// Rescore everything that was or is in the cache, and whatever triangles of theirs are left
+		nBest = UINT32_MAX;
+		float fBestScore = -1.0f;
+		for (uint32_t i = 0; i < vNewCache.size(); ++i)
+		{
+			uint32_t nVertex = vNewCache[i];
+			vCachePosition[nVertex] = i < nOptimiseCacheSize ? static_cast<int32_t>(i) : -1;
+			vVertexScore[nVertex] = CacheScore(vCachePosition[nVertex]) + ValenceScore(vRemaining[nVertex]);
+		}
+		for (uint32_t nVertex : vNewCache)
+		{
+			for (uint32_t j = 0; j < vRemaining[nVertex]; ++j)
+			{
+				uint32_t nOther = vTriangles[vFirst[nVertex] + j];
+				const uint32_t* pOther = &vIndices[nOther * 3];
+				vTriangleScore[nOther] = vVertexScore[pOther[0]] + vVertexScore[pOther[1]] + vVertexScore[pOther[2]];
+				if (vTriangleScore[nOther] > fBestScore) { fBestScore = vTriangleScore[nOther]; nBest = nOther; }
+			}
+		}
+
+		if (vNewCache.size() > nOptimiseCacheSize) vNewCache.resize(nOptimiseCacheSize);
+		std::swap(vCache, vNewCache);
+	}
+
+	return vOutput;
+}
+
+std::vector<uint32_t> MeshConverter::OptimiseOverdraw(const std::vector<uint32_t>& vIndices, const std::vector<glm::vec3>& vPositions)
+{
+	uint32_t nTriangles = static_cast<uint32_t>(vIndices.size() / 3);
+
+	// Cut the cache optimised order into clusters wherever a triangle misses on all three vertices
+	std::vector<uint32_t> vClusterStarts = { 0 };
+	{
+		std::vector<uint64_t> vEntered(vPositions.size(), 0);
+		uint64_t nTime = nClusterCacheSize + 1;
+		for (uint32_t i = 0; i < nTriangles; ++i)
+		{
+			uint32_t nMisses = 0;
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				uint32_t nIndex = vIndices[i * 3 + j];
+				if (nTime - vEntered[nIndex] > nClusterCacheSize) { vEntered[nIndex] = nTime++; nMisses++; }
+			}
+			if (nMisses == 3 && i - vClusterStarts.back() >= nMinClusterTriangles) vClusterStarts.push_back(i);
+		}
+	}
+	vClusterStarts.push_back(nTriangles);
+
+	// Area weighted centroids and normals, of the whole mesh and each cluster
+	struct Cluster
+	{
+		uint32_t nFirst;
+		uint32_t nCount;
+		float fSort;
+	};
+	std::vector<Cluster> vClusters;
+	std::vector<glm::vec3> vCentroids;
+	std::vector<glm::vec3> vNormals;
+	glm::vec3 meshCentroid = glm::vec3(0.0f);
+	float fMeshArea = 0.0f;
+	for (size_t c = 0; c + 1 < vClusterStarts.size(); ++c)
+	{
+		glm::vec3 centroid = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float fArea = 0.0f;
+		for (uint32_t i = vClusterStarts[c]; i < vClusterStarts[c + 1]; ++i)
+		{
+			const glm::vec3& a = vPositions[vIndices[i * 3]];
+			const glm::vec3& b = vPositions[vIndices[i * 3 + 1]];
+			const glm::vec3& d = vPositions[vIndices[i * 3 + 2]];
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float fTriangleArea = glm::length(cross);
+			centroid += (a + b + d) * (fTriangleArea / 3.0f);
+			normal += cross;
+			fArea += fTriangleArea;
+		}
+
+		meshCentroid += centroid;
+		fMeshArea += fArea;
+		vCentroids.push_back(fArea > 0.0f ? centroid / fArea : centroid);
+		vNormals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f));
+		vClusters.push_back({ vClusterStarts[c], vClusterStarts[c + 1] - vClusterStarts[c], 0.0f });
+	}
+	if (fMeshArea > 0.0f) meshCentroid /= fMeshArea;
+
+	// Clusters facing out from the middle tend to hide the ones that don't, whichever way the mesh is
+	// seen from - drawing them first means more of the rest fails the depth test
+	for (size_t c = 0; c < vClusters.size(); ++c) vClusters[c].fSort = glm::dot(vCentroids[c] - meshCentroid, vNormals[c]);
+	std::stable_sort(vClusters.begin(), vClusters.end(), [](const Cluster& a, const Cluster& b) { return a.fSort > b.fSort; });
+
+	std::vector<uint32_t> vOutput;
+	vOutput.reserve(vIndices.size());
+	for (const Cluster& cluster : vClusters)
+	{
+		vOutput.insert(vOutput.end(), vIndices.begin() + cluster.nFirst * 3, vIndices.begin() + (cluster.nFirst + cluster.nCount) * 3);
+	}
+	return vOutput;
+}
+
+void MeshConverter::OptimiseVertexFetch(std::vector<uint32_t>& vIndices, std::vector<Vertex>& vVertices, std::vector<glm::vec3>& vPositions)
+{
+	// Renumbered in the order they're first used, so the vertex fetch walks the buffer front to back.
+	// Anything unused (welded away, or only in degenerate triangles) is dropped
+	std::vector<uint32_t> vRemap(vVertices.size(), UINT32_MAX);
+	std::vector<Vertex> vNewVertices;
+	std::vector<glm::vec3> vNewPositions;
+	for (uint32_t& nIndex : vIndices)
+	{
+		if (vRemap[nIndex] == UINT32_MAX)
+		{
+			vRemap[nIndex] = static_cast<uint32_t>(vNewVertices.size());
+			vNewVertices.push_back(vVertices[nIndex]);
+			vNewPositions.push_back(vPositions[nIndex]);
+		}
+		nIndex = vRemap[nIndex];
+	}
+	vVertices = std::move(vNewVertices);
+	vPositions = std::move(vNewPositions);
+}
+
+std::vector<Meshlet> MeshConverter::BuildMeshlets(const std::vector<uint32_t>& vIndices, const std::vector<glm::vec3>& vPositions)
+{
+	// Greedily along the index buffer, so each one's a range of it and can be drawn on its own
+	std::vector<Meshlet> vMeshlets;
+	std::vector<uint32_t> vUsedIn(vPositions.size(), UINT32_MAX); // Meshlet that last used each vertex
+	std::vector<glm::vec3> vPoints;
+	uint32_t nTriangles = static_cast<uint32_t>(vIndices.size() / 3);
+
+	uint32_t nFirst = 0;
+	while (nFirst < nTriangles)
+	{
+		uint32_t nMeshlet = static_cast<uint32_t>(vMeshlets.size());
+		uint32_t nVertices = 0;
+		uint32_t nLast = nFirst;
+		vPoints.clear();
+		while (nLast < nTriangles && nLast - nFirst < nMaxMeshletTriangles)
+		{
+			uint32_t nNew = 0;
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				uint32_t nIndex = vIndices[nLast * 3 + j];
+				bool bRepeat = (j > 0 && vIndices[nLast * 3] == nIndex) || (j > 1 && vIndices[nLast * 3 + 1] == nIndex);
+				if (vUsedIn[nIndex] != nMeshlet && !bRepeat) nNew++;
+			}
+			if (nVertices + nNew > nMaxMeshletVertices) break;
+
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				uint32_t nIndex = vIndices[nLast * 3 + j];
+				if (vUsedIn[nIndex] == nMeshlet) continue;
+				vUsedIn[nIndex] = nMeshlet;
+				vPoints.push_back(vPositions[nIndex]);
+			}
+			nVertices += nNew;
+			nLast++;
+		}
+
+		Meshlet meshlet{};
+		meshlet.nFirstIndex = nFirst * 3;
+		meshlet.nIndexCount = (nLast - nFirst) * 3;
+		meshlet.nVertexCount = nVertices;
+
+		glm::vec3 minimum = glm::vec3(FLT_MAX), maximum = glm::vec3(-FLT_MAX);
+		for (const glm::vec3& point : vPoints)
+		{
+			minimum = glm::min(minimum, point);
+			maximum = glm::max(maximum, point);
+		}
+		meshlet.boundingSphere = BoundingSphere(minimum, maximum, vPoints);
+
+		// The normals' average, and how far the furthest strays from it. If they're all within θ of the axis,
+		// they all face away from views within 90° - θ, where cos(90° - θ) = sin θ
+		glm::vec3 axis = glm::vec3(0.0f);
+		std::vector<glm::vec3> vTriangleNormals;
+		for (uint32_t i = nFirst; i < nLast; ++i)
+		{
+			const glm::vec3& a = vPositions[vIndices[i * 3]];
+			glm::vec3 normal = glm::cross(vPositions[vIndices[i * 3 + 1]] - a, vPositions[vIndices[i * 3 + 2]] - a);
+			if (glm::length(normal) == 0.0f) continue;
+			vTriangleNormals.push_back(glm::normalize(normal));
+			axis += vTriangleNormals.back();
+		}
+		meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		if (glm::length(axis) > 0.0f)
+		{
+			axis = glm::normalize(axis);
+			float fMinDot = 1.0f;
+			for (const glm::vec3& normal : vTriangleNormals) fMinDot = std::min(fMinDot, glm::dot(axis, normal));
+			if (fMinDot > 0.0f) meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - fMinDot * fMinDot));
+		}
+
+		vMeshlets.push_back(meshlet);
+		nFirst = nLast;
+	}
+	return vMeshlets;
+}
+
+std::vector<uint32_t> MeshConverter::Build(const MeshSource& original, MeshConversionStats* pStats)
+{
+	MeshSource source = original;
+	size_t nSourceVertices = source.vPositions.size();
+	if (source.vIndices.empty() || source.vIndices.size() % 3 != 0) throw std::runtime_error("Meshes need whole triangles");
+	for (uint32_t nIndex : source.vIndices) if (nIndex >= nSourceVertices) throw std::runtime_error("Mesh has an index out of range");
+	if (source.vNormals.empty()) GenerateNormals(source);
+
+	// Quantise, then weld whatever's come out the same
+	std::vector<Vertex> vVertices;
+	std::vector<glm::vec3> vPositions; // What the GPU will see, for bounds
+	std::vector<uint32_t> vRemap(nSourceVertices);
+	std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> welded;
+	for (size_t i = 0; i < nSourceVertices; ++i)
+	{
+		glm::vec2 uv = source.vUvs.empty() ? glm::vec2(0.0f) : source.vUvs[i];
+		glm::vec4 colour = source.vColours.empty() ? glm::vec4(1.0f) : source.vColours[i];
+		Vertex vertex = Vertex::Pack(source.vPositions[i], source.vNormals[i], uv, colour);
+
+		auto it = welded.find(vertex);
+		if (it == welded.end())
+		{
+			it = welded.emplace(vertex, static_cast<uint32_t>(vVertices.size())).first;
+			vVertices.push_back(vertex);
+			vPositions.push_back(vertex.GetPosition());
+		}
+		vRemap[i] = it->second;
+	}
+
+	// Triangles that collapsed to a line or a point draw nothing
+	std::vector<uint32_t> vIndices;
+	vIndices.reserve(source.vIndices.size());
+	for (size_t i = 0; i < source.vIndices.size(); i += 3)
+	{
+		uint32_t a = vRemap[source.vIndices[i]], b = vRemap[source.vIndices[i + 1]], c = vRemap[source.vIndices[i + 2]];
+		if (a == b || b == c || c == a) continue;
+		vIndices.insert(vIndices.end(), { a, b, c });
+	}
+	if (vIndices.empty()) throw std::runtime_error("Mesh has nothing but degenerate triangles");
+
+	float fAcmrBefore = GetAcmr(vIndices, static_cast<uint32_t>(vVertices.size()));
+	vIndices = OptimiseVertexCache(vIndices, static_cast<uint32_t>(vVertices.size()));
+	vIndices = OptimiseOverdraw(vIndices, vPositions);
+	OptimiseVertexFetch(vIndices, vVertices, vPositions);
+	std::vector<Meshlet> vMeshlets = BuildMeshlets(vIndices, vPositions);
+
+	MeshFileHeader header{};
+	std::memcpy(header.magic, meshFileMagic, sizeof(meshFileMagic));
+	header.nVersion = nMeshFileVersion;
+	header.nVertexCount = static_cast<uint32_t>(vVertices.size());
+	header.nIndexCount = static_cast<uint32_t>(vIndices.size());
+	header.nIndexSize = vVertices.size() <= 0xFFFF ? 2 : 4;
+	header.nMeshletCount = static_cast<uint32_t>(vMeshlets.size());
+	header.nVertexOffset = AlignUp(sizeof(MeshFileHeader), 16);
+	header.nIndexOffset = AlignUp(header.nVertexOffset + vVertices.size() * sizeof(Vertex), 16);
+	header.nMeshletOffset = AlignUp(header.nIndexOffset + vIndices.size() * header.nIndexSize, 16);
+
+	glm::vec3 minimum = glm::vec3(FLT_MAX), maximum = glm::vec3(-FLT_MAX);
+	for (const glm::vec3& position : vPositions)
+	{
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	glm::vec4 sphere = BoundingSphere(minimum, maximum, vPositions);
+	std::memcpy(header.boundsMin, &minimum, sizeof(header.boundsMin));
+	std::memcpy(header.boundsMax, &maximum, sizeof(header.boundsMax));
+	std::memcpy(header.boundingSphere, &sphere, sizeof(header.boundingSphere));
+
+	uint64_t nSize = AlignUp(header.nMeshletOffset + vMeshlets.size() * sizeof(Meshlet), 16);
+	std::vector<uint32_t> vFile(static_cast<size_t>(nSize / sizeof(uint32_t)), 0);
+	uint8_t* pFile = reinterpret_cast<uint8_t*>(vFile.data());
+	std::memcpy(pFile, &header, sizeof(header));
+	std::memcpy(pFile + header.nVertexOffset, vVertices.data(), vVertices.size() * sizeof(Vertex));
+	if (header.nIndexSize == 2)
+	{
+		uint16_t* pIndices = reinterpret_cast<uint16_t*>(pFile + header.nIndexOffset);
+		for (size_t i = 0; i < vIndices.size(); ++i) pIndices[i] = static_cast<uint16_t>(vIndices[i]);
+	}
+	else std::memcpy(pFile + header.nIndexOffset, vIndices.data(), vIndices.size() * sizeof(uint32_t));
+	std::memcpy(pFile + header.nMeshletOffset, vMeshlets.data(), vMeshlets.size() * sizeof(Meshlet));
+
+	if (pStats)
+	{
+		pStats->nSourceVertices = static_cast<uint32_t>(nSourceVertices);
+		pStats->nVertices = header.nVertexCount;
+		pStats->nTriangles = header.nIndexCount / 3;
+		pStats->nMeshlets = header.nMeshletCount;
+		pStats->fAcmrBefore = fAcmrBefore;
+		pStats->fAcmrAfter = GetAcmr(vIndices, header.nVertexCount);
+		pStats->nBytesBefore = nSourceVertices * 12 * sizeof(float) + original.vIndices.size() * sizeof(uint32_t);
+		pStats->nBytesAfter = static_cast<size_t>(nSize);
+	}
+	return vFile;
+}
+
+MeshConversionStats MeshConverter::Convert(const std::string& sSource, const std::string& sDestination)
+{
+	// glTF needs a JSON parser, which there isn't one of yet - export it as OBJ in the meantime
+	std::string sExtension = std::filesystem::path(sSource).extension().string();
+	std::transform(sExtension.begin(), sExtension.end(), sExtension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+	if (sExtension != ".obj") throw std::runtime_error("Only OBJ meshes can be converted, not " + sSource);
+
+	MeshConversionStats stats;
+	std::vector<uint32_t> vFile = Build(LoadObj(sSource), &stats);
+
+	// Written to the side then moved into place, so nothing ever maps half a mesh
+	std::string sTemporary = sDestination + ".tmp";
+	{
+		std::ofstream fFile(sTemporary, std::ios::binary | std::ios::trunc);
+		if (!fFile.is_open()) throw std::runtime_error("Unable to write " + sDestination + "!");
+		fFile.write(reinterpret_cast<const char*>(vFile.data()), vFile.size() * sizeof(uint32_t));
+		if (!fFile) throw std::runtime_error("Unable to write " + sDestination + "!");
+	}
+	std::error_code error;
+	std::filesystem::rename(sTemporary, sDestination, error);
+	if (error) throw std::runtime_error("Unable to write " + sDestination + "!");
+	return stats;
+}
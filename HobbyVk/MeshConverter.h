@@ -0,0 +1,59 @@
+#pragma once
+#ifndef MESH_CONVERTER_H
+#define MESH_CONVERTER_H
+
+#include "Mesh.h"
+#include <string>
+#include <vector>
+
+// Full precision triangles, as they come out of a modelling package - one set of attributes per vertex
+struct MeshSource
+{
+	std::vector<glm::vec3> vPositions;
+	std::vector<glm::vec3> vNormals;	// Generated (smooth, area weighted) if empty
+	std::vector<glm::vec2> vUvs;		// All optional from here
+	std::vector<glm::vec4> vColours;
+	std::vector<uint32_t> vIndices;
+};
+
+struct MeshConversionStats
+{
+	uint32_t nSourceVertices = 0;
+	uint32_t nVertices = 0;		// Once identical (after quantising) ones are welded
+	uint32_t nTriangles = 0;
+	uint32_t nMeshlets = 0;
+	float fAcmrBefore = 0.0f;	// Average cache miss ratio - vertices transformed per triangle, for a
+	float fAcmrAfter = 0.0f;	// 32 entry FIFO cache. 3 is no reuse at all, 0.5 about the best there is
+	size_t nBytesBefore = 0;	// Vertices and indices as they came - 12 floats a vertex, 32 bit indices
+	size_t nBytesAfter = 0;		// The whole file
+};
+
+// Turns meshes into .hvkmesh files offline, so loading one is a mapping and a couple of uploads. Along the way
+// vertices are quantised (see Vertex) and welded, triangles are ordered for the post transform cache (Forsyth's
+// algorithm), then clusters of them for less overdraw (outward facing ones first, as in Sander et al's
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), vertices are ordered by first use
+// so they're fetched front to back, and runs of the index buffer are cut into meshlets for culling
+class MeshConverter
+{
+public:
+	// Wavefront OBJ - positions (and vertex colours if they're tacked on), normals and UVs, polygons fanned into
+	// triangles. Throws if it can't be read
+	static MeshSource LoadObj(const std::string& sFilename);
+
+	// Returns the file's contents, in words so it can go straight into an AssetSpan
+	static std::vector<uint32_t> Build(const MeshSource& source, MeshConversionStats* pStats = nullptr);
+
+	// LoadObj, Build, then writes it out. Throws on failure
+	static MeshConversionStats Convert(const std::string& sSource, const std::string& sDestination);
+
+	static float GetAcmr(const std::vector<uint32_t>& vIndices, uint32_t nVertices, uint32_t nCacheSize = 32);
+
+private:
+	static void GenerateNormals(MeshSource& source);
+	static std::vector<uint32_t> OptimiseVertexCache(const std::vector<uint32_t>& vIndices, uint32_t nVertices);
+	static std::vector<uint32_t> OptimiseOverdraw(const std::vector<uint32_t>& vIndices, const std::vector<glm::vec3>& vPositions);
+	static void OptimiseVertexFetch(std::vector<uint32_t>& vIndices, std::vector<Vertex>& vVertices, std::vector<glm::vec3>& vPositions);
+	static std::vector<Meshlet> BuildMeshlets(const std::vector<uint32_t>& vIndices, const std::vector<glm::vec3>& vPositions);
+};
+
+#endif
@@ -0,0 +1,460 @@
+#include "PipelineLibrary.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	inline void HashCombine(size_t& nHash, size_t nValue)
+	{
+		nHash ^= nValue + 0x9e3779b9 + (nHash << 6) + (nHash >> 2);
+	}
+
+	template<typename T> inline size_t HashHandle(T handle)
+	{
+		return std::hash<uint64_t>()(reinterpret_cast<uint64_t>(static_cast<typename T::CType>(handle)));
+	}
+}
+
+SpecializationConstants& SpecializationConstants::Set(uint32_t nId, uint32_t nValue)
+{
+	// Kept sorted by id, so the same constants set in any order compare (and hash) the same
+	auto it = std::lower_bound(m_vEntries.begin(), m_vEntries.end(), nId, [](const vk::SpecializationMapEntry& entry, uint32_t nId) { return entry.constantID < nId; });
+	size_t nIndex = it - m_vEntries.begin();
+	if (it != m_vEntries.end() && it->constantID == nId) { m_vData[nIndex] = nValue; return *this; }
+
+	m_vEntries.insert(it, vk::SpecializationMapEntry(nId, 0, sizeof(uint32_t)));
+	m_vData.insert(m_vData.begin() + nIndex, nValue);
+	for (size_t i = 0; i < m_vEntries.size(); ++i) m_vEntries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+	return *this;
+}
+
+SpecializationConstants& SpecializationConstants::Set(uint32_t nId, float fValue)
+{
+	uint32_t nValue;
+	std::memcpy(&nValue, &fValue, sizeof(float));
+	return Set(nId, nValue);
+}
+
+vk::SpecializationInfo SpecializationConstants::GetInfo() const
+{
+	return vk::SpecializationInfo(static_cast<uint32_t>(m_vEntries.size()), m_vEntries.data(), m_vData.size() * sizeof(uint32_t), m_vData.data());
+}
+
+bool SpecializationConstants::operator==(const SpecializationConstants& other) const
+{
+	if (m_vData != other.m_vData || m_vEntries.size() != other.m_vEntries.size()) return false;
+	for (size_t i = 0; i < m_vEntries.size(); ++i) if (m_vEntries[i].constantID != other.m_vEntries[i].constantID) return false;
+	return true;
+}
+
+size_t SpecializationConstants::Hash() const
+{
+	size_t nHash = m_vEntries.size();
+	for (size_t i = 0; i < m_vEntries.size(); ++i)
+	{
+		HashCombine(nHash, m_vEntries[i].constantID);
+		HashCombine(nHash, m_vData[i]);
+	}
+	return nHash;
+}
+
+bool GraphicsPipelineKey::operator==(const GraphicsPipelineKey& other) const
+{
+	return	sVertexShader == other.sVertexShader && sFragmentShader == other.sFragmentShader &&
+			vBindings == other.vBindings && vAttributes == other.vAttributes &&
+			vertexConstants == other.vertexConstants && fragmentConstants == other.fragmentConstants &&
+			topology == other.topology && polygonMode == other.polygonMode && cullMode == other.cullMode && frontFace == other.frontFace &&
+			bAlphaBlend == other.bAlphaBlend && samples == other.samples &&
+			bDepthTest == other.bDepthTest && bDepthWrite == other.bDepthWrite && depthCompareOp == other.depthCompareOp &&
+			layout == other.layout && renderPass == other.renderPass && nSubpass == other.nSubpass;
+}
+
+size_t GraphicsPipelineKey::FamilyHash() const
+{
+	size_t nHash = std::hash<std::string>()(sVertexShader);
+	HashCombine(nHash, std::hash<std::string>()(sFragmentShader));
+	HashCombine(nHash, HashHandle(layout));
+	HashCombine(nHash, HashHandle(renderPass));
+	HashCombine(nHash, nSubpass);
+	return nHash;
+}
+
+size_t GraphicsPipelineKey::Hash() const
+{
+	size_t nHash = FamilyHash();
+	HashCombine(nHash, vertexConstants.Hash());
+	HashCombine(nHash, fragmentConstants.Hash());
+	for (const auto& binding : vBindings)
+	{
+		HashCombine(nHash, binding.binding);
+		HashCombine(nHash, binding.stride);
+		HashCombine(nHash, static_cast<size_t>(binding.inputRate));
+	}
+	for (const auto& attribute : vAttributes)
+	{
+		HashCombine(nHash, attribute.location);
+		HashCombine(nHash, attribute.binding);
+		HashCombine(nHash, static_cast<size_t>(attribute.format));
+		HashCombine(nHash, attribute.offset);
+	}
+
+	HashCombine(nHash, static_cast<size_t>(topology));
+	HashCombine(nHash, static_cast<size_t>(polygonMode));
+	HashCombine(nHash, static_cast<size_t>(static_cast<VkCullModeFlags>(cullMode)));
+	HashCombine(nHash, static_cast<size_t>(frontFace));
+	HashCombine(nHash, bAlphaBlend);
+	HashCombine(nHash, static_cast<size_t>(samples));
+	HashCombine(nHash, bDepthTest);
+	HashCombine(nHash, bDepthWrite);
+	HashCombine(nHash, static_cast<size_t>(depthCompareOp));
+	return nHash;
+}
+
+bool ComputePipelineKey::operator==(const ComputePipelineKey& other) const
+{
+	return sShader == other.sShader && constants == other.constants && layout == other.layout;
+}
+
+size_t ComputePipelineKey::FamilyHash() const
+{
+	size_t nHash = std::hash<std::string>()(sShader);
+	HashCombine(nHash, HashHandle(layout));
+	return nHash;
+}
+
+size_t ComputePipelineKey::Hash() const
+{
+	size_t nHash = FamilyHash();
+	HashCombine(nHash, constants.Hash());
+	return nHash;
+}
+
+PipelineLibrary::PipelineLibrary(vk::Device device, vk::PipelineCache pipelineCache, ShaderCompiler& shaderCompiler, JobSystem& jobSystem, uint32_t nFramesInFlight)
+	: m_Device(device), m_PipelineCache(pipelineCache), m_ShaderCompiler(shaderCompiler), m_JobSystem(jobSystem), m_nFramesInFlight(nFramesInFlight)
+{
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+	m_JobSystem.Wait(m_BackgroundJobs);
+}
+
+template<typename Key> vk::Pipeline PipelineLibrary::GetFrom(PipelineMap<Key>& pipelines, const Key& key)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto& pEntry = pipelines[key];
+	if (!pEntry) pEntry = std::make_unique<Entry>();
+	Entry& entry = *pEntry; // Entries never move, even as the map grows
+
+	// Someone else is already on it - unless it's a reload, in which case the old one will do
+	if (entry.bReady) return entry.pipeline.get();
+	if (entry.bCompiling)
+	{
+		m_Compiled.wait(lock, [&entry]() { return !entry.bCompiling; });
+		if (entry.bReady) return entry.pipeline.get();
+		throw std::runtime_error(entry.sError);
+	}
+
+	// Nobody's on it, or the last go failed - either way it's built here, so the error goes to whoever wanted it
+	entry.bCompiling = true;
+	lock.unlock();
+	std::string sError;
+	if (!TryCompile(key, entry, sError)) throw std::runtime_error(sError);
+	return entry.pipeline.get();
+}
+
+template<typename Key> vk::Pipeline PipelineLibrary::RequestFrom(PipelineMap<Key>& pipelines, const Key& key)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto& pEntry = pipelines[key];
+	if (!pEntry) pEntry = std::make_unique<Entry>();
+	Entry& entry = *pEntry;
+
+	if (entry.bReady) return entry.pipeline.get();
+	if (entry.bCompiling) return vk::Pipeline{};
+	if (!entry.sError.empty())
+	{
+		if (!entry.bReported) std::cerr << "Pipeline failed to build:\n" << entry.sError << std::endl;
+		entry.bReported = true;
+		return vk::Pipeline{};
+	}
+
+	// The key's copied, as the caller's may well be gone by the time this runs. Failures are kept
+	// for the next Request, as nothing can be thrown from a worker
+	entry.bCompiling = true;
+	m_JobSystem.ScheduleBackground([this, key, &entry]() { std::string sError; TryCompile(key, entry, sError); }, &m_BackgroundJobs);
+	return vk::Pipeline{};
+}
+
+template<typename Key> bool PipelineLibrary::TryCompile(const Key& key, Entry& entry, std::string& sError)
+{
+	try
+	{
+		Compile(key, entry);
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		sError = e.what();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			entry.bCompiling = false;
+			entry.sError = sError;
+			entry.bReported = false;
+		}
+		m_Compiled.notify_all();
+		return false;
+	}
+}
+
+vk::Pipeline PipelineLibrary::Get(const GraphicsPipelineKey& key)			{ return GetFrom(m_Pipelines, key); }
+vk::Pipeline PipelineLibrary::Request(const GraphicsPipelineKey& key)		{ return RequestFrom(m_Pipelines, key); }
+vk::Pipeline PipelineLibrary::GetCompute(const ComputePipelineKey& key)		{ return GetFrom(m_ComputePipelines, key); }
+vk::Pipeline PipelineLibrary::RequestCompute(const ComputePipelineKey& key)	{ return RequestFrom(m_ComputePipelines, key); }
+
+void PipelineLibrary::Evict(vk::RenderPass renderPass)
+{
+	// Background compiles may be deriving from what's about to go
+	m_JobSystem.Wait(m_BackgroundJobs);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto it = m_Pipelines.begin(); it != m_Pipelines.end();)
+	{
+		if (it->first.renderPass == renderPass && it->second->bReady)
+		{
+			size_t nFamily = it->first.FamilyHash();
+			auto parent = m_FamilyParents.find(nFamily);
+			if (parent != m_FamilyParents.end() && parent->second == it->second->pipeline.get()) m_FamilyParents.erase(parent);
+			it = m_Pipelines.erase(it);
+		}
+		else ++it;
+	}
+}
+
+template<typename Key> void PipelineLibrary::ScheduleReloads(PipelineMap<Key>& pipelines, const std::vector<std::string>& vChanged)
+{
+	// Only called with the lock held
+	for (auto& [key, pEntry] : pipelines)
+	{
+		// Whatever's already compiling loads the new shader anyway, and ones that failed get another go
+		if ((!pEntry->bReady && pEntry->sError.empty()) || pEntry->bCompiling) continue;
+		if (std::none_of(vChanged.begin(), vChanged.end(), [&key](const std::string& sShader) { return key.UsesShader(sShader); })) continue;
+
+		Entry& entry = *pEntry;
+		entry.bCompiling = true;
+		bool bHasPipeline = entry.bReady;
+		m_JobSystem.ScheduleBackground([this, key = key, &entry, bHasPipeline]()
+		{
+			std::string sError;
+			if (TryCompile(key, entry, sError)) return;
+			std::cerr << (bHasPipeline ? "Shader reload failed, keeping the old pipeline:\n" : "Shader reload failed:\n") << sError << std::endl;
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			entry.bReported = true;
+		}, &m_BackgroundJobs);
+	}
+}
+
+void PipelineLibrary::ReloadChangedShaders()
+{
+	std::vector<std::string> vChanged = m_ShaderCompiler.FindChanged();
+	if (vChanged.empty()) return;
+	for (const std::string& sShader : vChanged) std::cout << "Reloading " << sShader << std::endl;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ScheduleReloads(m_Pipelines, vChanged);
+	ScheduleReloads(m_ComputePipelines, vChanged);
+}
+
+void PipelineLibrary::CollectRetired()
+{
+	// Compiles still running may be deriving from one of them, so they're kept until those are done too
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& retired : m_vRetired) if (retired.first > 0) --retired.first;
+	if (!m_BackgroundJobs.IsDone()) return;
+	m_vRetired.erase(std::remove_if(m_vRetired.begin(), m_vRetired.end(), [](const auto& retired) { return retired.first == 0; }), m_vRetired.end());
+}
+
+vk::UniqueShaderModule PipelineLibrary::CreateShaderModule(const std::string& sFilename)
+{
+	// Shader modules only need to live until the pipeline's made
+	ShaderCode code = m_ShaderCompiler.Load(sFilename);
+	return m_Device.createShaderModuleUnique(vk::ShaderModuleCreateInfo({}, code->GetSize(), code->As<uint32_t>()));
+}
+
+void PipelineLibrary::Compile(const GraphicsPipelineKey& key, Entry& entry)
+{
+	// Compiling GLSL can take a while, so it's done without the lock
+	vk::UniqueShaderModule vertexShaderModule = CreateShaderModule(key.sVertexShader);
+	vk::UniqueShaderModule fragmentShaderModule = CreateShaderModule(key.sFragmentShader);
+	vk::Pipeline parent;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		parent = FindParent(key.FamilyHash());
+	}
+	vk::SpecializationInfo vertexSpecialization = key.vertexConstants.GetInfo();
+	vk::SpecializationInfo fragmentSpecialization = key.fragmentConstants.GetInfo();
+
+	// Create shaders - specialization constants set shader contents, allowing optimisation of if statements and the like
+	vk::PipelineShaderStageCreateInfo vertexShaderStageInfo = {};
+	vertexShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
+	vertexShaderStageInfo.module = vertexShaderModule.get();
+	vertexShaderStageInfo.pName = "main"; // main() in shader
+	vertexShaderStageInfo.pSpecializationInfo = key.vertexConstants.IsEmpty() ? nullptr : &vertexSpecialization;
+
+	vk::PipelineShaderStageCreateInfo fragmentShaderStageInfo = {};
+	fragmentShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
+	fragmentShaderStageInfo.module = fragmentShaderModule.get();
+	fragmentShaderStageInfo.pName = "main";  // main() in shader
+	fragmentShaderStageInfo.pSpecializationInfo = key.fragmentConstants.IsEmpty() ? nullptr : &fragmentSpecialization;
+
+	vk::PipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
+
+	vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(key.vBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = key.vBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(key.vAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = key.vAttributes.data();
+
+	// Input assembly - what kind of geometry will be drawn and if primitive
+	// restart should be enabled
+	vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.topology = key.topology;
+	inputAssembly.primitiveRestartEnable = false;
+
+	// Viewport and scissors (the region in which pixels will actually be stored) are dynamic
+	// state, set when recording, so the pipeline survives the swapchain being resized
+	vk::PipelineViewportStateCreateInfo viewportState{};
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = nullptr; // Ignored, as they're dynamic
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = nullptr;
+
+	// Rasteris(z)er - takes care of depth testing, face culling, the scissor test,
+	// fill mode (wireframe rendering or polygons), and, erm.... rasteris(z)ing
+	vk::PipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.depthClampEnable = false; // If true, clamp fragments too near or far apart instead of discarding them
+	rasterizer.rasterizerDiscardEnable = false; // Basically disables any output to the framebufer
+	rasterizer.polygonMode = key.polygonMode; // Important: using any other mode than fill requires a GPU feature!
+	rasterizer.lineWidth = 1.0f; // Anything thicker than 1.0 requires enabling the wideLines GPU feature
+	rasterizer.cullMode = key.cullMode;
+	rasterizer.frontFace = key.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE; // The depth bias can add a constant value to depthmaps, useful for shadowmaps
+
+	vk::PipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sampleShadingEnable = false;
+	multisampling.rasterizationSamples = key.samples;
+	multisampling.minSampleShading = 1.0f; // Optional
+	multisampling.pSampleMask = nullptr;
+	multisampling.alphaToCoverageEnable = false;
+	multisampling.alphaToOneEnable = false;
+
+	// Early-Z friendly as long as shaders don't discard or write gl_FragDepth - the test runs before
+	// shading, and the compare direction's left for the whole frame so hierarchical Z stays valid
+	vk::PipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.depthTestEnable = key.bDepthTest;
+	depthStencil.depthWriteEnable = key.bDepthWrite;
+	depthStencil.depthCompareOp = key.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = false;
+	depthStencil.stencilTestEnable = false;
+
+	// Colour blending - alpha blending if asked for
+	vk::PipelineColorBlendAttachmentState colourBlendAttatchment{};
+	colourBlendAttatchment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+	colourBlendAttatchment.blendEnable = key.bAlphaBlend;
+	colourBlendAttatchment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+	colourBlendAttatchment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+	colourBlendAttatchment.colorBlendOp = vk::BlendOp::eAdd;
+	colourBlendAttatchment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+	colourBlendAttatchment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
+	colourBlendAttatchment.alphaBlendOp = vk::BlendOp::eAdd;
+
+	// More colour blending - constants for blend factors for all the framebuffers
+	vk::PipelineColorBlendStateCreateInfo colourBlending{};
+	colourBlending.logicOpEnable = false;
+	colourBlending.logicOp = vk::LogicOp::eCopy;
+	colourBlending.attachmentCount = 1;
+	colourBlending.pAttachments = &colourBlendAttatchment;
+
+	// Dynamic state - allows certain things to be changed at draw time,
+	// like viewport and line width, in which case the nessecary above values are ignored
+	vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	vk::PipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	vk::GraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.stageCount = 2; // Fragment and vertex
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil; // Ignored by subpasses without depth, but needed (even with it all off) by ones with it
+	pipelineInfo.pColorBlendState = &colourBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = key.layout;
+	pipelineInfo.renderPass = key.renderPass;
+	pipelineInfo.subpass = key.nSubpass;
+
+	// Anything can be a parent, and anything with a sibling already built derives from it
+	pipelineInfo.flags = vk::PipelineCreateFlagBits::eAllowDerivatives;
+	if (parent) pipelineInfo.flags |= vk::PipelineCreateFlagBits::eDerivative;
+	pipelineInfo.basePipelineHandle = parent;
+	pipelineInfo.basePipelineIndex = -1;
+
+	// The pipeline cache is internally synchronised, so workers can all go through it at once
+	vk::UniquePipeline pipeline = m_Device.createGraphicsPipelineUnique(m_PipelineCache, pipelineInfo);
+	Finish(key.FamilyHash(), entry, std::move(pipeline));
+}
+
+void PipelineLibrary::Compile(const ComputePipelineKey& key, Entry& entry)
+{
+	vk::UniqueShaderModule shaderModule = CreateShaderModule(key.sShader);
+	vk::Pipeline parent;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		parent = FindParent(key.FamilyHash());
+	}
+	vk::SpecializationInfo specialization = key.constants.GetInfo();
+
+	// Much simpler than the graphics one - there's no fixed function state at all
+	vk::ComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.stage = vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, shaderModule.get(), "main",
+															key.constants.IsEmpty() ? nullptr : &specialization);
+	pipelineInfo.layout = key.layout;
+	pipelineInfo.flags = vk::PipelineCreateFlagBits::eAllowDerivatives;
+	if (parent) pipelineInfo.flags |= vk::PipelineCreateFlagBits::eDerivative;
+	pipelineInfo.basePipelineHandle = parent;
+	pipelineInfo.basePipelineIndex = -1;
+
+	vk::UniquePipeline pipeline = m_Device.createComputePipelineUnique(m_PipelineCache, pipelineInfo);
+	Finish(key.FamilyHash(), entry, std::move(pipeline));
+}
+
+vk::Pipeline PipelineLibrary::FindParent(size_t nFamily)
+{
+	// Only called with the lock held
+	auto it = m_FamilyParents.find(nFamily);
+	return it != m_FamilyParents.end() ? it->second : vk::Pipeline{};
+}
+
+void PipelineLibrary::Finish(size_t nFamily, Entry& entry, vk::UniquePipeline pipeline)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		vk::UniquePipeline oldPipeline = std::move(entry.pipeline);
+		entry.pipeline = std::move(pipeline);
+		entry.bReady = true;
+		entry.bCompiling = false;
+		entry.sError.clear();
+
+		// A reload replaces the family's parent in place, and the old one waits out the frames that might be using it
+		auto parent = m_FamilyParents.find(nFamily);
+		if (parent == m_FamilyParents.end()) m_FamilyParents.emplace(nFamily, entry.pipeline.get());
+		else if (oldPipeline && parent->second == oldPipeline.get()) parent->second = entry.pipeline.get();
+		if (oldPipeline) m_vRetired.emplace_back(m_nFramesInFlight + 1, std::move(oldPipeline));
+	}
+	m_Compiled.notify_all();
+}
@@ -0,0 +1,164 @@
+#pragma once
+#ifndef PIPELINE_LIBRARY_H
+#define PIPELINE_LIBRARY_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include "JobSystem.h"
+#include "ShaderCompiler.h"
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+// Values for a shader's specialization constants (layout(constant_id = n) const ...), baked in when the
+// pipeline's built so the driver can fold away branches and unroll loops. Every constant's 32 bits,
+// which covers bool, int, uint and float - as well as local_size_x_id and friends for workgroup sizes
+class SpecializationConstants
+{
+public:
+	SpecializationConstants& Set(uint32_t nId, uint32_t nValue);
+	inline SpecializationConstants& Set(uint32_t nId, int32_t nValue) { return Set(nId, static_cast<uint32_t>(nValue)); }
+	SpecializationConstants& Set(uint32_t nId, float fValue);
+	inline SpecializationConstants& Set(uint32_t nId, bool bValue) { return Set(nId, static_cast<uint32_t>(bValue ? VK_TRUE : VK_FALSE)); }
+
+	inline bool IsEmpty() const { return m_vEntries.empty(); }
+
+	// Points into this, so only valid as long as it is (and isn't changed)
+	vk::SpecializationInfo GetInfo() const;
+
+	bool operator==(const SpecializationConstants& other) const;
+	size_t Hash() const;
+
+private:
+	std::vector<vk::SpecializationMapEntry> m_vEntries; // Sorted by id, entry i's value is m_vData[i]
+	std::vector<uint32_t> m_vData;
+};
+
+// Everything that goes into a graphics pipeline. Viewport and scissor are always dynamic, so aren't here
+struct GraphicsPipelineKey
+{
+	std::string sVertexShader;		// GLSL or SPIR-V files, see ShaderCompiler
+	std::string sFragmentShader;
+	std::vector<vk::VertexInputBindingDescription> vBindings;
+	std::vector<vk::VertexInputAttributeDescription> vAttributes;
+	SpecializationConstants vertexConstants;
+	SpecializationConstants fragmentConstants;
+
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+	vk::CullModeFlags cullMode = vk::CullModeFlagBits::eBack;
+	vk::FrontFace frontFace = vk::FrontFace::eClockwise;
+	bool bAlphaBlend = false;
+	vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+	bool bDepthTest = false;
+	bool bDepthWrite = false;
+	vk::CompareOp depthCompareOp = vk::CompareOp::eLess;
+
+	vk::PipelineLayout layout;
+	vk::RenderPass renderPass;
+	uint32_t nSubpass = 0;
+
+	inline bool UsesShader(const std::string& sShader) const { return sVertexShader == sShader || sFragmentShader == sShader; }
+	bool operator==(const GraphicsPipelineKey& other) const;
+	size_t Hash() const;
+	size_t FamilyHash() const; // Just shaders, layout and render pass - pipelines sharing these (say, specialisations) derive from each other
+};
+
+struct ComputePipelineKey
+{
+	std::string sShader; // GLSL or SPIR-V file
+	SpecializationConstants constants;
+	vk::PipelineLayout layout;
+
+	inline bool UsesShader(const std::string& sOther) const { return sShader == sOther; }
+	bool operator==(const ComputePipelineKey& other) const;
+	size_t Hash() const;
+	size_t FamilyHash() const; // Shader and layout
+};
+
+// Deduplicates graphics pipelines by their state, and compiles them on the job system through the
+// pipeline cache so a new one never has to hitch the render thread. Pipelines that only differ in
+// fixed function state from one already built are created as its derivatives, which some drivers
+// can both build and switch between faster.
+// Shaders edited on disk can be hot reloaded, rebuilding just the pipelines using them in the
+// background - the old ones keep being handed out until then, so fetch pipelines from here each
+// frame rather than holding onto them
+class PipelineLibrary
+{
+public:
+	PipelineLibrary(vk::Device device, vk::PipelineCache pipelineCache, ShaderCompiler& shaderCompiler, JobSystem& jobSystem, uint32_t nFramesInFlight);
+	~PipelineLibrary(); // Waits for anything still compiling
+
+	// Blocks until the pipeline exists, compiling it right here if nobody else is. Throws if it can't be
+	// built - and tries again next time, so a fixed shader gets picked up
+	vk::Pipeline Get(const GraphicsPipelineKey& key);
+
+	// Never blocks - returns the pipeline if it's ready, otherwise kicks off compiling it in the
+	// background (if it isn't already) and returns a null handle, so skip or substitute the draw.
+	// One that fails to build says why on the next Request, and stays null until Get or a reload fixes it
+	vk::Pipeline Request(const GraphicsPipelineKey& key);
+
+	// The same again, for compute
+	vk::Pipeline GetCompute(const ComputePipelineKey& key);
+	vk::Pipeline RequestCompute(const ComputePipelineKey& key);
+
+	// Forgets every pipeline built against a render pass, once the GPU's done with them
+	void Evict(vk::RenderPass renderPass);
+
+	// Rebuilds, in the background, every pipeline using a shader that's changed on disk. One that no
+	// longer compiles just logs why and keeps its old pipeline
+	void ReloadChangedShaders();
+
+	// Call once a frame, after waiting on the frame - destroys pipelines replaced by reloads
+	// once no frame in flight could still be using them
+	void CollectRetired();
+
+	inline uint32_t GetPipelineCount() { std::lock_guard<std::mutex> lock(m_Mutex); return static_cast<uint32_t>(m_Pipelines.size() + m_ComputePipelines.size()); }
+
+private:
+	struct Entry
+	{
+		vk::UniquePipeline pipeline;
+		bool bReady = false;
+		bool bCompiling = false;
+		std::string sError;		// Why the last build failed, empty if it didn't
+		bool bReported = false;	// Whether a Request has passed sError on yet
+	};
+	template<typename Key> struct KeyHash { size_t operator()(const Key& key) const { return key.Hash(); } };
+	template<typename Key> using PipelineMap = std::unordered_map<Key, std::unique_ptr<Entry>, KeyHash<Key>>;
+
+	template<typename Key> vk::Pipeline GetFrom(PipelineMap<Key>& pipelines, const Key& key);
+	template<typename Key> vk::Pipeline RequestFrom(PipelineMap<Key>& pipelines, const Key& key);
+	template<typename Key> void ScheduleReloads(PipelineMap<Key>& pipelines, const std::vector<std::string>& vChanged);
+
+	// Compile, but on failure the entry's marked as failed and anyone waiting on it woken, rather than left compiling
+	template<typename Key> bool TryCompile(const Key& key, Entry& entry, std::string& sError);
+
+	// Build the pipeline and mark the entry as ready, with the lock not held
+	void Compile(const GraphicsPipelineKey& key, Entry& entry);
+	void Compile(const ComputePipelineKey& key, Entry& entry);
+	vk::Pipeline FindParent(size_t nFamily);
+	void Finish(size_t nFamily, Entry& entry, vk::UniquePipeline pipeline);
+	vk::UniqueShaderModule CreateShaderModule(const std::string& sFilename);
+
+	vk::Device m_Device;
+	vk::PipelineCache m_PipelineCache;
+	ShaderCompiler& m_ShaderCompiler;
+	JobSystem& m_JobSystem;
+	JobCounter m_BackgroundJobs;
+	uint32_t m_nFramesInFlight;
+
+	PipelineMap<GraphicsPipelineKey> m_Pipelines;
+	PipelineMap<ComputePipelineKey> m_ComputePipelines;
+	std::unordered_map<size_t, vk::Pipeline> m_FamilyParents; // The first of each family to be built
+	std::vector<std::pair<uint32_t, vk::UniquePipeline>> m_vRetired; // With how many more frames they must live
+	std::mutex m_Mutex;
+	std::condition_variable m_Compiled;
+};
+
+#endif
@@ -0,0 +1,657 @@
+#include "RenderGraph.h"
+#include <algorithm>
+
+namespace
+{
+	// Render pass structs are all 32 bit fields, so there's no padding to worry about hashing them as bytes
+	template<typename T> void HashBytes(size_t& nHash, const std::vector<T>& vItems)
+	{
+		uint64_t nValue = nHash ^ vItems.size();
+		const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(vItems.data());
+		for (size_t i = 0; i < vItems.size() * sizeof(T); ++i)
+		{
+			nValue ^= pBytes[i];
+			nValue *= 0x100000001b3ull;
+		}
+		nHash = static_cast<size_t>(nValue);
+	}
+
+	const vk::AccessFlags writeAccess =	vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+										vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+}
+
+bool RenderPassCache::Key::operator==(const Key& other) const
+{
+	return	vAttachments == other.vAttachments && vColourReferences == other.vColourReferences && vResolveReferences == other.vResolveReferences &&
+			depthReference == other.depthReference && vDependencies == other.vDependencies;
+}
+
+size_t RenderPassCache::Key::Hash() const
+{
+	size_t nHash = 0;
+	HashBytes(nHash, vAttachments);
+	HashBytes(nHash, vColourReferences);
+	HashBytes(nHash, vResolveReferences);
+	HashBytes(nHash, std::vector<vk::AttachmentReference>{ depthReference });
+	HashBytes(nHash, vDependencies);
+	return nHash;
+}
+
+vk::RenderPass RenderPassCache::Get(const Key& key)
+{
+	auto it = m_RenderPasses.find(key);
+	if (it != m_RenderPasses.end()) return it->second.get();
+
+	vk::SubpassDescription subpass{};
+	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+	subpass.colorAttachmentCount = static_cast<uint32_t>(key.vColourReferences.size());
+	subpass.pColorAttachments = key.vColourReferences.data();
+	subpass.pResolveAttachments = key.vResolveReferences.empty() ? nullptr : key.vResolveReferences.data();
+	subpass.pDepthStencilAttachment = key.depthReference.attachment != VK_ATTACHMENT_UNUSED ? &key.depthReference : nullptr;
+
+	vk::RenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(key.vAttachments.size());
+	renderPassInfo.pAttachments = key.vAttachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(key.vDependencies.size());
+	renderPassInfo.pDependencies = key.vDependencies.data();
+
+	vk::UniqueRenderPass renderPass = m_Device.createRenderPassUnique(renderPassInfo);
+	return m_RenderPasses.emplace(key, std::move(renderPass)).first->second.get();
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Colour(GraphResource resource, vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue)
+{
+	Use use{ resource, ResourceUsage::eColourAttachment, true, loadOp, clearValue };
+	m_Graph.AddUse(m_nPass, use);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Depth(GraphResource resource, vk::AttachmentLoadOp loadOp, vk::ClearValue clearValue)
+{
+	Use use{ resource, ResourceUsage::eDepthAttachment, true, loadOp, clearValue };
+	m_Graph.AddUse(m_nPass, use);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Resolve(GraphResource resource)
+{
+	// Find the colour attachment it's for
+	const std::vector<Use>& vUses = m_Graph.m_vPasses[m_nPass].vUses;
+	uint32_t nColour = VK_ATTACHMENT_UNUSED;
+	for (uint32_t i = 0; i < vUses.size(); ++i) if (vUses[i].usage == ResourceUsage::eColourAttachment) nColour = i;
+	if (nColour == VK_ATTACHMENT_UNUSED) throw std::runtime_error("Resolve without a colour attachment to resolve!");
+
+	Use use{ resource, ResourceUsage::eResolveAttachment, true, vk::AttachmentLoadOp::eDontCare };
+	use.nResolveOf = nColour;
+	m_Graph.AddUse(m_nPass, use);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(GraphResource resource, ResourceUsage usage)
+{
+	m_Graph.AddUse(m_nPass, Use{ resource, usage });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(GraphResource resource, ResourceUsage usage)
+{
+	m_Graph.AddUse(m_nPass, Use{ resource, usage });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SecondaryCommandBuffers()
+{
+	m_Graph.m_vPasses[m_nPass].bSecondaryCommandBuffers = true;
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SideEffects()
+{
+	m_Graph.m_vPasses[m_nPass].bSideEffects = true;
+	return *this;
+}
+
+RenderGraph::RenderGraph(MemoryAllocator& allocator, vk::Device device, RenderPassCache& renderPassCache, vk::Extent2D extent)
+	: m_Allocator(allocator), m_Device(device), m_RenderPassCache(renderPassCache), m_Extent(extent)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	// Images before the memory they're in
+	m_vPasses.clear();
+	m_vResources.clear();
+	for (MemoryAllocation& slot : m_vSlots) m_Allocator.Free(slot);
+}
+
+GraphResource RenderGraph::ImportImage(const std::string& sName, vk::Format format, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags readyStage)
+{
+	Resource resource;
+	resource.sName = sName;
+	resource.bImported = true;
+	resource.format = format;
+	resource.initialLayout = initialLayout;
+	resource.finalLayout = finalLayout;
+	resource.readyStage = readyStage;
+	m_vResources.push_back(std::move(resource));
+	return static_cast<GraphResource>(m_vResources.size() - 1);
+}
+
+GraphResource RenderGraph::ImportBuffer(const std::string& sName)
+{
+	Resource resource;
+	resource.sName = sName;
+	resource.bImported = true;
+	resource.bBuffer = true;
+	resource.readyStage = vk::PipelineStageFlagBits::eTopOfPipe; // Waiting on frames has it covered
+	m_vResources.push_back(std::move(resource));
+	return static_cast<GraphResource>(m_vResources.size() - 1);
+}
+
+GraphResource RenderGraph::CreateImage(const std::string& sName, vk::Format format, vk::SampleCountFlagBits samples)
+{
+	Resource resource;
+	resource.sName = sName;
+	resource.format = format;
+	resource.samples = samples;
+	m_vResources.push_back(std::move(resource));
+	return static_cast<GraphResource>(m_vResources.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const std::string& sName, PassType type, Recorder recorder)
+{
+	Pass pass;
+	pass.sName = sName;
+	pass.type = type;
+	pass.recorder = std::move(recorder);
+	m_vPasses.push_back(std::move(pass));
+	return PassBuilder(*this, static_cast<GraphPass>(m_vPasses.size() - 1));
+}
+
+RenderGraph::Pass& RenderGraph::AddUse(GraphPass nPass, const Use& use)
+{
+	Pass& pass = m_vPasses[nPass];
+	if (use.bAttachment && pass.type != PassType::eGraphics) throw std::runtime_error("Attachments are only for graphics passes!");
+	pass.vUses.push_back(use);
+	return pass;
+}
+
+void RenderGraph::MarkOutput(GraphResource resource)
+{
+	m_vResources[resource].bOutput = true;
+}
+
+void RenderGraph::SetImage(GraphResource resource, vk::Image image, vk::ImageView view)
+{
+	m_vResources[resource].image = image;
+	m_vResources[resource].view = view;
+}
+
+void RenderGraph::SetBuffer(GraphResource resource, vk::Buffer buffer)
+{
+	m_vResources[resource].buffer = buffer;
+}
+
+RenderGraph::UsageInfo RenderGraph::GetUsageInfo(const Use& use, PassType type)
+{
+	vk::PipelineStageFlags shaderStages = type == PassType::eGraphics ?	vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader :
+																		vk::PipelineStageFlags(vk::PipelineStageFlagBits::eComputeShader);
+	vk::AccessFlags attachmentRead = use.loadOp == vk::AttachmentLoadOp::eLoad ? vk::AccessFlagBits::eColorAttachmentRead : vk::AccessFlags{};
+
+	switch (use.usage)
+	{
+	case ResourceUsage::eColourAttachment:
+		return { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite | attachmentRead,
+				 vk::ImageLayout::eColorAttachmentOptimal, vk::ImageUsageFlagBits::eColorAttachment, true };
+	case ResourceUsage::eDepthAttachment:
+		return { vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+				 vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+				 vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, true };
+	case ResourceUsage::eResolveAttachment:
+		return { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentWrite,
+				 vk::ImageLayout::eColorAttachmentOptimal, vk::ImageUsageFlagBits::eColorAttachment, true };
+	case ResourceUsage::eSampled:
+		return { shaderStages, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled, false };
+	case ResourceUsage::eStorageRead:
+		return { shaderStages, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, false };
+	case ResourceUsage::eStorageWrite:
+		return { shaderStages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage, true };
+	case ResourceUsage::eIndirectRead:
+		return { vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, vk::ImageLayout::eUndefined, vk::ImageUsageFlags{}, false };
+	case ResourceUsage::eTransferSrc:
+		return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageUsageFlagBits::eTransferSrc, false };
+	case ResourceUsage::eTransferDst:
+		return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageUsageFlagBits::eTransferDst, true };
+	}
+	return {};
+}
+
+vk::ImageAspectFlags RenderGraph::GetAspect(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eD16Unorm:
+	case vk::Format::eD32Sfloat:
+	case vk::Format::eX8D24UnormPack32:
+		return vk::ImageAspectFlagBits::eDepth;
+	case vk::Format::eD16UnormS8Uint:
+	case vk::Format::eD24UnormS8Uint:
+	case vk::Format::eD32SfloatS8Uint:
+		return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+	default:
+		return vk::ImageAspectFlagBits::eColor;
+	}
+}
+
+void RenderGraph::Compile()
+{
+	CullPasses();
+	CreateTransientImages();
+
+	// Imported resources start each frame as declared, but transient images carry on from the
+	// frame before - so walk the frame once to find how it leaves them, then again for real
+	std::vector<State> vInitial(m_vResources.size() + m_vSlots.size());
+	for (GraphResource i = 0; i < m_vResources.size(); ++i)
+	{
+		if (!m_vResources[i].bImported) continue;
+		vInitial[i].occupant = i;
+		vInitial[i].layout = m_vResources[i].initialLayout;
+		vInitial[i].stages = m_vResources[i].readyStage;
+	}
+
+	std::vector<State> vStates = vInitial;
+	Simulate(vStates, false);
+	std::copy(vStates.begin() + m_vResources.size(), vStates.end(), vInitial.begin() + m_vResources.size());
+	Simulate(vInitial, true);
+
+	m_bCompiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Work back from the outputs - a pass is needed if it writes something needed, and then so is everything it reads
+	std::vector<bool> vNeeded(m_vResources.size());
+	for (GraphResource i = 0; i < m_vResources.size(); ++i) vNeeded[i] = m_vResources[i].bOutput;
+
+	for (size_t i = m_vPasses.size(); i-- > 0;)
+	{
+		Pass& pass = m_vPasses[i];
+		pass.bCulled = !pass.bSideEffects;
+		for (const Use& use : pass.vUses) if (GetUsageInfo(use, pass.type).bWrite && vNeeded[use.resource]) pass.bCulled = false;
+		if (pass.bCulled) continue;
+
+		for (const Use& use : pass.vUses)
+		{
+			bool bReads = use.bAttachment ? use.loadOp == vk::AttachmentLoadOp::eLoad : !GetUsageInfo(use, pass.type).bWrite || use.usage == ResourceUsage::eStorageWrite;
+			if (bReads) vNeeded[use.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::CreateTransientImages()
+{
+	struct Slot
+	{
+		vk::MemoryRequirements requirements;
+		bool bLazy;
+		std::vector<std::pair<uint32_t, uint32_t>> vLifetimes; // First and last pass using each image in it
+	};
+	std::vector<Slot> vSlots;
+
+	// Gather up what each transient image is used for and when
+	std::vector<vk::ImageUsageFlags> vUsage(m_vResources.size());
+	std::vector<bool> vAttachmentOnly(m_vResources.size(), true);
+	std::vector<std::pair<uint32_t, uint32_t>> vLifetimes(m_vResources.size(), { UINT32_MAX, 0 });
+	for (uint32_t i = 0; i < m_vPasses.size(); ++i)
+	{
+		if (m_vPasses[i].bCulled) continue;
+		for (const Use& use : m_vPasses[i].vUses)
+		{
+			vUsage[use.resource] |= GetUsageInfo(use, m_vPasses[i].type).imageUsage;
+			vAttachmentOnly[use.resource] = vAttachmentOnly[use.resource] && use.bAttachment;
+			vLifetimes[use.resource].first = std::min(vLifetimes[use.resource].first, i);
+			vLifetimes[use.resource].second = std::max(vLifetimes[use.resource].second, i);
+		}
+	}
+
+	std::vector<GraphResource> vTransients;
+	for (GraphResource i = 0; i < m_vResources.size(); ++i)
+	{
+		Resource& resource = m_vResources[i];
+		if (resource.bImported || vLifetimes[i].first == UINT32_MAX) continue; // Culled along with everything using it
+
+		// Only ever being an attachment means it never has to leave tile memory, so may not need memory at all
+		vk::ImageCreateInfo imageInfo{};
+		imageInfo.imageType = vk::ImageType::e2D;
+		imageInfo.format = resource.format;
+		imageInfo.extent = vk::Extent3D(m_Extent.width, m_Extent.height, 1);
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = resource.samples;
+		imageInfo.tiling = vk::ImageTiling::eOptimal;
+		imageInfo.usage = vUsage[i] | (vAttachmentOnly[i] ? vk::ImageUsageFlagBits::eTransientAttachment : vk::ImageUsageFlags{});
+		imageInfo.sharingMode = vk::SharingMode::eExclusive;
+		imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+		resource.ownedImage = m_Device.createImageUnique(imageInfo);
+		resource.image = resource.ownedImage.get();
+		vTransients.push_back(i);
+	}
+
+	// Biggest first, each into the first slot whose images are never alive at the same time as it
+	std::vector<vk::MemoryRequirements> vRequirements(m_vResources.size());
+	for (GraphResource i : vTransients) vRequirements[i] = m_Device.getImageMemoryRequirements(m_vResources[i].image);
+	std::sort(vTransients.begin(), vTransients.end(), [&vRequirements](GraphResource a, GraphResource b) { return vRequirements[a].size > vRequirements[b].size; });
+
+	for (GraphResource i : vTransients)
+	{
+		const vk::MemoryRequirements& requirements = vRequirements[i];
+		bool bLazy = vAttachmentOnly[i];
+		auto overlaps = [&vLifetimes, i](const std::pair<uint32_t, uint32_t>& lifetime) { return lifetime.first <= vLifetimes[i].second && vLifetimes[i].first <= lifetime.second; };
+
+		uint32_t nSlot = 0;
+		for (; nSlot < vSlots.size(); ++nSlot)
+		{
+			Slot& slot = vSlots[nSlot];
+			if (slot.bLazy != bLazy || !(slot.requirements.memoryTypeBits & requirements.memoryTypeBits)) continue;
+			if (std::none_of(slot.vLifetimes.begin(), slot.vLifetimes.end(), overlaps)) break;
+		}
+		if (nSlot == vSlots.size()) vSlots.push_back({ requirements, bLazy, {} });
+
+		Slot& slot = vSlots[nSlot];
+		slot.requirements.size = std::max(slot.requirements.size, requirements.size);
+		slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+		slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+		slot.vLifetimes.push_back(vLifetimes[i]);
+		m_vResources[i].nSlot = nSlot;
+	}
+
+	// Lazily allocated memory is only committed on tiled GPUs if an attachment spills out of tile memory
+	for (const Slot& slot : vSlots)
+		m_vSlots.push_back(m_Allocator.Allocate(slot.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+												slot.bLazy ? vk::MemoryPropertyFlagBits::eLazilyAllocated : vk::MemoryPropertyFlags{}, false));
+
+	for (GraphResource i : vTransients)
+	{
+		Resource& resource = m_vResources[i];
+		const MemoryAllocation& slot = m_vSlots[resource.nSlot];
+		m_Device.bindImageMemory(resource.image, slot.memory, slot.offset);
+
+		vk::ImageViewCreateInfo viewInfo{};
+		viewInfo.image = resource.image;
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.format = resource.format;
+		viewInfo.subresourceRange = vk::ImageSubresourceRange(GetAspect(resource.format), 0, 1, 0, 1);
+		resource.ownedView = m_Device.createImageViewUnique(viewInfo);
+		resource.view = resource.ownedView.get();
+	}
+}
+
+void RenderGraph::Simulate(std::vector<State>& vStates, bool bRecord)
+{
+	// Transient images share their state with whatever else is aliased into the same memory
+	auto stateOf = [this, &vStates](GraphResource resource) -> State&
+	{
+		return m_vResources[resource].bImported ? vStates[resource] : vStates[m_vResources.size() + m_vResources[resource].nSlot];
+	};
+
+	// Whether anything reads what's left in an attachment - the next use of its memory, this frame or the next
+	auto needsStoring = [this](uint32_t nPass, GraphResource resource)
+	{
+		if (m_vResources[resource].bImported) return true;
+		for (uint32_t i = 1; i <= m_vPasses.size(); ++i)
+		{
+			const Pass& pass = m_vPasses[(nPass + i) % m_vPasses.size()];
+			if (pass.bCulled) continue;
+			for (const Use& use : pass.vUses)
+			{
+				if (m_vResources[use.resource].bImported || m_vResources[use.resource].nSlot != m_vResources[resource].nSlot) continue;
+				return use.resource == resource && !(use.bAttachment && use.loadOp != vk::AttachmentLoadOp::eLoad);
+			}
+		}
+		return false;
+	};
+
+	// A write starts over what it's visible to, whereas anything else is only made visible to what it does
+	auto settle = [](State& state, GraphResource resource, vk::ImageLayout layout, const UsageInfo& info)
+	{
+		state.occupant = resource;
+		state.layout = layout;
+		state.stages = info.stages;
+		if (info.bWrite)
+		{
+			state.writeAccess = info.access & writeAccess;
+			state.writeStages = info.stages;
+			state.visibleStages = vk::PipelineStageFlags{};
+			state.visibleAccess = vk::AccessFlags{};
+		}
+		else
+		{
+			state.visibleStages = info.stages;
+			state.visibleAccess = info.access;
+		}
+	};
+
+	std::vector<uint32_t> vLastPass(m_vResources.size(), UINT32_MAX);
+	for (uint32_t i = 0; i < m_vPasses.size(); ++i) if (!m_vPasses[i].bCulled) for (const Use& use : m_vPasses[i].vUses) vLastPass[use.resource] = i;
+
+	for (uint32_t nPass = 0; nPass < m_vPasses.size(); ++nPass)
+	{
+		Pass& pass = m_vPasses[nPass];
+		if (pass.bCulled) continue;
+
+		BarrierBatch batch;
+		RenderPassCache::Key key;
+		vk::SubpassDependency dependency = vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0);
+		std::vector<uint32_t> vAttachmentIndex(pass.vUses.size(), VK_ATTACHMENT_UNUSED);
+		pass.vClearValues.clear();
+
+		for (uint32_t nUse = 0; nUse < pass.vUses.size(); ++nUse)
+		{
+			const Use& use = pass.vUses[nUse];
+			const Resource& resource = m_vResources[use.resource];
+			UsageInfo info = GetUsageInfo(use, pass.type);
+			State& state = stateOf(use.resource);
+
+			// Anything else having been in its memory, or being cleared, means the old contents can go
+			bool bDiscard = !resource.bBuffer && (state.occupant != use.resource || (use.bAttachment && use.loadOp != vk::AttachmentLoadOp::eLoad));
+			vk::ImageLayout oldLayout = bDiscard ? vk::ImageLayout::eUndefined : state.layout;
+
+			if (use.bAttachment)
+			{
+				// Attachments transition through their render pass, and wait on their last use with its external dependency
+				bool bLast = vLastPass[use.resource] == nPass && resource.bImported && resource.finalLayout != vk::ImageLayout::eUndefined;
+				bool bStore = needsStoring(nPass, use.resource);
+				vk::AttachmentDescription attachment{};
+				attachment.format = resource.format;
+				attachment.samples = resource.samples;
+				attachment.loadOp = use.loadOp;
+				attachment.storeOp = bStore ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+				bool bStencil = static_cast<bool>(GetAspect(resource.format) & vk::ImageAspectFlagBits::eStencil);
+				attachment.stencilLoadOp = bStencil ? use.loadOp : vk::AttachmentLoadOp::eDontCare;
+				attachment.stencilStoreOp = bStencil ? attachment.storeOp : vk::AttachmentStoreOp::eDontCare;
+				attachment.initialLayout = oldLayout;
+				attachment.finalLayout = bLast ? resource.finalLayout : info.layout;
+
+				vAttachmentIndex[nUse] = static_cast<uint32_t>(key.vAttachments.size());
+				key.vAttachments.push_back(attachment);
+				pass.vClearValues.push_back(use.clearValue);
+
+				dependency.srcStageMask |= state.stages;
+				dependency.srcAccessMask |= state.writeAccess;
+				dependency.dstStageMask |= info.stages;
+				dependency.dstAccessMask |= info.access;
+
+				settle(state, use.resource, attachment.finalLayout, info);
+				continue;
+			}
+
+			// Reads after reads in the same layout needn't wait on each other, but whatever writes next waits for them all
+			bool bLayoutChange = !resource.bBuffer && oldLayout != info.layout;
+			vk::ImageLayout newLayout = resource.bBuffer ? vk::ImageLayout::eUndefined : info.layout;
+			if (!info.bWrite && !bLayoutChange)
+			{
+				// Though the last write still has to be made visible to each stage and access type that hasn't seen it yet -
+				// along with everything that has, so this one barrier covers every pairing of the two. Waiting on those
+				// too chains on from any layout change since the write
+				bool bVisible = (state.visibleStages & info.stages) == info.stages && (state.visibleAccess & info.access) == info.access;
+				if (state.writeAccess && !bVisible)
+				{
+					batch.srcStages |= state.writeStages | state.visibleStages;
+					state.visibleStages |= info.stages;
+					state.visibleAccess |= info.access;
+					batch.dstStages |= state.visibleStages;
+					batch.vBarriers.push_back({ use.resource, oldLayout, newLayout, state.writeAccess, state.visibleAccess });
+				}
+				state.stages |= info.stages;
+				continue;
+			}
+
+			batch.srcStages |= state.stages;
+			batch.dstStages |= info.stages;
+			batch.vBarriers.push_back({ use.resource, oldLayout, newLayout, state.writeAccess, info.access });
+			settle(state, use.resource, info.layout, info);
+		}
+
+		if (!bRecord) continue;
+		pass.barriers = std::move(batch);
+		if (pass.type != PassType::eGraphics) continue;
+
+		// One subpass, with everything added in the order the pass declared it
+		for (uint32_t nUse = 0; nUse < pass.vUses.size(); ++nUse)
+		{
+			const Use& use = pass.vUses[nUse];
+			vk::AttachmentReference reference = vk::AttachmentReference(vAttachmentIndex[nUse], GetUsageInfo(use, pass.type).layout);
+			if (use.usage == ResourceUsage::eColourAttachment) key.vColourReferences.push_back(reference);
+			else if (use.usage == ResourceUsage::eDepthAttachment) key.depthReference = reference;
+		}
+		for (uint32_t nUse = 0; nUse < pass.vUses.size(); ++nUse)
+		{
+			const Use& use = pass.vUses[nUse];
+			if (use.usage != ResourceUsage::eResolveAttachment) continue;
+
+			// pResolveAttachments has an entry for every colour attachment, resolved or not
+			key.vResolveReferences.resize(key.vColourReferences.size(), vk::AttachmentReference(VK_ATTACHMENT_UNUSED));
+			uint32_t nColour = 0;
+			for (uint32_t i = 0; i < use.nResolveOf; ++i) if (pass.vUses[i].usage == ResourceUsage::eColourAttachment) ++nColour;
+			key.vResolveReferences[nColour] = vk::AttachmentReference(vAttachmentIndex[nUse], vk::ImageLayout::eColorAttachmentOptimal);
+		}
+
+		if (!dependency.srcStageMask) dependency.srcStageMask = vk::PipelineStageFlagBits::eTopOfPipe;
+		key.vDependencies.push_back(dependency);
+		pass.renderPass = m_RenderPassCache.Get(key);
+	}
+
+	if (!bRecord) return;
+
+	// Leave imported images how the outside world wants them
+	m_FinalBarriers = BarrierBatch{};
+	for (GraphResource i = 0; i < m_vResources.size(); ++i)
+	{
+		const Resource& resource = m_vResources[i];
+		if (!resource.bImported || resource.bBuffer || resource.finalLayout == vk::ImageLayout::eUndefined) continue;
+
+		State& state = vStates[i];
+		if (state.layout == resource.finalLayout) continue;
+		m_FinalBarriers.srcStages |= state.stages;
+		m_FinalBarriers.dstStages |= vk::PipelineStageFlagBits::eBottomOfPipe;
+		m_FinalBarriers.vBarriers.push_back({ i, state.layout, resource.finalLayout, state.writeAccess, vk::AccessFlags{} });
+	}
+}
+
+vk::RenderPass RenderGraph::GetRenderPass(GraphPass nPass) const
+{
+	return m_vPasses[nPass].renderPass;
+}
+
+vk::Framebuffer RenderGraph::GetFramebuffer(GraphPass nPass)
+{
+	Pass& pass = m_vPasses[nPass];
+	if (pass.type != PassType::eGraphics || pass.bCulled) return vk::Framebuffer{};
+
+	std::vector<vk::ImageView> vAttachments;
+	std::vector<VkImageView> vViews;
+	for (const Use& use : pass.vUses)
+	{
+		if (!use.bAttachment) continue;
+		vAttachments.push_back(m_vResources[use.resource].view);
+		vViews.push_back(static_cast<VkImageView>(m_vResources[use.resource].view));
+	}
+
+	auto it = pass.framebuffers.find(vViews);
+	if (it != pass.framebuffers.end()) return it->second.get();
+
+	vk::FramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.renderPass = pass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(vAttachments.size());
+	framebufferInfo.pAttachments = vAttachments.data();
+	framebufferInfo.width = m_Extent.width;
+	framebufferInfo.height = m_Extent.height;
+	framebufferInfo.layers = 1;
+	vk::UniqueFramebuffer framebuffer = m_Device.createFramebufferUnique(framebufferInfo);
+	return pass.framebuffers.emplace(vViews, std::move(framebuffer)).first->second.get();
+}
+
+void RenderGraph::RecordBarriers(vk::CommandBuffer commandBuffer, const BarrierBatch& batch)
+{
+	if (batch.vBarriers.empty()) return;
+
+	std::vector<vk::ImageMemoryBarrier> vImageBarriers;
+	std::vector<vk::BufferMemoryBarrier> vBufferBarriers;
+	for (const Barrier& barrier : batch.vBarriers)
+	{
+		const Resource& resource = m_vResources[barrier.resource];
+		if (resource.bBuffer)
+		{
+			vBufferBarriers.push_back(vk::BufferMemoryBarrier(	barrier.srcAccess, barrier.dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+																resource.buffer, 0, VK_WHOLE_SIZE));
+		}
+		else
+		{
+			vImageBarriers.push_back(vk::ImageMemoryBarrier(barrier.srcAccess, barrier.dstAccess, barrier.oldLayout, barrier.newLayout,
+															VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, resource.image,
+															vk::ImageSubresourceRange(GetAspect(resource.format), 0, 1, 0, 1)));
+		}
+	}
+
+	vk::PipelineStageFlags srcStages = batch.srcStages ? batch.srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+	commandBuffer.pipelineBarrier(srcStages, batch.dstStages, vk::DependencyFlags{}, nullptr, vBufferBarriers, vImageBarriers);
+}
+
+void RenderGraph::Execute(vk::CommandBuffer commandBuffer, GpuProfiler* pProfiler)
+{
+	if (!m_bCompiled) throw std::runtime_error("Render graph executed before it was compiled!");
+
+	for (GraphPass i = 0; i < m_vPasses.size(); ++i)
+	{
+		Pass& pass = m_vPasses[i];
+		if (pass.bCulled) continue;
+
+		if (pProfiler) pProfiler->BeginPass(commandBuffer, pass.sName);
+		RecordBarriers(commandBuffer, pass.barriers);
+
+		PassContext context{ commandBuffer };
+		if (pass.type == PassType::eGraphics)
+		{
+			context.renderPass = pass.renderPass;
+			context.framebuffer = GetFramebuffer(i);
+
+			vk::RenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.renderPass = context.renderPass;
+			renderPassInfo.framebuffer = context.framebuffer;
+			renderPassInfo.renderArea = vk::Rect2D({ 0, 0 }, m_Extent);
+			renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.vClearValues.size());
+			renderPassInfo.pClearValues = pass.vClearValues.data();
+
+			commandBuffer.beginRenderPass(renderPassInfo, pass.bSecondaryCommandBuffers ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+			pass.recorder(context);
+			commandBuffer.endRenderPass();
+		}
+		else pass.recorder(context);
+
+		if (pProfiler) pProfiler->EndPass(commandBuffer);
+	}
+
+	RecordBarriers(commandBuffer, m_FinalBarriers);
+}
@@ -0,0 +1,251 @@
+#pragma once
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+#include "GpuProfiler.h"
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+
+using GraphResource = uint32_t;
+using GraphPass = uint32_t;
+
+// How a pass uses a resource - the graph works out stages, access masks and layouts from these
+enum class ResourceUsage
+{
+	eColourAttachment,	// Graphics passes only, through PassBuilder::Colour/Depth/Resolve
+	eDepthAttachment,
+	eResolveAttachment,
+	eSampled,			// Read through a sampler or texelFetch, in whichever shader stages the pass has
+	eStorageRead,
+	eStorageWrite,
+	eIndirectRead,		// Draw or dispatch arguments
+	eTransferSrc,
+	eTransferDst
+};
+
+enum class PassType
+{
+	eGraphics, // Recorded inside a render pass the graph builds from the pass' attachments
+	eCompute,
+	eTransfer
+};
+
+// Render passes keyed on their attachments, subpass and dependencies - graphs get rebuilt on every
+// resize, but as long as the formats don't change their render passes (and so the pipelines made
+// against them) stay the same
+class RenderPassCache
+{
+public:
+	struct Key
+	{
+		std::vector<vk::AttachmentDescription> vAttachments;
+		std::vector<vk::AttachmentReference> vColourReferences;
+		std::vector<vk::AttachmentReference> vResolveReferences; // Empty, or one per colour reference
+		vk::AttachmentReference depthReference = vk::AttachmentReference(VK_ATTACHMENT_UNUSED);
+		std::vector<vk::SubpassDependency> vDependencies;
+
+		bool operator==(const Key& other) const;
+		size_t Hash() const;
+	};
+
+	RenderPassCache(vk::Device device) : m_Device(device) {}
+	vk::RenderPass Get(const Key& key); // Render thread only
+
+private:
+	struct KeyHash { size_t operator()(const Key& key) const { return key.Hash(); } };
+
+	vk::Device m_Device;
+	std::unordered_map<Key, vk::UniqueRenderPass, KeyHash> m_RenderPasses;
+};
+
+// Frame graph - passes declare what they read and write, and Compile() orders the barriers and
+// layout transitions between them (the ones between attachments folded into their render passes'
+// layouts and subpass dependencies), culls passes whose results nothing uses, decides which
+// attachments need storing, and aliases the memory of transient images whose lifetimes don't
+// overlap. Declare everything, Compile() once, then Execute() every frame - rebuild it (retiring
+// the old one until frames in flight are done with it) whenever the frame's shape changes.
+// Transient images are shared by every frame in flight: they're also ordered against their use
+// in the frame before, like a single depth buffer would be
+class RenderGraph
+{
+public:
+	struct PassContext
+	{
+		vk::CommandBuffer commandBuffer;
+		vk::RenderPass renderPass;		// Graphics passes only, begun already
+		vk::Framebuffer framebuffer;
+	};
+	using Recorder = std::function<void(const PassContext& context)>;
+
+	class PassBuilder
+	{
+	public:
+		PassBuilder& Colour(GraphResource resource, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear, vk::ClearValue clearValue = vk::ClearValue{});
+		PassBuilder& Depth(GraphResource resource, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear, vk::ClearValue clearValue = vk::ClearDepthStencilValue(1.0f, 0));
+		PassBuilder& Resolve(GraphResource resource); // Resolves the last Colour() into it at the end of the pass
+		PassBuilder& Read(GraphResource resource, ResourceUsage usage);
+		PassBuilder& Write(GraphResource resource, ResourceUsage usage);
+		PassBuilder& SecondaryCommandBuffers(); // The recorder only executes secondaries, see GetRenderPass/GetFramebuffer
+		PassBuilder& SideEffects(); // Never culled - for passes whose results live outside the graph, and look after their own barriers
+		inline GraphPass Get() const { return m_nPass; }
+
+	private:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& graph, GraphPass nPass) : m_Graph(graph), m_nPass(nPass) {}
+
+		RenderGraph& m_Graph;
+		GraphPass m_nPass;
+	};
+
+	RenderGraph(MemoryAllocator& allocator, vk::Device device, RenderPassCache& renderPassCache, vk::Extent2D extent);
+	~RenderGraph();
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	// Imported resources live outside the graph, and are bound every frame with SetImage/SetBuffer.
+	// Images are waited for at readyStage (where the submit waits on their semaphore, say) and left in finalLayout
+	GraphResource ImportImage(	const std::string& sName, vk::Format format, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout,
+								vk::PipelineStageFlags readyStage = vk::PipelineStageFlagBits::eColorAttachmentOutput);
+	GraphResource ImportBuffer(const std::string& sName);
+
+	// Transient images are made by the graph at its extent, and only exist within a frame
+	GraphResource CreateImage(const std::string& sName, vk::Format format, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+
+	PassBuilder AddPass(const std::string& sName, PassType type, Recorder recorder);
+
+	// Passes are kept only if what they write ends up in one of these, imported ones included
+	void MarkOutput(GraphResource resource);
+
+	void Compile();
+
+	// Per frame, for imported resources, before GetFramebuffer or Execute
+	void SetImage(GraphResource resource, vk::Image image, vk::ImageView view);
+	void SetBuffer(GraphResource resource, vk::Buffer buffer);
+
+	// For graphics passes, once compiled - for pipelines and secondary command buffer inheritance
+	vk::RenderPass GetRenderPass(GraphPass nPass) const;
+	vk::Framebuffer GetFramebuffer(GraphPass nPass);
+
+	void Execute(vk::CommandBuffer commandBuffer, GpuProfiler* pProfiler = nullptr);
+
+	inline bool IsCulled(GraphPass nPass) const { return m_vPasses[nPass].bCulled; }
+	inline vk::ImageView GetImageView(GraphResource resource) const { return m_vResources[resource].view; } // Transient images, once compiled
+	inline vk::Extent2D GetExtent() const { return m_Extent; }
+
+private:
+	struct Resource
+	{
+		std::string sName;
+		bool bImported = false;
+		bool bBuffer = false;
+		bool bOutput = false;
+		vk::Format format = vk::Format::eUndefined;
+		vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+		vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+		vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+		vk::PipelineStageFlags readyStage;
+
+		// Bound for imported ones, made by Compile() for transient ones
+		vk::Image image;
+		vk::ImageView view;
+		vk::Buffer buffer;
+		vk::UniqueImage ownedImage;
+		vk::UniqueImageView ownedView;
+		uint32_t nSlot = 0; // Which memory slot a transient image is aliased into
+	};
+
+	struct Use
+	{
+		GraphResource resource;
+		ResourceUsage usage;
+		bool bAttachment = false;
+		vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eDontCare;
+		vk::ClearValue clearValue;
+		uint32_t nResolveOf = VK_ATTACHMENT_UNUSED; // Resolve attachments - index of the colour use they resolve
+	};
+
+	struct Barrier
+	{
+		GraphResource resource;
+		vk::ImageLayout oldLayout;
+		vk::ImageLayout newLayout;
+		vk::AccessFlags srcAccess;
+		vk::AccessFlags dstAccess;
+	};
+
+	struct BarrierBatch
+	{
+		vk::PipelineStageFlags srcStages;
+		vk::PipelineStageFlags dstStages;
+		std::vector<Barrier> vBarriers;
+	};
+
+	struct Pass
+	{
+		std::string sName;
+		PassType type;
+		Recorder recorder;
+		std::vector<Use> vUses;
+		bool bSecondaryCommandBuffers = false;
+		bool bSideEffects = false;
+		bool bCulled = false;
+
+		// From Compile()
+		BarrierBatch barriers; // Before the pass
+		vk::RenderPass renderPass;
+		std::vector<vk::ClearValue> vClearValues;
+		std::map<std::vector<VkImageView>, vk::UniqueFramebuffer> framebuffers; // Imported images' views change frame to frame
+	};
+
+	// Where a resource - or for transients, the memory slot it's in - was last left
+	struct State
+	{
+		GraphResource occupant = UINT32_MAX;
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+		vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eTopOfPipe;
+		vk::AccessFlags writeAccess; // What last wrote it, in writeStages
+		vk::PipelineStageFlags writeStages;
+		vk::PipelineStageFlags visibleStages; // Where, and to what, that write has been made visible since
+		vk::AccessFlags visibleAccess;
+	};
+
+	struct UsageInfo
+	{
+		vk::PipelineStageFlags stages;
+		vk::AccessFlags access;
+		vk::ImageLayout layout;
+		vk::ImageUsageFlags imageUsage;
+		bool bWrite;
+	};
+
+	Pass& AddUse(GraphPass nPass, const Use& use);
+	void CullPasses();
+	void CreateTransientImages();
+	void Simulate(std::vector<State>& vStates, bool bRecord);
+	static UsageInfo GetUsageInfo(const Use& use, PassType type);
+	static vk::ImageAspectFlags GetAspect(vk::Format format);
+	void RecordBarriers(vk::CommandBuffer commandBuffer, const BarrierBatch& batch);
+
+	MemoryAllocator& m_Allocator;
+	vk::Device m_Device;
+	RenderPassCache& m_RenderPassCache;
+	vk::Extent2D m_Extent;
+
+	std::vector<Resource> m_vResources;
+	std::vector<Pass> m_vPasses;
+	std::vector<MemoryAllocation> m_vSlots; // Memory transient images are aliased into
+	BarrierBatch m_FinalBarriers; // Into imported images' final layouts
+	bool m_bCompiled = false;
+};
+
+#endif
@@ -1,7 +1,13 @@
 #include "Renderer.h"
+#include "MeshConverter.h"
+#include "Arguments.h"
 #include <iostream>
 #include <set>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
 
 #ifdef _DEBUG
 	constexpr bool bEnableValidationLayers = true;
@@ -9,29 +15,60 @@
 	constexpr bool bEnableValidationLayers = false;
 #endif
 
-Renderer::Renderer(const uint32_t width, const uint32_t height) : m_Width(width), m_Height(height), m_Window(width, height, "HobbyVk")
+Renderer::Renderer(const uint32_t width, const uint32_t height, const RendererConfig& config)
+	: m_Width(width), m_Height(height), m_Config(config), m_Window(config.bHeadless ? nullptr : std::make_unique<Window>(width, height, "HobbyVk")), m_nFramesInFlight(std::max(1u, config.nFramesInFlight))
 {
 	InitVulkan();
 }
 
 void Renderer::InitVulkan()
 {
+	m_JobSystem = std::make_unique<JobSystem>();
+	RegisterCpuStages();
+	CreateAssetLibrary();
+
+	// There's nothing to present to when headless
+	if (!m_Config.bHeadless) m_DeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
 	CreateInstance();
 	SetupDebugMessanger();
 	CheckValidationLayerSupport();
 	CreateSurface();
 	PickPhysicalDevice();
 	CreateLogicalDevice();
-	CreateSwapChain();
+	CreateAllocator();
+	if (m_Config.bHeadless) CreateOffscreenImages();
+	else CreateSwapChain();
 	CreateImageViews();
-	CreateRenderPass();
+	CreateRenderGraph();
+	CreatePipelineCache();
+	CreateDescriptors();
 	CreateGraphicsPipeline();
-	CreateFramebuffers();
-	CreateCommandPool();
+	CreateCommandPools();
+	CreateStagingRing();
+	CreateTextureStreamer();
+	CreateGeometryBuffers();
+	CreateGpuCuller();
+	CreateInstanceBuffer();
+	CreateReadbackBuffers();
 	CreateCommandBuffers();
+	CreateGpuProfiler();
+	CreateComputeCommands();
+	CreateFrameCapture();
 	CreateSyncObjects();
 }
 
+void Renderer::CreateAssetLibrary()
+{
+	// Hot reload edits loose files, so those have to win over whatever was packed
+	m_AssetLibrary = std::make_unique<AssetLibrary>(m_Config.bHotReload);
+	for (const std::string& sArchive : m_Config.vAssetArchives)
+	{
+		m_AssetLibrary->Mount(sArchive);
+		std::cout << "Mounted " << sArchive << std::endl;
+	}
+}
+
 void Renderer::CreateInstance()
 {
 	// App info
@@ -104,12 +141,18 @@ bool Renderer::CheckValidationLayerSupport()
 }
 
 void Renderer::CreateSurface()
+{
+	if (m_Config.bHeadless) return;
+	m_Surface = CreateSurfaceFor(*m_Window);
+}
+
+vk::UniqueSurfaceKHR Renderer::CreateSurfaceFor(Window& window)
 {
 	vk::SurfaceKHR surface;
-	if (glfwCreateWindowSurface(m_Instance.get(), m_Window.m_Window, nullptr, reinterpret_cast<VkSurfaceKHR*>(&surface)) != VK_SUCCESS)
+	if (glfwCreateWindowSurface(m_Instance.get(), window.m_Window, nullptr, reinterpret_cast<VkSurfaceKHR*>(&surface)) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create window surface!");
 	vk::ObjectDestroy<vk::Instance, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE> _deleter(m_Instance.get());
-	m_Surface = vk::UniqueSurfaceKHR(surface, _deleter);
+	return vk::UniqueSurfaceKHR(surface, _deleter);
 }
 
 void Renderer::PickPhysicalDevice()
@@ -118,14 +161,93 @@ void Renderer::PickPhysicalDevice()
 	std::vector<vk::PhysicalDevice> vDevices = m_Instance.get().enumeratePhysicalDevices();
 	if (vDevices.size() == 0) throw std::runtime_error("Failed to detect any Vulkan compatible GPUs!");
 
-	// Chose GPU
+	// An override can be an index into that list or (part of) a device name
+	const std::string& sOverride = m_Config.sDevice;
+	bool bOverrideIsIndex = !sOverride.empty() && std::all_of(sOverride.begin(), sOverride.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+	uint32_t nOverrideIndex = 0;
+	if (bOverrideIsIndex && !TryParseCount(sOverride, nOverrideIndex)) throw std::runtime_error("Invalid GPU index " + sOverride + "!");
+
+	// Score every GPU, rather than just taking the first that works - that's often an integrated one
+	uint64_t nBestScore = 0;
 	bool bChoseDevice = false;
-	for (const auto& device : vDevices)
+	bool bMatchedOverride = false;
+	for (uint32_t i = 0; i < vDevices.size(); ++i)
+	{
+		vk::PhysicalDevice device = vDevices[i];
+		std::string sName = device.getProperties().deviceName;
+		bool bSuitable = IsDeviceSuitable(device);
+		uint64_t nScore = bSuitable ? RateDevice(device) : 0;
+		std::cout << "GPU " << i << ": " << sName << " (" << vk::to_string(device.getProperties().deviceType) << ") ";
+		if (bSuitable) std::cout << "score " << nScore << std::endl;
+		else std::cout << "unsuitable" << std::endl;
+		if (!bSuitable) continue;
+
+		bool bMatches = !sOverride.empty() && (bOverrideIsIndex ? nOverrideIndex == i : sName.find(sOverride) != std::string::npos);
+
+		// A suitable override always wins, otherwise the highest score does
+		if (bMatchedOverride) continue;
+		if (bMatches || !bChoseDevice || nScore > nBestScore)
+		{
+			m_PhysicalDevice = device;
+			nBestScore = nScore;
+			bChoseDevice = true;
+			bMatchedOverride = bMatches;
+		}
+	}
+	if (!bChoseDevice) throw std::runtime_error("Failed to find a suitable Vulkan GPU!");
+	if (!sOverride.empty() && !bMatchedOverride) std::cout << "No suitable GPU matches " << sOverride << ", using the best scoring one instead" << std::endl;
+
+	vk::PhysicalDeviceProperties properties = m_PhysicalDevice.getProperties();
+	std::cout << "Chose GPU " << properties.deviceName << " (" << vk::to_string(properties.deviceType) << ", "
+		<< GetDeviceLocalMemory(m_PhysicalDevice) / (1024 * 1024) << " MiB device local)" << std::endl << std::endl;
+}
+
+vk::DeviceSize Renderer::GetDeviceLocalMemory(vk::PhysicalDevice device)
+{
+	// The largest device local heap - on integrated GPUs this is just system memory
+	vk::PhysicalDeviceMemoryProperties memoryProperties = device.getMemoryProperties();
+	vk::DeviceSize nSize = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
 	{
-		if (IsDeviceSuitable(device)) { m_PhysicalDevice = device; bChoseDevice = true; break; }
+		if (memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) nSize = std::max(nSize, memoryProperties.memoryHeaps[i].size);
 	}
-	if (!bChoseDevice) throw new std::runtime_error("Failed to find a suitable Vulkan GPU!");
-	std::cout << "Chose GPU " << m_PhysicalDevice.getProperties().deviceName << std::endl << std::endl;
+	return nSize;
+}
+
+uint64_t Renderer::RateDevice(vk::PhysicalDevice device)
+{
+	vk::PhysicalDeviceProperties properties = device.getProperties();
+
+	// Device type dominates - a discrete GPU is worth more than anything else we can measure
+	uint64_t nScore = 0;
+	switch (properties.deviceType)
+	{
+	case vk::PhysicalDeviceType::eDiscreteGpu:		nScore = 4; break;
+	case vk::PhysicalDeviceType::eIntegratedGpu:	nScore = 3; break;
+	case vk::PhysicalDeviceType::eVirtualGpu:		nScore = 2; break;
+	case vk::PhysicalDeviceType::eCpu:				nScore = 1; break;
+	default:										nScore = 0; break;
+	}
+	nScore *= 1000000;
+
+	// Then memory, a point per MiB is plenty to separate cards
+	nScore += std::min<uint64_t>(GetDeviceLocalMemory(device) / (1024 * 1024), 500000);
+
+	// Bigger limits usually mean a beefier GPU
+	nScore += properties.limits.maxImageDimension2D / 16;
+	nScore += properties.limits.maxComputeSharedMemorySize / 1024;
+
+	// Dedicated compute and transfer queues let work overlap with drawing
+	bool bDedicatedCompute = false, bDedicatedTransfer = false;
+	for (const auto& family : device.getQueueFamilyProperties())
+	{
+		if ((family.queueFlags & vk::QueueFlagBits::eCompute) && !(family.queueFlags & vk::QueueFlagBits::eGraphics)) bDedicatedCompute = true;
+		if ((family.queueFlags & vk::QueueFlagBits::eTransfer) && !(family.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) bDedicatedTransfer = true;
+	}
+	if (bDedicatedCompute) nScore += 2000;
+	if (bDedicatedTransfer) nScore += 1000;
+
+	return nScore;
 }
 
 bool Renderer::IsDeviceSuitable(vk::PhysicalDevice device)
@@ -136,15 +258,19 @@ bool Renderer::IsDeviceSuitable(vk::PhysicalDevice device)
 
 	bool bExtensionsSupported = CheckDeviceExtensionSupport(device);
 
-	bool bSwapChainAdequate = false;
-	if (bExtensionsSupported)
+	bool bSwapChainAdequate = m_Config.bHeadless; // Offscreen images don't need a surface
+	if (bExtensionsSupported && !m_Config.bHeadless)
 	{
-		auto swapChainSupport = QuerySwapChainSupport(device);
+		auto swapChainSupport = QuerySwapChainSupport(device, m_Surface.get());
 		bSwapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
 
+	// We lean on Vulkan 1.2 timeline semaphores for cross queue synchronisation
+	auto features12 = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+	bool bTimelineSemaphores = properties.apiVersion >= VK_API_VERSION_1_2 && features12.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore;
+
 	QueueFamilyIndices indices = FindQueueFamilies(device);
-	return indices.IsComplete() && bExtensionsSupported && bSwapChainAdequate;
+	return indices.IsComplete() && bExtensionsSupported && bSwapChainAdequate && bTimelineSemaphores;
 }
 
 bool Renderer::CheckDeviceExtensionSupport(vk::PhysicalDevice device)
@@ -169,15 +295,33 @@ Renderer::QueueFamilyIndices Renderer::FindQueueFamilies(vk::PhysicalDevice devi
 	int i = 0;
 	for (const auto& family : vFamilies)
 	{
-		if (family.queueFlags & vk::QueueFlagBits::eGraphics) indices.graphicsFamily = i;
+		if (!indices.graphicsFamily.has_value() && (family.queueFlags & vk::QueueFlagBits::eGraphics)) indices.graphicsFamily = i;
 
-		auto bPresentSupport = device.getSurfaceSupportKHR(i, m_Surface.get());
-		if (bPresentSupport) indices.presentFamily = i;
+		// Headless has nothing to present to, so the graphics family stands in for the present one
+		if (!indices.presentFamily.has_value())
+		{
+			auto bPresentSupport = m_Config.bHeadless ?	static_cast<bool>(family.queueFlags & vk::QueueFlagBits::eGraphics) :
+														static_cast<bool>(device.getSurfaceSupportKHR(i, m_Surface.get()));
+			if (bPresentSupport) indices.presentFamily = i;
+		}
+
+		// A transfer only family usually maps to the GPU's DMA engines, which can copy
+		// while the rest of the GPU is busy drawing
+		bool bTransferOnly = (family.queueFlags & vk::QueueFlagBits::eTransfer) &&
+							!(family.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+		if (!indices.transferFamily.has_value() && bTransferOnly) indices.transferFamily = i;
+
+		// Likewise a compute family without graphics can run alongside rasterisation on GPUs that overlap the two
+		bool bComputeOnly = (family.queueFlags & vk::QueueFlagBits::eCompute) && !(family.queueFlags & vk::QueueFlagBits::eGraphics);
+		if (!indices.computeFamily.has_value() && bComputeOnly) indices.computeFamily = i;
 
-		if (indices.IsComplete()) break;
 		i++;
 	}
 
+	// Graphics (and compute) queues can always transfer too
+	if (!indices.transferFamily.has_value()) indices.transferFamily = indices.graphicsFamily;
+	if (!indices.computeFamily.has_value()) indices.computeFamily = indices.graphicsFamily;
+
 	return indices;
 }
 
@@ -187,14 +331,14 @@ void Renderer::CreateLogicalDevice()
 
 	// Create a set of all unique queue families that are nessecary
 	std::vector<vk::DeviceQueueCreateInfo> vQueueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value(), indices.computeFamily.value() };
 
 	float fPriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies)
 	{
 		// Specify the queues to be created
 		vk::DeviceQueueCreateInfo queueCreateInfo{};
-		queueCreateInfo.queueFamilyIndex = indices.graphicsFamily.value();
+		queueCreateInfo.queueFamilyIndex = queueFamily;
 		queueCreateInfo.queueCount = 1;
 		queueCreateInfo.pQueuePriorities = &fPriority;
 		vQueueCreateInfos.push_back(queueCreateInfo);
@@ -202,9 +346,60 @@ void Renderer::CreateLogicalDevice()
 
 	// Special GPU features
 	vk::PhysicalDeviceFeatures deviceFeatures{};
+	vk::PhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.timelineSemaphore = true; // Lets the graphics queue wait on uploads, and frames be paced, without fences
+
+#ifdef HOBBYVK_PRESENT_WAIT
+	// Latency mode can see when frames actually reach the screen with these, rather than guessing
+	vk::PhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	vk::PhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	if (m_Config.bLowLatency && !m_Config.bHeadless)
+	{
+		std::set<std::string> sExtensions;
+		for (const auto& extension : m_PhysicalDevice.enumerateDeviceExtensionProperties()) sExtensions.insert(extension.extensionName);
+		if (sExtensions.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) && sExtensions.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+		{
+			auto presentFeatures = m_PhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>();
+			m_bPresentWait =	presentFeatures.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+								presentFeatures.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+		}
+		if (m_bPresentWait)
+		{
+			m_DeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			m_DeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.presentId = true;
+			presentWaitFeatures.presentWait = true;
+			presentIdFeatures.pNext = &presentWaitFeatures;
+			vulkan12Features.pNext = &presentIdFeatures;
+		}
+	}
+#endif
+
+	// GPU driven drawing makes use of these when they're around, but copes without
+	auto supportedFeatures = m_PhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+	m_bDrawIndirectCount = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+	m_bMultiDrawIndirect = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features.multiDrawIndirect;
+	m_bDrawIndirectFirstInstance = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features.drawIndirectFirstInstance;
+	vulkan12Features.drawIndirectCount = m_bDrawIndirectCount;
+	deviceFeatures.multiDrawIndirect = m_bMultiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = m_bDrawIndirectFirstInstance;
+
+	// Textures come in whichever compressed formats the GPU has, and the streamer budgets against the driver's
+	// numbers when it can get them. It's only a query, so there's no feature to go with it
+	const vk::PhysicalDeviceFeatures& coreFeatures = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features;
+	deviceFeatures.textureCompressionBC = coreFeatures.textureCompressionBC;
+	deviceFeatures.textureCompressionETC2 = coreFeatures.textureCompressionETC2;
+	deviceFeatures.textureCompressionASTC_LDR = coreFeatures.textureCompressionASTC_LDR;
+	deviceFeatures.samplerAnisotropy = coreFeatures.samplerAnisotropy;
+	for (const auto& extension : m_PhysicalDevice.enumerateDeviceExtensionProperties())
+	{
+		if (std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) m_bMemoryBudget = true;
+	}
+	if (m_bMemoryBudget) m_DeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
 	// Create logical device
 	vk::DeviceCreateInfo createInfo{};
+	createInfo.pNext = &vulkan12Features;
 	createInfo.pQueueCreateInfos = vQueueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(vQueueCreateInfos.size());
 	createInfo.pEnabledFeatures = &deviceFeatures;
@@ -221,12 +416,23 @@ void Renderer::CreateLogicalDevice()
 	// Retrieve queues too - only need one queue from families, so we'll use index 0
 	m_GraphicsQueue = m_Device.get().getQueue(indices.graphicsFamily.value(), 0);
 	m_PresentQueue = m_Device.get().getQueue(indices.presentFamily.value(), 0);
+	m_TransferQueue = m_Device.get().getQueue(indices.transferFamily.value(), 0);
+	m_ComputeQueue = m_Device.get().getQueue(indices.computeFamily.value(), 0);
+}
+
+void Renderer::CreateAllocator()
+{
+	m_Allocator = std::make_unique<MemoryAllocator>(m_PhysicalDevice, m_Device.get(), m_bMemoryBudget);
 }
 
 std::vector<const char*> Renderer::GetRequiredExtensions()
 {
-	std::pair<uint32_t, const char**> glfwExtensions = m_Window.GetExtensions();
-	std::vector<const char*> vExtensions(glfwExtensions.second, glfwExtensions.second + glfwExtensions.first);
+	std::vector<const char*> vExtensions;
+	if (m_Window)
+	{
+		std::pair<uint32_t, const char**> glfwExtensions = m_Window->GetExtensions();
+		vExtensions.assign(glfwExtensions.second, glfwExtensions.second + glfwExtensions.first);
+	}
 	if (bEnableValidationLayers) vExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
 	return vExtensions;
@@ -301,14 +507,14 @@ void Renderer::SetupDebugMessanger()
 		throw std::runtime_error("Failed to setup Vulkan debug messanger!");
 }
 
-Renderer::SwapChainSupportDetails Renderer::QuerySwapChainSupport(vk::PhysicalDevice device)
+Renderer::SwapChainSupportDetails Renderer::QuerySwapChainSupport(vk::PhysicalDevice device, vk::SurfaceKHR surface)
 {
 	SwapChainSupportDetails details;
 
 	// "'operator =' is ambiguous" my arse
-	auto capabilities = device.getSurfaceCapabilitiesKHR(m_Surface.get());
-	auto formats = device.getSurfaceFormatsKHR(m_Surface.get());
-	auto presentModes = device.getSurfacePresentModesKHR(m_Surface.get());
+	auto capabilities = device.getSurfaceCapabilitiesKHR(surface);
+	auto formats = device.getSurfaceFormatsKHR(surface);
+	auto presentModes = device.getSurfacePresentModesKHR(surface);
 	details.capabilities = capabilities;
 	details.formats = formats;
 	details.presentModes = presentModes;
@@ -328,16 +534,17 @@ vk::SurfaceFormatKHR Renderer::ChoseSwapSurfaceFormat(const std::vector<vk::Surf
 
 vk::PresentModeKHR Renderer::ChoseSwapPresentMode(const std::vector<vk::PresentModeKHR>& vAvailablePresentModes)
 {
-	// Try to get tripple buffering, but fall back to (basically) v-sync if unavailable
+	// Use whatever was asked for, but fall back to v-sync if unavailable, which is guaranteed to be supported
 	for (const auto& availablePresentMode : vAvailablePresentModes)
 	{
-		if (availablePresentMode == vk::PresentModeKHR::eMailbox) return availablePresentMode;
+		if (availablePresentMode == m_Config.presentMode) return availablePresentMode;
 	}
 
+	std::cout << "Present mode " << vk::to_string(m_Config.presentMode) << " unavailable, falling back to FIFO" << std::endl;
 	return vk::PresentModeKHR::eFifo;
 }
 
-vk::Extent2D Renderer::ChoseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities)
+vk::Extent2D Renderer::ChoseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities, Window& window)
 {
 	// Vulkan tells us to match the resolution of the window by
 	// setting the width and height in the currentExtent member. However,
@@ -347,31 +554,39 @@ vk::Extent2D Renderer::ChoseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabil
 	else
 	{
 		// Clamp between min and max allowed values
-		vk::Extent2D actualExtent = { m_Width, m_Height };
+		auto framebufferSize = window.GetFramebufferSize();
+		vk::Extent2D actualExtent = { framebufferSize.first, framebufferSize.second };
 		actualExtent.width =	std::max(capabilities.minImageExtent.width,	std::min(capabilities.maxImageExtent.width,	 actualExtent.width));
 		actualExtent.height =	std::max(capabilities.minImageExtent.height,std::min(capabilities.maxImageExtent.height, actualExtent.height));
 		return actualExtent;
 	}
 }
 
-void Renderer::CreateSwapChain()
+void Renderer::CreateSwapChain(vk::SwapchainKHR oldSwapchain)
+{
+	m_Swapchain = CreateSwapchainFor(m_Surface.get(), *m_Window, oldSwapchain, true, m_SwapchainImages, m_SwapchainImageFormat, m_SwapChainExtent);
+}
+
+vk::UniqueSwapchainKHR Renderer::CreateSwapchainFor(vk::SurfaceKHR surface, Window& window, vk::SwapchainKHR oldSwapchain, bool bCapturable,
+													std::vector<vk::Image>& vImages, vk::Format& format, vk::Extent2D& extent)
 {
-	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice);
+	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice, surface);
 
 	vk::SurfaceFormatKHR surfaceFormat = ChoseSwapSurfaceFormat(swapChainSupport.formats);
 	vk::PresentModeKHR presentMode = ChoseSwapPresentMode(swapChainSupport.presentModes);
-	vk::Extent2D extent = ChoseSwapExtent(swapChainSupport.capabilities);
+	extent = ChoseSwapExtent(swapChainSupport.capabilities, window);
 
 	// We know there's a minimum amount of images, but we really want more as
 	// that means that we may sometimes be waiting for the driver to complete
-	// its stuff, so let's request at least one more than the minimum
-	uint32_t nImages = swapChainSupport.capabilities.minImageCount + 1;
+	// its stuff, so unless told otherwise let's request one more than the minimum
+	uint32_t nImages = m_Config.nSwapchainImages > 0 ? m_Config.nSwapchainImages : swapChainSupport.capabilities.minImageCount + 1;
+	nImages = std::max(nImages, swapChainSupport.capabilities.minImageCount);
 	if (swapChainSupport.capabilities.maxImageCount > 0 && nImages > swapChainSupport.capabilities.maxImageCount)
 		nImages = swapChainSupport.capabilities.maxImageCount; // Zero is a special number, meaning zero limits ^^^
 
 	// Create the swapchain
 	vk::SwapchainCreateInfoKHR createInfo{};
-	createInfo.surface = m_Surface.get();
+	createInfo.surface = surface;
 	createInfo.minImageCount = nImages;
 	createInfo.imageFormat = surfaceFormat.format;
 	createInfo.imageColorSpace = surfaceFormat.colorSpace;
@@ -380,6 +595,13 @@ void Renderer::CreateSwapChain()
 	createInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
 	// We're just rendering directly, like a framebuffer with a colour attatchment, but if we're using an FBO then VK_IMAGE_USAGE_TRANSFER_DST_BIT would be wise
 
+	// Capturing copies straight out of the (main window's) swapchain images, if the surface lets us
+	if (bCapturable)
+	{
+		m_bSwapchainTransferSrc = static_cast<bool>(swapChainSupport.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc);
+		if (!m_Config.sCaptureTarget.empty() && m_bSwapchainTransferSrc) createInfo.imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+	}
+
 	// Decide what to do if a swap chain image is across multiple queue families
 	// VK_SHARING_MODE_EXCLUSIVE - nice and fast, VK_SHARING_MODE_CONCURRENT no need for ownership transfers
 	QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
@@ -401,24 +623,252 @@ void Renderer::CreateSwapChain()
 	createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque; // How should transparrency be treated?..... Ignore it
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = true; // Just clip pixels outside the window, we don't need to sample them, and I do like a good bit of performance
-	//createInfo.oldSwapchain = vk::SwapchainKHR(...); // Our swapchain can become invalid, if a window is resized for example, but what to do?...
+	createInfo.oldSwapchain = oldSwapchain; // Lets the driver reuse resources, and hand over any images still being presented
+
+	vk::UniqueSwapchainKHR swapchain = m_Device.get().createSwapchainKHRUnique(createInfo);
+	auto swapchainImages = m_Device.get().getSwapchainImagesKHR(swapchain.get()); // "ambigious" operator "fix"
+	vImages = swapchainImages;
+	format = surfaceFormat.format;
+	return swapchain;
+}
+
+void Renderer::RecreateSwapChain()
+{
+	// Minimised windows have a zero sized framebuffer, and so can't have a swapchain - wait it out
+	auto framebufferSize = m_Window->GetFramebufferSize();
+	while ((framebufferSize.first == 0 || framebufferSize.second == 0) && !m_Window->ShouldClose())
+	{
+		m_Window->WaitEvents();
+		framebufferSize = m_Window->GetFramebufferSize();
+	}
+	m_Window->m_bFramebufferResized = false;
+	if (m_Window->ShouldClose()) return;
+
+	// Rather than waiting for the device to idle, retire everything tied to the old swapchain's
+	// images and extent - DrawFrame destroys it once the frames which might be using it are done
+	RetiredSwapchain retired;
+	retired.swapchain = std::move(m_Swapchain);
+	retired.vImageViews = std::move(m_SwapchainImageViews);
+	retired.renderGraph = std::move(m_RenderGraph);
+	retired.depthPyramid = std::move(m_DepthPyramid);
+	retired.nFrame = m_nFrameNumber;
+	m_SwapchainImageViews.clear();
+
+	vk::RenderPass oldRenderPass = m_RenderPass;
+	CreateSwapChain(retired.swapchain.get());
+	m_vRetiredSwapchains.push_back(std::move(retired));
+	CreateImageViews();
+	CreateRenderGraph();
+	CreateDepthPyramid();
+
+	// The graph's render pass comes out of the cache the same unless the format changed, which very rarely
+	// happens - so neither does the pipeline. Viewport and scissor are dynamic state, so the extent doesn't matter
+	if (m_RenderPass != oldRenderPass)
+	{
+		WaitIdle();
+		m_PipelineLibrary->Evict(oldRenderPass);
+		CreateGraphicsPipeline();
+	}
 
-	m_Swapchain = m_Device.get().createSwapchainKHRUnique(createInfo);
-	auto swapchainImages = m_Device.get().getSwapchainImagesKHR(m_Swapchain.get()); // "ambigious" operator "fix"
-	m_SwapchainImages = swapchainImages;
-	m_SwapchainImageFormat = surfaceFormat.format;
-	m_SwapChainExtent = extent;
+	m_vImagesInFlight.assign(m_SwapchainImages.size(), 0); // New images aren't in use by anything yet
+	if (m_FramePacer) m_FramePacer->OnSwapchainRecreated();
+}
+
+Renderer::WindowId Renderer::AddWindow(uint32_t nWidth, uint32_t nHeight, const std::string& sTitle)
+{
+	if (m_Config.bHeadless) throw std::runtime_error("Can't add windows when headless!");
+	if (m_GpuCuller) throw std::runtime_error("Can't add windows when GPU driven!");
+
+	auto pView = std::make_unique<View>();
+	View& view = *pView;
+	view.id = static_cast<WindowId>(m_vViews.size() + 1); // Before the graph, which names its pass after it
+	view.window = std::make_unique<Window>(nWidth, nHeight, sTitle);
+	view.surface = CreateSurfaceFor(*view.window);
+
+	// The device was picked for the main window's surface, so this one might be on a GPU that can't present to it
+	if (!m_PhysicalDevice.getSurfaceSupportKHR(FindQueueFamilies(m_PhysicalDevice).presentFamily.value(), view.surface.get()))
+		throw std::runtime_error("The device can't present to " + sTitle + "!");
+
+	// Only the main window's captured, so the rest needn't be transfer sources
+	view.swapchain = CreateSwapchainFor(view.surface.get(), *view.window, vk::SwapchainKHR{}, false, view.vImages, view.format, view.extent);
+	view.vImageViews = CreateSwapchainImageViews(view.vImages, view.format);
+	CreateViewGraph(view);
+
+	vk::SemaphoreCreateInfo semaphoreInfo{};
+	for (size_t i = 0; i < m_nFramesInFlight; ++i)
+	{
+		view.vImageAvailableSemaphores.push_back(m_Device.get().createSemaphoreUnique(semaphoreInfo));
+		view.vRenderFinishedSemaphores.push_back(m_Device.get().createSemaphoreUnique(semaphoreInfo));
+	}
+	view.vImagesInFlight.assign(view.vImages.size(), 0);
+	view.viewProjection = m_ViewProjection;
+
+	// Almost always the main window's pipeline, its render pass coming out of the cache the same - if not it's built now
+	GraphicsPipelineKey key = m_SceneKey;
+	key.renderPass = view.renderPass;
+	m_PipelineLibrary->Get(key);
+
+	m_vViews.push_back(std::move(pView));
+	return view.id;
+}
+
+void Renderer::SetViewProjection(WindowId window, const glm::mat4& viewProjection)
+{
+	if (window == 0) m_ViewProjection = viewProjection;
+	else m_vViews[window - 1]->viewProjection = viewProjection;
+}
+
+void Renderer::CreateViewGraph(View& view)
+{
+	// Just the scene, drawn from secondaries recorded against this graph's framebuffer
+	view.renderGraph = std::make_unique<RenderGraph>(*m_Allocator, m_Device.get(), *m_RenderPassCache, view.extent);
+	RenderGraph& graph = *view.renderGraph;
+
+	view.outputImage = graph.ImportImage("Output", view.format, vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR);
+	graph.MarkOutput(view.outputImage);
+
+	View* pView = &view;
+	RenderGraph::PassBuilder mainPass = graph.AddPass("Window " + std::to_string(view.id + 1) + " main pass", PassType::eGraphics, [pView](const RenderGraph::PassContext& context)
+	{
+		if (!pView->vSceneCommandBuffers.empty()) context.commandBuffer.executeCommands(pView->vSceneCommandBuffers);
+	});
+	AddSceneAttachments(graph, mainPass, view.outputImage, view.format);
+	mainPass.SecondaryCommandBuffers();
+	view.mainPass = mainPass.Get();
+
+	graph.Compile();
+	view.renderPass = graph.GetRenderPass(view.mainPass);
+}
+
+bool Renderer::RecreateView(View& view)
+{
+	// Unlike the main window, a minimised one doesn't hold everything up - it's just not drawn
+	auto framebufferSize = view.window->GetFramebufferSize();
+	if (framebufferSize.first == 0 || framebufferSize.second == 0) return false;
+	view.window->m_bFramebufferResized = false;
+	view.bOutOfDate = false;
+
+	// Retired the same as the main window's
+	RetiredSwapchain retired;
+	retired.swapchain = std::move(view.swapchain);
+	retired.vImageViews = std::move(view.vImageViews);
+	retired.renderGraph = std::move(view.renderGraph);
+	retired.nFrame = m_nFrameNumber;
+	view.vImageViews.clear();
+
+	view.swapchain = CreateSwapchainFor(view.surface.get(), *view.window, retired.swapchain.get(), false, view.vImages, view.format, view.extent);
+	m_vRetiredSwapchains.push_back(std::move(retired));
+	view.vImageViews = CreateSwapchainImageViews(view.vImages, view.format);
+	CreateViewGraph(view);
+
+	view.vImagesInFlight.assign(view.vImages.size(), 0);
+	return true;
+}
+
+void Renderer::AcquireViews()
+{
+	for (auto& pView : m_vViews)
+	{
+		View& view = *pView;
+		view.bAcquired = false;
+		if (view.bClosed) continue;
+		if (view.window->ShouldClose())
+		{
+			view.window->Hide();
+			view.bClosed = true;
+			continue;
+		}
+		if ((view.window->m_bFramebufferResized || view.bOutOfDate) && !RecreateView(view)) continue;
+
+		vk::Result acquireResult;
+		{
+			CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nAcquire);
+			acquireResult = m_Device.get().acquireNextImageKHR(view.swapchain.get(), UINT64_MAX, view.vImageAvailableSemaphores[m_nCurrentFrame].get(), vk::Fence{}, &view.nImageIndex);
+		}
+		if (acquireResult == vk::Result::eErrorOutOfDateKHR) { view.bOutOfDate = true; continue; }
+		if (acquireResult != vk::Result::eSuccess && acquireResult != vk::Result::eSuboptimalKHR) throw std::runtime_error("Failed to acquire swapchain image!");
+
+		if (!m_FrameTimeline->IsComplete(view.vImagesInFlight[view.nImageIndex]))
+		{
+			CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nWaitForImage);
+			m_FrameTimeline->Wait(view.vImagesInFlight[view.nImageIndex]);
+		}
+		view.vImagesInFlight[view.nImageIndex] = FrameTimeline::GetValue(m_nFrameNumber);
+		view.bAcquired = true;
+	}
+}
+
+void Renderer::RecordViews(vk::CommandBuffer commandBuffer)
+{
+	for (auto& pView : m_vViews)
+	{
+		View& view = *pView;
+		if (!view.bAcquired) continue;
+
+		view.renderGraph->SetImage(view.outputImage, view.vImages[view.nImageIndex], view.vImageViews[view.nImageIndex].get());
+		vk::Framebuffer framebuffer = view.renderGraph->GetFramebuffer(view.mainPass);
+
+		// Its own camera, otherwise the same as the main window's frame uniforms
+		FrameUniforms uniforms;
+		uniforms.viewProjection = view.viewProjection;
+		uniforms.time = glm::vec4(std::chrono::duration<float>(std::chrono::steady_clock::now() - m_StartTime).count(), static_cast<float>(m_nFrameNumber), 0.0f, 0.0f);
+
+		GraphicsPipelineKey key = m_SceneKey;
+		key.renderPass = view.renderPass;
+		SceneTarget target = { m_PipelineLibrary->Get(key), view.extent, m_UniformRing->Push(uniforms), &view.vDrawCommands };
+
+		RecordSceneBatches(target, view.renderPass, framebuffer, view.vSceneCommandBuffers);
+		view.renderGraph->Execute(commandBuffer, m_GpuProfiler.get());
+
+		m_FrameStats.nDraws += static_cast<uint32_t>(view.vDrawCommands.size());
+		for (const DrawCommand& draw : view.vDrawCommands) m_FrameStats.nTriangles += static_cast<uint64_t>(draw.nIndexCount / 3) * m_nInstances;
+	}
+}
+
+void Renderer::CreateOffscreenImages()
+{
+	// Stands in for a swapchain when headless - a ring of images we render into and
+	// then copy out of, rather than present
+	m_SwapchainImageFormat = vk::Format::eB8G8R8A8Srgb; // Same as we'd prefer from a surface
+	m_SwapChainExtent = vk::Extent2D(m_Width, m_Height);
+	uint32_t nImages = std::max(m_nFramesInFlight, m_Config.nSwapchainImages);
+
+	vk::ImageCreateInfo imageInfo{};
+	imageInfo.imageType = vk::ImageType::e2D;
+	imageInfo.format = m_SwapchainImageFormat;
+	imageInfo.extent = vk::Extent3D(m_Width, m_Height, 1);
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = vk::SampleCountFlagBits::e1;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+	imageInfo.sharingMode = vk::SharingMode::eExclusive;
+	imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+	m_vOffscreenImages.clear();
+	m_SwapchainImages.clear();
+	for (uint32_t i = 0; i < nImages; ++i)
+	{
+		m_vOffscreenImages.emplace_back(*m_Allocator, m_Device.get(), imageInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		m_SwapchainImages.push_back(m_vOffscreenImages.back().Get());
+	}
 }
 
 void Renderer::CreateImageViews()
 {
-	m_SwapchainImageViews.resize(m_SwapchainImages.size()); // Allocate space
-	for (size_t i = 0; i < m_SwapchainImages.size(); ++i)
+	if (m_Config.bHeadless) return; // Offscreen images come with their own views
+	m_SwapchainImageViews = CreateSwapchainImageViews(m_SwapchainImages, m_SwapchainImageFormat);
+}
+
+std::vector<vk::UniqueImageView> Renderer::CreateSwapchainImageViews(const std::vector<vk::Image>& vImages, vk::Format format)
+{
+	std::vector<vk::UniqueImageView> vImageViews(vImages.size()); // Allocate space
+	for (size_t i = 0; i < vImages.size(); ++i)
 	{
 		vk::ImageViewCreateInfo createInfo{};
-		createInfo.image = m_SwapchainImages[i];
+		createInfo.image = vImages[i];
 		createInfo.viewType = vk::ImageViewType::e2D; // 1D array, 2D texture or 3D texture / cubemap?
-		createInfo.format = m_SwapchainImageFormat;
+		createInfo.format = format;
 		// If we really want we can swizzle colour channels...
 		createInfo.components.r = vk::ComponentSwizzle::eIdentity;	createInfo.components.r = vk::ComponentSwizzle::eIdentity;
 		createInfo.components.r = vk::ComponentSwizzle::eIdentity;	createInfo.components.r = vk::ComponentSwizzle::eIdentity;
@@ -429,356 +879,1059 @@ void Renderer::CreateImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1; // You might want more than 1 layer for stereoscopic 3D for example
 
-		m_SwapchainImageViews[i] = m_Device.get().createImageViewUnique(createInfo);
+		vImageViews[i] = m_Device.get().createImageViewUnique(createInfo);
 	}
+	return vImageViews;
 }
 
 void Renderer::CreateGraphicsPipeline()
 {
-	auto sVertexShader		= ReadFile("Shaders/vert.spv");
-	auto sFragmentShader	= ReadFile("Shaders/frag.spv");
+	// Pipeline layout - used for uniforms, the frame's in set 0 and per draw bits are pushed
+	vk::PushConstantRange pushConstantRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(DrawConstants));
+	vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_FrameSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	if (!m_PipelineLayout) m_PipelineLayout = m_Device.get().createPipelineLayoutUnique(pipelineLayoutInfo);
 
-	vk::UniqueShaderModule vertexShaderModule =	CreateShaderModule(sVertexShader);
-	vk::UniqueShaderModule fragmentShaderModule = CreateShaderModule(sFragmentShader);
+	if (!m_PipelineLibrary)
+	{
+		m_ShaderCompiler = std::make_unique<ShaderCompiler>(*m_AssetLibrary, m_Config.sShaderCacheDirectory);
+		m_PipelineLibrary = std::make_unique<PipelineLibrary>(m_Device.get(), m_PipelineCache.get(), *m_ShaderCompiler, *m_JobSystem, m_nFramesInFlight);
+	}
 
-	// Create shaders - one could also put vertexShaderStageInfo.pSpecializationInfo
-	// so as to set shader contents, allowing optimisation of if statements and the like
-	vk::PipelineShaderStageCreateInfo vertexShaderStageInfo = {};
-	vertexShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
-	vertexShaderStageInfo.module = vertexShaderModule.get();
-	vertexShaderStageInfo.pName = "main"; // main() in shader
+	// Vertex input - see Vertex.h, then the per instance streams after it
+	GraphicsPipelineKey key;
+	key.sVertexShader = "Shaders/shader.vert";
+	key.sFragmentShader = "Shaders/shader.frag";
+
+	auto vertexAttributeDescriptions = Vertex::GetAttributeDescriptions();
+	key.vBindings = { Vertex::GetBindingDescription() };
+	key.vAttributes.assign(vertexAttributeDescriptions.begin(), vertexAttributeDescriptions.end());
+
+	auto instanceBindingDescriptions = InstanceBuffer::GetBindingDescriptions(1);
+	auto instanceAttributeDescriptions = InstanceBuffer::GetAttributeDescriptions(1, static_cast<uint32_t>(key.vAttributes.size()));
+	key.vBindings.insert(key.vBindings.end(), instanceBindingDescriptions.begin(), instanceBindingDescriptions.end());
+	key.vAttributes.insert(key.vAttributes.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+
+	// Less or equal so that overlapping draws at the same depth still go in submission order
+	key.bDepthTest = true;
+	key.bDepthWrite = true;
+	key.depthCompareOp = vk::CompareOp::eLessOrEqual;
+	key.samples = m_MsaaSamples;
+
+	// Everything else is the key's defaults - filled triangles, back faces culled, no blending
+	key.layout = m_PipelineLayout.get();
+	key.renderPass = m_RenderPass;
+	key.nSubpass = 0;
+
+	// We can't draw anything without this one, so there's no point building it in the background
+	m_SceneKey = key;
+	m_GraphicsPipeline = m_PipelineLibrary->Get(m_SceneKey);
+}
 
-	vk::PipelineShaderStageCreateInfo fragmentShaderStageInfo = {};
-	fragmentShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
-	fragmentShaderStageInfo.module = fragmentShaderModule.get();
-	fragmentShaderStageInfo.pName = "main";  // main() in shader
-	
-	vk::PipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
-
-	// Vertex input - none for now
-	vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr; // optional
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr; // optional
-
-	// Input assembly - what kind of geometry will be drawn and if primitive
-	// restart should be enabled
-	vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
-	inputAssembly.primitiveRestartEnable = false;
-
-	// Viewport
-	vk::Viewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_SwapChainExtent.width;
-	viewport.height = (float)m_SwapChainExtent.height;
-	viewport.minDepth = 0.0f; // Must be within [0,1], but min
-	viewport.maxDepth = 1.0f; // can be higher than max
-
-	// Scissors - region in which pixels will actually be stored
-	vk::Rect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_SwapChainExtent;
-
-	// Combine viewport and scissors into a viewport state.
-	vk::PipelineViewportStateCreateInfo viewportState{};
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	// Rasteris(z)er - takes care of depth testing, face culling, the scissor test,
-	// fill mode (wireframe rendering or polygons), and, erm.... rasteris(z)ing
-	vk::PipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.depthClampEnable = false; // If true, clamp fragments too near or far apart instead of discarding them
-	rasterizer.rasterizerDiscardEnable = false; // Basically disables any output to the framebufer
-	rasterizer.polygonMode = vk::PolygonMode::eFill; // Important: using any other mode than fill requires a GPU feature!
-	rasterizer.lineWidth = 1.0f; // Anything thicker than 1.0 requires enabling the wideLines GPU feature
-	rasterizer.cullMode = vk::CullModeFlagBits::eBack;
-	rasterizer.frontFace = vk::FrontFace::eClockwise;
-	rasterizer.depthBiasEnable = VK_FALSE; // The depth bias can add a constant value to depthmaps, useful for shadowmaps
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-	// Multisampling - disabled for now
-	vk::PipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sampleShadingEnable = false;
-	multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr;
-	multisampling.alphaToCoverageEnable = false;
-	multisampling.alphaToOneEnable = false;
-
-	// Todo: Depth and stencil with optional VkPipelineDepthStencilStateCreateInfo
-
-	// Colour blending - configured for alpha blending yet disabled
-	vk::PipelineColorBlendAttachmentState colourBlendAttatchment{};
-	colourBlendAttatchment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-	colourBlendAttatchment.blendEnable = false;
-	colourBlendAttatchment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
-	colourBlendAttatchment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
-	colourBlendAttatchment.colorBlendOp = vk::BlendOp::eAdd;
-	colourBlendAttatchment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
-	colourBlendAttatchment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
-	colourBlendAttatchment.alphaBlendOp = vk::BlendOp::eAdd;
-
-	// More colour blending - constants for blend factors for all the framebuffers
-	vk::PipelineColorBlendStateCreateInfo colourBlending{};
-	colourBlending.logicOpEnable = false;
-	colourBlending.logicOp = vk::LogicOp::eCopy;
-	colourBlending.attachmentCount = 1;
-	colourBlending.pAttachments = &colourBlendAttatchment;
-	colourBlending.blendConstants[0] = 0.0f;	colourBlending.blendConstants[1] = 0.0f;
-	colourBlending.blendConstants[2] = 0.0f;	colourBlending.blendConstants[3] = 0.0f;
-
-	// Todo: Dynamic state (if we want) - allows certain things to be changed at draw time,
-	// like viewport and line width, in which case the nessecary above values are ignored
-
-	// Pipeline layout - used for uniforms
-	vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
-	m_PipelineLayout = m_Device.get().createPipelineLayoutUnique(pipelineLayoutInfo);
-
-	// Create the graphics pipeline
-	vk::GraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.stageCount = 2; // Fragment and vertex
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
-	pipelineInfo.pColorBlendState = &colourBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
-	pipelineInfo.layout = m_PipelineLayout.get();
-	pipelineInfo.renderPass = m_RenderPass.get();
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = vk::Pipeline {}; // Optional - these two can be used to create pipelines from others, as switching would be cheaper,
-	pipelineInfo.basePipelineIndex = -1; // Optional - as would creating them be too.
-
-	m_GraphicsPipeline = m_Device.get().createGraphicsPipelineUnique(vk::PipelineCache{}, pipelineInfo);
-}
-
-const std::vector<char> Renderer::ReadFile(const std::string & sFilename)
-{
-	// Read from end of file with ate so that determining size is easier
-	std::ifstream fFile(sFilename, std::ios::ate | std::ios::binary);
-	if (!fFile.is_open()) throw std::runtime_error("Unable to open file " + sFilename + "!");
-	size_t fileSize = static_cast<size_t>(fFile.tellg());
-	std::vector<char> vBuffer(fileSize);
-
-	fFile.seekg(0);
-	fFile.read(vBuffer.data(), fileSize);
-	fFile.close();
+void Renderer::CreateDescriptors()
+{
+	m_DescriptorLayoutCache = std::make_unique<DescriptorLayoutCache>(m_Device.get());
+	m_DescriptorAllocator = std::make_unique<DescriptorAllocator>(m_Device.get(), m_nFramesInFlight);
+
+	// Plenty for a frame's worth of uniforms, with each push rounded up to the alignment
+	constexpr vk::DeviceSize nUniformFrameSize = 256 * 1024;
+	m_UniformRing = std::make_unique<UniformRing>(*m_Allocator, m_Device.get(), m_PhysicalDevice, nUniformFrameSize, m_nFramesInFlight, sizeof(FrameUniforms));
+
+	// The frame set never changes, only its dynamic offset, so it lives in its own pool rather than a frame's
+	vk::DescriptorSetLayoutBinding frameBinding = vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBufferDynamic, 1,
+		vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute);
+	m_FrameSetLayout = m_DescriptorLayoutCache->Get({ frameBinding });
+
+	vk::DescriptorPoolSize poolSize = vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1);
+	m_PersistentDescriptorPool = m_Device.get().createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, 1, 1, &poolSize));
+	m_FrameDescriptorSet = m_Device.get().allocateDescriptorSets(vk::DescriptorSetAllocateInfo(m_PersistentDescriptorPool.get(), 1, &m_FrameSetLayout))[0];
 
-	return vBuffer;
+	vk::DescriptorBufferInfo bufferInfo = m_UniformRing->GetDescriptorInfo();
+	vk::WriteDescriptorSet write = vk::WriteDescriptorSet(m_FrameDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &bufferInfo);
+	m_Device.get().updateDescriptorSets(write, nullptr);
 }
 
-vk::UniqueShaderModule Renderer::CreateShaderModule(const std::vector<char>& vCode)
+std::string Renderer::GetPipelineCacheFilename()
 {
-	vk::ShaderModuleCreateInfo createInfo = vk::ShaderModuleCreateInfo({}, vCode.size(), reinterpret_cast<const uint32_t*>(vCode.data()));
-	vk::UniqueShaderModule shaderModule = m_Device.get().createShaderModuleUnique(createInfo);
-	return shaderModule;
+	// One file per GPU model, so swapping GPUs doesn't throw away the other one's cache
+	vk::PhysicalDeviceProperties properties = m_PhysicalDevice.getProperties();
+	std::stringstream sFilename;
+	sFilename << "PipelineCache_" << std::hex << properties.vendorID << "_" << properties.deviceID << ".bin";
+	return sFilename.str();
 }
 
-void Renderer::CreateRenderPass()
+bool Renderer::IsPipelineCacheCompatible(const AssetSpan& data)
 {
-	vk::AttachmentDescription colourAttatchment{};
-	colourAttatchment.format = m_SwapchainImageFormat;
-	colourAttatchment.samples = vk::SampleCountFlagBits::e1; // No multisampling
-	colourAttatchment.loadOp = vk::AttachmentLoadOp::eClear; // Clear to black before drawing a new frame
-	colourAttatchment.storeOp = vk::AttachmentStoreOp::eStore; // We'd like to read this framebuffer from memory later
-	colourAttatchment.initialLayout = vk::ImageLayout::eUndefined; // We don't care what the previous layout was, we're cleaing it anyway
-	colourAttatchment.finalLayout = vk::ImageLayout::ePresentSrcKHR; //  We want the image to be ready for presentation to the swap chain later
+	// The cache begins with a header (see VkPipelineCacheHeaderVersion) - a driver update
+	// changes pipelineCacheUUID, at which point the old data is useless and should be dropped
+	struct PipelineCacheHeader
+	{
+		uint32_t nLength;
+		uint32_t nVersion;
+		uint32_t nVendorID;
+		uint32_t nDeviceID;
+		uint8_t  uuid[VK_UUID_SIZE];
+	};
+	if (data.GetSize() < sizeof(PipelineCacheHeader)) return false;
+
+	PipelineCacheHeader header;
+	std::memcpy(&header, data.GetData(), sizeof(PipelineCacheHeader));
+
+	vk::PhysicalDeviceProperties properties = m_PhysicalDevice.getProperties();
+	return	header.nLength >= sizeof(PipelineCacheHeader) &&
+			header.nVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+			header.nVendorID == properties.vendorID &&
+			header.nDeviceID == properties.deviceID &&
+			!std::memcmp(header.uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+}
 
-	// Subpasses and attachment references - only need one
-	vk::AttachmentReference colourAttachmentReference{};
-	colourAttachmentReference.attachment = 0;
-	colourAttachmentReference.layout = vk::ImageLayout::eColorAttachmentOptimal; // Best for colour attachments
+void Renderer::CreatePipelineCache()
+{
+	// Load any previous cache from disk, it's fine if there isn't one yet
+	// Mapped rather than read, the driver copies what it wants out of it. The mapping's dropped straight after,
+	// so saving over it on exit is fine
+	AssetSpan data;
+	if (AssetLibrary::TryOpenLoose(GetPipelineCacheFilename(), data) && !IsPipelineCacheCompatible(data))
+	{
+		std::cout << "Discarding stale pipeline cache " << GetPipelineCacheFilename() << std::endl;
+		data = AssetSpan();
+	}
 
-	vk::SubpassDescription subpass{};
-	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics; // It's for graphics!
-	subpass.colorAttachmentCount = 1; // layout(location = 0) out vec4 outColor, could also mention pInputAttachments, 
-	subpass.pColorAttachments = &colourAttachmentReference; // pResolveAttachments, pDepthStencilAttachment, and pPreserveAttachments too.
+	vk::PipelineCacheCreateInfo createInfo{};
+	createInfo.initialDataSize = data.GetSize();
+	createInfo.pInitialData = data.IsEmpty() ? nullptr : data.GetData();
+	m_PipelineCache = m_Device.get().createPipelineCacheUnique(createInfo);
+}
 
-	// Create the render pass
-	vk::RenderPassCreateInfo renderPassInfo{};
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colourAttatchment;
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	m_RenderPass = m_Device.get().createRenderPassUnique(renderPassInfo);
+void Renderer::SavePipelineCache()
+{
+	std::vector<uint8_t> vData = m_Device.get().getPipelineCacheData(m_PipelineCache.get());
+
+	std::ofstream fFile(GetPipelineCacheFilename(), std::ios::binary | std::ios::trunc);
+	if (!fFile.is_open()) { std::cerr << "Unable to write pipeline cache " << GetPipelineCacheFilename() << "!" << std::endl; return; }
+	fFile.write(reinterpret_cast<const char*>(vData.data()), vData.size());
+	fFile.close();
+}
 
-	// Subpass dependency
-	vk::SubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-	dependency.srcAccessMask = vk::AccessFlagBits{};
-	dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-	dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+vk::Format Renderer::FindDepthFormat()
+{
+	// D32 is the most precise and (with D32S8) what AMD supports, D24S8 is for everyone else
+	for (vk::Format format : { vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint })
+	{
+		vk::FormatProperties properties = m_PhysicalDevice.getFormatProperties(format);
+		if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) return format;
+	}
+	throw std::runtime_error("Failed to find a supported depth format!");
 }
 
-void Renderer::CreateFramebuffers()
+vk::SampleCountFlagBits Renderer::PickSampleCount(uint32_t nRequested)
 {
-	// Create a framebuffer for each image view in the swapchain
-	m_SwapchainFramebuffers.resize(m_SwapchainImageViews.size());
+	// Colour and depth are multisampled together, so it has to be a count both support
+	vk::PhysicalDeviceLimits limits = m_PhysicalDevice.getProperties().limits;
+	vk::SampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+
+	uint32_t nSamples = 1;
+	while (nSamples * 2 <= nRequested && nSamples < 64) nSamples *= 2; // Round down to a power of two
+	while (nSamples > 1 && !(supported & static_cast<vk::SampleCountFlagBits>(nSamples))) nSamples /= 2;
+
+	if (nSamples != nRequested) std::cout << nRequested << "x MSAA unsupported, using " << nSamples << "x" << std::endl;
+	return static_cast<vk::SampleCountFlagBits>(nSamples);
+}
 
-	for (size_t i = 0; i < m_SwapchainImageViews.size(); ++i)
+void Renderer::CreateRenderGraph()
+{
+	if (m_DepthFormat == vk::Format::eUndefined)
 	{
-		vk::ImageView attachments[] = { m_SwapchainImageViews[i].get() };
-		
-		vk::FramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.renderPass = m_RenderPass.get();
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
-		framebufferInfo.width = m_SwapChainExtent.width;
-		framebufferInfo.height = m_SwapChainExtent.height;
-		framebufferInfo.layers = 1;
+		m_DepthFormat = FindDepthFormat();
+		m_MsaaSamples = PickSampleCount(m_Config.nMsaaSamples);
+		m_RenderPassCache = std::make_unique<RenderPassCache>(m_Device.get());
 
-		m_SwapchainFramebuffers[i] = m_Device.get().createFramebufferUnique(framebufferInfo);
+		// The pyramid's built by sampling depth, so it has to be one sample and no stencil (a view can't be of both)
+		m_bOcclusionCulling = m_Config.bOcclusionCulling && m_Config.bGpuDriven;
+		if (m_bOcclusionCulling)
+		{
+			vk::FormatProperties properties = m_PhysicalDevice.getFormatProperties(m_DepthFormat);
+			if (m_DepthFormat != vk::Format::eD32Sfloat || m_MsaaSamples != vk::SampleCountFlagBits::e1 || !(properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage))
+			{
+				std::cout << "Occlusion culling needs a sampled D32 depth buffer without MSAA, frustum culling only" << std::endl;
+				m_bOcclusionCulling = false;
+			}
+		}
+		else if (m_Config.bOcclusionCulling) std::cout << "Occlusion culling is GPU driven only" << std::endl;
+	}
+	m_RenderGraph = std::make_unique<RenderGraph>(*m_Allocator, m_Device.get(), *m_RenderPassCache, m_SwapChainExtent);
+	RenderGraph& graph = *m_RenderGraph;
+
+	// The swapchain (or offscreen) image is bound each frame, and left ready to present or be copied out
+	vk::ImageLayout outputLayout = m_Config.bHeadless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+	m_OutputImage = graph.ImportImage("Output", m_SwapchainImageFormat, vk::ImageLayout::eUndefined, outputLayout);
+	graph.MarkOutput(m_OutputImage);
+
+	if (m_Config.bGpuDriven)
+	{
+		m_DrawBuffer = graph.ImportBuffer("Draws");
+		m_DrawCountBuffer = graph.ImportBuffer("Draw count");
+		graph.AddPass("Cull", PassType::eCompute, [this](const RenderGraph::PassContext& context)
+		{
+			m_GpuCuller->RecordCull(context.commandBuffer, static_cast<uint32_t>(m_nCurrentFrame), GpuCuller::ExtractFrustumPlanes(m_ViewProjection), m_DepthPyramid.get());
+		})
+		.Write(m_DrawBuffer, ResourceUsage::eStorageWrite)
+		.Write(m_DrawCountBuffer, ResourceUsage::eStorageWrite);
+	}
+
+	// Depth only ever lives inside the main pass, so it's cleared on the way in and never stored - on a tiled
+	// GPU it needn't leave tile memory, and clearing (rather than loading) keeps any hierarchical Z valid.
+	// With MSAA the samples are the same, resolved into the output at the end of the subpass
+	RenderGraph::PassBuilder mainPass = graph.AddPass("Main pass", PassType::eGraphics, [this](const RenderGraph::PassContext& context)
+	{
+		if (m_GpuCuller)
+		{
+			BindSceneState(context.commandBuffer, GetMainTarget());
+			DrawConstants constants = { glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) }; // Objects carry their placement in their instances
+			context.commandBuffer.pushConstants(m_PipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(DrawConstants), &constants);
+			m_GpuCuller->RecordDraws(context.commandBuffer, static_cast<uint32_t>(m_nCurrentFrame), *m_InstanceBuffer, 1);
+		}
+		else if (!m_vSceneCommandBuffers.empty()) context.commandBuffer.executeCommands(m_vSceneCommandBuffers);
+	});
+
+	m_DepthImage = AddSceneAttachments(graph, mainPass, m_OutputImage, m_SwapchainImageFormat);
+
+	if (m_Config.bGpuDriven) mainPass.Read(m_DrawBuffer, ResourceUsage::eIndirectRead).Read(m_DrawCountBuffer, ResourceUsage::eIndirectRead);
+	else mainPass.SecondaryCommandBuffers();
+	m_MainPass = mainPass.Get();
+
+	// Reading depth afterwards means it's stored after all - the pyramid's for the next frame's cull, which the graph
+	// can't see, so the pass would be culled without SideEffects
+	if (m_bOcclusionCulling)
+	{
+		graph.AddPass("Depth pyramid", PassType::eCompute, [this](const RenderGraph::PassContext& context)
+		{
+			m_DepthPyramid->RecordBuild(context.commandBuffer, m_ViewProjection);
+		})
+		.Read(m_DepthImage, ResourceUsage::eSampled)
+		.SideEffects();
+	}
+
+	// Offscreen frames are copied out for ReadbackFrame
+	if (m_Config.bHeadless)
+	{
+		m_ReadbackBuffer = graph.ImportBuffer("Readback");
+		graph.MarkOutput(m_ReadbackBuffer);
+		graph.AddPass("Readback", PassType::eTransfer, [this](const RenderGraph::PassContext& context)
+		{
+			vk::BufferImageCopy region{};
+			region.bufferOffset = 0;
+			region.bufferRowLength = 0; // Tightly packed
+			region.bufferImageHeight = 0;
+			region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+			region.imageOffset = vk::Offset3D(0, 0, 0);
+			region.imageExtent = vk::Extent3D(m_SwapChainExtent.width, m_SwapChainExtent.height, 1);
+			context.commandBuffer.copyImageToBuffer(m_SwapchainImages[m_nImageIndex], vk::ImageLayout::eTransferSrcOptimal, m_vReadbackBuffers[m_nCurrentFrame].Get(), region);
+
+			// Make the copy visible to the host once the frame's done - the graph doesn't know about the host
+			vk::MemoryBarrier barrier = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+			context.commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags{}, barrier, nullptr, nullptr);
+		})
+		.Read(m_OutputImage, ResourceUsage::eTransferSrc)
+		.Write(m_ReadbackBuffer, ResourceUsage::eTransferDst);
+	}
+
+	graph.Compile();
+	m_RenderPass = graph.GetRenderPass(m_MainPass);
+}
+
+GraphResource Renderer::AddSceneAttachments(RenderGraph& graph, RenderGraph::PassBuilder& mainPass, GraphResource output, vk::Format format)
+{
+	vk::ClearValue clearColour = vk::ClearColorValue(std::array<float, 4>{ 0.2f, 0.3f, 0.3f, 1.0f });
+	if (m_MsaaSamples != vk::SampleCountFlagBits::e1)
+	{
+		GraphResource multisampled = graph.CreateImage("Multisampled colour", format, m_MsaaSamples);
+		mainPass.Colour(multisampled, vk::AttachmentLoadOp::eClear, clearColour).Resolve(output);
 	}
+	else mainPass.Colour(output, vk::AttachmentLoadOp::eClear, clearColour);
+
+	GraphResource depth = graph.CreateImage("Depth", m_DepthFormat, m_MsaaSamples);
+	mainPass.Depth(depth);
+	return depth;
 }
 
-void Renderer::CreateCommandPool()
+void Renderer::CreateCommandPools()
 {
 	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	m_nRecordingThreads = m_JobSystem->GetThreadCount();
 
+	// Transient tells the driver these are short lived, and we reset whole pools
+	// rather than individual command buffers so there's no need for eResetCommandBuffer
 	vk::CommandPoolCreateInfo poolInfo{};
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-	m_CommandPool = m_Device.get().createCommandPoolUnique(poolInfo);
+	m_vFrameCommands.resize(m_nFramesInFlight);
+	for (auto& frame : m_vFrameCommands)
+	{
+		frame.commandPool = m_Device.get().createCommandPoolUnique(poolInfo);
+
+		frame.vThreadPools.resize(m_nRecordingThreads);
+		for (auto& threadPool : frame.vThreadPools) threadPool.commandPool = m_Device.get().createCommandPoolUnique(poolInfo);
+	}
+}
+
+void Renderer::CreateStagingRing()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	constexpr vk::DeviceSize nStagingSize = 32 * 1024 * 1024;
+	m_StagingRing = std::make_unique<StagingRing>(*m_Allocator, m_Device.get(), m_TransferQueue, queueFamilyIndices.transferFamily.value(), nStagingSize, m_QueueMutex);
+}
+
+void Renderer::CreateTextureStreamer()
+{
+	// Sampled on graphics (and maybe compute), uploaded by the staging ring's family
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	std::vector<uint32_t> vFamilies = GetComputeSharingFamilies();
+	vFamilies.push_back(queueFamilyIndices.transferFamily.value());
+
+	float fMaxAnisotropy = 1.0f;
+	if (m_PhysicalDevice.getFeatures().samplerAnisotropy) fMaxAnisotropy = std::min(16.0f, m_PhysicalDevice.getProperties().limits.maxSamplerAnisotropy);
+	m_TextureStreamer = std::make_unique<TextureStreamer>(*m_Allocator, m_PhysicalDevice, m_Device.get(), *m_StagingRing, *m_AssetLibrary, vFamilies, m_nFramesInFlight, fMaxAnisotropy);
+}
+
+void Renderer::CreateGeometryBuffers()
+{
+	if (!m_Config.sMesh.empty()) m_Mesh = Mesh(m_AssetLibrary->Open(m_Config.sMesh));
+	else
+	{
+		// Converted on the spot, it's a triangle so there's not much to it
+		MeshSource triangle;
+		triangle.vPositions = { { 0.0f, -0.5f, 0.0f }, { 0.5f, 0.5f, 0.0f }, { -0.5f, 0.5f, 0.0f } };
+		triangle.vColours = { { 1.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } };
+		triangle.vIndices = { 0, 1, 2 };
+		m_Mesh = Mesh(AssetSpan(MeshConverter::Build(triangle)));
+	}
+
+	// Independent, so let the job system create and upload them side by side
+	JobCounter counter;
+	m_JobSystem->Schedule([this]() { CreateVertexBuffer(); }, &counter);
+	m_JobSystem->Schedule([this]() { CreateIndexBuffer(); }, &counter);
+	m_JobSystem->Wait(counter);
+
+	const MeshFileHeader& header = m_Mesh.GetHeader();
+	m_Scene.Add({ m_Mesh.GetIndexCount(), 0, 0 }, glm::vec4(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]));
+}
+
+void Renderer::CreateGpuCuller()
+{
+	if (!m_Config.bGpuDriven) return;
+
+	// Objects are uploaded by CullScene as the scene changes
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	m_GpuCuller = std::make_unique<GpuCuller>(	*m_Allocator, m_Device.get(), *m_PipelineLibrary, m_bOcclusionCulling ? "Shaders/cull_occlusion.comp" : "Shaders/cull.comp",
+												std::vector<uint32_t>{ queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.transferFamily.value() },
+												m_nFramesInFlight, m_Config.nMaxGpuObjects, m_bDrawIndirectCount, m_bMultiDrawIndirect, m_bDrawIndirectFirstInstance, m_bOcclusionCulling);
+	m_vGpuFrameVersions.assign(m_nFramesInFlight, UINT64_MAX);
+	CreateDepthPyramid();
+
+	if (!m_bDrawIndirectFirstInstance) std::cout << "drawIndirectFirstInstance unsupported, draws will be issued one by one" << std::endl;
+	else if (!m_bDrawIndirectCount) std::cout << "drawIndirectCount unsupported, culled draws will be issued empty" << std::endl;
+}
+
+void Renderer::CreateDepthPyramid()
+{
+	// Sized to the depth buffer, and pointing at its view, so it's remade along with the graph
+	if (!m_bOcclusionCulling) return;
+	m_DepthPyramid = std::make_unique<DepthPyramid>(*m_Allocator, m_Device.get(), *m_PipelineLibrary, "Shaders/depth_pyramid.comp",
+													m_SwapChainExtent, m_RenderGraph->GetImageView(m_DepthImage));
+}
+
+void Renderer::BuildDrawList(const glm::mat4& viewProjection, std::vector<uint32_t>& vVisible, std::vector<DrawCommand>& vDrawCommands)
+{
+	// Each draw pushes its object's transform
+	m_Scene.Cull(GpuCuller::ExtractFrustumPlanes(viewProjection), *m_JobSystem, vVisible);
+	vDrawCommands.clear();
+	for (uint32_t nSlot : vVisible)
+	{
+		const SceneDraw& draw = m_Scene.GetDraw(nSlot);
+		vDrawCommands.push_back({ draw.nIndexCount, draw.nFirstIndex, draw.nVertexOffset, m_Scene.GetTransform(nSlot) });
+	}
+}
+
+void Renderer::CullScene()
+{
+	if (!m_GpuCuller)
+	{
+		// Each window only records what's in its own frustum
+		BuildDrawList(m_ViewProjection, m_vVisible, m_vDrawCommands);
+		for (auto& pView : m_vViews)
+		{
+			if (pView->bAcquired) BuildDrawList(pView->viewProjection, pView->vVisible, pView->vDrawCommands);
+		}
+		return;
+	}
+
+	// The GPU culls everything itself, so it only needs to hear about changes - each frame in flight has its own
+	// copy of the objects, so one upload per frame, of a list that's only rebuilt when the scene changes
+	uint32_t nFrame = static_cast<uint32_t>(m_nCurrentFrame);
+	uint64_t nVersion = m_Scene.GetVersion();
+	if (m_vGpuFrameVersions[nFrame] == nVersion) return;
+
+	if (m_nGpuObjectsVersion != nVersion)
+	{
+		// An object per meshlet, with the bounding spheres the converter worked out moved to where the object is,
+		// so the cull throws away the parts of a draw that are off screen rather than all or nothing. Meshlets are
+		// in index order, so a draw's are a run of them - unless its range doesn't line up with them, when it's one object
+		const Meshlet* pMeshlets = m_Mesh.GetMeshlets();
+		const Meshlet* pMeshletsEnd = pMeshlets + m_Mesh.GetMeshletCount();
+		uint32_t nObjects = std::min(m_Scene.GetCount(), m_Config.nMaxInstances); // Instance i is object i's transform
+		m_vGpuObjects.clear();
+		for (uint32_t nSlot = 0; nSlot < nObjects; ++nSlot)
+		{
+			const SceneDraw& draw = m_Scene.GetDraw(nSlot);
+			uint32_t nLastIndex = draw.nFirstIndex + draw.nIndexCount;
+			const Meshlet* pFirst = std::lower_bound(pMeshlets, pMeshletsEnd, draw.nFirstIndex, [](const Meshlet& meshlet, uint32_t nIndex) { return meshlet.nFirstIndex < nIndex; });
+			const Meshlet* pLast = pFirst;
+			while (pLast != pMeshletsEnd && pLast->nFirstIndex + pLast->nIndexCount <= nLastIndex) ++pLast;
+
+			bool bCovered = pFirst != pLast && pFirst->nFirstIndex == draw.nFirstIndex && (pLast - 1)->nFirstIndex + (pLast - 1)->nIndexCount == nLastIndex;
+			for (const Meshlet* pMeshlet = pFirst; bCovered && pMeshlet + 1 != pLast; ++pMeshlet) bCovered = pMeshlet->nFirstIndex + pMeshlet->nIndexCount == (pMeshlet + 1)->nFirstIndex;
+			if (!bCovered)
+			{
+				m_vGpuObjects.push_back({ draw.nIndexCount, draw.nFirstIndex, draw.nVertexOffset, nSlot, m_Scene.GetWorldSphere(nSlot) });
+				continue;
+			}
+
+			const glm::vec4& transform = m_Scene.GetTransform(nSlot);
+			for (const Meshlet* pMeshlet = pFirst; pMeshlet != pLast; ++pMeshlet)
+				m_vGpuObjects.push_back({ pMeshlet->nIndexCount, pMeshlet->nFirstIndex, draw.nVertexOffset, nSlot, SceneStore::TransformSphere(pMeshlet->boundingSphere, transform) });
+		}
+
+		if (m_vGpuObjects.size() > m_GpuCuller->GetMaxObjects())
+		{
+			std::cout << "Scene has " << m_vGpuObjects.size() << " meshlets, only drawing the first " << m_GpuCuller->GetMaxObjects() << std::endl;
+			m_vGpuObjects.resize(m_GpuCuller->GetMaxObjects());
+		}
+		m_nGpuTriangles = 0;
+		for (const DrawObject& object : m_vGpuObjects) m_nGpuTriangles += object.nIndexCount / 3;
+		m_nGpuObjectsVersion = nVersion;
+	}
+
+	m_GpuCuller->SetObjects(*m_StagingRing, nFrame, m_vGpuObjects);
+	m_vGpuFrameVersions[nFrame] = nVersion;
+}
+
+void Renderer::CreateInstanceBuffer()
+{
+	m_InstanceBuffer = std::make_unique<InstanceBuffer>(*m_Allocator, m_Device.get(), m_nFramesInFlight, m_Config.nMaxInstances);
+}
+
+void Renderer::UpdateInstances()
+{
+	InstanceStreams streams = m_InstanceBuffer->GetStreams(static_cast<uint32_t>(m_nCurrentFrame));
+	if (m_InstanceUpdater)
+	{
+		m_nInstances = std::min(m_InstanceUpdater(streams, static_cast<uint32_t>(m_nCurrentFrame)), streams.nCapacity);
+		return;
+	}
+
+	// Nothing to say otherwise, so one plain instance - or if GPU driven, one per object placing it where the scene says
+	uint32_t nDefault = std::min(m_GpuCuller ? std::max(1u, m_Scene.GetCount()) : 1u, streams.nCapacity);
+	for (uint32_t i = 0; i < nDefault; ++i)
+	{
+		streams.pTransforms[i] = m_GpuCuller && i < m_Scene.GetCount() ? m_Scene.GetTransform(i) : glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		streams.pColours[i] = 0xFFFFFFFF;
+	}
+	m_nInstances = 1;
+}
+
+void Renderer::CreateVertexBuffer()
+{
+	// Device local, filled via the staging ring on the transfer queue, and read by the graphics queue
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	vk::DeviceSize size = sizeof(Vertex) * m_Mesh.GetVertexCount();
+	m_VertexBuffer = Buffer(*m_Allocator, m_Device.get(), size, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+							vk::MemoryPropertyFlagBits::eDeviceLocal, { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.transferFamily.value() });
+	m_StagingRing->Upload(m_VertexBuffer.Get(), 0, m_Mesh.GetVertices(), size);
+}
+
+void Renderer::CreateIndexBuffer()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	vk::DeviceSize size = m_Mesh.GetIndexBufferSize();
+	m_IndexBuffer = Buffer(*m_Allocator, m_Device.get(), size, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+							vk::MemoryPropertyFlagBits::eDeviceLocal, { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.transferFamily.value() });
+	m_StagingRing->Upload(m_IndexBuffer.Get(), 0, m_Mesh.GetIndices(), size);
 }
 
 void Renderer::CreateCommandBuffers()
 {
-	m_CommandBuffers.resize(m_SwapchainFramebuffers.size());
+	// One primary command buffer per frame in flight, secondaries are allocated on demand
+	for (auto& frame : m_vFrameCommands)
+	{
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.commandPool = frame.commandPool.get();
+		allocateInfo.level = vk::CommandBufferLevel::ePrimary; // Primary command buffer, not owned by another
+		allocateInfo.commandBufferCount = 1;
 
-	vk::CommandBufferAllocateInfo allocateInfo{};
-	allocateInfo.commandPool = m_CommandPool.get();
-	allocateInfo.level = vk::CommandBufferLevel::ePrimary; // Primary command buffer, not owned by another
-	allocateInfo.commandBufferCount = static_cast<uint32_t>(m_CommandBuffers.size());
+		auto vCommandBuffers = m_Device.get().allocateCommandBuffersUnique(allocateInfo);
+		frame.commandBuffer = std::move(vCommandBuffers[0]);
+	}
+}
 
-	m_CommandBuffers = m_Device.get().allocateCommandBuffersUnique(allocateInfo);
+void Renderer::CreateGpuProfiler()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	m_GpuProfiler = std::make_unique<GpuProfiler>(m_PhysicalDevice, m_Device.get(), queueFamilyIndices.graphicsFamily.value(), m_nFramesInFlight);
+	if (!m_GpuProfiler->IsSupported()) std::cout << "GPU timestamps unsupported on the graphics queue, GPU timings will be unavailable" << std::endl;
+}
+
+void Renderer::CreateFrameCapture()
+{
+	if (m_Config.sCaptureTarget.empty()) return;
+
+	// Offscreen images are always created copyable
+	if (!m_Config.bHeadless && !m_bSwapchainTransferSrc) { std::cout << "Swapchain images can't be copied from, frame capture disabled" << std::endl; return; }
+	if (!FrameCapture::IsFormatSupported(m_SwapchainImageFormat)) { std::cout << "Can't capture " << vk::to_string(m_SwapchainImageFormat) << " frames, frame capture disabled" << std::endl; return; }
+
+	m_FrameCapture = std::make_unique<FrameCapture>(*m_Allocator, m_Device.get(), m_Config.captureSink, m_Config.sCaptureTarget, m_nFramesInFlight);
+	std::cout << "Capturing " << m_SwapChainExtent.width << "x" << m_SwapChainExtent.height << " " << vk::to_string(m_SwapchainImageFormat) << " frames to " << m_Config.sCaptureTarget << std::endl;
+}
 
-	// Start command buffer recording
-	for (size_t i = 0; i < m_CommandBuffers.size(); ++i)
+void Renderer::CreateComputeCommands()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+
+	vk::CommandPoolCreateInfo poolInfo{};
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+
+	m_vComputeCommands.resize(m_nFramesInFlight);
+	for (auto& compute : m_vComputeCommands)
 	{
-		vk::CommandBufferBeginInfo beginInfo{};
-		beginInfo.flags = vk::CommandBufferUsageFlags{};
-		beginInfo.pInheritanceInfo = nullptr; // Only needed for secondary command buffers
+		compute.commandPool = m_Device.get().createCommandPoolUnique(poolInfo);
 
-		m_CommandBuffers[i].get().begin(beginInfo);
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.commandPool = compute.commandPool.get();
+		allocateInfo.level = vk::CommandBufferLevel::ePrimary;
+		allocateInfo.commandBufferCount = 1;
+		compute.commandBuffer = std::move(m_Device.get().allocateCommandBuffersUnique(allocateInfo)[0]);
+	}
+}
 
-		vk::RenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.renderPass = m_RenderPass.get();
-		renderPassInfo.framebuffer = m_SwapchainFramebuffers[i].get();
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = m_SwapChainExtent;
+std::vector<uint32_t> Renderer::GetComputeSharingFamilies()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+	return { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.computeFamily.value() };
+}
 
-		vk::ClearValue clearColour = vk::ClearColorValue(std::array<float, 4>{ 0.2f, 0.3f, 0.3f, 1.0f });
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColour;
-		
-		m_CommandBuffers[i].get().beginRenderPass(renderPassInfo, vk::SubpassContents::eInline); // No secondary command buffers
-		
-			m_CommandBuffers[i].get().bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline.get());
-			m_CommandBuffers[i].get().draw(3, 1, 0, 0);
+void Renderer::SetAsyncCompute(ComputeRecorder recorder, vk::PipelineStageFlags graphicsWaitStage, bool bAfterPreviousFrame)
+{
+	m_ComputeRecorder = std::move(recorder);
+	m_ComputeWaitStage = graphicsWaitStage;
+	m_bComputeAfterPreviousFrame = bAfterPreviousFrame;
+}
+
+bool Renderer::SubmitAsyncCompute()
+{
+	if (!m_ComputeRecorder) return false;
+
+	// This frame slot's last frame has been waited on, and the graphics work it covers waited on this
+	ComputeCommands& compute = m_vComputeCommands[m_nCurrentFrame];
+	m_Device.get().resetCommandPool(compute.commandPool.get(), vk::CommandPoolResetFlags{});
+
+	vk::CommandBufferBeginInfo beginInfo{};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	compute.commandBuffer.get().begin(beginInfo);
+	m_ComputeRecorder(compute.commandBuffer.get(), static_cast<uint32_t>(m_nCurrentFrame));
+	compute.commandBuffer.get().end();
+
+	// Straight off the frame timeline, as the previous frame's value
+	uint64_t nWaitValue = FrameTimeline::GetValue(m_nFrameNumber - 1);
+	uint64_t nSignalValue = ++m_nComputeValue;
+	vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eComputeShader;
+	bool bWait = m_bComputeAfterPreviousFrame && m_nFrameNumber > 0;
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.waitSemaphoreValueCount = bWait ? 1 : 0;
+	timelineInfo.pWaitSemaphoreValues = &nWaitValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &nSignalValue;
+
+	vk::SubmitInfo submitInfo{};
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = bWait ? 1 : 0;
+	vk::Semaphore waitSemaphore = m_FrameTimeline->GetSemaphore();
+	submitInfo.pWaitSemaphores = &waitSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &compute.commandBuffer.get();
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_ComputeTimeline.get();
+	{
+		std::lock_guard<std::mutex> lock(m_QueueMutex);
+		m_ComputeQueue.submit(submitInfo, vk::Fence{});
+	}
+
+	return true;
+}
+
+vk::CommandBuffer Renderer::BeginSecondaryCommandBuffer(uint32_t nThread, vk::RenderPass renderPass, vk::Framebuffer framebuffer)
+{
+	ThreadCommandPool& threadPool = m_vFrameCommands[m_nCurrentFrame].vThreadPools[nThread];
+
+	// Reuse one from a previous frame if we can, they're already reset along with the pool
+	if (threadPool.nUsed == threadPool.vSecondaryCommandBuffers.size())
+	{
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.commandPool = threadPool.commandPool.get();
+		allocateInfo.level = vk::CommandBufferLevel::eSecondary;
+		allocateInfo.commandBufferCount = 1;
+
+		auto vCommandBuffers = m_Device.get().allocateCommandBuffersUnique(allocateInfo);
+		threadPool.vSecondaryCommandBuffers.push_back(std::move(vCommandBuffers[0]));
+	}
+	vk::CommandBuffer commandBuffer = threadPool.vSecondaryCommandBuffers[threadPool.nUsed++].get();
+
+	// Secondary command buffers executed within a render pass need to know which one
+	vk::CommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = framebuffer; // Optional, but may help the driver
+
+	vk::CommandBufferBeginInfo beginInfo{};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+	commandBuffer.begin(beginInfo);
+
+	return commandBuffer;
+}
+
+void Renderer::BindSceneState(vk::CommandBuffer commandBuffer, const SceneTarget& target)
+{
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, target.pipeline);
+
+	vk::Viewport viewport = vk::Viewport(0.0f, 0.0f, (float)target.extent.width, (float)target.extent.height, 0.0f, 1.0f);
+	vk::Rect2D scissor = vk::Rect2D({ 0, 0 }, target.extent);
+	commandBuffer.setViewport(0, viewport);
+	commandBuffer.setScissor(0, scissor);
+	commandBuffer.bindVertexBuffers(0, m_VertexBuffer.Get(), vk::DeviceSize{ 0 });
+	commandBuffer.bindIndexBuffer(m_IndexBuffer.Get(), 0, m_Mesh.GetIndexType());
+	m_InstanceBuffer->Bind(commandBuffer, static_cast<uint32_t>(m_nCurrentFrame), 1);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout.get(), 0, m_FrameDescriptorSet, target.nFrameUniformOffset);
+}
+
+void Renderer::RecordScene(vk::CommandBuffer commandBuffer, const SceneTarget& target, uint32_t nFirstDraw, uint32_t nLastDraw)
+{
+	// Secondary command buffers don't inherit any state, so each batch binds its own
+	BindSceneState(commandBuffer, target);
+
+	for (uint32_t i = nFirstDraw; i < nLastDraw; ++i)
+	{
+		const DrawCommand& draw = (*target.pDrawCommands)[i];
+		DrawConstants constants = { draw.transform };
+		commandBuffer.pushConstants(m_PipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(DrawConstants), &constants);
+		if (m_nInstances > 0) commandBuffer.drawIndexed(draw.nIndexCount, m_nInstances, draw.nFirstIndex, draw.nVertexOffset, 0);
+	}
+}
+
+void Renderer::RecordSceneBatches(const SceneTarget& target, vk::RenderPass renderPass, vk::Framebuffer framebuffer, std::vector<vk::CommandBuffer>& vCommandBuffers)
+{
+	// Draws are recorded into secondary command buffers in batches spread across the job
+	// system, each batch writing to its own slot so they're executed in draw list order
+	uint32_t nDraws = static_cast<uint32_t>(target.pDrawCommands->size());
+	vCommandBuffers.assign((nDraws + nDrawsPerBatch - 1) / nDrawsPerBatch, vk::CommandBuffer{});
+	m_JobSystem->ParallelFor(nDraws, nDrawsPerBatch, [&](uint32_t nBegin, uint32_t nEnd, uint32_t nThread)
+	{
+		vk::CommandBuffer secondaryCommandBuffer = BeginSecondaryCommandBuffer(nThread, renderPass, framebuffer);
+		RecordScene(secondaryCommandBuffer, target, nBegin, nEnd);
+		secondaryCommandBuffer.end();
+		vCommandBuffers[nBegin / nDrawsPerBatch] = secondaryCommandBuffer;
+	});
+}
+
+void Renderer::RecordCommandBuffer(uint32_t nImageIndex)
+{
+	FrameCommands& frame = m_vFrameCommands[m_nCurrentFrame];
+
+	// Picks up a reloaded pipeline once it's ready - it's one hash lookup, so not worth being clever about
+	m_GraphicsPipeline = m_PipelineLibrary->Get(m_SceneKey);
+
+	// One lot of frame uniforms, shared by every draw through its dynamic offset
+	FrameUniforms uniforms;
+	uniforms.viewProjection = m_ViewProjection;
+	uniforms.time = glm::vec4(std::chrono::duration<float>(std::chrono::steady_clock::now() - m_StartTime).count(), static_cast<float>(m_nFrameNumber), 0.0f, 0.0f);
+	m_nFrameUniformOffset = m_UniformRing->Push(uniforms);
+
+	// Bind this frame's imported resources, before the framebuffer they're in is looked up
+	m_nImageIndex = nImageIndex;
+	m_RenderGraph->SetImage(m_OutputImage, m_SwapchainImages[nImageIndex], m_Config.bHeadless ? m_vOffscreenImages[nImageIndex].GetView() : m_SwapchainImageViews[nImageIndex].get());
+	if (m_GpuCuller)
+	{
+		m_RenderGraph->SetBuffer(m_DrawBuffer, m_GpuCuller->GetDrawBuffer(static_cast<uint32_t>(m_nCurrentFrame)));
+		m_RenderGraph->SetBuffer(m_DrawCountBuffer, m_GpuCuller->GetCountBuffer(static_cast<uint32_t>(m_nCurrentFrame)));
+	}
+	if (m_Config.bHeadless) m_RenderGraph->SetBuffer(m_ReadbackBuffer, m_vReadbackBuffers[m_nCurrentFrame].Get());
+	vk::Framebuffer framebuffer = m_RenderGraph->GetFramebuffer(m_MainPass);
+
+	// GPU driven has no secondary command buffers, its draws come from the cull
+	if (m_GpuCuller)
+	{
+		m_FrameStats = { m_GpuCuller->GetObjectCount(static_cast<uint32_t>(m_nCurrentFrame)), 1, m_nGpuTriangles };
+		m_vSceneCommandBuffers.clear();
+	}
+	else
+	{
+		m_FrameStats = { static_cast<uint32_t>(m_vDrawCommands.size()), m_nInstances, 0 };
+		for (const DrawCommand& draw : m_vDrawCommands) m_FrameStats.nTriangles += static_cast<uint64_t>(draw.nIndexCount / 3) * m_nInstances;
+		RecordSceneBatches(GetMainTarget(), m_RenderPass, framebuffer, m_vSceneCommandBuffers);
+	}
 
-		m_CommandBuffers[i].get().endRenderPass();
+	// Then stitched together in the primary, by the graph's passes
+	vk::CommandBufferBeginInfo beginInfo{};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	beginInfo.pInheritanceInfo = nullptr; // Only needed for secondary command buffers
 
-		m_CommandBuffers[i].get().end();
+	frame.commandBuffer.get().begin(beginInfo);
+	m_GpuProfiler->BeginFrame(frame.commandBuffer.get(), static_cast<uint32_t>(m_nCurrentFrame));
+	m_RenderGraph->Execute(frame.commandBuffer.get(), m_GpuProfiler.get());
+	RecordViews(frame.commandBuffer.get());
 
+	// Never waits - if the writer's fallen behind the frame's just dropped
+	if (m_FrameCapture)
+	{
+		vk::ImageLayout layout = m_Config.bHeadless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+		m_FrameCapture->RecordCopy(frame.commandBuffer.get(), m_SwapchainImages[nImageIndex], layout, m_SwapChainExtent, m_SwapchainImageFormat, m_nCurrentFrame, m_nFrameNumber);
 	}
+
+	frame.commandBuffer.get().end();
 }
 
 void Renderer::CreateSyncObjects()
 {
-	m_vImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	m_vRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	m_vInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	m_vImagesInFlight.resize(m_SwapchainImages.size());
+	m_vImageAvailableSemaphores.resize(m_nFramesInFlight);
+	m_vRenderFinishedSemaphores.resize(m_nFramesInFlight);
+	m_vImagesInFlight.assign(m_SwapchainImages.size(), 0);
 
+	// Acquire and present still need binary semaphores
 	vk::SemaphoreCreateInfo semaphoreInfo{};
-	vk::FenceCreateInfo fenceInfo = vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled);
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	for (size_t i = 0; i < m_nFramesInFlight; ++i)
 	{
 		m_vImageAvailableSemaphores[i] = m_Device.get().createSemaphoreUnique(semaphoreInfo);
 		m_vRenderFinishedSemaphores[i] = m_Device.get().createSemaphoreUnique(semaphoreInfo);
-		m_vInFlightFences[i] = m_Device.get().createFence(fenceInfo);
+	}
+
+	// Timelines for graphics and compute to wait on each other with, the graphics one pacing frames too
+	m_FrameTimeline = std::make_unique<FrameTimeline>(m_Device.get());
+	vk::SemaphoreTypeCreateInfo timelineInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0);
+	vk::SemaphoreCreateInfo timelineSemaphoreInfo{};
+	timelineSemaphoreInfo.pNext = &timelineInfo;
+	m_ComputeTimeline = m_Device.get().createSemaphoreUnique(timelineSemaphoreInfo);
+
+	if (m_Config.bLowLatency && !m_Config.bHeadless)
+	{
+		m_FramePacer = std::make_unique<FramePacer>(m_Device.get(), m_bPresentWait, m_Window->GetRefreshPeriodMs());
+		if (!m_bPresentWait) std::cout << "Present wait unsupported, latency mode will predict vblanks instead" << std::endl;
 	}
 }
 
+void Renderer::RegisterCpuStages()
+{
+	m_CpuStages.nFrame			= m_CpuProfiler.RegisterStage("frame");
+	m_CpuStages.nWaitForFrame	= m_CpuProfiler.RegisterStage("wait_for_frame");
+	m_CpuStages.nAcquire		= m_CpuProfiler.RegisterStage("acquire");
+	m_CpuStages.nWaitForImage	= m_CpuProfiler.RegisterStage("wait_for_image");
+	m_CpuStages.nCull			= m_CpuProfiler.RegisterStage("cull");
+	m_CpuStages.nRecord			= m_CpuProfiler.RegisterStage("record");
+	m_CpuStages.nSubmit			= m_CpuProfiler.RegisterStage("submit");
+	m_CpuStages.nPresent		= m_CpuProfiler.RegisterStage("present");
+	m_CpuStages.nPace			= m_CpuProfiler.RegisterStage("pace");
+	m_CpuStages.nInputToPresent	= m_CpuProfiler.RegisterStage("input_to_present");
+}
+
 void Renderer::DrawFrame()
 {
-	// Wait for in flight fences
-	m_Device.get().waitForFences(m_vInFlightFences[m_nCurrentFrame], true, UINT64_MAX);
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nFrame);
+		RenderFrame();
+	}
+	m_CpuProfiler.EndFrame();
+}
+
+void Renderer::WaitForFrameStart()
+{
+	if (!m_FramePacer || m_bFrameStarted) return;
+	m_bFrameStarted = true;
 
-	// Acquire next image
-	uint32_t nImageIndex = m_Device.get().acquireNextImageKHR(m_Swapchain.get(), UINT64_MAX, m_vImageAvailableSemaphores[m_nCurrentFrame].get(), vk::Fence{});
+	m_FramePacer->WaitToStart(m_Swapchain.get());
+	m_CpuProfiler.Record(m_CpuStages.nPace, m_FramePacer->GetLastSleepMs());
+	double fLatencyMs = 0.0;
+	if (m_FramePacer->TakeLatencySample(fLatencyMs)) m_CpuProfiler.Record(m_CpuStages.nInputToPresent, fLatencyMs);
+
+	// Input's read as late as the frame starts, or the wait was for nothing
+	m_Window->Update();
+}
+
+void Renderer::RenderFrame()
+{
+	WaitForFrameStart();
+	m_bFrameStarted = false; // The next one waits again
+
+	// Wait for the last frame to use this slot - only blocks if the GPU's more than a full set of frames behind,
+	// long waits here meaning we're GPU bound
+	if (m_nFrameNumber >= m_nFramesInFlight)
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nWaitForFrame);
+		m_FrameTimeline->Wait(FrameTimeline::GetValue(m_nFrameNumber - m_nFramesInFlight));
+	}
+
+	// Any frames this slot captured are now in host memory, so off they go to be written
+	if (m_FrameCapture) m_FrameCapture->OnFrameComplete(m_nCurrentFrame);
+
+	// Anything retired by a resize at least a full set of frames ago is no longer in use
+	m_vRetiredSwapchains.erase(std::remove_if(m_vRetiredSwapchains.begin(), m_vRetiredSwapchains.end(),
+		[this](const RetiredSwapchain& retired) { return retired.nFrame + m_nFramesInFlight <= m_nFrameNumber; }), m_vRetiredSwapchains.end());
+	m_PipelineLibrary->CollectRetired();
+	m_TextureStreamer->Update(m_nFrameNumber);
+
+	// Polling a handful of timestamps a couple of times a second is plenty, the rebuilds themselves happen in the background
+	if (m_Config.bHotReload && std::chrono::steady_clock::now() - m_LastShaderCheck > std::chrono::milliseconds(500))
+	{
+		m_LastShaderCheck = std::chrono::steady_clock::now();
+		m_PipelineLibrary->ReloadChangedShaders();
+	}
+
+	// The GPU's done with this frame's command buffers, so recycle them all in one go
+	FrameCommands& frame = m_vFrameCommands[m_nCurrentFrame];
+	m_Device.get().resetCommandPool(frame.commandPool.get(), vk::CommandPoolResetFlags{});
+	m_DescriptorAllocator->ResetFrame(static_cast<uint32_t>(m_nCurrentFrame));
+	m_UniformRing->Reset(static_cast<uint32_t>(m_nCurrentFrame));
+	for (auto& threadPool : frame.vThreadPools)
+	{
+		if (threadPool.nUsed == 0) continue;
+		m_Device.get().resetCommandPool(threadPool.commandPool.get(), vk::CommandPoolResetFlags{});
+		threadPool.nUsed = 0;
+	}
+
+	// Acquire next image - the pointer overload returns the result rather than throwing on out of date
+	// Long waits here mean presentation's holding us up. Headless just cycles through its images
+	uint32_t nImageIndex = 0;
+	if (m_Config.bHeadless) nImageIndex = static_cast<uint32_t>(m_nFrameNumber % m_SwapchainImages.size());
+	else
+	{
+		vk::Result acquireResult;
+		{
+			CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nAcquire);
+			auto acquireStart = std::chrono::steady_clock::now();
+			acquireResult = m_Device.get().acquireNextImageKHR(m_Swapchain.get(), UINT64_MAX, m_vImageAvailableSemaphores[m_nCurrentFrame].get(), vk::Fence{}, &nImageIndex);
+			if (m_FramePacer) m_FramePacer->OnAcquired(acquireStart, std::chrono::steady_clock::now());
+		}
+		if (acquireResult == vk::Result::eErrorOutOfDateKHR) { RecreateSwapChain(); m_Window->Update(); return; }
+		if (acquireResult != vk::Result::eSuccess && acquireResult != vk::Result::eSuboptimalKHR) throw std::runtime_error("Failed to acquire swapchain image!");
+	}
 	
-	// Check if a previous frame is using this image
-	if (m_vImagesInFlight[nImageIndex] != vk::Fence{})
-		m_Device.get().waitForFences(m_vImagesInFlight[nImageIndex], true, UINT64_MAX);
-	// Mark the iamge as now being in use by this frame
-	m_vImagesInFlight[nImageIndex] = m_vInFlightFences[m_nCurrentFrame];
+	// Check if a previous frame is still using this image, then mark it as being in use by this one
+	if (!m_FrameTimeline->IsComplete(m_vImagesInFlight[nImageIndex]))
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nWaitForImage);
+		m_FrameTimeline->Wait(m_vImagesInFlight[nImageIndex]);
+	}
+	m_vImagesInFlight[nImageIndex] = FrameTimeline::GetValue(m_nFrameNumber);
+	AcquireViews();
+
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nCull);
+		CullScene();
+	}
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nRecord);
+		UpdateInstances();
+		RecordCommandBuffer(nImageIndex);
+	}
 
 	// Submit info
 	vk::SubmitInfo submitInfo{};
 
-	// Semaphores
-	vk::Semaphore waitSemaphores[] = { m_vImageAvailableSemaphores[m_nCurrentFrame].get() };
-	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput }; //
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
+	// Semaphores - wait for any uploads in flight before reading vertices (or culling objects, or sampling textures), and for the image (unless headless)
+	uint64_t nUploadValue = m_StagingRing->Flush();
+	std::vector<vk::Semaphore> vWaitSemaphores = { m_StagingRing->GetSemaphore() };
+	std::vector<vk::PipelineStageFlags> vWaitStages = { vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader };
+	std::vector<uint64_t> vWaitValues = { nUploadValue };
+	if (!m_Config.bHeadless)
+	{
+		vWaitSemaphores.push_back(m_vImageAvailableSemaphores[m_nCurrentFrame].get());
+		vWaitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+		vWaitValues.push_back(0); // Binary semaphores ignore their value
+	}
+	for (auto& pView : m_vViews)
+	{
+		if (!pView->bAcquired) continue;
+		vWaitSemaphores.push_back(pView->vImageAvailableSemaphores[m_nCurrentFrame].get());
+		vWaitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+		vWaitValues.push_back(0);
+	}
+	if (SubmitAsyncCompute())
+	{
+		vWaitSemaphores.push_back(m_ComputeTimeline.get());
+		vWaitStages.push_back(m_ComputeWaitStage);
+		vWaitValues.push_back(m_nComputeValue);
+	}
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(vWaitSemaphores.size());
+	submitInfo.pWaitSemaphores = vWaitSemaphores.data();
+	submitInfo.pWaitDstStageMask = vWaitStages.data();
+
+	// More sempahores - the frame timeline, and the image being ready to present
+	std::vector<vk::Semaphore> vSignalSemaphores = { m_FrameTimeline->GetSemaphore() };
+	std::vector<uint64_t> vSignalValues = { FrameTimeline::GetValue(m_nFrameNumber) };
+	if (!m_Config.bHeadless)
+	{
+		vSignalSemaphores.push_back(m_vRenderFinishedSemaphores[m_nCurrentFrame].get());
+		vSignalValues.push_back(0);
+	}
+	for (auto& pView : m_vViews)
+	{
+		if (!pView->bAcquired) continue;
+		vSignalSemaphores.push_back(pView->vRenderFinishedSemaphores[m_nCurrentFrame].get());
+		vSignalValues.push_back(0);
+	}
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(vSignalSemaphores.size());
+	submitInfo.pSignalSemaphores = vSignalSemaphores.data();
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(vWaitValues.size());
+	timelineInfo.pWaitSemaphoreValues = vWaitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(vSignalValues.size());
+	timelineInfo.pSignalSemaphoreValues = vSignalValues.data();
+	submitInfo.pNext = &timelineInfo;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_CommandBuffers[nImageIndex].get();
+	submitInfo.pCommandBuffers = &frame.commandBuffer.get();
 
-	// More sempahores
-	vk::Semaphore signalSemaphores[] = { m_vRenderFinishedSemaphores[m_nCurrentFrame].get() };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	// Submit commands - no fence, the timeline says when it's done
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nSubmit);
+		std::lock_guard<std::mutex> lock(m_QueueMutex);
+		m_GraphicsQueue.submit(submitInfo, vk::Fence{});
+	}
 
-	// Reset fences
-	m_Device.get().resetFences(m_vInFlightFences[m_nCurrentFrame]);
+	if (m_Config.bHeadless)
+	{
+		m_nFrameNumber++;
+		m_nCurrentFrame = (m_nCurrentFrame + 1) % m_nFramesInFlight;
+		return;
+	}
 
-	// Submit commands
-	m_GraphicsQueue.submit(submitInfo, m_vInFlightFences[m_nCurrentFrame]);
+	// Every window goes out in the one present, the main one first
+	std::vector<vk::Semaphore> vPresentSemaphores = { m_vRenderFinishedSemaphores[m_nCurrentFrame].get() };
+	std::vector<vk::SwapchainKHR> vSwapchains = { m_Swapchain.get() };
+	std::vector<uint32_t> vImageIndices = { nImageIndex };
+	std::vector<View*> vPresentedViews;
+	for (auto& pView : m_vViews)
+	{
+		if (!pView->bAcquired) continue;
+		pView->bAcquired = false;
+		vPresentSemaphores.push_back(pView->vRenderFinishedSemaphores[m_nCurrentFrame].get());
+		vSwapchains.push_back(pView->swapchain.get());
+		vImageIndices.push_back(pView->nImageIndex);
+		vPresentedViews.push_back(pView.get());
+	}
+	std::vector<vk::Result> vPresentResults(vSwapchains.size(), vk::Result::eSuccess);
 
 	vk::PresentInfoKHR presentInfo{};
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.waitSemaphoreCount = static_cast<uint32_t>(vPresentSemaphores.size());
+	presentInfo.pWaitSemaphores = vPresentSemaphores.data();
+	presentInfo.swapchainCount = static_cast<uint32_t>(vSwapchains.size());
+	presentInfo.pSwapchains = vSwapchains.data();
+	presentInfo.pImageIndices = vImageIndices.data();
+	presentInfo.pResults = vPresentResults.data();
+
+	// Latency mode learns how long frames take, and tags them so it can wait for them to be shown
+	uint64_t nPresentId = 0;
+	if (m_FramePacer)
+	{
+		double fGpuMs = 0.0;
+		for (const GpuPassTiming& timing : m_GpuProfiler->GetTimings()) fGpuMs += timing.fLastMs;
+		nPresentId = m_FramePacer->OnPresent(fGpuMs);
+	}
+#ifdef HOBBYVK_PRESENT_WAIT
+	// Only the main window's waited on, the rest are tagged 0 - no id
+	std::vector<uint64_t> vPresentIds(vSwapchains.size(), 0);
+	vPresentIds[0] = nPresentId;
+	vk::PresentIdKHR presentId = vk::PresentIdKHR(static_cast<uint32_t>(vPresentIds.size()), vPresentIds.data());
+	if (m_bPresentWait) presentInfo.pNext = &presentId;
+#endif
 
-	vk::SwapchainKHR swapChains[] = { m_Swapchain.get() };
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &nImageIndex;
+	// Suboptimal still presented fine, but we may as well keep up with the window. Each swapchain
+	// gets its own result, so one window going out of date doesn't stop the others
+	{
+		CpuProfiler::ScopedTimer timer(m_CpuProfiler, m_CpuStages.nPresent);
+		std::lock_guard<std::mutex> lock(m_QueueMutex);
+		static_cast<void>(m_PresentQueue.presentKHR(&presentInfo));
+	}
+	m_nFrameNumber++;
+	m_nCurrentFrame = (m_nCurrentFrame + 1) % m_nFramesInFlight;
 
-	m_PresentQueue.presentKHR(presentInfo);
+	for (size_t i = 0; i < vPresentedViews.size(); ++i)
+	{
+		vk::Result viewResult = vPresentResults[i + 1];
+		if (viewResult == vk::Result::eErrorOutOfDateKHR || viewResult == vk::Result::eSuboptimalKHR) vPresentedViews[i]->bOutOfDate = true;
+		else if (viewResult != vk::Result::eSuccess) throw std::runtime_error("Failed to present swapchain image!");
+	}
 
-	m_Window.Update();
-	m_nCurrentFrame = (m_nCurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	m_Window->Update();
+	vk::Result presentResult = vPresentResults[0];
+	if (presentResult == vk::Result::eErrorOutOfDateKHR || presentResult == vk::Result::eSuboptimalKHR || m_Window->m_bFramebufferResized) RecreateSwapChain();
+	else if (presentResult != vk::Result::eSuccess) throw std::runtime_error("Failed to present swapchain image!");
+}
+
+void Renderer::CreateReadbackBuffers()
+{
+	if (!m_Config.bHeadless) return;
+
+	// One per frame in flight, so reading one back never waits on the frame being recorded
+	vk::DeviceSize size = static_cast<vk::DeviceSize>(m_SwapChainExtent.width) * m_SwapChainExtent.height * 4; // 4 bytes per pixel
+	m_vReadbackBuffers.clear();
+	for (uint32_t i = 0; i < m_nFramesInFlight; ++i)
+	{
+		m_vReadbackBuffers.emplace_back(*m_Allocator, m_Device.get(), size, vk::BufferUsageFlagBits::eTransferDst,
+										vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+}
+
+bool Renderer::ReadbackFrame(std::vector<uint8_t>& vPixels)
+{
+	if (!m_Config.bHeadless || m_nFrameNumber == 0) return false;
+
+	// The last frame submitted, which could well still be rendering
+	size_t nFrame = (m_nCurrentFrame + m_nFramesInFlight - 1) % m_nFramesInFlight;
+	m_FrameTimeline->Wait(FrameTimeline::GetValue(m_nFrameNumber - 1));
+
+	const Buffer& buffer = m_vReadbackBuffers[nFrame];
+	vPixels.resize(static_cast<size_t>(buffer.GetSize()));
+	std::memcpy(vPixels.data(), buffer.GetMapped(), vPixels.size());
+	return true;
 }
 
 void Renderer::WaitIdle()
 {
+	// Idling the device counts as using every queue on it
+	std::lock_guard<std::mutex> lock(m_QueueMutex);
 	m_Device.get().waitIdle();
 }
 
 Renderer::~Renderer()
 {
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) m_Device.get().destroyFence(m_vInFlightFences[i]);
+	SavePipelineCache();
+
+	// Finish writing out captured frames while the buffers they're in still exist
+	if (m_FrameCapture)
+	{
+		WaitIdle();
+		m_FrameCapture.reset();
+	}
+
+	if (!m_Config.sCpuTimingsCsv.empty() && !m_CpuProfiler.WriteCsv(m_Config.sCpuTimingsCsv))
+		std::cerr << "Unable to write CPU timings to " << m_Config.sCpuTimingsCsv << "!" << std::endl;
+	if (!m_Config.sCpuTimingsJson.empty() && !m_CpuProfiler.WriteJson(m_Config.sCpuTimingsJson))
+		std::cerr << "Unable to write CPU timings to " << m_Config.sCpuTimingsJson << "!" << std::endl;
 
 	if (bEnableValidationLayers) DestroyDebugUtilsMessangerEXT(m_Instance.get(), m_DebugMessenger, nullptr);
 }
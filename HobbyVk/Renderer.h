@@ -11,41 +11,252 @@
 #include <vulkan/vulkan.hpp>
 
 #include "Window.h"
+#include "MemoryAllocator.h"
+#include "Buffer.h"
+#include "StagingRing.h"
+#include "Vertex.h"
+#include "JobSystem.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "Image.h"
+#include "FrameCapture.h"
+#include "GpuCuller.h"
+#include "InstanceBuffer.h"
+#include "Descriptors.h"
+#include "PipelineLibrary.h"
+#include "RenderGraph.h"
+#include "FrameTimeline.h"
+#include "FramePacer.h"
+#include "TextureStreamer.h"
+#include "AssetLibrary.h"
+#include "Mesh.h"
+#include "SceneStore.h"
+#include "DepthPyramid.h"
 #include <optional>
+#include <memory>
+#include <functional>
+#include <chrono>
+
+// Latency vs throughput knobs, fixed for the lifetime of the renderer
+struct RendererConfig
+{
+	// FIFO is v-sync and always available, FIFO relaxed tears when late rather than waiting a whole
+	// vblank, mailbox replaces queued frames for low latency without tearing, and immediate doesn't
+	// wait at all. Unsupported modes fall back to FIFO
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eMailbox;
+	uint32_t nFramesInFlight = 2;	// How far the CPU may run ahead of the GPU - more helps throughput, fewer helps latency
+	uint32_t nSwapchainImages = 0;	// 0 picks one more than the surface's minimum, clamped to what it supports
+
+	// Latency mode holds each frame back until as late as it can start and still make the next vblank - using
+	// VK_KHR_present_wait to see when frames reach the screen if it's there, predicting it from the refresh rate
+	// if not. Pairs best with FIFO, and costs throughput once frames take longer than a refresh. See FramePacer
+	bool bLowLatency = false;
+
+	// Headless renders into a ring of offscreen images rather than a window's swapchain, for
+	// machines without displays. nSwapchainImages then sets the ring's size (at least nFramesInFlight)
+	bool bHeadless = false;
+	uint32_t nMaxFrames = 0; // ShouldRun() goes false after this many frames, 0 for no limit
+
+	uint32_t nMaxInstances = 65536; // Per frame, see Renderer::SetInstanceUpdater
+
+	// MSAA sample count, rounded down to one the device can do with both colour and depth
+	uint32_t nMsaaSamples = 1;
+
+	// Cull and build the draw list on the GPU with a compute pass and indirect draws, rather than
+	// recording every draw across the job system
+	bool bGpuDriven = false;
+	uint32_t nMaxGpuObjects = 65536; // Meshlets the GPU culler can take, across every object in the scene
+
+	// GPU driven only - also cull whatever's behind what was drawn the frame before, against a pyramid of its depth.
+	// Needs single sampled, depth only depth buffers. Objects are a frame late appearing from behind anything
+	bool bOcclusionCulling = false;
+
+	// Use this GPU rather than the best scoring one, by index or (part of) its name, if it's suitable
+	std::string sDevice;
+
+	// Frames are captured to sCaptureTarget in the background if it's set - a file for raw,
+	// a filename prefix for PNG or a command to pipe frames into
+	CaptureSink captureSink = CaptureSink::eRaw;
+	std::string sCaptureTarget;
+
+	// Shaders are compiled from GLSL at startup, with the SPIR-V cached here between runs. Hot reload
+	// watches them (and their includes) and rebuilds the pipelines using any that are edited
+	std::string sShaderCacheDirectory = "ShaderCache";
+	bool bHotReload = false;
+
+	// A .hvkmesh (from HobbyVk --convert-mesh) to draw, through the asset library. The built in triangle if empty
+	std::string sMesh;
+
+	// Archives (from HobbyVk --pack-assets) that shaders, textures and the like are looked for in before loose files
+	std::vector<std::string> vAssetArchives;
+
+	// DrawFrame stage timings are written to these on exit, if set
+	std::string sCpuTimingsCsv;
+	std::string sCpuTimingsJson;
+};
+
+// Set 0, binding 0 - a dynamic uniform buffer from the uniform ring, pushed once a frame
+struct FrameUniforms
+{
+	glm::mat4 viewProjection;
+	glm::vec4 time; // Seconds since start in x, frame number in y
+};
+
+// What the last frame recorded. GPU driven draws are decided on the GPU, so they count everything that went to the cull
+struct FrameStats
+{
+	uint32_t nDraws = 0;
+	uint32_t nInstances = 0; // Of each draw - GPU driven draws are one each
+	uint64_t nTriangles = 0;
+};
+
+// Push constants, for small per draw data that doesn't warrant descriptors
+struct DrawConstants
+{
+	glm::vec4 transform; // Offset in xy, scale in z, rotation in w - applied on top of the instance's
+};
 
 class Renderer
 {
 public:
-	Renderer(const uint32_t width, const uint32_t height);
+	Renderer(const uint32_t width, const uint32_t height, const RendererConfig& config = RendererConfig{});
 	~Renderer();
 
-	inline bool ShouldRun() { return !m_Window.ShouldClose(); }
+	inline bool ShouldRun() { return (!m_Window || !m_Window->ShouldClose()) && (m_Config.nMaxFrames == 0 || m_nFrameNumber < m_Config.nMaxFrames); }
 
 	void DrawFrame();
 	void WaitIdle();
 
+	inline MemoryStats GetMemoryStats() { return m_Allocator->GetStats(); }
+	inline MemoryBudget GetMemoryBudget() { return m_Allocator->GetDeviceLocalBudget(); }
+	inline vk::PhysicalDeviceProperties GetDeviceProperties() const { return m_PhysicalDevice.getProperties(); }
+	inline const FrameStats& GetFrameStats() const { return m_FrameStats; }
+	inline JobSystem& GetJobSystem() { return *m_JobSystem; }
+	inline std::vector<GpuPassTiming> GetGpuTimings() const { return m_GpuProfiler->GetTimings(); } // A few frames behind
+	inline std::vector<CpuStageTiming> GetCpuTimings() const { return m_CpuProfiler.GetTimings(); }
+	inline LatencyTiming GetLatencyTiming() const { return m_FramePacer ? m_FramePacer->GetTiming() : LatencyTiming{}; } // Latency mode only
+
+	// Latency mode - blocks until the next frame should start, then polls input. Call it before reading input
+	// for the frame (or setting the camera from it), DrawFrame does otherwise. Returns straight away if it's off
+	void WaitForFrameStart();
+
+	// Copies out the last frame drawn, waiting for it to finish, as tightly packed pixels in GetFrameFormat().
+	// Only available when headless, returns false otherwise or if nothing's been drawn yet
+	bool ReadbackFrame(std::vector<uint8_t>& vPixels);
+	inline vk::Extent2D GetFrameExtent() const { return m_SwapChainExtent; }
+	inline vk::Format GetFrameFormat() const { return m_SwapchainImageFormat; }
+
+	// Camera, or identity for drawing straight into clip space as GPU driven culling does by default
+	inline void SetViewProjection(const glm::mat4& viewProjection) { m_ViewProjection = viewProjection; }
+
+	// Windows beyond the first, for more screens - each has a swapchain and render graph of its own, but shares the
+	// device and everything on it (pipelines, geometry, the scene), drawing the scene with its own camera (starting
+	// with the main one's). Every window's acquired each frame, recorded into the frame's one command buffer, submitted
+	// together and presented with a single vkQueuePresentKHR. Closing one hides it and stops it being drawn, closing
+	// the main one still ends things. Not when headless, or GPU driven - the culler has one draw list a frame
+	using WindowId = uint32_t; // The main window's 0
+	WindowId AddWindow(uint32_t nWidth, uint32_t nHeight, const std::string& sTitle);
+	void SetViewProjection(WindowId window, const glm::mat4& viewProjection);
+	inline uint32_t GetWindowCount() const { return 1 + static_cast<uint32_t>(m_vViews.size()); }
+
+	// Pipelines - derive variants from the scene's key, and Request them to have them built in the background
+	inline PipelineLibrary& GetPipelineLibrary() { return *m_PipelineLibrary; }
+	inline const GraphicsPipelineKey& GetScenePipelineKey() const { return m_SceneKey; }
+
+	// Descriptors - layouts are cached, and frame sets only live until the frame slot comes round again
+	inline DescriptorLayoutCache& GetDescriptorLayoutCache() { return *m_DescriptorLayoutCache; }
+	inline vk::DescriptorSet AllocateFrameDescriptorSet(vk::DescriptorSetLayout layout) { return m_DescriptorAllocator->Allocate(static_cast<uint32_t>(m_nCurrentFrame), layout); }
+
+	// Instancing - called every frame, once it's safe to write that frame's instance streams, and returns
+	// how many instances of each draw to make. Without one every draw gets a single untransformed instance.
+	// GPU driven draws take instance i for scene slot i instead (for all of its meshlets), ignoring the count, and
+	// without one that's the object's transform
+	using InstanceUpdater = std::function<uint32_t(InstanceStreams& streams, uint32_t nFrame)>;
+	inline void SetInstanceUpdater(InstanceUpdater updater) { m_InstanceUpdater = std::move(updater); }
+
+	// Async compute - recorded every frame into a command buffer on the compute queue and submitted ahead of
+	// the frame's graphics work, which waits for it at graphicsWaitStage. Resources used by both should be
+	// per frame in flight and shared between GetComputeSharingFamilies(). bAfterPreviousFrame also makes the
+	// compute work wait until the previous frame's graphics work is done, for things like post processing
+	using ComputeRecorder = std::function<void(vk::CommandBuffer commandBuffer, uint32_t nFrame)>;
+	void SetAsyncCompute(ComputeRecorder recorder, vk::PipelineStageFlags graphicsWaitStage = vk::PipelineStageFlagBits::eVertexInput, bool bAfterPreviousFrame = false);
+	inline vk::Pipeline GetComputePipeline(const std::string& sShaderFile, vk::PipelineLayout layout, const SpecializationConstants& constants = {})
+		{ return m_PipelineLibrary->GetCompute({ sShaderFile, constants, layout }); }
+	inline bool HasDedicatedComputeQueue() { QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice); return indices.computeFamily != indices.graphicsFamily; }
+	std::vector<uint32_t> GetComputeSharingFamilies();
+	inline vk::Device GetDevice() { return m_Device.get(); }
+	inline MemoryAllocator& GetAllocator() { return *m_Allocator; }
+	inline const AssetLibrary& GetAssetLibrary() const { return *m_AssetLibrary; }
+
+	// Textures - load them once, RequestSize each frame they're drawn, and write GetView into that frame's descriptor sets
+	inline TextureStreamer& GetTextureStreamer() { return *m_TextureStreamer; }
+	inline const Mesh& GetMesh() const { return m_Mesh; }
+
+	// Scene - everything drawn, and where. It starts off with the whole mesh, once, untransformed. Objects are frustum
+	// culled on the CPU before drawing, or by the GPU culler (a DrawObject per meshlet) when GPU driven, in which case
+	// they're drawn with instance i for slot i and the instances default to the objects' transforms
+	inline SceneStore& GetScene() { return m_Scene; }
+	inline uint32_t GetVisibleCount() const { return static_cast<uint32_t>(m_vVisible.size()); } // CPU culling only, for the last frame
+
 private:
 
 	// Main functions
 	void InitVulkan();
+	void CreateAssetLibrary();
 	void CreateInstance();
 	void SetupDebugMessanger();
 	bool CheckValidationLayerSupport();
 	void CreateSurface();
-	void CreateSwapChain();
+	void CreateSwapChain(vk::SwapchainKHR oldSwapchain = vk::SwapchainKHR{});
+	void RecreateSwapChain();
+	vk::UniqueSurfaceKHR CreateSurfaceFor(Window& window);
+	vk::UniqueSwapchainKHR CreateSwapchainFor(	vk::SurfaceKHR surface, Window& window, vk::SwapchainKHR oldSwapchain, bool bCapturable,
+												std::vector<vk::Image>& vImages, vk::Format& format, vk::Extent2D& extent);
+	std::vector<vk::UniqueImageView> CreateSwapchainImageViews(const std::vector<vk::Image>& vImages, vk::Format format);
+	void CreateOffscreenImages(); // The headless stand in for CreateSwapChain
+	void CreateReadbackBuffers();
 	void CreateImageViews();
-	void CreateRenderPass();
+	vk::Format FindDepthFormat();
+	vk::SampleCountFlagBits PickSampleCount(uint32_t nRequested);
+	void CreateRenderGraph();
+	GraphResource AddSceneAttachments(RenderGraph& graph, RenderGraph::PassBuilder& mainPass, GraphResource output, vk::Format format); // Returns the depth
+	void CreatePipelineCache();
+	void CreateDescriptors();
 	void CreateGraphicsPipeline();
-	void CreateFramebuffers();
-	void CreateCommandPool();
+	void CreateCommandPools();
+	void CreateStagingRing();
+	void CreateTextureStreamer();
+	void CreateGeometryBuffers();
+	void CreateVertexBuffer();
+	void CreateIndexBuffer();
 	void CreateCommandBuffers();
+	void CreateGpuProfiler();
+	void CreateComputeCommands();
+	void CreateGpuCuller();
+	void CreateInstanceBuffer();
+	void UpdateInstances();
+	void CullScene(); // Builds the draw list, or keeps the GPU culler's objects in step with the scene
+	void CreateDepthPyramid();
+	bool SubmitAsyncCompute(); // Returns whether there was any to submit
+	void CreateFrameCapture();
+	void RecordCommandBuffer(uint32_t nImageIndex);
+	struct SceneTarget;
+	void BindSceneState(vk::CommandBuffer commandBuffer, const SceneTarget& target);
+	void RecordScene(vk::CommandBuffer commandBuffer, const SceneTarget& target, uint32_t nFirstDraw, uint32_t nLastDraw);
+	void RecordSceneBatches(const SceneTarget& target, vk::RenderPass renderPass, vk::Framebuffer framebuffer, std::vector<vk::CommandBuffer>& vCommandBuffers);
+	vk::CommandBuffer BeginSecondaryCommandBuffer(uint32_t nThread, vk::RenderPass renderPass, vk::Framebuffer framebuffer); // Thread safe so long as each thread sticks to its own nThread
 	void CreateSyncObjects();
+	void RegisterCpuStages();
+	void RenderFrame(); // The body of DrawFrame, sans timing
 
 	// Picking and creating devices
 	void PickPhysicalDevice();
 	bool IsDeviceSuitable(vk::PhysicalDevice device);
+	uint64_t RateDevice(vk::PhysicalDevice device); // Higher is better, only meaningful for suitable devices
+	vk::DeviceSize GetDeviceLocalMemory(vk::PhysicalDevice device);
 	bool CheckDeviceExtensionSupport(vk::PhysicalDevice device);
 	void CreateLogicalDevice();
+	void CreateAllocator();
 
 	// Validation layers and debugging
 	std::vector<const char*> GetRequiredExtensions(); // Changes based on bEnableValidationLayers
@@ -68,40 +279,59 @@ private:
 		std::vector<vk::SurfaceFormatKHR> formats;
 		std::vector<vk::PresentModeKHR> presentModes;
 	};
-	SwapChainSupportDetails	QuerySwapChainSupport(vk::PhysicalDevice device);
+	SwapChainSupportDetails	QuerySwapChainSupport(vk::PhysicalDevice device, vk::SurfaceKHR surface);
 	vk::SurfaceFormatKHR	ChoseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR>& vAvailableFormats);
 	vk::PresentModeKHR		ChoseSwapPresentMode(const std::vector<vk::PresentModeKHR>& vAvailablePresentModes);
-	vk::Extent2D			ChoseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities);
+	vk::Extent2D			ChoseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities, Window& window);
+
+	// Extra windows, see AddWindow
+	struct View;
+	void CreateViewGraph(View& view);
+	bool RecreateView(View& view); // False while it's minimised
+	void AcquireViews();
+	void RecordViews(vk::CommandBuffer commandBuffer);
 
 	// Queue families
 	struct QueueFamilyIndices
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		std::optional<uint32_t> transferFamily; // Falls back to the graphics family if there's no dedicated one
+		std::optional<uint32_t> computeFamily; // Likewise
 		bool IsComplete() { return graphicsFamily.has_value() && presentFamily.has_value(); }
 	};
 	QueueFamilyIndices FindQueueFamilies(vk::PhysicalDevice device);
 
-	// Shaders
-	const std::vector<char> ReadFile(const std::string& sFilename);
-	vk::UniqueShaderModule CreateShaderModule(const std::vector<char>& vCode);
+	// Pipeline cache - persisted to disk so drivers needn't recompile shaders every launch
+	std::string GetPipelineCacheFilename();
+	bool IsPipelineCacheCompatible(const AssetSpan& data);
+	void SavePipelineCache();
 
 	const uint32_t m_Width;
 	const uint32_t m_Height;
+	const RendererConfig m_Config;
 
-	Window m_Window;
+	std::unique_ptr<Window> m_Window; // Null when headless
+
+	// Threads for recording, culling and uploads - the main thread just acquires, submits and presents
+	std::unique_ptr<JobSystem> m_JobSystem;
+	std::unique_ptr<AssetLibrary> m_AssetLibrary; // Before anything that loads from it, so it outlives them
 
 	vk::UniqueInstance m_Instance;
 
 	// Validation layers and device extensions //"VK_LAYER_LUNARG_api_dump"
 	const std::vector<const char*> m_vValidationLayers	 =  { "VK_LAYER_KHRONOS_validation" };
-	const std::vector<const char*> m_DeviceExtensions	 =  { VK_KHR_SWAPCHAIN_EXTENSION_NAME	};
+	std::vector<const char*> m_DeviceExtensions; // VK_KHR_swapchain is added unless headless
 	
 	// Devices, queue, surface
 	vk::PhysicalDevice m_PhysicalDevice;
 	vk::UniqueDevice m_Device; // Logical device
+	std::unique_ptr<MemoryAllocator> m_Allocator; // Must outlive every resource, but not the device
 	vk::Queue m_GraphicsQueue;
 	vk::Queue m_PresentQueue;
+	vk::Queue m_TransferQueue;
+	vk::Queue m_ComputeQueue;
+	std::mutex m_QueueMutex; // Held for every submit and present - the queues may well be one and the same, and the staging ring submits from I/O threads
 	vk::UniqueSurfaceKHR m_Surface;
 
 	// Swapchains
@@ -110,24 +340,209 @@ private:
 	vk::Format m_SwapchainImageFormat;
 	vk::Extent2D m_SwapChainExtent;
 	std::vector<vk::UniqueImageView> m_SwapchainImageViews;
-	std::vector<vk::UniqueFramebuffer> m_SwapchainFramebuffers;
 
-	// Pipeline and render pass
+	// Depth and multisampled colour are transient images in the render graph, picked once
+	vk::Format m_DepthFormat = vk::Format::eUndefined;
+	vk::SampleCountFlagBits m_MsaaSamples = vk::SampleCountFlagBits::e1;
+	std::vector<Image> m_vOffscreenImages; // Headless only, their handles are in m_SwapchainImages
+	std::vector<Buffer> m_vReadbackBuffers; // Headless only, one per frame in flight
+
+	// Extra windows - before the retired swapchains, as their surfaces have to outlive them
+	std::vector<std::unique_ptr<View>> m_vViews;
+
+	// Swapchains replaced on resize are kept alive until the frames in flight that used them are done,
+	// so resizing doesn't have to wait for the whole GPU to go idle
+	struct RetiredSwapchain
+	{
+		vk::UniqueSwapchainKHR swapchain;
+		std::vector<vk::UniqueImageView> vImageViews;
+		std::unique_ptr<RenderGraph> renderGraph; // Its framebuffers and transient images
+		std::unique_ptr<DepthPyramid> depthPyramid; // Sized to the old extent, and reading the old graph's depth
+		uint64_t nFrame; // Last frame which may have used it
+	};
+	std::vector<RetiredSwapchain> m_vRetiredSwapchains;
+
+	// Render graph - rebuilt with the swapchain, its render passes are cached so pipelines outlive it
+	std::unique_ptr<RenderPassCache> m_RenderPassCache;
+	std::unique_ptr<RenderGraph> m_RenderGraph;
+	vk::RenderPass m_RenderPass; // The main pass', owned by the cache
+	GraphPass m_MainPass = 0;
+	GraphResource m_OutputImage = 0;
+	GraphResource m_DrawBuffer = 0;
+	GraphResource m_DrawCountBuffer = 0;
+	GraphResource m_ReadbackBuffer = 0;
+	GraphResource m_DepthImage = 0;
+	uint32_t m_nImageIndex = 0; // Being recorded, for the graph's recorders
+	std::vector<vk::CommandBuffer> m_vSceneCommandBuffers; // This frame's, executed by the main pass
+
+	// Pipeline
+	vk::UniquePipelineCache m_PipelineCache;
 	vk::UniquePipelineLayout m_PipelineLayout;
-	vk::UniqueRenderPass m_RenderPass;
-	vk::UniquePipeline m_GraphicsPipeline;
+	std::unique_ptr<ShaderCompiler> m_ShaderCompiler;
+	std::unique_ptr<PipelineLibrary> m_PipelineLibrary;
+	GraphicsPipelineKey m_SceneKey;
+	vk::Pipeline m_GraphicsPipeline; // Owned by the library, and fetched again every frame in case it's been reloaded
+	std::chrono::steady_clock::time_point m_LastShaderCheck;
+
+	// Geometry - uploaded straight out of the mesh's mapping
+	Mesh m_Mesh;
+	SceneStore m_Scene;
+	std::vector<uint32_t> m_vVisible; // Slots that survived the CPU cull
+	std::unique_ptr<StagingRing> m_StagingRing;
+	std::unique_ptr<TextureStreamer> m_TextureStreamer; // Uploads through the ring, so is destroyed before it
+	Buffer m_VertexBuffer;
+	Buffer m_IndexBuffer;
+
+	// Draw list - recorded in batches of nDrawsPerBatch across the job system's threads
+	struct DrawCommand
+	{
+		uint32_t nIndexCount;
+		uint32_t nFirstIndex;
+		int32_t nVertexOffset;
+		glm::vec4 transform = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f); // Pushed as DrawConstants
+	};
+	std::vector<DrawCommand> m_vDrawCommands;
+	static constexpr uint32_t nDrawsPerBatch = 256;
+	void BuildDrawList(const glm::mat4& viewProjection, std::vector<uint32_t>& vVisible, std::vector<DrawCommand>& vDrawCommands); // Frustum culled
+
+	// What the scene's recorded with, for one window
+	struct SceneTarget
+	{
+		vk::Pipeline pipeline;
+		vk::Extent2D extent;
+		uint32_t nFrameUniformOffset;
+		const std::vector<DrawCommand>* pDrawCommands;
+	};
+	inline SceneTarget GetMainTarget() const { return { m_GraphicsPipeline, m_SwapChainExtent, m_nFrameUniformOffset, &m_vDrawCommands }; }
+
+	// A window beyond the first - everything the main one has in m_Window, m_Surface, m_Swapchain and so on, and its
+	// own render graph with just the main pass. Its draw list's culled for its camera, and recorded like the main one's
+	struct View
+	{
+		WindowId id = 0;
+		std::unique_ptr<Window> window; // Then its surface, then the swapchain on it, so they're destroyed the other way round
+		vk::UniqueSurfaceKHR surface;
+		vk::UniqueSwapchainKHR swapchain;
+		std::vector<vk::Image> vImages;
+		std::vector<vk::UniqueImageView> vImageViews;
+		vk::Format format;
+		vk::Extent2D extent;
+
+		std::unique_ptr<RenderGraph> renderGraph;
+		vk::RenderPass renderPass; // Owned by the cache, and the same as the main one unless the format's different
+		GraphPass mainPass = 0;
+		GraphResource outputImage = 0;
+
+		std::vector<vk::UniqueSemaphore> vImageAvailableSemaphores; // Per frame in flight, like the main window's
+		std::vector<vk::UniqueSemaphore> vRenderFinishedSemaphores;
+		std::vector<uint64_t> vImagesInFlight;
 
-	// Command buffers
-	vk::UniqueCommandPool m_CommandPool;
-	std::vector<vk::UniqueCommandBuffer> m_CommandBuffers; // SHould be automatically freed when their commands pools are destroyed
+		glm::mat4 viewProjection = glm::mat4(1.0f);
+		std::vector<uint32_t> vVisible;
+		std::vector<DrawCommand> vDrawCommands;
+		std::vector<vk::CommandBuffer> vSceneCommandBuffers; // This frame's, executed by its main pass
+
+		uint32_t nImageIndex = 0;
+		bool bAcquired = false;		// This frame - false if it's closed, minimised or was out of date
+		bool bOutOfDate = false;	// Recreated before the next acquire
+		bool bClosed = false;
+	};
+
+	// Command buffers - re-recorded every frame, so each frame in flight gets its own pools
+	// which are reset wholesale once its frame's finished on the timeline. Command pools mustn't be used by
+	// more than one thread at a time, hence a pool per recording thread for secondary buffers
+	struct ThreadCommandPool
+	{
+		vk::UniqueCommandPool commandPool;
+		std::vector<vk::UniqueCommandBuffer> vSecondaryCommandBuffers; // Reused after each reset
+		uint32_t nUsed = 0;
+	};
+	struct FrameCommands
+	{
+		vk::UniqueCommandPool commandPool;
+		vk::UniqueCommandBuffer commandBuffer; // Primary - should be automatically freed when its command pool is destroyed
+		std::vector<ThreadCommandPool> vThreadPools;
+	};
+	std::vector<FrameCommands> m_vFrameCommands;
+
+	// Async compute - one command buffer per frame in flight on the compute family. Waiting on the frame
+	// covers it, as the graphics work it's submitted with waits on it
+	struct ComputeCommands
+	{
+		vk::UniqueCommandPool commandPool;
+		vk::UniqueCommandBuffer commandBuffer;
+	};
+	std::vector<ComputeCommands> m_vComputeCommands;
+	ComputeRecorder m_ComputeRecorder;
+	vk::PipelineStageFlags m_ComputeWaitStage;
+	bool m_bComputeAfterPreviousFrame = false;
+	uint32_t m_nRecordingThreads;
+
+	std::unique_ptr<GpuProfiler> m_GpuProfiler;
+
+	// Descriptors - the frame uniform set is written once, each frame just gets a new dynamic offset into the ring
+	std::unique_ptr<DescriptorLayoutCache> m_DescriptorLayoutCache;
+	std::unique_ptr<DescriptorAllocator> m_DescriptorAllocator;
+	std::unique_ptr<UniformRing> m_UniformRing;
+	vk::UniqueDescriptorPool m_PersistentDescriptorPool;
+	vk::DescriptorSetLayout m_FrameSetLayout; // Owned by the cache
+	vk::DescriptorSet m_FrameDescriptorSet;
+	uint32_t m_nFrameUniformOffset = 0;
+	glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+	std::chrono::steady_clock::time_point m_StartTime = std::chrono::steady_clock::now();
+
+	std::unique_ptr<InstanceBuffer> m_InstanceBuffer; // Vertex bindings 1 and up
+	InstanceUpdater m_InstanceUpdater;
+	uint32_t m_nInstances = 1;
+	FrameStats m_FrameStats;
+	uint64_t m_nGpuTriangles = 0; // In m_vGpuObjects
+
+	std::unique_ptr<GpuCuller> m_GpuCuller; // Only when GPU driven
+	std::vector<DrawObject> m_vGpuObjects; // The scene, split into meshlets, as of m_nGpuObjectsVersion
+	uint64_t m_nGpuObjectsVersion = UINT64_MAX;
+	std::vector<uint64_t> m_vGpuFrameVersions; // Per frame in flight, what its copy of the objects is up to
+	std::unique_ptr<DepthPyramid> m_DepthPyramid; // Occlusion culling only
+	bool m_bOcclusionCulling = false;
+	bool m_bDrawIndirectCount = false;
+	bool m_bMultiDrawIndirect = false;
+	bool m_bDrawIndirectFirstInstance = false;
+	bool m_bMemoryBudget = false; // VK_EXT_memory_budget
+
+	std::unique_ptr<FrameCapture> m_FrameCapture;
+	bool m_bSwapchainTransferSrc = false; // Whether the swapchain images can be copied from, for capturing
+
+	// Where DrawFrame spends its time
+	CpuProfiler m_CpuProfiler;
+	struct CpuStages
+	{
+		uint32_t nFrame;
+		uint32_t nWaitForFrame;
+		uint32_t nAcquire;
+		uint32_t nWaitForImage;
+		uint32_t nCull;
+		uint32_t nRecord;
+		uint32_t nSubmit;
+		uint32_t nPresent;
+		uint32_t nPace;				// Latency mode holding the frame back
+		uint32_t nInputToPresent;	// Measured or predicted, for a recent frame rather than this one
+	} m_CpuStages;
 
 	// Sephamores
-	const int MAX_FRAMES_IN_FLIGHT = 2;
+	const uint32_t m_nFramesInFlight;
 	std::vector<vk::UniqueSemaphore> m_vImageAvailableSemaphores;
 	std::vector<vk::UniqueSemaphore> m_vRenderFinishedSemaphores;
-	std::vector<vk::Fence> m_vInFlightFences; // We do some funky stuff,
-	std::vector<vk::Fence> m_vImagesInFlight; // best manage memory ourselves
-	size_t m_nCurrentFrame;
+	std::vector<uint64_t> m_vImagesInFlight; // Frame timeline value of the last frame to use each image, 0 if none has
+	size_t m_nCurrentFrame = 0;
+	uint64_t m_nFrameNumber = 0; // Total frames drawn
+
+	// Timelines for the queues to wait on each other with - graphics signals FrameTimeline::GetValue(m_nFrameNumber)
+	// for each frame, which is also what the CPU paces itself on, and compute signals m_nComputeValue for each submission
+	std::unique_ptr<FrameTimeline> m_FrameTimeline;
+	std::unique_ptr<FramePacer> m_FramePacer; // Only in latency mode
+	bool m_bPresentWait = false;
+	bool m_bFrameStarted = false; // WaitForFrameStart's been called for the coming frame
+	vk::UniqueSemaphore m_ComputeTimeline;
+	uint64_t m_nComputeValue = 0;
 
 };
 
@@ -0,0 +1,216 @@
+#include "SceneStore.h"
+#include <cmath>
+
+// Widest there is for the target - MSVC only says if it's AVX, but x64 always has SSE2
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SCENE_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_SIMD_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SCENE_SIMD_NEON
+#endif
+
+SceneStore::ObjectId SceneStore::Add(const SceneDraw& draw, const glm::vec4& boundingSphere, const glm::vec4& transform)
+{
+	ObjectId id;
+	if (!m_vFreeIds.empty())
+	{
+		id = m_vFreeIds.back();
+		m_vFreeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<ObjectId>(m_vIdToSlot.size());
+		m_vIdToSlot.push_back(0);
+	}
+
+	uint32_t nSlot = GetCount();
+	m_vIdToSlot[id] = nSlot;
+	m_vSlotToId.push_back(id);
+	m_vDraws.push_back(draw);
+	m_vTransforms.push_back(transform);
+	m_vLocalSpheres.push_back(boundingSphere);
+	m_vCentreX.push_back(0.0f);
+	m_vCentreY.push_back(0.0f);
+	m_vCentreZ.push_back(0.0f);
+	m_vRadius.push_back(0.0f);
+	UpdateBounds(nSlot);
+	m_nVersion++;
+	return id;
+}
+
+void SceneStore::Remove(ObjectId id)
+{
+	// The last object moves into the hole, so the streams stay dense
+	uint32_t nSlot = m_vIdToSlot[id];
+	uint32_t nLast = GetCount() - 1;
+	if (nSlot != nLast)
+	{
+		m_vSlotToId[nSlot] = m_vSlotToId[nLast];
+		m_vIdToSlot[m_vSlotToId[nSlot]] = nSlot;
+		m_vDraws[nSlot] = m_vDraws[nLast];
+		m_vTransforms[nSlot] = m_vTransforms[nLast];
+		m_vLocalSpheres[nSlot] = m_vLocalSpheres[nLast];
+		m_vCentreX[nSlot] = m_vCentreX[nLast];
+		m_vCentreY[nSlot] = m_vCentreY[nLast];
+		m_vCentreZ[nSlot] = m_vCentreZ[nLast];
+		m_vRadius[nSlot] = m_vRadius[nLast];
+	}
+
+	m_vSlotToId.pop_back();
+	m_vDraws.pop_back();
+	m_vTransforms.pop_back();
+	m_vLocalSpheres.pop_back();
+	m_vCentreX.pop_back();
+	m_vCentreY.pop_back();
+	m_vCentreZ.pop_back();
+	m_vRadius.pop_back();
+	m_vFreeIds.push_back(id);
+	m_nVersion++;
+}
+
+void SceneStore::SetTransform(ObjectId id, const glm::vec4& transform)
+{
+	uint32_t nSlot = m_vIdToSlot[id];
+	m_vTransforms[nSlot] = transform;
+	UpdateBounds(nSlot);
+	m_nVersion++;
+}
+
+void SceneStore::Clear()
+{
+	m_vCentreX.clear();
+	m_vCentreY.clear();
+	m_vCentreZ.clear();
+	m_vRadius.clear();
+	m_vDraws.clear();
+	m_vTransforms.clear();
+	m_vLocalSpheres.clear();
+	m_vSlotToId.clear();
+	m_vIdToSlot.clear();
+	m_vFreeIds.clear();
+	m_nVersion++;
+}
+
+void SceneStore::UpdateBounds(uint32_t nSlot)
+{
+	glm::vec4 sphere = TransformSphere(m_vLocalSpheres[nSlot], m_vTransforms[nSlot]);
+	m_vCentreX[nSlot] = sphere.x;
+	m_vCentreY[nSlot] = sphere.y;
+	m_vCentreZ[nSlot] = sphere.z;
+	m_vRadius[nSlot] = sphere.w;
+}
+
+glm::vec4 SceneStore::TransformSphere(const glm::vec4& sphere, const glm::vec4& transform)
+{
+	// The same as Transform() in Shaders/shader.vert
+	float s = std::sin(transform.w);
+	float c = std::cos(transform.w);
+	float x = sphere.x * transform.z;
+	float y = sphere.y * transform.z;
+	return glm::vec4(c * x - s * y + transform.x, s * x + c * y + transform.y, sphere.z, sphere.w * std::abs(transform.z));
+}
+
+void SceneStore::Cull(const std::array<glm::vec4, 6>& planes, JobSystem& jobSystem, std::vector<uint32_t>& vVisible) const
+{
+	vVisible.clear();
+	uint32_t nBatches = (GetCount() + nCullBatchSize - 1) / nCullBatchSize;
+	if (m_vBatchVisible.size() < nBatches) m_vBatchVisible.resize(nBatches);
+
+	jobSystem.ParallelFor(GetCount(), nCullBatchSize, [&](uint32_t nBegin, uint32_t nEnd, uint32_t)
+	{
+		std::vector<uint32_t>& vBatch = m_vBatchVisible[nBegin / nCullBatchSize];
+		vBatch.clear();
+		CullRange(planes, nBegin, nEnd, vBatch);
+	});
+
+	for (uint32_t i = 0; i < nBatches; ++i) vVisible.insert(vVisible.end(), m_vBatchVisible[i].begin(), m_vBatchVisible[i].end());
+}
+
+void SceneStore::CullRange(const std::array<glm::vec4, 6>& planes, uint32_t nBegin, uint32_t nEnd, std::vector<uint32_t>& vVisible) const
+{
+	const float* pX = m_vCentreX.data();
+	const float* pY = m_vCentreY.data();
+	const float* pZ = m_vCentreZ.data();
+	const float* pRadius = m_vRadius.data();
+	uint32_t i = nBegin;
+
+	// A lane per object, all six planes at once - visible if it's not entirely behind any of them.
+	// Each lane's result comes out as a bit of the mask, lowest first
+#if defined(SCENE_SIMD_AVX)
+	for (; i + 8 <= nEnd; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(pX + i);
+		__m256 y = _mm256_loadu_ps(pY + i);
+		__m256 z = _mm256_loadu_ps(pZ + i);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(pRadius + i));
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+											_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z), _mm256_set1_ps(plane.w)));
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+		uint32_t nMask = static_cast<uint32_t>(_mm256_movemask_ps(visible));
+		for (uint32_t j = 0; nMask; ++j, nMask >>= 1) if (nMask & 1) vVisible.push_back(i + j);
+	}
+#elif defined(SCENE_SIMD_SSE)
+	for (; i + 4 <= nEnd; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(pX + i);
+		__m128 y = _mm_loadu_ps(pY + i);
+		__m128 z = _mm_loadu_ps(pZ + i);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(pRadius + i));
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+										 _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+		}
+		uint32_t nMask = static_cast<uint32_t>(_mm_movemask_ps(visible));
+		for (uint32_t j = 0; nMask; ++j, nMask >>= 1) if (nMask & 1) vVisible.push_back(i + j);
+	}
+#elif defined(SCENE_SIMD_NEON)
+	for (; i + 4 <= nEnd; i += 4)
+	{
+		float32x4_t x = vld1q_f32(pX + i);
+		float32x4_t y = vld1q_f32(pY + i);
+		float32x4_t z = vld1q_f32(pZ + i);
+		float32x4_t negativeRadius = vnegq_f32(vld1q_f32(pRadius + i));
+		uint32x4_t visible = vdupq_n_u32(0xFFFFFFFF);
+		for (const glm::vec4& plane : planes)
+		{
+			float32x4_t distance = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(plane.w), x, plane.x), y, plane.y), z, plane.z);
+			visible = vandq_u32(visible, vcgeq_f32(distance, negativeRadius));
+		}
+		uint32_t lanes[4];
+		vst1q_u32(lanes, visible);
+		for (uint32_t j = 0; j < 4; ++j) if (lanes[j]) vVisible.push_back(i + j);
+	}
+#endif
+
+	// Whatever doesn't fill a whole register, or everything if there's no SIMD
+	for (; i < nEnd; ++i)
+	{
+		bool bVisible = true;
+		for (const glm::vec4& plane : planes) bVisible = bVisible && plane.x * pX[i] + plane.y * pY[i] + plane.z * pZ[i] + plane.w >= -pRadius[i];
+		if (bVisible) vVisible.push_back(i);
+	}
+}
+
+const char* SceneStore::GetSimdName()
+{
+#if defined(SCENE_SIMD_AVX)
+	return "AVX";
+#elif defined(SCENE_SIMD_SSE)
+	return "SSE2";
+#elif defined(SCENE_SIMD_NEON)
+	return "NEON";
+#else
+	return "none";
+#endif
+}
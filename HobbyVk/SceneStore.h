@@ -0,0 +1,80 @@
+#pragma once
+#ifndef SCENE_STORE_H
+#define SCENE_STORE_H
+
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+#include "JobSystem.h"
+
+// Which part of the vertex and index buffers an object draws
+struct SceneDraw
+{
+	uint32_t nIndexCount;
+	uint32_t nFirstIndex;
+	int32_t nVertexOffset;
+};
+
+// Everything drawn, kept structure of arrays - culling only ever reads the world space bounding
+// spheres, so they're four tightly packed streams of floats that load straight into SIMD registers
+// (AVX, SSE or NEON, whichever the build targets), and the rest stays out of the cache until an object
+// turns out to be visible. Objects keep their ids, but their slots (the index into every stream)
+// move as others are removed: anything iterating should go by slot. Not thread safe, so change
+// it on the render thread between DrawFrames
+class SceneStore
+{
+public:
+	using ObjectId = uint32_t;
+	static constexpr ObjectId nInvalidObject = UINT32_MAX;
+
+	// boundingSphere is in the draw's own space, and transform is as DrawConstants - offset in xy, scale in z
+	// and rotation in w. Scale's uniform and everything stays in its plane, so the sphere moves with it
+	ObjectId Add(const SceneDraw& draw, const glm::vec4& boundingSphere, const glm::vec4& transform = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+	void Remove(ObjectId id);
+	void SetTransform(ObjectId id, const glm::vec4& transform);
+	void Clear();
+
+	inline uint32_t GetCount() const { return static_cast<uint32_t>(m_vDraws.size()); }
+	inline uint32_t GetSlot(ObjectId id) const { return m_vIdToSlot[id]; }
+	inline const SceneDraw& GetDraw(uint32_t nSlot) const { return m_vDraws[nSlot]; }
+	inline const glm::vec4& GetTransform(uint32_t nSlot) const { return m_vTransforms[nSlot]; }
+	inline glm::vec4 GetWorldSphere(uint32_t nSlot) const { return glm::vec4(m_vCentreX[nSlot], m_vCentreY[nSlot], m_vCentreZ[nSlot], m_vRadius[nSlot]); }
+	inline float GetScale(uint32_t nSlot) const { return m_vTransforms[nSlot].z; }
+	inline uint64_t GetVersion() const { return m_nVersion; } // Goes up with every change, for anything keeping a copy
+
+	// Fills vVisible with the slots of every object at least partly inside the planes (as from
+	// GpuCuller::ExtractFrustumPlanes), in slot order, with batches of them spread across the job system
+	void Cull(const std::array<glm::vec4, 6>& planes, JobSystem& jobSystem, std::vector<uint32_t>& vVisible) const;
+
+	static const char* GetSimdName(); // Which instruction set Cull was built for
+
+	// A sphere in a draw's own space moved to where transform puts it
+	static glm::vec4 TransformSphere(const glm::vec4& sphere, const glm::vec4& transform);
+
+private:
+	void UpdateBounds(uint32_t nSlot);
+	void CullRange(const std::array<glm::vec4, 6>& planes, uint32_t nBegin, uint32_t nEnd, std::vector<uint32_t>& vVisible) const;
+
+	// Big enough to be worth a job, small enough that there's plenty to steal
+	static constexpr uint32_t nCullBatchSize = 4096;
+
+	// Hot - world space bounding spheres
+	std::vector<float> m_vCentreX;
+	std::vector<float> m_vCentreY;
+	std::vector<float> m_vCentreZ;
+	std::vector<float> m_vRadius;
+
+	// Cold - only read for visible objects, or when something moves
+	std::vector<SceneDraw> m_vDraws;
+	std::vector<glm::vec4> m_vTransforms;
+	std::vector<glm::vec4> m_vLocalSpheres;
+
+	std::vector<ObjectId> m_vSlotToId;
+	std::vector<uint32_t> m_vIdToSlot;
+	std::vector<ObjectId> m_vFreeIds;
+	uint64_t m_nVersion = 0;
+
+	mutable std::vector<std::vector<uint32_t>> m_vBatchVisible; // Each batch's results, joined up in order once they're all done
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "ShaderCompiler.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	// Bump whenever the options below change, so stale SPIR-V in the cache isn't picked up
+	constexpr uint64_t nCacheVersion = 1;
+
+	uint64_t Fnv1a(const void* pData, size_t nSize, uint64_t nHash = 0xcbf29ce484222325ull)
+	{
+		const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+		for (size_t i = 0; i < nSize; ++i)
+		{
+			nHash ^= pBytes[i];
+			nHash *= 0x100000001b3ull;
+		}
+		return nHash;
+	}
+
+	// Resolves #include "file" relative to the file doing the including, and notes down everything
+	// it opens so the compiler knows what to watch
+	class Includer : public shaderc::CompileOptions::IncluderInterface
+	{
+	public:
+		Includer(const AssetLibrary& assets, std::vector<std::string>& vDependencies) : m_Assets(assets), m_vDependencies(vDependencies) {}
+
+		shaderc_include_result* GetInclude(const char* pRequested, shaderc_include_type type, const char* pRequesting, size_t) override
+		{
+			Include* pInclude = new Include();
+			std::filesystem::path path = type == shaderc_include_type_relative ? std::filesystem::path(pRequesting).parent_path() / pRequested : std::filesystem::path(pRequested);
+
+			AssetSpan source;
+			if (m_Assets.TryOpen(path.generic_string(), source))
+			{
+				pInclude->sName = path.generic_string();
+				pInclude->sContent.assign(reinterpret_cast<const char*>(source.GetData()), source.GetSize());
+				m_vDependencies.push_back(pInclude->sName);
+			}
+			else pInclude->sContent = "Unable to open file " + path.generic_string() + "!"; // An empty name means failure, with the content as the error
+
+			pInclude->result = { pInclude->sName.c_str(), pInclude->sName.size(), pInclude->sContent.c_str(), pInclude->sContent.size(), pInclude };
+			return &pInclude->result;
+		}
+
+		void ReleaseInclude(shaderc_include_result* pResult) override
+		{
+			delete static_cast<Include*>(pResult->user_data);
+		}
+
+	private:
+		struct Include
+		{
+			std::string sName;
+			std::string sContent;
+			shaderc_include_result result;
+		};
+
+		const AssetLibrary& m_Assets;
+		std::vector<std::string>& m_vDependencies;
+	};
+}
+
+ShaderCompiler::ShaderCompiler(const AssetLibrary& assets, const std::string& sCacheDirectory) : m_Assets(assets), m_sCacheDirectory(sCacheDirectory)
+{
+	std::error_code error;
+	std::filesystem::create_directories(m_sCacheDirectory, error);
+	if (error) std::cerr << "Unable to create shader cache " << m_sCacheDirectory << ", shaders will be compiled every run" << std::endl;
+}
+
+ShaderCode ShaderCompiler::Load(const std::string& sFilename)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Shaders.find(sFilename);
+		if (it != m_Shaders.end() && it->second.code) return it->second.code;
+	}
+
+	// Compiled without the lock, so shaders can build on several threads at once - two threads loading the same
+	// one just both do the work. Its write time's taken first, so an edit landing mid compile still gets noticed
+	std::error_code error;
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(sFilename, error);
+	std::vector<std::string> vDependencies = { sFilename };
+	ShaderCode code;
+	try
+	{
+		AssetSpan spirv;
+		if (std::filesystem::path(sFilename).extension() == ".spv")
+		{
+			spirv = m_Assets.Open(sFilename);
+			CheckSpirv(spirv, sFilename);
+		}
+		else spirv = Compile(sFilename, vDependencies);
+		code = std::make_shared<const AssetSpan>(std::move(spirv));
+	}
+	catch (...)
+	{
+		// Still watch what it was, so that it gets another go once it's fixed
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Shaders.find(sFilename);
+		if (it == m_Shaders.end()) m_Shaders[sFilename].vDependencies.push_back({ sFilename, writeTime });
+		throw;
+	}
+
+	std::vector<Dependency> vWatched = { { sFilename, writeTime } };
+	for (size_t i = 1; i < vDependencies.size(); ++i) vWatched.push_back({ vDependencies[i], std::filesystem::last_write_time(vDependencies[i], error) });
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Shader& shader = m_Shaders[sFilename];
+	shader.code = code;
+	shader.vDependencies = std::move(vWatched);
+	return code;
+}
+
+std::vector<std::string> ShaderCompiler::FindChanged()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::vector<std::string> vChanged;
+	for (auto& [sFilename, shader] : m_Shaders)
+	{
+		bool bChanged = false;
+		for (Dependency& dependency : shader.vDependencies)
+		{
+			// Editors often delete and rewrite files, so one that's briefly missing is left until it's back
+			std::error_code error;
+			std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(dependency.sFilename, error);
+			if (error || writeTime == dependency.writeTime) continue;
+			dependency.writeTime = writeTime;
+			bChanged = true;
+		}
+		if (!bChanged) continue;
+
+		shader.code.reset();
+		vChanged.push_back(sFilename);
+	}
+	return vChanged;
+}
+
+AssetSpan ShaderCompiler::Compile(const std::string& sFilename, std::vector<std::string>& vDependencies)
+{
+	// shaderc wants a string, so the source is about the only thing that's copied
+	AssetSpan source = m_Assets.Open(sFilename);
+	std::string sSource(reinterpret_cast<const char*>(source.GetData()), source.GetSize());
+	shaderc_shader_kind kind = GetShaderKind(sFilename);
+
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	options.SetIncluder(std::make_unique<Includer>(m_Assets, vDependencies));
+#ifdef _DEBUG
+	options.SetGenerateDebugInfo();
+#else
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+#endif
+
+	// Preprocessing's cheap next to compiling, and pulls the includes in, so its output is what's hashed
+	shaderc::PreprocessedSourceCompilationResult preprocessed = m_Compiler.PreprocessGlsl(sSource, kind, sFilename.c_str(), options);
+	if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success) throw std::runtime_error(preprocessed.GetErrorMessage());
+	std::string sPreprocessed(preprocessed.cbegin(), preprocessed.cend());
+
+	uint64_t nHash = Fnv1a(sPreprocessed.data(), sPreprocessed.size());
+	uint64_t nSettings[3] = { nCacheVersion, static_cast<uint64_t>(kind),
+#ifdef _DEBUG
+		1
+#else
+		0
+#endif
+	};
+	nHash = Fnv1a(nSettings, sizeof(nSettings), nHash);
+
+	std::stringstream sCacheFile;
+	sCacheFile << m_sCacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << nHash << ".spv";
+	AssetSpan cached;
+	if (AssetLibrary::TryOpenLoose(sCacheFile.str(), cached))
+	{
+		try
+		{
+			CheckSpirv(cached, sCacheFile.str());
+			return cached;
+		}
+		catch (const std::runtime_error&) {} // Half written by a crashed run, say, so compile it again
+	}
+
+	shaderc::SpvCompilationResult result = m_Compiler.CompileGlslToSpv(sPreprocessed, kind, sFilename.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success) throw std::runtime_error(result.GetErrorMessage());
+	std::vector<uint32_t> vCode(result.cbegin(), result.cend());
+
+	// Written to the side then moved into place, so another run (or thread) never sees half a file
+	std::stringstream sTemporary;
+	sTemporary << sCacheFile.str() << "." << std::this_thread::get_id() << ".tmp";
+	{
+		std::ofstream fCache(sTemporary.str(), std::ios::binary | std::ios::trunc);
+		fCache.write(reinterpret_cast<const char*>(vCode.data()), vCode.size() * sizeof(uint32_t));
+	}
+	std::error_code error;
+	std::filesystem::rename(sTemporary.str(), sCacheFile.str(), error);
+	if (error) std::filesystem::remove(sTemporary.str(), error);
+
+	return AssetSpan(std::move(vCode));
+}
+
+shaderc_shader_kind ShaderCompiler::GetShaderKind(const std::string& sFilename)
+{
+	std::string sExtension = std::filesystem::path(sFilename).extension().string();
+	if (sExtension == ".vert") return shaderc_vertex_shader;
+	if (sExtension == ".frag") return shaderc_fragment_shader;
+	if (sExtension == ".comp") return shaderc_compute_shader;
+	if (sExtension == ".geom") return shaderc_geometry_shader;
+	if (sExtension == ".tesc") return shaderc_tess_control_shader;
+	if (sExtension == ".tese") return shaderc_tess_evaluation_shader;
+	throw std::runtime_error("Unknown shader stage for " + sFilename + "!");
+}
+
+void ShaderCompiler::CheckSpirv(const AssetSpan& code, const std::string& sFilename)
+{
+	// Mapped straight from the file, which (being page or archive aligned) is aligned the way vk::ShaderModuleCreateInfo wants it
+	constexpr uint32_t nSpirvMagic = 0x07230203;
+	if (code.GetSize() < sizeof(uint32_t) || code.GetSize() % sizeof(uint32_t) != 0 || code.As<uint32_t>()[0] != nSpirvMagic)
+		throw std::runtime_error(sFilename + " isn't SPIR-V!");
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <shaderc/shaderc.hpp>
+#include "AssetLibrary.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+// SPIR-V words, straight out of the mapped cache file (or archive) where there is one
+using ShaderCode = std::shared_ptr<const AssetSpan>;
+
+// Turns GLSL into SPIR-V at runtime with shaderc, so there's no batch script to remember to run.
+// What comes out is cached on disk under a hash of the preprocessed source, includes and all, so
+// after the first boot nothing's compiled unless it actually changed. It also remembers which files
+// went into each shader, so it can tell which need reloading after an edit
+class ShaderCompiler
+{
+public:
+	// Sources (and .spv files) come from the asset library, the cache is always loose files on disk
+	ShaderCompiler(const AssetLibrary& assets, const std::string& sCacheDirectory);
+
+	// GLSL (by extension - .vert, .frag, .comp and so on) or already compiled .spv. Throws with
+	// the compiler's errors if it doesn't compile. Safe to call from any thread
+	ShaderCode Load(const std::string& sFilename);
+
+	// Shaders that, or whose includes, have been written to since they were loaded - the next Load
+	// of each recompiles it. Ones that then fail to compile are still watched, so fixing them works
+	std::vector<std::string> FindChanged();
+
+private:
+	struct Dependency
+	{
+		std::string sFilename;
+		std::filesystem::file_time_type writeTime;
+	};
+
+	struct Shader
+	{
+		ShaderCode code; // Null once it's changed, until it's loaded again
+		std::vector<Dependency> vDependencies; // The shader itself first
+	};
+
+	AssetSpan Compile(const std::string& sFilename, std::vector<std::string>& vDependencies);
+	static shaderc_shader_kind GetShaderKind(const std::string& sFilename);
+	static void CheckSpirv(const AssetSpan& code, const std::string& sFilename);
+
+	const AssetLibrary& m_Assets;
+	shaderc::Compiler m_Compiler; // Thread safe
+	std::string m_sCacheDirectory;
+
+	std::unordered_map<std::string, Shader> m_Shaders;
+	std::mutex m_Mutex;
+};
+
+#endif
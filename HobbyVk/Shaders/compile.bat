@@ -1,4 +1,8 @@
+rem Optional - the renderer compiles and caches these itself (see ShaderCompiler), this is just for checking them offline
 d:
 D:/VulkanSDK/1.2.148.1/Bin32/glslc.exe shader.vert -o vert.spv
 D:/VulkanSDK/1.2.148.1/Bin32/glslc.exe shader.frag -o frag.spv
+D:/VulkanSDK/1.2.148.1/Bin32/glslc.exe cull.comp -o cull.spv
+D:/VulkanSDK/1.2.148.1/Bin32/glslc.exe cull_occlusion.comp -o cull_occlusion.spv
+D:/VulkanSDK/1.2.148.1/Bin32/glslc.exe depth_pyramid.comp -o depth_pyramid.spv
 pause
\ No newline at end of file
@@ -0,0 +1,107 @@
+// Shared by cull.comp and cull_occlusion.comp, which differ only in whether OCCLUSION's defined
+
+// Set when the pipeline's built, see GpuCuller
+layout(local_size_x_id = 1) in;
+layout(constant_id = 0) const bool COMPACT = true;
+layout(constant_id = 2) const bool FIRST_INSTANCE = true; // Without drawIndirectFirstInstance the CPU binds each draw's instance instead
+
+struct DrawObject
+{
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint instance;
+	vec4 boundingSphere;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects { DrawObject objects[]; };
+layout(std430, binding = 1) writeonly buffer Draws { DrawCommand draws[]; };
+layout(std430, binding = 2) buffer DrawCount { uint drawCount; };
+
+layout(push_constant) uniform CullConstants
+{
+	vec4 planes[6];
+	uint objectCount;
+} cull;
+
+#ifdef OCCLUSION
+layout(binding = 3) uniform sampler2D depthPyramid; // Farthest depths, see DepthPyramid.h
+
+// See OcclusionUniforms in GpuCuller.h
+layout(std140, binding = 4) uniform Occlusion
+{
+	mat4 viewProjection;	// What the pyramid was drawn with, the frame before
+	uvec4 depthSize;		// The depth buffer's size in xy, the pyramid's levels in z, and w is 0 until it's been built
+} occlusion;
+
+// Whether the sphere's behind everything drawn over it last frame. Its bounding box's corners, projected, give a
+// rectangle on screen and the nearest it gets - and the first level where that rectangle's within 2x2 texels gives
+// the farthest anything is over it. Anything crossing the near plane is kept, as it could be anywhere on screen
+bool IsOccluded(vec4 sphere)
+{
+	if (occlusion.depthSize.w == 0) return false;
+
+	vec2 minimum = vec2(1.0);
+	vec2 maximum = vec2(-1.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = occlusion.viewProjection * vec4(corner, 1.0);
+		if (clip.w <= 0.0) return false;
+		vec3 ndc = clip.xyz / clip.w;
+		minimum = min(minimum, ndc.xy);
+		maximum = max(maximum, ndc.xy);
+		nearest = min(nearest, ndc.z);
+	}
+	if (nearest <= 0.0) return false;
+
+	// Depth buffer pixels first - level k's texels cover pixels p >> (k + 1), with the last one taking whatever's left over
+	ivec2 size = ivec2(occlusion.depthSize.xy);
+	ivec2 pixelMin = clamp(ivec2(floor((minimum * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+	ivec2 pixelMax = clamp(ivec2(floor((maximum * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+	int level = 0;
+	while (level + 1 < int(occlusion.depthSize.z) && any(greaterThan((pixelMax >> (level + 1)) - (pixelMin >> (level + 1)), ivec2(1)))) ++level;
+
+	ivec2 levelSize = textureSize(depthPyramid, level);
+	ivec2 texelMin = min(pixelMin >> (level + 1), levelSize - 1);
+	ivec2 texelMax = min(pixelMax >> (level + 1), levelSize - 1);
+	float farthest = max(	max(texelFetch(depthPyramid, texelMin, level).r, texelFetch(depthPyramid, ivec2(texelMax.x, texelMin.y), level).r),
+							max(texelFetch(depthPyramid, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(depthPyramid, texelMax, level).r));
+	return nearest > farthest;
+}
+#endif
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= cull.objectCount) return;
+
+	// Sphere against each frustum plane
+	DrawObject object = objects[index];
+	bool visible = true;
+	for (int i = 0; i < 6; ++i)
+	{
+		visible = visible && dot(cull.planes[i].xyz, object.boundingSphere.xyz) + cull.planes[i].w >= -object.boundingSphere.w;
+	}
+#ifdef OCCLUSION
+	visible = visible && !IsOccluded(object.boundingSphere);
+#endif
+
+	// Compacted when there's drawIndirectCount to make use of it, otherwise culled draws just draw nothing
+	if (COMPACT && !visible) return;
+	uint slot = COMPACT ? atomicAdd(drawCount, 1) : index;
+
+	// firstInstance carries the object's instance through to the vertex shader
+	draws[slot] = DrawCommand(object.indexCount, visible ? 1 : 0, object.firstIndex, object.vertexOffset, FIRST_INSTANCE ? object.instance : 0);
+}
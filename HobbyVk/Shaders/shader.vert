@@ -1,21 +1,51 @@
 #version 450
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// See Vertex.h - unpacked from halfs, snorms and unorms by the vertex input
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal; // Octahedral
+layout(location = 2) in vec4 inColour;
+
+// Per instance, see InstanceBuffer.h
+layout(location = 3) in vec4 inInstanceTransform; // Offset, scale, rotation
+layout(location = 4) in vec4 inInstanceColour;
+
+// See FrameUniforms and DrawConstants in Renderer.h
+layout(set = 0, binding = 0) uniform FrameUniforms
+{
+	mat4 viewProjection;
+	vec4 time;
+} frame;
+
+layout(push_constant) uniform DrawConstants
+{
+	vec4 transform;
+} draw;
 
 layout(location = 0) out vec3 fragColor;
 
+vec2 Transform(vec2 position, vec4 transform)
+{
+	float s = sin(transform.w);
+	float c = cos(transform.w);
+	return mat2(c, s, -s, c) * (position * transform.z) + transform.xy;
+}
+
+// The inverse of Vertex::EncodeOctahedral
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = max(-normal.z, 0.0);
+	normal.xy += vec2(normal.x >= 0.0 ? -t : t, normal.y >= 0.0 ? -t : t);
+	return normalize(normal);
+}
+
 void main()
 {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+	vec2 position = Transform(Transform(inPosition.xy, inInstanceTransform), draw.transform);
+	vec3 normal = DecodeOctahedral(inNormal);
+
+    gl_Position = frame.viewProjection * vec4(position, inPosition.z, 1.0);
+
+	// A little shading so meshes have some shape to them - anything facing the camera (like the triangle) is as it was
+	fragColor = inColour.rgb * inInstanceColour.rgb * (0.5 + 0.5 * abs(normal.z));
+}
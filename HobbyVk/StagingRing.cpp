@@ -0,0 +1,209 @@
+#include "StagingRing.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr vk::DeviceSize nStagingAlignment = 16;
+
+StagingRing::StagingRing(MemoryAllocator& allocator, vk::Device device, vk::Queue transferQueue, uint32_t nTransferFamily, vk::DeviceSize size, std::mutex& queueMutex)
+	: m_Device(device), m_TransferQueue(transferQueue), m_QueueMutex(queueMutex), m_nSize(size)
+{
+	m_Buffer = Buffer(allocator, device, size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+	// Command buffers are short lived and individually recycled
+	vk::CommandPoolCreateInfo poolInfo{};
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+	poolInfo.queueFamilyIndex = nTransferFamily;
+	m_CommandPool = m_Device.createCommandPoolUnique(poolInfo);
+
+	vk::SemaphoreTypeCreateInfo timelineInfo = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0);
+	vk::SemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.pNext = &timelineInfo;
+	m_Semaphore = m_Device.createSemaphoreUnique(semaphoreInfo);
+}
+
+void StagingRing::BeginBatch()
+{
+	Batch batch;
+	if (!m_vFreeCommandBuffers.empty())
+	{
+		batch.commandBuffer = std::move(m_vFreeCommandBuffers.back());
+		m_vFreeCommandBuffers.pop_back();
+		batch.commandBuffer.get().reset(vk::CommandBufferResetFlags{});
+	}
+	else
+	{
+		vk::CommandBufferAllocateInfo allocateInfo = vk::CommandBufferAllocateInfo(m_CommandPool.get(), vk::CommandBufferLevel::ePrimary, 1);
+		auto vCommandBuffers = m_Device.allocateCommandBuffersUnique(allocateInfo);
+		batch.commandBuffer = std::move(vCommandBuffers[0]);
+	}
+
+	vk::CommandBufferBeginInfo beginInfo = vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	batch.commandBuffer.get().begin(beginInfo);
+	m_CurrentBatch = std::move(batch);
+}
+
+void StagingRing::SubmitBatch()
+{
+	if (!m_CurrentBatch.has_value()) return;
+
+	Batch batch = std::move(m_CurrentBatch.value());
+	m_CurrentBatch.reset();
+	batch.commandBuffer.get().end();
+	batch.nSignalValue = m_nNextValue++;
+	batch.nRingEnd = m_nHead;
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &batch.nSignalValue;
+
+	vk::SubmitInfo submitInfo{};
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer.get();
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_Semaphore.get();
+	{
+		std::lock_guard<std::mutex> queueLock(m_QueueMutex);
+		m_TransferQueue.submit(submitInfo, vk::Fence{});
+	}
+
+	m_InFlightBatches.push_back(std::move(batch));
+}
+
+void StagingRing::RetireBatches(bool bWaitForOldest)
+{
+	if (bWaitForOldest && !m_InFlightBatches.empty())
+	{
+		uint64_t nValue = m_InFlightBatches.front().nSignalValue;
+		vk::SemaphoreWaitInfo waitInfo = vk::SemaphoreWaitInfo(vk::SemaphoreWaitFlags{}, 1, &m_Semaphore.get(), &nValue);
+		m_Device.waitSemaphores(waitInfo, UINT64_MAX);
+	}
+
+	// Everything up to the completed value is done with its slice of the ring
+	uint64_t nCompleted = m_Device.getSemaphoreCounterValue(m_Semaphore.get());
+	while (!m_InFlightBatches.empty() && m_InFlightBatches.front().nSignalValue <= nCompleted)
+	{
+		m_nTail = m_InFlightBatches.front().nRingEnd;
+		m_vFreeCommandBuffers.push_back(std::move(m_InFlightBatches.front().commandBuffer));
+		m_InFlightBatches.pop_front();
+	}
+}
+
+vk::DeviceSize StagingRing::Reserve(vk::DeviceSize size)
+{
+	size = (size + nStagingAlignment - 1) / nStagingAlignment * nStagingAlignment;
+
+	while (true)
+	{
+		// Never straddle the end of the ring - skip to the start instead
+		vk::DeviceSize offset = m_nHead % m_nSize;
+		if (offset + size > m_nSize)
+		{
+			vk::DeviceSize nSkip = m_nSize - offset;
+			if (m_nHead + nSkip - m_nTail <= m_nSize) { m_nHead += nSkip; continue; }
+		}
+		else if (m_nHead + size - m_nTail <= m_nSize)
+		{
+			m_nHead += size;
+			return offset;
+		}
+
+		// Ring's full, so we'll have to wait for the transfer queue to catch up. If what's
+		// hogging the ring hasn't even been submitted yet then do so first
+		if (m_InFlightBatches.empty()) SubmitBatch();
+		RetireBatches(true);
+		if (!m_CurrentBatch.has_value()) BeginBatch();
+	}
+}
+
+void StagingRing::Upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void* pData, vk::DeviceSize size)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	RetireBatches(false);
+
+	const char* pSource = static_cast<const char*>(pData);
+	vk::DeviceSize nChunkSize = m_nSize / 2; // Anything bigger is uploaded in pieces
+	while (size > 0)
+	{
+		if (!m_CurrentBatch.has_value()) BeginBatch();
+
+		vk::DeviceSize nChunk = std::min(size, nChunkSize);
+		vk::DeviceSize offset = Reserve(nChunk);
+		std::memcpy(static_cast<char*>(m_Buffer.GetMapped()) + offset, pSource, static_cast<size_t>(nChunk));
+
+		vk::BufferCopy copyRegion = vk::BufferCopy(offset, dstOffset, nChunk);
+		m_CurrentBatch->commandBuffer.get().copyBuffer(m_Buffer.Get(), dst, copyRegion);
+
+		pSource += nChunk;
+		dstOffset += nChunk;
+		size -= nChunk;
+	}
+}
+
+void StagingRing::UploadImageLevel(	vk::Image dst, uint32_t nMipLevel, vk::Extent2D extent, uint32_t nBlockWidth, uint32_t nBlockHeight,
+									uint32_t nBlockSize, const void* pData, vk::ImageLayout finalLayout)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	RetireBatches(false);
+	if (!m_CurrentBatch.has_value()) BeginBatch();
+
+	vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, nMipLevel, 1, 0, 1);
+	vk::ImageMemoryBarrier toTransfer = vk::ImageMemoryBarrier(	vk::AccessFlags{}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined,
+																vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, dst, range);
+	m_CurrentBatch->commandBuffer.get().pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+														vk::DependencyFlags{}, nullptr, nullptr, toTransfer);
+
+	// Levels bigger than a chunk go in bands of whole block rows
+	uint32_t nBlocksWide = (extent.width + nBlockWidth - 1) / nBlockWidth;
+	uint32_t nBlocksHigh = (extent.height + nBlockHeight - 1) / nBlockHeight;
+	vk::DeviceSize nRowSize = static_cast<vk::DeviceSize>(nBlocksWide) * nBlockSize;
+	uint32_t nRowsPerChunk = static_cast<uint32_t>(std::max<vk::DeviceSize>(1, (m_nSize / 2) / nRowSize));
+
+	const char* pSource = static_cast<const char*>(pData);
+	for (uint32_t nRow = 0; nRow < nBlocksHigh; nRow += nRowsPerChunk)
+	{
+		if (!m_CurrentBatch.has_value()) BeginBatch();
+
+		uint32_t nRows = std::min(nRowsPerChunk, nBlocksHigh - nRow);
+		vk::DeviceSize nChunk = nRows * nRowSize;
+		vk::DeviceSize offset = Reserve(nChunk);
+		std::memcpy(static_cast<char*>(m_Buffer.GetMapped()) + offset, pSource, static_cast<size_t>(nChunk));
+
+		// Partial blocks at the edges are still copied whole, the extent just stops at the level's edge
+		uint32_t nY = nRow * nBlockHeight;
+		vk::BufferImageCopy copyRegion{};
+		copyRegion.bufferOffset = offset;
+		copyRegion.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, nMipLevel, 0, 1);
+		copyRegion.imageOffset = vk::Offset3D(0, static_cast<int32_t>(nY), 0);
+		copyRegion.imageExtent = vk::Extent3D(extent.width, std::min(nRows * nBlockHeight, extent.height - nY), 1);
+		m_CurrentBatch->commandBuffer.get().copyBufferToImage(m_Buffer.Get(), dst, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+
+		pSource += nChunk;
+	}
+
+	// The transfer queue can't name the stages that'll read it - the semaphore the frame waits on covers that
+	if (!m_CurrentBatch.has_value()) BeginBatch();
+	vk::ImageMemoryBarrier toFinal = vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags{}, vk::ImageLayout::eTransferDstOptimal,
+															finalLayout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, dst, range);
+	m_CurrentBatch->commandBuffer.get().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+														vk::DependencyFlags{}, nullptr, nullptr, toFinal);
+}
+
+uint64_t StagingRing::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	SubmitBatch();
+	return m_nNextValue - 1;
+}
+
+void StagingRing::WaitIdle()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	SubmitBatch();
+	while (!m_InFlightBatches.empty()) RetireBatches(true);
+}
+
+StagingRing::~StagingRing()
+{
+	WaitIdle();
+}
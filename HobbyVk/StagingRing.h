@@ -0,0 +1,71 @@
+#pragma once
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include "Buffer.h"
+#include <deque>
+#include <optional>
+
+// Uploads data to device local buffers through a persistently mapped ring of host memory.
+// Copies are batched into command buffers on the (ideally dedicated) transfer queue, each
+// batch signalling a timeline semaphore value that the graphics queue can wait on, so
+// uploads run alongside rendering rather than stalling it
+class StagingRing
+{
+public:
+	// Without a transfer only family the queue's the graphics one, shared with the render thread - so every submit
+	// to it, by us or anyone else, has to hold queueMutex (Vulkan wants queues externally synchronised)
+	StagingRing(MemoryAllocator& allocator, vk::Device device, vk::Queue transferQueue, uint32_t nTransferFamily, vk::DeviceSize size, std::mutex& queueMutex);
+	~StagingRing();
+
+	// Copies pData into the ring now and queues a copy to dst. Large uploads are split up
+	void Upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void* pData, vk::DeviceSize size);
+
+	// Same for one mip level of a 2D image, tightly packed rows of nBlockSize byte blocks (1x1 texel
+	// ones for uncompressed formats). The level's transitioned from undefined, so whatever was in it is
+	// gone, and left in finalLayout. The image needs to be shared with the transfer queue's family, and
+	// the frame that samples it to wait on Flush()'s value
+	void UploadImageLevel(	vk::Image dst, uint32_t nMipLevel, vk::Extent2D extent, uint32_t nBlockWidth, uint32_t nBlockHeight,
+							uint32_t nBlockSize, const void* pData, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+	// Submits anything queued since the last flush, returning the semaphore value which
+	// signals once everything uploaded so far has landed (0 if nothing has ever been uploaded)
+	uint64_t Flush();
+	void WaitIdle();
+
+	inline vk::Semaphore GetSemaphore() const { return m_Semaphore.get(); }
+
+private:
+	struct Batch
+	{
+		vk::UniqueCommandBuffer commandBuffer;
+		uint64_t nSignalValue = 0;
+		uint64_t nRingEnd = 0; // Ring head once the batch was submitted, where the tail may advance to once it's done
+	};
+
+	vk::DeviceSize Reserve(vk::DeviceSize size); // Returns offset into the ring
+	void BeginBatch();
+	void SubmitBatch();
+	void RetireBatches(bool bWaitForOldest);
+
+	vk::Device m_Device;
+	vk::Queue m_TransferQueue;
+	std::mutex& m_QueueMutex;
+
+	Buffer m_Buffer;
+	vk::DeviceSize m_nSize;
+	uint64_t m_nHead = 0; // Both only ever increase, wrap with % m_nSize
+	uint64_t m_nTail = 0;
+
+	vk::UniqueCommandPool m_CommandPool;
+	vk::UniqueSemaphore m_Semaphore; // Timeline
+	uint64_t m_nNextValue = 1;
+
+	std::optional<Batch> m_CurrentBatch;
+	std::deque<Batch> m_InFlightBatches;
+	std::vector<vk::UniqueCommandBuffer> m_vFreeCommandBuffers;
+
+	std::mutex m_Mutex;
+};
+
+#endif
@@ -0,0 +1,481 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+
+// Levels this small (and smaller) are always resident, so there's never nothing to sample
+constexpr uint32_t nTailSize = 64;
+
+// Frames without a request before a texture's happy with just its tail
+constexpr uint64_t nDemandFrames = 30;
+
+// Evict above the one, stream in below the other - the gap stops the two undoing each other
+constexpr float fEvictAbove = 0.9f;
+constexpr float fStreamBelow = 0.85f;
+
+// Images being rebuilt at once, each of which holds its old one alive until it's swapped
+constexpr uint32_t nMaxStreams = 4;
+
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t nVkFormat;
+	uint32_t nTypeSize;
+	uint32_t nPixelWidth;
+	uint32_t nPixelHeight;
+	uint32_t nPixelDepth;
+	uint32_t nLayerCount;
+	uint32_t nFaceCount;
+	uint32_t nLevelCount;
+	uint32_t nSupercompressionScheme;
+	uint32_t nDfdByteOffset;
+	uint32_t nDfdByteLength;
+	uint32_t nKvdByteOffset;
+	uint32_t nKvdByteLength;
+	uint64_t nSgdByteOffset;
+	uint64_t nSgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header isn't packed as expected");
+
+struct Ktx2Level
+{
+	uint64_t nByteOffset;
+	uint64_t nByteLength;
+	uint64_t nUncompressedByteLength;
+};
+
+constexpr uint8_t ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+struct FormatBlock
+{
+	vk::Format format;
+	uint32_t nWidth;
+	uint32_t nHeight;
+	uint32_t nSize; // Bytes
+};
+
+// What we know how to lay out - anything else is turned away when it's loaded
+static const FormatBlock formatBlocks[] =
+{
+	{ vk::Format::eR8Unorm, 1, 1, 1 },
+	{ vk::Format::eR8G8Unorm, 1, 1, 2 },
+	{ vk::Format::eR8G8B8A8Unorm, 1, 1, 4 },
+	{ vk::Format::eR8G8B8A8Srgb, 1, 1, 4 },
+	{ vk::Format::eB8G8R8A8Unorm, 1, 1, 4 },
+	{ vk::Format::eB8G8R8A8Srgb, 1, 1, 4 },
+	{ vk::Format::eR16G16B16A16Sfloat, 1, 1, 8 },
+	{ vk::Format::eR32G32B32A32Sfloat, 1, 1, 16 },
+	{ vk::Format::eBc1RgbUnormBlock, 4, 4, 8 },
+	{ vk::Format::eBc1RgbSrgbBlock, 4, 4, 8 },
+	{ vk::Format::eBc1RgbaUnormBlock, 4, 4, 8 },
+	{ vk::Format::eBc1RgbaSrgbBlock, 4, 4, 8 },
+	{ vk::Format::eBc2UnormBlock, 4, 4, 16 },
+	{ vk::Format::eBc2SrgbBlock, 4, 4, 16 },
+	{ vk::Format::eBc3UnormBlock, 4, 4, 16 },
+	{ vk::Format::eBc3SrgbBlock, 4, 4, 16 },
+	{ vk::Format::eBc4UnormBlock, 4, 4, 8 },
+	{ vk::Format::eBc4SnormBlock, 4, 4, 8 },
+	{ vk::Format::eBc5UnormBlock, 4, 4, 16 },
+	{ vk::Format::eBc5SnormBlock, 4, 4, 16 },
+	{ vk::Format::eBc6HUfloatBlock, 4, 4, 16 },
+	{ vk::Format::eBc6HSfloatBlock, 4, 4, 16 },
+	{ vk::Format::eBc7UnormBlock, 4, 4, 16 },
+	{ vk::Format::eBc7SrgbBlock, 4, 4, 16 },
+	{ vk::Format::eEtc2R8G8B8UnormBlock, 4, 4, 8 },
+	{ vk::Format::eEtc2R8G8B8SrgbBlock, 4, 4, 8 },
+	{ vk::Format::eEtc2R8G8B8A8UnormBlock, 4, 4, 16 },
+	{ vk::Format::eEtc2R8G8B8A8SrgbBlock, 4, 4, 16 },
+	{ vk::Format::eAstc4x4UnormBlock, 4, 4, 16 },
+	{ vk::Format::eAstc4x4SrgbBlock, 4, 4, 16 },
+	{ vk::Format::eAstc5x5UnormBlock, 5, 5, 16 },
+	{ vk::Format::eAstc5x5SrgbBlock, 5, 5, 16 },
+	{ vk::Format::eAstc6x6UnormBlock, 6, 6, 16 },
+	{ vk::Format::eAstc6x6SrgbBlock, 6, 6, 16 },
+	{ vk::Format::eAstc8x8UnormBlock, 8, 8, 16 },
+	{ vk::Format::eAstc8x8SrgbBlock, 8, 8, 16 },
+	{ vk::Format::eAstc10x10UnormBlock, 10, 10, 16 },
+	{ vk::Format::eAstc10x10SrgbBlock, 10, 10, 16 },
+	{ vk::Format::eAstc12x12UnormBlock, 12, 12, 16 },
+	{ vk::Format::eAstc12x12SrgbBlock, 12, 12, 16 },
+};
+
+TextureStreamer::TextureStreamer(	MemoryAllocator& allocator, vk::PhysicalDevice physicalDevice, vk::Device device, StagingRing& stagingRing, const AssetLibrary& assets,
+									std::vector<uint32_t> vQueueFamilies, uint32_t nFramesInFlight, float fMaxAnisotropy, uint32_t nIoThreads)
+	: m_Allocator(allocator), m_PhysicalDevice(physicalDevice), m_Device(device), m_StagingRing(stagingRing), m_Assets(assets), m_nFramesInFlight(nFramesInFlight)
+{
+	std::set<uint32_t> uniqueFamilies(vQueueFamilies.begin(), vQueueFamilies.end());
+	m_vQueueFamilies.assign(uniqueFamilies.begin(), uniqueFamilies.end());
+
+	// Plain white, so whatever it's multiplied with comes through as is
+	vk::ImageCreateInfo fallbackInfo{};
+	fallbackInfo.imageType = vk::ImageType::e2D;
+	fallbackInfo.format = vk::Format::eR8G8B8A8Unorm;
+	fallbackInfo.extent = vk::Extent3D(1, 1, 1);
+	fallbackInfo.mipLevels = 1;
+	fallbackInfo.arrayLayers = 1;
+	fallbackInfo.samples = vk::SampleCountFlagBits::e1;
+	fallbackInfo.tiling = vk::ImageTiling::eOptimal;
+	fallbackInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+	fallbackInfo.initialLayout = vk::ImageLayout::eUndefined;
+	if (m_vQueueFamilies.size() > 1)
+	{
+		fallbackInfo.sharingMode = vk::SharingMode::eConcurrent;
+		fallbackInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_vQueueFamilies.size());
+		fallbackInfo.pQueueFamilyIndices = m_vQueueFamilies.data();
+	}
+	m_Fallback = Image(m_Allocator, m_Device, fallbackInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+	uint32_t nWhite = 0xFFFFFFFF;
+	m_StagingRing.UploadImageLevel(m_Fallback.Get(), 0, vk::Extent2D(1, 1), 1, 1, sizeof(nWhite), &nWhite);
+	m_StagingRing.Flush();
+
+	// Views only ever have the resident levels in them, so there's no need to clamp the LOD
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear;
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.anisotropyEnable = fMaxAnisotropy > 1.0f;
+	samplerInfo.maxAnisotropy = fMaxAnisotropy;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	m_Sampler = m_Device.createSamplerUnique(samplerInfo);
+
+	for (uint32_t i = 0; i < std::max(1u, nIoThreads); ++i) m_vIoThreads.emplace_back(&TextureStreamer::IoThread, this);
+}
+
+TextureHandle TextureStreamer::Load(const std::string& sFilename)
+{
+	auto texture = std::make_unique<Texture>();
+	texture->sFilename = sFilename;
+	texture->file = m_Assets.Open(sFilename);
+
+	const uint8_t* pData = texture->file.GetData();
+	size_t nFileSize = texture->file.GetSize();
+	if (nFileSize < sizeof(Ktx2Header)) throw std::runtime_error(sFilename + " is too small to be a KTX2 file");
+
+	Ktx2Header header;
+	std::memcpy(&header, pData, sizeof(header));
+	if (std::memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0) throw std::runtime_error(sFilename + " isn't a KTX2 file");
+
+	// Basis (format 0) and zstd payloads would need transcoding or inflating first, which we don't do
+	if (header.nSupercompressionScheme != 0 || header.nVkFormat == 0) throw std::runtime_error(sFilename + " is supercompressed, which isn't supported");
+	if (header.nPixelWidth == 0 || header.nPixelHeight == 0 || header.nPixelDepth > 0 || header.nLayerCount > 1 || header.nFaceCount != 1)
+		throw std::runtime_error(sFilename + " isn't a plain 2D texture");
+
+	texture->format = static_cast<vk::Format>(header.nVkFormat);
+	const FormatBlock* pBlock = nullptr;
+	for (const auto& block : formatBlocks) if (block.format == texture->format) pBlock = &block;
+	if (!pBlock) throw std::runtime_error(sFilename + " is in a format that isn't supported (" + vk::to_string(texture->format) + ")");
+	texture->nBlockWidth = pBlock->nWidth;
+	texture->nBlockHeight = pBlock->nHeight;
+	texture->nBlockSize = pBlock->nSize;
+
+	vk::FormatProperties formatProperties = m_PhysicalDevice.getFormatProperties(texture->format);
+	if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage))
+		throw std::runtime_error(sFilename + " is in a format this GPU can't sample (" + vk::to_string(texture->format) + ")");
+
+	// The level index follows the header, biggest level first, and there can't be more levels than halve down to 1x1
+	uint32_t nLevels = std::max(1u, header.nLevelCount);
+	uint32_t nMaxLevels = 1;
+	for (uint32_t nExtent = std::max(header.nPixelWidth, header.nPixelHeight); nExtent > 1; nExtent >>= 1) ++nMaxLevels;
+	if (nLevels > nMaxLevels) throw std::runtime_error(sFilename + " has more levels than its size allows");
+	if (nFileSize < sizeof(Ktx2Header) + nLevels * sizeof(Ktx2Level)) throw std::runtime_error(sFilename + " is truncated");
+	for (uint32_t i = 0; i < nLevels; ++i)
+	{
+		Ktx2Level ktxLevel;
+		std::memcpy(&ktxLevel, pData + sizeof(Ktx2Header) + i * sizeof(Ktx2Level), sizeof(ktxLevel));
+
+		Level level;
+		level.extent = vk::Extent2D(std::max(1u, header.nPixelWidth >> i), std::max(1u, header.nPixelHeight >> i));
+
+		// Offsets and lengths are 64-bit in the file, so check them before they could wrap
+		uint64_t nBlocksWide = (level.extent.width + pBlock->nWidth - 1) / pBlock->nWidth;
+		uint64_t nBlocksHigh = (level.extent.height + pBlock->nHeight - 1) / pBlock->nHeight;
+		bool bOutside = ktxLevel.nByteOffset > nFileSize || ktxLevel.nByteLength > nFileSize - ktxLevel.nByteOffset;
+		if (ktxLevel.nByteLength != nBlocksWide * nBlocksHigh * pBlock->nSize || bOutside)
+			throw std::runtime_error(sFilename + " has a malformed level " + std::to_string(i));
+		level.nOffset = ktxLevel.nByteOffset;
+		level.nSize = ktxLevel.nByteLength;
+		texture->vLevels.push_back(level);
+	}
+
+	texture->nTailMip = nLevels - 1;
+	for (uint32_t i = 0; i < nLevels; ++i)
+	{
+		if (std::max(texture->vLevels[i].extent.width, texture->vLevels[i].extent.height) <= nTailSize) { texture->nTailMip = i; break; }
+	}
+
+	// Nothing's resident until the tail's in
+	texture->nResidentMip = nLevels;
+	texture->nDesiredMip = texture->nTailMip;
+	texture->nLastRequested = m_nFrame;
+
+	TextureHandle handle = static_cast<TextureHandle>(m_vTextures.size());
+	m_vTextures.push_back(std::move(texture));
+	Queue(handle, m_vTextures[handle]->nTailMip);
+	return handle;
+}
+
+void TextureStreamer::RequestSize(TextureHandle texture, float fScreenTexels)
+{
+	Texture& t = *m_vTextures[texture];
+	t.fRequestedTexels = std::max(t.fRequestedTexels, fScreenTexels);
+}
+
+vk::ImageView TextureStreamer::GetView(TextureHandle texture) const
+{
+	const Texture& t = *m_vTextures[texture];
+	return t.image.IsValid() ? t.image.GetView() : m_Fallback.GetView();
+}
+
+uint32_t TextureStreamer::GetResidentMip(TextureHandle texture) const
+{
+	return m_vTextures[texture]->nResidentMip;
+}
+
+void TextureStreamer::Queue(TextureHandle handle, uint32_t nFirstMip)
+{
+	Texture& texture = *m_vTextures[handle];
+	texture.bStreaming = true;
+	m_nStreaming++;
+
+	auto job = std::make_unique<StreamJob>();
+	job->handle = handle;
+	job->pTexture = &texture;
+	job->nFirstMip = nFirstMip;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_PendingJobs.push_back(std::move(job));
+	}
+	m_JobReady.notify_one();
+}
+
+void TextureStreamer::IoThread()
+{
+	while (true)
+	{
+		std::unique_ptr<StreamJob> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobReady.wait(lock, [this] { return m_bQuit || !m_PendingJobs.empty(); });
+			if (m_bQuit) return;
+			job = std::move(m_PendingJobs.front());
+			m_PendingJobs.pop_front();
+		}
+
+		RunJob(*job);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_CompletedJobs.push_back(std::move(job));
+	}
+}
+
+void TextureStreamer::RunJob(StreamJob& job)
+{
+	const Texture& texture = *job.pTexture;
+	try
+	{
+		const Level& first = texture.vLevels[job.nFirstMip];
+		vk::ImageCreateInfo imageInfo{};
+		imageInfo.imageType = vk::ImageType::e2D;
+		imageInfo.format = texture.format;
+		imageInfo.extent = vk::Extent3D(first.extent.width, first.extent.height, 1);
+		imageInfo.mipLevels = static_cast<uint32_t>(texture.vLevels.size()) - job.nFirstMip;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = vk::SampleCountFlagBits::e1;
+		imageInfo.tiling = vk::ImageTiling::eOptimal;
+		imageInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+		imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+		if (m_vQueueFamilies.size() > 1)
+		{
+			imageInfo.sharingMode = vk::SharingMode::eConcurrent;
+			imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_vQueueFamilies.size());
+			imageInfo.pQueueFamilyIndices = m_vQueueFamilies.data();
+		}
+		job.image = Image(m_Allocator, m_Device, imageInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		// Fault everything in before the staging ring's locked, so other uploads aren't stuck behind the disk
+		for (uint32_t i = job.nFirstMip; i < texture.vLevels.size(); ++i)
+		{
+			texture.file.Prefetch(static_cast<size_t>(texture.vLevels[i].nOffset), static_cast<size_t>(texture.vLevels[i].nSize));
+		}
+
+		// The levels below are already on the GPU in the old image, but they're a third of the size at most
+		// and the pages are cached, so uploading them again is simpler than a copy on another queue
+		for (uint32_t i = job.nFirstMip; i < texture.vLevels.size(); ++i)
+		{
+			const Level& level = texture.vLevels[i];
+			m_StagingRing.UploadImageLevel(	job.image.Get(), i - job.nFirstMip, level.extent, texture.nBlockWidth, texture.nBlockHeight,
+											texture.nBlockSize, texture.file.GetData() + level.nOffset);
+		}
+		m_StagingRing.Flush();
+	}
+	catch (const std::exception& e)
+	{
+		job.image = Image();
+		job.sError = e.what();
+	}
+}
+
+uint32_t TextureStreamer::GetDesiredMip(const Texture& texture, uint64_t nFrame) const
+{
+	if (nFrame - texture.nLastRequested > nDemandFrames) return texture.nTailMip;
+	if (texture.fRequestedTexels <= 0.0f) return texture.nDesiredMip;
+
+	// One texel per pixel is as detailed as it's worth being, anything more is just aliasing
+	const vk::Extent2D& extent = texture.vLevels[0].extent;
+	float fTexels = static_cast<float>(std::max(extent.width, extent.height));
+	float fMip = std::floor(std::log2(std::max(1.0f, fTexels / texture.fRequestedTexels)));
+	return std::min(static_cast<uint32_t>(fMip), texture.nTailMip);
+}
+
+vk::DeviceSize TextureStreamer::GetSize(const Texture& texture, uint32_t nFirstMip) const
+{
+	vk::DeviceSize nSize = 0;
+	for (uint32_t i = nFirstMip; i < texture.vLevels.size(); ++i) nSize += texture.vLevels[i].nSize;
+	return nSize;
+}
+
+void TextureStreamer::Update(uint64_t nFrame)
+{
+	m_nFrame = nFrame;
+
+	// Finished images are swapped in straight away - the frame's submit waits on everything the staging ring's flushed
+	std::deque<std::unique_ptr<StreamJob>> completedJobs;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		completedJobs.swap(m_CompletedJobs);
+	}
+	for (auto& job : completedJobs)
+	{
+		Texture& texture = *job->pTexture;
+		texture.bStreaming = false;
+		m_nStreaming--;
+
+		if (!job->sError.empty())
+		{
+			std::cerr << "Failed to stream " << texture.sFilename << ": " << job->sError << std::endl;
+			texture.bFailed = true;
+			continue;
+		}
+
+		if (job->nFirstMip < texture.nResidentMip) m_nStreamedIn++;
+		else m_nEvicted++;
+
+		// Frames up to the last one may have sampled the old image
+		if (texture.image.IsValid()) m_vRetiredImages.push_back({ std::move(texture.image), nFrame > 0 ? nFrame - 1 : 0 });
+		texture.image = std::move(job->image);
+		texture.nResidentMip = job->nFirstMip;
+	}
+
+	m_vRetiredImages.erase(std::remove_if(m_vRetiredImages.begin(), m_vRetiredImages.end(),
+		[&](const RetiredImage& retired) { return retired.nFrame + m_nFramesInFlight <= nFrame; }), m_vRetiredImages.end());
+
+	for (auto& texture : m_vTextures)
+	{
+		if (texture->fRequestedTexels > 0.0f) texture->nLastRequested = nFrame;
+		texture->nDesiredMip = GetDesiredMip(*texture, nFrame);
+		texture->fRequestedTexels = 0.0f;
+	}
+
+	MemoryBudget budget = m_Allocator.GetDeviceLocalBudget();
+	if (budget.nUsage > budget.nBudget * fEvictAbove) Evict();
+	else if (budget.nUsage < budget.nBudget * fStreamBelow) StreamIn(budget);
+}
+
+void TextureStreamer::Evict()
+{
+	// One level a frame - the memory only comes back once the smaller image's swapped in and the old one's retired,
+	// so evicting more on the strength of numbers that haven't caught up yet would overshoot
+	if (m_nStreaming >= nMaxStreams) return;
+
+	// Anything holding more than it wants goes first, then whatever's gone longest without being asked for
+	Texture* pVictim = nullptr;
+	TextureHandle victim = 0;
+	for (TextureHandle i = 0; i < m_vTextures.size(); ++i)
+	{
+		Texture& texture = *m_vTextures[i];
+		if (texture.bStreaming || texture.bFailed || texture.nResidentMip >= texture.nTailMip) continue;
+
+		if (pVictim)
+		{
+			bool bSurplus = texture.nResidentMip < texture.nDesiredMip;
+			bool bVictimSurplus = pVictim->nResidentMip < pVictim->nDesiredMip;
+			if (bSurplus != bVictimSurplus) { if (!bSurplus) continue; }
+			else if (texture.nLastRequested > pVictim->nLastRequested) continue;
+			else if (texture.nLastRequested == pVictim->nLastRequested && GetSize(texture, texture.nResidentMip) <= GetSize(*pVictim, pVictim->nResidentMip)) continue;
+		}
+		pVictim = &texture;
+		victim = i;
+	}
+
+	if (pVictim) Queue(victim, pVictim->nResidentMip + 1);
+}
+
+void TextureStreamer::StreamIn(const MemoryBudget& budget)
+{
+	// Most recently wanted first, then whichever's furthest from what it wants
+	std::vector<TextureHandle> vWanted;
+	for (TextureHandle i = 0; i < m_vTextures.size(); ++i)
+	{
+		const Texture& texture = *m_vTextures[i];
+		if (!texture.bStreaming && !texture.bFailed && texture.nDesiredMip < texture.nResidentMip) vWanted.push_back(i);
+	}
+	std::sort(vWanted.begin(), vWanted.end(), [this](TextureHandle a, TextureHandle b)
+	{
+		const Texture& textureA = *m_vTextures[a];
+		const Texture& textureB = *m_vTextures[b];
+		if (textureA.nLastRequested != textureB.nLastRequested) return textureA.nLastRequested > textureB.nLastRequested;
+		return textureA.nResidentMip - textureA.nDesiredMip > textureB.nResidentMip - textureB.nDesiredMip;
+	});
+
+	// The new image's whole size counts, as the old one's around until it's swapped
+	vk::DeviceSize nHeadroom = static_cast<vk::DeviceSize>(budget.nBudget * fStreamBelow) - budget.nUsage;
+	for (TextureHandle handle : vWanted)
+	{
+		if (m_nStreaming >= nMaxStreams) break;
+
+		const Texture& texture = *m_vTextures[handle];
+		uint32_t nFirstMip = texture.nDesiredMip;
+		while (nFirstMip < texture.nResidentMip && GetSize(texture, nFirstMip) > nHeadroom) nFirstMip++;
+		if (nFirstMip >= texture.nResidentMip) continue;
+
+		nHeadroom -= GetSize(texture, nFirstMip);
+		Queue(handle, nFirstMip);
+	}
+}
+
+TextureStreamerStats TextureStreamer::GetStats()
+{
+	TextureStreamerStats stats;
+	stats.nTextures = static_cast<uint32_t>(m_vTextures.size());
+	stats.nStreaming = m_nStreaming;
+	stats.nStreamedIn = m_nStreamedIn;
+	stats.nEvicted = m_nEvicted;
+	stats.budget = m_Allocator.GetDeviceLocalBudget();
+	for (const auto& texture : m_vTextures)
+	{
+		if (texture->bFailed) stats.nFailed++;
+		if (texture->image.IsValid()) stats.nResidentBytes += GetSize(*texture, texture->nResidentMip);
+	}
+	return stats;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_JobReady.notify_all();
+	for (auto& thread : m_vIoThreads) thread.join();
+
+	// Uploads may still be landing in images that are about to go
+	m_StagingRing.WaitIdle();
+}
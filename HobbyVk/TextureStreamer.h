@@ -0,0 +1,146 @@
+#pragma once
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "Image.h"
+#include "StagingRing.h"
+#include "AssetLibrary.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using TextureHandle = uint32_t;
+
+struct TextureStreamerStats
+{
+	uint32_t nTextures = 0;
+	uint32_t nStreaming = 0;		// Levels being loaded or dropped right now
+	uint32_t nFailed = 0;
+	vk::DeviceSize nResidentBytes = 0;
+	uint64_t nStreamedIn = 0;		// Totals
+	uint64_t nEvicted = 0;
+	MemoryBudget budget;
+};
+
+// Loads KTX2 textures (block compressed or not, but not supercompressed) and keeps only as many of
+// each one's mip levels in memory as are being looked at. Files are memory mapped when loaded, and
+// levels go from the mapping straight into the staging ring on a couple of I/O threads, so nothing
+// on the render thread waits on the disk. How big a texture is on screen decides the most detailed
+// level it wants - levels come in while there's room under the device local heap's budget, and the
+// least wanted go again once it's nearly full. Images can't gain or lose levels, so changing what's
+// resident builds a new image on the I/O thread and swaps it in once it's uploaded - the smallest
+// levels (the tail) are always loaded, so that's never more than a third again of what's wanted
+class TextureStreamer
+{
+public:
+	// vQueueFamilies - everything that samples textures, plus the staging ring's family
+	TextureStreamer(MemoryAllocator& allocator, vk::PhysicalDevice physicalDevice, vk::Device device, StagingRing& stagingRing, const AssetLibrary& assets,
+					std::vector<uint32_t> vQueueFamilies, uint32_t nFramesInFlight, float fMaxAnisotropy = 1.0f, uint32_t nIoThreads = 2);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Opens the file (mapped, or in an archive) and queues its tail to load. Throws if it can't be opened or isn't something we can use
+	TextureHandle Load(const std::string& sFilename);
+
+	// How many texels across the texture covers on screen - the biggest request since the last Update wins.
+	// Textures nothing's asked about in a while fall back to their tail
+	void RequestSize(TextureHandle texture, float fScreenTexels);
+
+	// Once per frame from the render thread, before recording with any views. Swaps in finished images,
+	// frees replaced ones once the frames that might've used them are done, and decides what to stream
+	void Update(uint64_t nFrame);
+
+	// A 1x1 placeholder until the texture's tail has loaded. Valid for this frame, views change as levels stream
+	vk::ImageView GetView(TextureHandle texture) const;
+	inline vk::Sampler GetSampler() const { return m_Sampler.get(); }
+	uint32_t GetResidentMip(TextureHandle texture) const; // Most detailed level loaded, the level count if none are yet
+
+	TextureStreamerStats GetStats();
+
+private:
+	struct Level
+	{
+		uint64_t nOffset = 0; // Into the file
+		uint64_t nSize = 0;
+		vk::Extent2D extent;
+	};
+
+	struct Texture
+	{
+		// Fixed once loaded, so the I/O threads can read them without locking
+		std::string sFilename;
+		AssetSpan file;
+		vk::Format format = vk::Format::eUndefined;
+		uint32_t nBlockWidth = 1;
+		uint32_t nBlockHeight = 1;
+		uint32_t nBlockSize = 0;
+		std::vector<Level> vLevels; // 0 is the biggest
+		uint32_t nTailMip = 0;
+
+		// Render thread only
+		Image image;						// Levels [nResidentMip, vLevels.size())
+		uint32_t nResidentMip = 0;
+		uint32_t nDesiredMip = 0;
+		float fRequestedTexels = 0.0f;		// Since the last Update
+		uint64_t nLastRequested = 0;
+		bool bStreaming = false;
+		bool bFailed = false;
+	};
+
+	// Rebuilding a texture with levels [nFirstMip, end)
+	struct StreamJob
+	{
+		TextureHandle handle = 0;
+		Texture* pTexture = nullptr;
+		uint32_t nFirstMip = 0;
+		Image image;
+		std::string sError;
+	};
+
+	struct RetiredImage
+	{
+		Image image;
+		uint64_t nFrame;
+	};
+
+	void IoThread();
+	void RunJob(StreamJob& job);
+	void Queue(TextureHandle handle, uint32_t nFirstMip);
+	uint32_t GetDesiredMip(const Texture& texture, uint64_t nFrame) const;
+	vk::DeviceSize GetSize(const Texture& texture, uint32_t nFirstMip) const;
+	void Evict();
+	void StreamIn(const MemoryBudget& budget);
+
+	MemoryAllocator& m_Allocator;
+	vk::PhysicalDevice m_PhysicalDevice;
+	vk::Device m_Device;
+	StagingRing& m_StagingRing;
+	const AssetLibrary& m_Assets;
+	std::vector<uint32_t> m_vQueueFamilies;
+	uint32_t m_nFramesInFlight;
+	uint64_t m_nFrame = 0;
+
+	std::vector<std::unique_ptr<Texture>> m_vTextures; // Indexed by handle
+	std::vector<RetiredImage> m_vRetiredImages;
+	Image m_Fallback;
+	vk::UniqueSampler m_Sampler;
+	uint32_t m_nStreaming = 0;
+	uint64_t m_nStreamedIn = 0;
+	uint64_t m_nEvicted = 0;
+
+	// Jobs go out to the I/O threads, and come back done
+	std::vector<std::thread> m_vIoThreads;
+	std::deque<std::unique_ptr<StreamJob>> m_PendingJobs;
+	std::deque<std::unique_ptr<StreamJob>> m_CompletedJobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobReady;
+	bool m_bQuit = false;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#ifndef _DEBUG
+#define VULKAN_HPP_NO_EXCEPTIONS
+#endif
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+#include <array>
+
+// Quantised to 20 bytes - half float positions, octahedral normals in two snorms, half float UVs
+// and 8 bit colour, all of which the vertex input unpacks for free. Meshes are converted into this
+// offline (see MeshConverter), so it's also the layout of a .hvkmesh file's vertices
+struct Vertex
+{
+	uint32_t position[2];	// Half xy, half z and a 1 for w
+	uint32_t normal;		// Octahedral, snorm16 x2
+	uint32_t uv;			// Half x2, not read by any shader yet
+	uint32_t colour;		// RGBA8 unorm
+
+	static Vertex Pack(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec4& colour)
+	{
+		Vertex vertex;
+		vertex.position[0] = glm::packHalf2x16(glm::vec2(position.x, position.y));
+		vertex.position[1] = glm::packHalf2x16(glm::vec2(position.z, 1.0f));
+		vertex.normal = glm::packSnorm2x16(EncodeOctahedral(normal));
+		vertex.uv = glm::packHalf2x16(uv);
+		vertex.colour = glm::packUnorm4x8(colour);
+		return vertex;
+	}
+
+	inline glm::vec3 GetPosition() const
+	{
+		return glm::vec3(glm::unpackHalf2x16(position[0]), glm::unpackHalf2x16(position[1]).x);
+	}
+
+	// The unit sphere folded onto a square - the lower hemisphere's mirrored over the upper's diagonals.
+	// Decoded in Shaders/shader.vert
+	static glm::vec2 EncodeOctahedral(glm::vec3 normal)
+	{
+		normal /= glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+		glm::vec2 encoded = glm::vec2(normal.x, normal.y);
+		if (normal.z < 0.0f)
+		{
+			glm::vec2 sign = glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+			encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+		}
+		return encoded;
+	}
+
+	// Describes how to step through the vertex buffer - one vertex at a time, tightly packed
+	static vk::VertexInputBindingDescription GetBindingDescription()
+	{
+		vk::VertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(Vertex);
+		bindingDescription.inputRate = vk::VertexInputRate::eVertex; // As opposed to per instance
+		return bindingDescription;
+	}
+
+	// layout(location = n) in the vertex shader - the UVs are left out until something samples with them
+	static std::array<vk::VertexInputAttributeDescription, 3> GetAttributeDescriptions()
+	{
+		std::array<vk::VertexInputAttributeDescription, 3> attributeDescriptions{};
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = vk::Format::eR16G16B16A16Sfloat; // vec4
+		attributeDescriptions[0].offset = offsetof(Vertex, position);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = vk::Format::eR16G16Snorm; // vec2
+		attributeDescriptions[1].offset = offsetof(Vertex, normal);
+
+		attributeDescriptions[2].binding = 0;
+		attributeDescriptions[2].location = 2;
+		attributeDescriptions[2].format = vk::Format::eR8G8B8A8Unorm; // vec4
+		attributeDescriptions[2].offset = offsetof(Vertex, colour);
+		return attributeDescriptions;
+	}
+};
+static_assert(sizeof(Vertex) == 20, "Vertex should be tightly packed");
+
+#endif
@@ -1,13 +1,40 @@
 #include "Window.h"
 
+// GLFW's initialised with the first window and terminated with the last
+static uint32_t nWindows = 0;
+
 Window::Window(const uint32_t width, const uint32_t height, const std::string& title)
 {
-	glfwInit();
+	if (nWindows++ == 0) glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	m_Window = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+	glfwSetWindowUserPointer(m_Window, this);
+	glfwSetFramebufferSizeCallback(m_Window, FramebufferResizeCallback);
+}
+
+void Window::FramebufferResizeCallback(GLFWwindow* pWindow, int width, int height)
+{
+	Window* pThis = reinterpret_cast<Window*>(glfwGetWindowUserPointer(pWindow));
+	pThis->m_bFramebufferResized = true;
+}
+
+std::pair<uint32_t, uint32_t> Window::GetFramebufferSize()
+{
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(m_Window, &width, &height);
+	return std::pair<uint32_t, uint32_t>(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+}
+
+double Window::GetRefreshPeriodMs()
+{
+	// Windowed ones have no monitor of their own, so the primary one's the best guess
+	GLFWmonitor* pMonitor = glfwGetWindowMonitor(m_Window);
+	if (!pMonitor) pMonitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* pMode = pMonitor ? glfwGetVideoMode(pMonitor) : nullptr;
+	return pMode && pMode->refreshRate > 0 ? 1000.0 / pMode->refreshRate : 1000.0 / 60.0;
 }
 
 std::pair<uint32_t, const char**> Window::GetExtensions()
@@ -20,5 +47,5 @@ std::pair<uint32_t, const char**> Window::GetExtensions()
 Window::~Window()
 {
 	glfwDestroyWindow(m_Window);
-	glfwTerminate();
+	if (--nWindows == 0) glfwTerminate();
 }
\ No newline at end of file
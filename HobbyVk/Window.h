@@ -15,10 +15,18 @@ public:
 
 	inline bool ShouldClose() { return glfwWindowShouldClose(m_Window); }
 	inline void Update() { glfwPollEvents(); }
+	inline void WaitEvents() { glfwWaitEvents(); } // Blocks, for when there's nothing to draw (minimised, etc)
+	inline void Hide() { glfwHideWindow(m_Window); }
 
 	std::pair<uint32_t, const char**> GetExtensions();
+	std::pair<uint32_t, uint32_t> GetFramebufferSize(); // In pixels, which needn't match screen coordinates
+	double GetRefreshPeriodMs(); // Of the monitor it's (probably) on, 60Hz if that can't be found
 
 	GLFWwindow* m_Window;
+	bool m_bFramebufferResized = false; // Set by GLFW, cleared once the swapchain's been recreated
+
+private:
+	static void FramebufferResizeCallback(GLFWwindow* pWindow, int width, int height);
 };
 
 #endif
\ No newline at end of file
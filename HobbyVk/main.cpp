@@ -1,9 +1,258 @@
 #include <iostream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
 #include "Renderer.h"
+#include "MeshConverter.h"
+#include "Benchmark.h"
+#include "Arguments.h"
 
-int main()
+// Lays out a square grid of spinning, tinted copies of the scene - enough to stress instancing
+void SetupCrowd(Renderer& renderer, uint32_t nInstances)
 {
-	Renderer renderer = Renderer(800, 600);
+	const uint32_t nSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(nInstances))));
+	const float fSpacing = 2.0f / nSide;
+	uint64_t nFrame = 0;
+
+	renderer.SetInstanceUpdater([=](InstanceStreams& streams, uint32_t) mutable
+	{
+		uint32_t nCount = std::min(nInstances, streams.nCapacity);
+		float fTime = static_cast<float>(nFrame++) * 0.01f;
+
+		// Each stream written in its own pass, front to back
+		for (uint32_t i = 0; i < nCount; ++i)
+		{
+			float x = -1.0f + fSpacing * (i % nSide + 0.5f);
+			float y = -1.0f + fSpacing * (i / nSide + 0.5f);
+			streams.pTransforms[i] = glm::vec4(x, y, fSpacing * 0.5f, fTime + i * 0.1f);
+		}
+		for (uint32_t i = 0; i < nCount; ++i)
+		{
+			uint32_t r = 128 + (i * 37) % 128, g = 128 + (i * 91) % 128, b = 128 + (i * 53) % 128;
+			streams.pColours[i] = r | (g << 8) | (b << 16) | (0xFFu << 24);
+		}
+		return nCount;
+	});
+}
+
+// Replaces the scene with a square grid of copies of the mesh, twice the size of the view across, so
+// three quarters of it's off screen - enough to stress culling
+void SetupScene(Renderer& renderer, uint32_t nObjects)
+{
+	SceneStore& scene = renderer.GetScene();
+	const MeshFileHeader& header = renderer.GetMesh().GetHeader();
+	const glm::vec4 sphere = glm::vec4(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]);
+	const glm::vec2 minimum = glm::vec2(header.boundsMin[0], header.boundsMin[1]);
+	const glm::vec2 size = glm::vec2(header.boundsMax[0], header.boundsMax[1]) - minimum;
+	const glm::vec2 centre = minimum + size * 0.5f;
+
+	const uint32_t nSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(nObjects))));
+	const float fScale = 2.0f / nSide;
+	scene.Clear();
+	for (uint32_t i = 0; i < nObjects; ++i)
+	{
+		glm::vec2 cell = centre - size + size * (glm::vec2(static_cast<float>(i % nSide), static_cast<float>(i / nSide)) + 0.5f) * fScale;
+		scene.Add({ renderer.GetMesh().GetIndexCount(), 0, 0 }, sphere, glm::vec4(cell - centre * fScale, fScale, 0.0f));
+	}
+	std::cout << nObjects << " objects, culled with " << SceneStore::GetSimdName() << std::endl;
+}
+
+// HobbyVk --pack-assets assets.pak Shaders textures/brick.ktx2 - directories are packed with everything in them,
+// under the paths given, so run it from wherever the renderer will be run
+int PackAssets(int argc, char** argv)
+{
+	if (argc < 4) { std::cerr << "Usage: HobbyVk --pack-assets <archive> <files or directories...>" << std::endl; return 1; }
+
+	std::vector<std::string> vFiles;
+	for (int i = 3; i < argc; ++i)
+	{
+		std::filesystem::path path = argv[i];
+		if (!std::filesystem::is_directory(path)) { vFiles.push_back(path.generic_string()); continue; }
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+		{
+			if (entry.is_regular_file()) vFiles.push_back(entry.path().generic_string());
+		}
+	}
+	std::sort(vFiles.begin(), vFiles.end());
+
+	try
+	{
+		AssetLibrary::Pack(argv[2], vFiles);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "Packed " << vFiles.size() << " files into " << argv[2] << std::endl;
+	return 0;
+}
+
+// HobbyVk --convert-mesh bunny.obj bunny.hvkmesh - then draw it with --mesh bunny.hvkmesh
+int ConvertMesh(int argc, char** argv)
+{
+	if (argc != 4) { std::cerr << "Usage: HobbyVk --convert-mesh <source.obj> <destination.hvkmesh>" << std::endl; return 1; }
+
+	MeshConversionStats stats;
+	try
+	{
+		stats = MeshConverter::Convert(argv[2], argv[3]);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << "Converted " << argv[2] << " to " << argv[3] << std::endl;
+	std::cout << "  Vertices: " << stats.nSourceVertices << " -> " << stats.nVertices << ", " << stats.nTriangles << " triangles in " << stats.nMeshlets << " meshlets" << std::endl;
+	std::cout << "  ACMR: " << stats.fAcmrBefore << " -> " << stats.fAcmrAfter << std::endl;
+	std::cout << "  Size: " << stats.nBytesBefore << " -> " << stats.nBytesAfter << " bytes" << std::endl;
+	return 0;
+}
+
+// Looks at a loaded mesh down -z, with its bounds filling the view - y flipped, as meshes tend to be y up
+void FitMesh(Renderer& renderer)
+{
+	const MeshFileHeader& header = renderer.GetMesh().GetHeader();
+	glm::vec3 minimum = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	glm::vec3 maximum = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	glm::vec3 centre = (minimum + maximum) * 0.5f;
+	float fHalfSize = std::max(std::max(maximum.x - minimum.x, maximum.y - minimum.y) * 0.55f, 1e-6f);
+	float fDepth = std::max(maximum.z - minimum.z, 1e-6f);
+
+	// Orthographic, nearest (largest z) at depth 0
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	viewProjection[0][0] = 1.0f / fHalfSize;
+	viewProjection[1][1] = -1.0f / fHalfSize;
+	viewProjection[2][2] = -1.0f / fDepth;
+	viewProjection[3] = glm::vec4(-centre.x / fHalfSize, centre.y / fHalfSize, maximum.z / fDepth, 1.0f);
+	renderer.SetViewProjection(viewProjection);
+}
+
+// Everything from the command line - the renderer's config, and what to set up once it's running
+struct AppOptions
+{
+	RendererConfig config;
+	uint32_t nInstances = 0;	// SetupCrowd
+	uint32_t nObjects = 0;		// SetupScene
+	uint32_t nWindows = 1;		// Renderer::AddWindow for the rest
+};
+
+// Leaves nValue as it was, and says so, if sValue isn't a whole number that fits
+bool ParseCount(const std::string& sArgument, const std::string& sValue, uint32_t& nValue)
+{
+	if (TryParseCount(sValue, nValue)) return true;
+	std::cerr << "Invalid number " << sValue << " for " << sArgument << std::endl;
+	return false;
+}
+
+// Eg: HobbyVk --present-mode immediate --frames-in-flight 3 --swapchain-images 4
+// or: HobbyVk --headless --frames 1000 --capture-png frames/frame
+AppOptions ParseArguments(int argc, char** argv)
+{
+	AppOptions options;
+	RendererConfig& config = options.config;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string sArgument = argv[i];
+
+		// Flags on their own
+		if (sArgument == "--headless") { config.bHeadless = true; continue; }
+		if (sArgument == "--gpu-driven") { config.bGpuDriven = true; continue; }
+		if (sArgument == "--hot-reload") { config.bHotReload = true; continue; }
+		if (sArgument == "--low-latency") { config.bLowLatency = true; continue; }
+		if (sArgument == "--occlusion") { config.bOcclusionCulling = true; continue; }
+
+		// Everything else takes a value
+		if (i + 1 >= argc) { std::cerr << "Missing value for " << sArgument << std::endl; break; }
+		std::string sValue = argv[++i];
+
+		if (sArgument == "--present-mode")
+		{
+			if (sValue == "fifo")				config.presentMode = vk::PresentModeKHR::eFifo;
+			else if (sValue == "fifo-relaxed")	config.presentMode = vk::PresentModeKHR::eFifoRelaxed;
+			else if (sValue == "mailbox")		config.presentMode = vk::PresentModeKHR::eMailbox;
+			else if (sValue == "immediate")		config.presentMode = vk::PresentModeKHR::eImmediate;
+			else std::cerr << "Unknown present mode " << sValue << std::endl;
+		}
+		else if (sArgument == "--frames-in-flight")	ParseCount(sArgument, sValue, config.nFramesInFlight);
+		else if (sArgument == "--swapchain-images")	ParseCount(sArgument, sValue, config.nSwapchainImages);
+		else if (sArgument == "--gpu")				config.sDevice = sValue;
+		else if (sArgument == "--instances")		ParseCount(sArgument, sValue, options.nInstances);
+		else if (sArgument == "--msaa")				ParseCount(sArgument, sValue, config.nMsaaSamples);
+		else if (sArgument == "--frames")			ParseCount(sArgument, sValue, config.nMaxFrames);
+		else if (sArgument == "--capture-raw")		{ config.captureSink = CaptureSink::eRaw; config.sCaptureTarget = sValue; }
+		else if (sArgument == "--capture-png")		{ config.captureSink = CaptureSink::ePng; config.sCaptureTarget = sValue; }
+		else if (sArgument == "--capture-pipe")		{ config.captureSink = CaptureSink::ePipe; config.sCaptureTarget = sValue; }
+		else if (sArgument == "--cpu-timings-csv")	config.sCpuTimingsCsv = sValue;
+		else if (sArgument == "--cpu-timings-json")	config.sCpuTimingsJson = sValue;
+		else if (sArgument == "--shader-cache")		config.sShaderCacheDirectory = sValue;
+		else if (sArgument == "--assets")			config.vAssetArchives.push_back(sValue);
+		else if (sArgument == "--mesh")				config.sMesh = sValue;
+		else if (sArgument == "--objects")			ParseCount(sArgument, sValue, options.nObjects);
+		else if (sArgument == "--windows")			ParseCount(sArgument, sValue, options.nWindows);
+		else std::cerr << "Unknown argument " << sArgument << std::endl;
+	}
+
+	// Room for the crowd, and for the scene's objects - GPU driven ones are an instance each
+	config.nMaxInstances = std::max(config.nMaxInstances, std::max(options.nInstances, options.nObjects));
+	return options;
+}
+
+// HobbyVk --benchmark report.json --scene draws=50000 --warmup 120 --frames 1000 --gpu-driven - every scene (at its
+// default size) unless some are given, and anything else is as it would be for the renderer
+int RunBenchmark(int argc, char** argv)
+{
+	if (argc < 3) { std::cerr << "Usage: HobbyVk --benchmark <report.json> [--scene <name[=count]>...] [--warmup <frames>] [renderer options...]" << std::endl; return 1; }
+
+	// Ours are taken out, the rest go to the renderer
+	std::vector<BenchmarkScene> vScenes;
+	uint32_t nWarmupFrames = 120;
+	std::vector<char*> vRendererArguments = { argv[0] };
+	try
+	{
+		for (int i = 3; i < argc; ++i)
+		{
+			std::string sArgument = argv[i];
+			if (sArgument == "--scene" && i + 1 < argc)			vScenes.push_back(Benchmark::ParseScene(argv[++i]));
+			else if (sArgument == "--warmup" && i + 1 < argc)	{ if (!ParseCount(sArgument, argv[++i], nWarmupFrames)) return 1; }
+			else vRendererArguments.push_back(argv[i]);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if (vScenes.empty()) vScenes = Benchmark::GetDefaultScenes();
+
+	RendererConfig config = ParseArguments(static_cast<int>(vRendererArguments.size()), vRendererArguments.data()).config;
+	Benchmark benchmark = Benchmark(config, nWarmupFrames, config.nMaxFrames > 0 ? config.nMaxFrames : 1000);
+	for (const BenchmarkScene& scene : vScenes) benchmark.Run(scene);
+
+	if (!benchmark.WriteJson(argv[2])) { std::cerr << "Unable to write the benchmark report to " << argv[2] << "!" << std::endl; return 1; }
+	std::cout << "Wrote " << argv[2] << std::endl;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::string(argv[1]) == "--pack-assets") return PackAssets(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--convert-mesh") return ConvertMesh(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") return RunBenchmark(argc, argv);
+
+	AppOptions options = ParseArguments(argc, argv);
+	const RendererConfig& config = options.config;
+	Renderer renderer = Renderer(800, 600, config);
+	if (!config.sMesh.empty()) FitMesh(renderer);
+	if (options.nObjects > 0) SetupScene(renderer, options.nObjects);
+	if (options.nInstances > 0) SetupCrowd(renderer, options.nInstances);
+
+	// The rest of the windows share the first's device and scene, one per screen say
+	if (options.nWindows > 1 && (config.bHeadless || config.bGpuDriven)) std::cerr << "Extra windows aren't supported headless or GPU driven" << std::endl;
+	else for (uint32_t i = 1; i < options.nWindows; ++i) renderer.AddWindow(800, 600, "HobbyVk " + std::to_string(i + 1));
 
 	while (renderer.ShouldRun())
 	{
@@ -13,4 +262,4 @@ int main()
 	renderer.WaitIdle();
 
 	return 0;
-}
\ No newline at end of file
+}